@@ -5,6 +5,10 @@
 #include "utility/glTF_loader.h"
 #include "my_mesh_optimizer.h"
 #include "virtual_geometry.h"
+#include "mesh_file.h"
+#include "task_scheduler.h"
+#include <algorithm>
+#include <iterator>
 #define MAX_FRAME_COUNT 3
 
 void MeshletApp::_Init()
@@ -104,13 +108,28 @@ void MeshletApp::_InitModels()
 	glTFLoader gltfScene{};
 	//gltfScene.Load("E:/GitStorage/LearnVulkan/res/models/cornell_box/scene.gltf");
 	//gltfScene.GetSceneSimpleMeshes(meshs, matrices);
-	MeshUtility::Load("E:/GitStorage/LearnVulkan/res/models/bunny/bunny.obj", meshs);
+	// meshlets are cooked with the mesh, only virtual geometry is built at runtime
+	// compressed on disk, streams that go to device as they are are decoded into stagging memory in _InitBuffers
+	CHECK_TRUE(m_meshFile.OpenOrCookObj(
+		"E:/GitStorage/LearnVulkan/res/models/bunny/bunny.obj",
+		"E:/GitStorage/LearnVulkan/res/models/bunny/bunny.lvmesh",
+		MeshFile::CookSettings{ .compress = true }), "Failed to load bunny!");
+	CHECK_TRUE(m_meshFile.GetStaticMeshes(meshs), "Failed to decode bunny!");
 	//MeshUtility::Load("E:/GitStorage/LearnVulkan/res/models/20.obj", meshs);
 	//trans.SetScale(0.01, 0.01, 0.01);
 	matrices.push_back(trans.GetModelMatrix());
 	VirtualGeometry vg{};
+	VirtualGeometry::BuildSettings vgSettings{};
+	vgSettings.parallelBuild = true;
 	vg.PresetStaticMesh(meshs[0]);
+	vg.PresetBuildSettings(vgSettings);
+	vg.PresetCacheFile("E:/GitStorage/LearnVulkan/bin/bunny.vgcache");
 	vg.Init();
+	vg.GetVirtualGeometryDeviceData(m_vgModel.rootIndex, m_vgModel.nodes, m_vgModel.groups);
+	for (const auto& group : m_vgModel.groups)
+	{
+		m_vgModel.clusterCount += group.GetClusterCount();
+	}
 
 	for (size_t i = 0; i < meshs.size(); ++i)
 	{
@@ -124,11 +143,23 @@ void MeshletApp::_InitModels()
 		model.modelMatrix = matrices[i];
 		if (i == 0)
 		{
+			// meshlets of virtual geometry point to its own vertices, draw of virtual geometry uses this VBO too
 			vg.GetMeshletsAtLOD(3, meshlets);
+			vg.GetVirtualGeometryVertices(model.mesh.verts);
+			model.mesh.indices.clear();
 		}
 		else
 		{
-			optimizer.BuildMeshlets(staticMesh.verts, staticMesh.indices, meshlets);
+			const MeshFile::MeshView& cookedMesh = m_meshFile.GetMesh(static_cast<uint32_t>(i));
+
+			// host culls with meshlets and bounds, they are decoded here
+			model.vecMeshlet.resize(cookedMesh.GetSectionSize(MeshCodec::STREAM_MESHLET) / sizeof(Meshlet::DeviceDataRef));
+			model.vecMeshletBounds.resize(cookedMesh.GetSectionSize(MeshCodec::STREAM_MESHLET_BOUNDS) / sizeof(MeshletBounds));
+			CHECK_TRUE(cookedMesh.ReadSection(MeshCodec::STREAM_MESHLET, model.vecMeshlet.data()), "Failed to decode meshlets!");
+			CHECK_TRUE(cookedMesh.ReadSection(MeshCodec::STREAM_MESHLET_BOUNDS, model.vecMeshletBounds.data()), "Failed to decode meshlet bounds!");
+			model.pCookedMesh = &cookedMesh;
+			m_models.push_back(model);
+			continue;
 		}
 		
 		for (const auto& meshlet : meshlets)
@@ -140,7 +171,7 @@ void MeshletApp::_InitModels()
 		model.vecTriangleIndex = meshletData.meshletIndices;
 		for (const auto& meshlet : model.vecMeshlet)
 		{
-			model.vecMeshletBounds.push_back(optimizer.ComputeMeshletBounds(staticMesh.verts, meshletData, meshlet));
+			model.vecMeshletBounds.push_back(optimizer.ComputeMeshletBounds(model.mesh.verts, meshletData, meshlet));
 		}
 		m_models.push_back(model);
 	}
@@ -222,6 +253,14 @@ void MeshletApp::_InitBuffers()
 				sbo.coneNormalCutoff = glm::vec4(meshletBounds.coneAxis, meshletBounds.coneCutoff);
 				sbos.push_back(sbo);
 			}
+			curModel.meshletSpheres.Resize(curModel.vecMeshletBounds.size());
+			curModel.meshletCones.Resize(curModel.vecMeshletBounds.size());
+			for (size_t j = 0; j < curModel.vecMeshletBounds.size(); ++j)
+			{
+				const MeshletBounds& meshletBounds = curModel.vecMeshletBounds[j];
+				curModel.meshletSpheres.Set(j, glm::vec4(meshletBounds.center, meshletBounds.radius));
+				curModel.meshletCones.Set(j, meshletBounds.coneApex, meshletBounds.coneAxis, meshletBounds.coneCutoff);
+			}
 			bufferInfo.size = static_cast<uint32_t>(sizeof(MeshletBoundsSBO)) * static_cast<uint32_t>(sbos.size());
 			m_tBound = sbos;
 			meshletBoundsBuffer->PresetCreateInformation(bufferInfo);
@@ -229,30 +268,55 @@ void MeshletApp::_InitBuffers()
 			meshletBoundsBuffer->CopyFromHost(sbos.data());
 		}
 		
-		bufferInfo.size = static_cast<uint32_t>(sizeof(uint32_t)) * static_cast<uint32_t>(curModel.vecVertexRemap.size());
-		meshletVertexBuffer->PresetCreateInformation(bufferInfo);
-		meshletVertexBuffer->Init();
-		meshletVertexBuffer->CopyFromHost(curModel.vecVertexRemap.data());
+		if (curModel.pCookedMesh != nullptr)
+		{
+			const MeshFile::MeshView* pCookedMesh = curModel.pCookedMesh;
+
+			// decoded straight into stagging memory, no temporary copy
+			bufferInfo.size = static_cast<uint32_t>(pCookedMesh->GetSectionSize(MeshCodec::STREAM_MESHLET_VERTEX));
+			meshletVertexBuffer->PresetCreateInformation(bufferInfo);
+			meshletVertexBuffer->Init();
+			meshletVertexBuffer->WriteFromHost(0, bufferInfo.size, [pCookedMesh](void* _pDst)
+				{
+					CHECK_TRUE(pCookedMesh->ReadSection(MeshCodec::STREAM_MESHLET_VERTEX, _pDst), "Failed to decode meshlet vertices!");
+				});
+
+			bufferInfo.size = static_cast<uint32_t>(pCookedMesh->GetSectionSize(MeshCodec::STREAM_MESHLET_INDEX));
+			meshletTriangleBuffer->PresetCreateInformation(bufferInfo);
+			meshletTriangleBuffer->Init();
+			meshletTriangleBuffer->WriteFromHost(0, bufferInfo.size, [pCookedMesh](void* _pDst)
+				{
+					CHECK_TRUE(pCookedMesh->ReadSection(MeshCodec::STREAM_MESHLET_INDEX, _pDst), "Failed to decode meshlet triangles!");
+				});
+		}
+		else
+		{
+			bufferInfo.size = static_cast<uint32_t>(sizeof(uint32_t)) * static_cast<uint32_t>(curModel.vecVertexRemap.size());
+			meshletVertexBuffer->PresetCreateInformation(bufferInfo);
+			meshletVertexBuffer->Init();
+			meshletVertexBuffer->CopyFromHost(curModel.vecVertexRemap.data());
 
-		bufferInfo.size = static_cast<uint32_t>(sizeof(uint8_t)) * static_cast<uint32_t>(curModel.vecTriangleIndex.size());
-		meshletTriangleBuffer->PresetCreateInformation(bufferInfo);
-		meshletTriangleBuffer->Init();
-		meshletTriangleBuffer->CopyFromHost(curModel.vecTriangleIndex.data());
+			bufferInfo.size = static_cast<uint32_t>(sizeof(uint8_t)) * static_cast<uint32_t>(curModel.vecTriangleIndex.size());
+			meshletTriangleBuffer->PresetCreateInformation(bufferInfo);
+			meshletTriangleBuffer->Init();
+			meshletTriangleBuffer->CopyFromHost(curModel.vecTriangleIndex.data());
+		}
 
 		{
-			std::vector<VBO> vbos;
-			vbos.reserve(curModel.mesh.verts.size());
-			for (const auto& vertex : curModel.mesh.verts)
-			{
-				VBO vbo{};
-				vbo.normal = vertex.normal.has_value() ? vertex.normal.value() : glm::vec3(0, 0, 1);
-				vbo.pos = vertex.position;
-				vbos.push_back(vbo);
-			}
 			bufferInfo.size = static_cast<uint32_t>(sizeof(VBO)) * static_cast<uint32_t>(curModel.mesh.verts.size());
 			meshletVBOBuffer->PresetCreateInformation(bufferInfo);
 			meshletVBOBuffer->Init();
-			meshletVBOBuffer->CopyFromHost(vbos.data());
+			// vertices are converted in stagging memory, no temporary copy
+			meshletVBOBuffer->WriteFromHost(0, bufferInfo.size, [&curModel](void* _pDst)
+				{
+					VBO* pVBOs = static_cast<VBO*>(_pDst);
+					for (size_t j = 0; j < curModel.mesh.verts.size(); ++j)
+					{
+						const Vertex& vertex = curModel.mesh.verts[j];
+						pVBOs[j].normal = vertex.normal.has_value() ? vertex.normal.value() : glm::vec3(0, 0, 1);
+						pVBOs[j].pos = vertex.position;
+					}
+				});
 		}
 
 		{
@@ -273,6 +337,7 @@ void MeshletApp::_InitBuffers()
 				}
 				ubo.maxScale = std::sqrt(scale2);
 			}
+			curModel.maxScale = ubo.maxScale;
 
 			bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 
@@ -289,9 +354,46 @@ void MeshletApp::_InitBuffers()
 		m_meshUBOBuffers.push_back(std::move(meshUBOBuffer));
 		m_meshletBoundsBuffers.push_back(std::move(meshletBoundsBuffer));
 	}
+
+	// host writes visible meshlets every frame, padded to whole task workgroups
+	for (int frame = 0; frame < MAX_FRAME_COUNT; ++frame)
+	{
+		for (int i = 0; i < n; ++i)
+		{
+			Buffer::CreateInformation bufferInfo{};
+			std::unique_ptr<Buffer> culledMeshletBuffer = std::make_unique<Buffer>(Buffer{});
+			std::unique_ptr<Buffer> culledBoundsBuffer = std::make_unique<Buffer>(Buffer{});
+			const uint32_t capacity = common_utils::AlignUp(std::max(static_cast<uint32_t>(m_models[i].vecMeshlet.size()), 1u), 32);
+
+			bufferInfo.optMemoryProperty = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+			bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+			bufferInfo.size = static_cast<uint32_t>(sizeof(MeshletSBO)) * capacity;
+			culledMeshletBuffer->PresetCreateInformation(bufferInfo);
+			culledMeshletBuffer->Init();
+
+			bufferInfo.size = static_cast<uint32_t>(sizeof(MeshletBoundsSBO)) * capacity;
+			culledBoundsBuffer->PresetCreateInformation(bufferInfo);
+			culledBoundsBuffer->Init();
+
+			m_hostCulledMeshletBuffers.push_back(std::move(culledMeshletBuffer));
+			m_hostCulledBoundsBuffers.push_back(std::move(culledBoundsBuffer));
+		}
+	}
+	m_hostVisibleCounts.assign(n, 0u);
+
+	_InitVirtualGeometryBuffers();
+
+	// everything in the file is on device now
+	for (auto& model : m_models)
+	{
+		model.pCookedMesh = nullptr;
+	}
+	m_meshFile.Close();
 }
 void MeshletApp::_UninitBuffers()
 {
+	_UninitVirtualGeometryBuffers();
+
 	auto meshBuffers = {
 		&m_meshUBOBuffers,
 		&m_meshletVBOBuffers,
@@ -299,6 +401,8 @@ void MeshletApp::_UninitBuffers()
 		&m_meshletVertexBuffers,
 		&m_meshletBuffers,
 		&m_meshletBoundsBuffers,
+		&m_hostCulledMeshletBuffers,
+		&m_hostCulledBoundsBuffers,
 	};
 	for (auto pVec : meshBuffers)
 	{
@@ -322,6 +426,131 @@ void MeshletApp::_UninitBuffers()
 	m_frustumBuffers.clear();
 }
 
+void MeshletApp::_InitVirtualGeometryBuffers()
+{
+	Buffer::CreateInformation bufferInfo{};
+	std::vector<uint32_t> nodeWords;
+	std::vector<uint32_t> groupWords;
+	std::vector<uint32_t> groupOffsets;
+	const uint32_t nodeCount = static_cast<uint32_t>(m_vgModel.nodes.size());
+	const uint32_t queueHeaderSize = 4; // head, tail, pending, padding
+
+	// pack device data of all nodes and groups
+	nodeWords.reserve(nodeCount * 16);
+	for (const auto& node : m_vgModel.nodes)
+	{
+		const void* pSrc = nullptr;
+		size_t size = 0;
+		node.GetDataToCopyToDevice(pSrc, size);
+		nodeWords.insert(nodeWords.end(), static_cast<const uint32_t*>(pSrc), static_cast<const uint32_t*>(pSrc) + size / sizeof(uint32_t));
+	}
+	groupOffsets.reserve(m_vgModel.groups.size());
+	for (const auto& group : m_vgModel.groups)
+	{
+		const void* pSrc = nullptr;
+		size_t size = 0;
+		// vg_cull.comp and vg_cluster.mesh read the RAW layout only
+		CHECK_TRUE(group.GetEncoding() == VirtualGeometry::ClusterGroupData::Encoding::RAW, "Device shaders need RAW cluster group encoding!");
+		group.GetDataToCopyToDevice(pSrc, size);
+		groupOffsets.push_back(static_cast<uint32_t>(groupWords.size()));
+		groupWords.insert(groupWords.end(), static_cast<const uint32_t*>(pSrc), static_cast<const uint32_t*>(pSrc) + size / sizeof(uint32_t));
+	}
+
+	bufferInfo.optMemoryProperty = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	auto funcCreateStorageBuffer = [&bufferInfo](const std::vector<uint32_t>& _data)
+		{
+			std::unique_ptr<Buffer> uptrBuffer = std::make_unique<Buffer>(Buffer{});
+			bufferInfo.size = static_cast<uint32_t>(sizeof(uint32_t)) * static_cast<uint32_t>(_data.size());
+			uptrBuffer->PresetCreateInformation(bufferInfo);
+			uptrBuffer->Init();
+			uptrBuffer->CopyFromHost(_data.data());
+			return uptrBuffer;
+		};
+	m_vgNodeBuffer = funcCreateStorageBuffer(nodeWords);
+	m_vgGroupBuffer = funcCreateStorageBuffer(groupWords);
+	m_vgGroupOffsetBuffer = funcCreateStorageBuffer(groupOffsets);
+
+	// each node is pushed at most once in a traversal
+	// one mesh workgroup for each selected cluster, so the indirect draw stays in device limits
+	VkPhysicalDeviceMeshShaderPropertiesEXT meshShaderProperties{};
+	MyDevice::GetInstance().GetPhysicalDeviceMeshShaderProperties(meshShaderProperties);
+	m_vgClusterCapacity = std::min({
+		m_vgModel.clusterCount,
+		meshShaderProperties.maxMeshWorkGroupCount[0],
+		meshShaderProperties.maxMeshWorkGroupTotalCount });
+	if (m_vgClusterCapacity < m_vgModel.clusterCount)
+	{
+		std::cout << "Virtual geometry cut is limited to " << m_vgClusterCapacity << " of " << m_vgModel.clusterCount << " clusters" << std::endl;
+	}
+	m_vgTraversal.Init(m_vgModel.rootIndex, m_vgModel.nodes, m_vgModel.groups);
+	m_vgCullRecords.assign(MAX_FRAME_COUNT, VirtualGeometryCullRecord{});
+
+	m_vgQueueReset.assign(queueHeaderSize + nodeCount, ~0u);
+	m_vgQueueReset[0] = 0;						// head
+	m_vgQueueReset[1] = 1;						// tail
+	m_vgQueueReset[2] = 1;						// pending
+	m_vgQueueReset[3] = 0;						// padding
+	m_vgQueueReset[4] = m_vgModel.rootIndex;	// nodeQueue[0]
+
+	for (int i = 0; i < MAX_FRAME_COUNT; ++i)
+	{
+		std::unique_ptr<Buffer> queueBuffer = std::make_unique<Buffer>(Buffer{});
+		std::unique_ptr<Buffer> clusterListBuffer = std::make_unique<Buffer>(Buffer{});
+		std::unique_ptr<Buffer> indirectBuffer = std::make_unique<Buffer>(Buffer{});
+
+		// reset by host every frame
+		bufferInfo.optMemoryProperty = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+		bufferInfo.size = static_cast<uint32_t>(sizeof(uint32_t)) * static_cast<uint32_t>(m_vgQueueReset.size());
+		queueBuffer->PresetCreateInformation(bufferInfo);
+		queueBuffer->Init();
+
+		bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+		bufferInfo.size = static_cast<uint32_t>(sizeof(VkDrawMeshTasksIndirectCommandEXT));
+		indirectBuffer->PresetCreateInformation(bufferInfo);
+		indirectBuffer->Init();
+
+		// read back by _ValidateVirtualGeometryCut
+		bufferInfo.optMemoryProperty = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		bufferInfo.size = static_cast<uint32_t>(sizeof(glm::uvec2)) * std::max(m_vgClusterCapacity, 1u);
+		clusterListBuffer->PresetCreateInformation(bufferInfo);
+		clusterListBuffer->Init();
+
+		m_vgQueueBuffers.push_back(std::move(queueBuffer));
+		m_vgClusterListBuffers.push_back(std::move(clusterListBuffer));
+		m_vgIndirectBuffers.push_back(std::move(indirectBuffer));
+	}
+}
+void MeshletApp::_UninitVirtualGeometryBuffers()
+{
+	m_vgCullRecords.clear();
+
+	auto frameBuffers = {
+		&m_vgQueueBuffers,
+		&m_vgClusterListBuffers,
+		&m_vgIndirectBuffers,
+	};
+	for (auto pVec : frameBuffers)
+	{
+		for (auto& uptr : *pVec)
+		{
+			uptr->Uninit();
+		}
+		pVec->clear();
+	}
+
+	for (auto pUptr : { &m_vgNodeBuffer, &m_vgGroupBuffer, &m_vgGroupOffsetBuffer })
+	{
+		if (*pUptr)
+		{
+			(*pUptr)->Uninit();
+			pUptr->reset();
+		}
+	}
+}
+
 void MeshletApp::_InitImagesAndViews()
 {
 	m_swapchainImages = pDevice->GetSwapchainImages();
@@ -397,9 +626,19 @@ void MeshletApp::_InitPipelines()
 		"E:/GitStorage/LearnVulkan/bin/shaders/flat_task.mesh.spv",
 		"E:/GitStorage/LearnVulkan/bin/shaders/flat_task.frag.spv"
 		}, MAX_FRAME_COUNT);
+
+	m_vgCullProgram.Init({ "E:/GitStorage/LearnVulkan/bin/shaders/vg_cull.comp.spv" }, MAX_FRAME_COUNT);
+
+	m_vgDrawProgram.PresetRenderPass(&m_renderPass, 0);
+	m_vgDrawProgram.Init({
+		"E:/GitStorage/LearnVulkan/bin/shaders/vg_cluster.mesh.spv",
+		"E:/GitStorage/LearnVulkan/bin/shaders/flat_task.frag.spv"
+		}, MAX_FRAME_COUNT);
 }
 void MeshletApp::_UninitPipelines()
 {
+	m_vgDrawProgram.Uninit();
+	m_vgCullProgram.Uninit();
 	m_program.Uninit();
 }
 
@@ -466,7 +705,219 @@ void MeshletApp::_UpdateUniformBuffer()
 	frustumUBO.nearFace = cameraFrustum.nearPlane;
 	m_frustumBuffers[m_currentFrame]->CopyFromHost(&frustumUBO);
 
+	// device traversal starts from root every frame
+	if (m_useVirtualGeometry)
+	{
+		VkDrawMeshTasksIndirectCommandEXT indirectCommand{ 0, 1, 1 };
+		VirtualGeometryCullRecord& record = m_vgCullRecords[m_currentFrame];
+
+		// commands of this frame slot are done, check its cut before buffers are reset
+		if (m_validateVirtualGeometry && record.valid)
+		{
+			_ValidateVirtualGeometryCut(m_currentFrame);
+		}
+		record.valid = true;
+		record.camera = m_camera;
+		record.pixelError = m_vgPixelError;
+
+		m_vgQueueBuffers[m_currentFrame]->CopyFromHost(m_vgQueueReset.data());
+		m_vgIndirectBuffers[m_currentFrame]->CopyFromHost(&indirectCommand);
+	}
+	else if (m_cullMeshletsOnHost)
+	{
+		_CullMeshletsOnHost();
+	}
+}
+void MeshletApp::_CullMeshletsOnHost()
+{
+	const uint32_t meshletCountPerWorkgroup = 32;
+	const uint32_t cullRange = 4096; // meshlets each task culls, testing one meshlet is only a few instructions
+	const uint32_t modelCount = static_cast<uint32_t>(m_models.size());
+	const double startTime = glfwGetTime();
+	const Frustum cameraFrustum = m_camera.GetFrustum();
+	const std::array<glm::vec4, 6> worldPlanes = {
+		cameraFrustum.topPlane,
+		cameraFrustum.bottomPlane,
+		cameraFrustum.leftPlane,
+		cameraFrustum.rightPlane,
+		cameraFrustum.nearPlane,
+		cameraFrustum.farPlane,
+	};
+	MeshletBoundsSBO culledBounds{};
+
+	// padding fails both tests in task shader
+	culledBounds.boundSphere = glm::vec4(0.0f, 0.0f, 0.0f, -FLT_MAX);
+	culledBounds.coneApex = glm::vec3(0.0f);
+	culledBounds.coneNormalCutoff = glm::vec4(0.0f, 0.0f, 1.0f, -2.0f);
+
+	for (uint32_t i = 0; i < modelCount; ++i)
+	{
+		const Model& model = m_models[i];
+		const uint32_t meshletCount = static_cast<uint32_t>(model.vecMeshlet.size());
+		const uint32_t bufferIndex = m_currentFrame * modelCount + i;
+		const glm::mat4 transposeModel = glm::transpose(model.modelMatrix);
+		const glm::vec3 eye = glm::vec3(glm::inverse(model.modelMatrix) * glm::vec4(m_camera.eye, 1.0f));
+		std::array<glm::vec4, 6> planes{};
+		uint32_t visibleCount = 0;
+		uint32_t paddedCount = 0;
+
+		// test in object space so bounds are not transformed, dot(plane, M * p) = dot(transpose(M) * plane, p)
+		// keeps world distance, cones are exact only when model has uniform scale
+		for (size_t p = 0; p < planes.size(); ++p)
+		{
+			planes[p] = transposeModel * worldPlanes[p];
+		}
+
+		m_hostVisibleFlags.resize(meshletCount);
+		m_hostVisibleIndices.resize(meshletCount);
+		MyTaskScheduler::GetInstance().ParallelFor(meshletCount, cullRange, [&](uint32_t _begin, uint32_t _end, uint32_t)
+			{
+				simd_math::CullSpheres(model.meshletSpheres, planes, model.maxScale, _begin, _end, m_hostVisibleFlags.data());
+				simd_math::CullCones(model.meshletCones, eye, _begin, _end, m_hostVisibleFlags.data());
+			});
+		visibleCount = static_cast<uint32_t>(simd_math::CompactIndices(m_hostVisibleFlags.data(), meshletCount, m_hostVisibleIndices.data()));
+		paddedCount = common_utils::AlignUp(visibleCount, meshletCountPerWorkgroup);
+
+		m_hostMeshletSBOs.assign(paddedCount, MeshletSBO{});
+		m_hostBoundsSBOs.assign(paddedCount, culledBounds);
+		for (uint32_t j = 0; j < visibleCount; ++j)
+		{
+			const Meshlet::DeviceDataRef& meshlet = model.vecMeshlet[m_hostVisibleIndices[j]];
+			const MeshletBounds& meshletBounds = model.vecMeshletBounds[m_hostVisibleIndices[j]];
+			MeshletSBO& sbo = m_hostMeshletSBOs[j];
+			MeshletBoundsSBO& boundsSBO = m_hostBoundsSBOs[j];
+
+			sbo.triangleCount = meshlet.triangleCount;
+			sbo.triangleOffset = meshlet.indexOffset;
+			sbo.vertexCount = meshlet.vertexCount;
+			sbo.vertexOffset = meshlet.vertexOffset;
+			boundsSBO.boundSphere = glm::vec4(meshletBounds.center, meshletBounds.radius);
+			boundsSBO.coneApex = meshletBounds.coneApex;
+			boundsSBO.coneNormalCutoff = glm::vec4(meshletBounds.coneAxis, meshletBounds.coneCutoff);
+		}
+		if (paddedCount > 0)
+		{
+			m_hostCulledMeshletBuffers[bufferIndex]->CopyFromHost(m_hostMeshletSBOs.data(), 0, sizeof(MeshletSBO) * paddedCount);
+			m_hostCulledBoundsBuffers[bufferIndex]->CopyFromHost(m_hostBoundsSBOs.data(), 0, sizeof(MeshletBoundsSBO) * paddedCount);
+		}
+		m_hostVisibleCounts[i] = visibleCount;
+	}
+
+	m_hostCullTime = static_cast<float>((glfwGetTime() - startTime) * 1000.0);
+}
+void MeshletApp::_CullVirtualGeometry(CommandSubmission* _pCmd)
+{
+	auto& manager = m_vgCullProgram.GetDescriptorSetManager();
+	const uint32_t persistentWorkgroupCount = 32; // workgroups keep fetching nodes until the queue is drained
+	VirtualGeometryCullPushConstant cullSettings{};
+	VkMemoryBarrier barrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+
+	cullSettings.pixelError = m_vgPixelError;
+	cullSettings.pixelsPerUnit = 0.5f * m_camera.height * m_camera.GetInverseTangentHalfFOVy();
+	cullSettings.nearClip = m_camera.near_clip;
+	cullSettings.clusterCapacity = m_vgClusterCapacity;
+
+	manager.StartBind();
+	manager.BindDescriptor(
+		0, 0,
+		{ m_cameraBuffers[m_currentFrame]->GetDescriptorInfo() },
+		DescriptorSetManager::DESCRIPTOR_BIND_SETTING::CONSTANT_DESCRIPTOR_SET_PER_FRAME);
+	manager.BindDescriptor(
+		0, 1,
+		{ m_frustumBuffers[m_currentFrame]->GetDescriptorInfo() },
+		DescriptorSetManager::DESCRIPTOR_BIND_SETTING::CONSTANT_DESCRIPTOR_SET_PER_FRAME);
+	manager.BindDescriptor(
+		1, 0,
+		{ m_vgNodeBuffer->GetDescriptorInfo() },
+		DescriptorSetManager::DESCRIPTOR_BIND_SETTING::CONSTANT_DESCRIPTOR_SET_ACROSS_FRAMES);
+	manager.BindDescriptor(
+		1, 1,
+		{ m_vgGroupBuffer->GetDescriptorInfo() },
+		DescriptorSetManager::DESCRIPTOR_BIND_SETTING::CONSTANT_DESCRIPTOR_SET_ACROSS_FRAMES);
+	manager.BindDescriptor(
+		1, 2,
+		{ m_vgGroupOffsetBuffer->GetDescriptorInfo() },
+		DescriptorSetManager::DESCRIPTOR_BIND_SETTING::CONSTANT_DESCRIPTOR_SET_ACROSS_FRAMES);
+	manager.BindDescriptor(
+		1, 3,
+		{ m_meshUBOBuffers[0]->GetDescriptorInfo() },
+		DescriptorSetManager::DESCRIPTOR_BIND_SETTING::CONSTANT_DESCRIPTOR_SET_ACROSS_FRAMES);
+	manager.BindDescriptor(
+		2, 0,
+		{ m_vgQueueBuffers[m_currentFrame]->GetDescriptorInfo() },
+		DescriptorSetManager::DESCRIPTOR_BIND_SETTING::CONSTANT_DESCRIPTOR_SET_PER_FRAME);
+	manager.BindDescriptor(
+		2, 1,
+		{ m_vgClusterListBuffers[m_currentFrame]->GetDescriptorInfo() },
+		DescriptorSetManager::DESCRIPTOR_BIND_SETTING::CONSTANT_DESCRIPTOR_SET_PER_FRAME);
+	manager.BindDescriptor(
+		2, 2,
+		{ m_vgIndirectBuffers[m_currentFrame]->GetDescriptorInfo() },
+		DescriptorSetManager::DESCRIPTOR_BIND_SETTING::CONSTANT_DESCRIPTOR_SET_PER_FRAME);
+	manager.EndBind();
+
+	m_vgCullProgram.PushConstant(VK_SHADER_STAGE_COMPUTE_BIT, &cullSettings);
+	m_vgCullProgram.DispatchWorkGroup(_pCmd, persistentWorkgroupCount, 1, 1);
+
+	// cluster list and indirect arguments are consumed by mesh shader draw
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	_pCmd->AddPipelineBarrier(
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_MESH_SHADER_BIT_EXT,
+		{ barrier });
 }
+
+void MeshletApp::_ValidateVirtualGeometryCut(uint32_t _frame)
+{
+	const VirtualGeometryCullRecord& record = m_vgCullRecords[_frame];
+	VkDrawMeshTasksIndirectCommandEXT indirectCommand{};
+	std::vector<VirtualGeometryTraversal::SelectedCluster> hostClusters;
+	std::vector<glm::uvec2> deviceCut;
+	std::vector<glm::uvec2> hostCut;
+	std::vector<glm::uvec2> difference;
+	size_t deviceOnlyCount = 0;
+	size_t hostOnlyCount = 0;
+	auto funcLess = [](const glm::uvec2& inLhs, const glm::uvec2& inRhs)
+		{
+			return inLhs.x != inRhs.x ? inLhs.x < inRhs.x : inLhs.y < inRhs.y;
+		};
+
+	m_vgIndirectBuffers[_frame]->CopyToHost(&indirectCommand, 0, sizeof(VkDrawMeshTasksIndirectCommandEXT));
+	deviceCut.resize(indirectCommand.groupCountX);
+	if (!deviceCut.empty())
+	{
+		m_vgClusterListBuffers[_frame]->CopyToHost(deviceCut.data(), 0, deviceCut.size() * sizeof(glm::uvec2));
+	}
+
+	// virtual geometry model has identity model matrix, so host traversal in world space sees the same spheres
+	m_vgTraversal.Traverse(record.camera, record.pixelError, hostClusters);
+	hostCut.reserve(hostClusters.size());
+	for (const auto& cluster : hostClusters)
+	{
+		hostCut.push_back(glm::uvec2(cluster.groupIndex, cluster.clusterIndex));
+	}
+
+	std::sort(deviceCut.begin(), deviceCut.end(), funcLess);
+	std::sort(hostCut.begin(), hostCut.end(), funcLess);
+	std::set_difference(deviceCut.begin(), deviceCut.end(), hostCut.begin(), hostCut.end(), std::back_inserter(difference), funcLess);
+	deviceOnlyCount = difference.size();
+	difference.clear();
+	std::set_difference(hostCut.begin(), hostCut.end(), deviceCut.begin(), deviceCut.end(), std::back_inserter(difference), funcLess);
+	hostOnlyCount = difference.size();
+
+	m_vgValidationResult = "GPU " + std::to_string(deviceCut.size()) + ", CPU " + std::to_string(hostCut.size())
+		+ ", GPU only " + std::to_string(deviceOnlyCount) + ", CPU only " + std::to_string(hostOnlyCount);
+	if (hostCut.size() > m_vgClusterCapacity)
+	{
+		m_vgValidationResult += " (cut exceeds capacity " + std::to_string(m_vgClusterCapacity) + ")";
+	}
+	if (deviceOnlyCount != 0 || hostOnlyCount != 0)
+	{
+		std::cout << "Virtual geometry cut differs from host traversal: " << m_vgValidationResult << std::endl;
+	}
+}
+
 void MeshletApp::_DrawFrame()
 {
 	if (MyDevice::GetInstance().NeedRecreateSwapchain())
@@ -484,12 +935,61 @@ void MeshletApp::_DrawFrame()
 	waitInfo.waitPipelineStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 	cmd->StartCommands({ waitInfo });
 
-	m_program.BindFramebuffer(cmd.get(), m_framebuffers[imageIndex.value()].get());
-	
-	for (int i = 0; i < m_models.size(); ++i)
+	if (m_useVirtualGeometry)
+	{
+		_CullVirtualGeometry(cmd.get());
+	}
+
+	GraphicsProgram& drawProgram = m_useVirtualGeometry ? m_vgDrawProgram : m_program;
+	drawProgram.BindFramebuffer(cmd.get(), m_framebuffers[imageIndex.value()].get());
+
+	if (m_useVirtualGeometry)
+	{
+		auto& manager = m_vgDrawProgram.GetDescriptorSetManager();
+
+		manager.StartBind();
+		manager.BindDescriptor(
+			0, 0,
+			{ m_cameraBuffers[m_currentFrame]->GetDescriptorInfo() },
+			DescriptorSetManager::DESCRIPTOR_BIND_SETTING::CONSTANT_DESCRIPTOR_SET_PER_FRAME);
+		manager.BindDescriptor(
+			1, 1,
+			{ m_vgGroupBuffer->GetDescriptorInfo() },
+			DescriptorSetManager::DESCRIPTOR_BIND_SETTING::CONSTANT_DESCRIPTOR_SET_ACROSS_FRAMES);
+		manager.BindDescriptor(
+			1, 2,
+			{ m_vgGroupOffsetBuffer->GetDescriptorInfo() },
+			DescriptorSetManager::DESCRIPTOR_BIND_SETTING::CONSTANT_DESCRIPTOR_SET_ACROSS_FRAMES);
+		manager.BindDescriptor(
+			1, 3,
+			{ m_meshUBOBuffers[0]->GetDescriptorInfo() },
+			DescriptorSetManager::DESCRIPTOR_BIND_SETTING::CONSTANT_DESCRIPTOR_SET_ACROSS_FRAMES);
+		manager.BindDescriptor(
+			1, 4,
+			{ m_meshletVBOBuffers[0]->GetDescriptorInfo() },
+			DescriptorSetManager::DESCRIPTOR_BIND_SETTING::CONSTANT_DESCRIPTOR_SET_ACROSS_FRAMES);
+		manager.BindDescriptor(
+			2, 1,
+			{ m_vgClusterListBuffers[m_currentFrame]->GetDescriptorInfo() },
+			DescriptorSetManager::DESCRIPTOR_BIND_SETTING::CONSTANT_DESCRIPTOR_SET_PER_FRAME);
+		manager.EndBind();
+
+		m_vgDrawProgram.DispatchWorkGroupIndirect(cmd.get(), m_vgIndirectBuffers[m_currentFrame]->vkBuffer);
+	}
+
+	for (int i = 0; i < m_models.size() && !m_useVirtualGeometry; ++i)
 	{
 		auto& manager = m_program.GetDescriptorSetManager();
 		const uint32_t meshletCountPerWorkgroup = 32;
+		const uint32_t bufferIndex = m_currentFrame * static_cast<uint32_t>(m_models.size()) + i;
+		const uint32_t meshletCount = m_cullMeshletsOnHost ? m_hostVisibleCounts[i] : static_cast<uint32_t>(m_models[i].vecMeshlet.size());
+		Buffer* pMeshletBuffer = m_cullMeshletsOnHost ? m_hostCulledMeshletBuffers[bufferIndex].get() : m_meshletBuffers[i].get();
+		Buffer* pBoundsBuffer = m_cullMeshletsOnHost ? m_hostCulledBoundsBuffers[bufferIndex].get() : m_meshletBoundsBuffers[i].get();
+		const auto bindSetting = m_cullMeshletsOnHost ?
+			DescriptorSetManager::DESCRIPTOR_BIND_SETTING::DEDICATE_DESCRIPTOR_SET_PER_FRAME :
+			DescriptorSetManager::DESCRIPTOR_BIND_SETTING::DEDICATE_DESCRIPTOR_SET_ACROSS_FRAMES;
+
+		if (meshletCount == 0) continue;
 
 		manager.StartBind();
 		
@@ -503,8 +1003,8 @@ void MeshletApp::_DrawFrame()
 			DescriptorSetManager::DESCRIPTOR_BIND_SETTING::CONSTANT_DESCRIPTOR_SET_PER_FRAME);
 		manager.BindDescriptor(
 			1, 0,
-			{ m_meshletBuffers[i]->GetDescriptorInfo() },
-			DescriptorSetManager::DESCRIPTOR_BIND_SETTING::DEDICATE_DESCRIPTOR_SET_ACROSS_FRAMES);
+			{ pMeshletBuffer->GetDescriptorInfo() },
+			bindSetting);
 		manager.BindDescriptor(
 			1, 1,
 			{ m_meshletVertexBuffers[i]->GetDescriptorInfo() },
@@ -523,13 +1023,13 @@ void MeshletApp::_DrawFrame()
 			DescriptorSetManager::DESCRIPTOR_BIND_SETTING::DEDICATE_DESCRIPTOR_SET_ACROSS_FRAMES);
 		manager.BindDescriptor(
 			1, 5,
-			{ m_meshletBoundsBuffers[i]->GetDescriptorInfo() },
-			DescriptorSetManager::DESCRIPTOR_BIND_SETTING::DEDICATE_DESCRIPTOR_SET_ACROSS_FRAMES);
+			{ pBoundsBuffer->GetDescriptorInfo() },
+			bindSetting);
 
 		manager.EndBind();
 		m_program.DispatchWorkGroup(
 			cmd.get(),
-			(static_cast<uint32_t>(m_models[i].vecMeshlet.size()) + meshletCountPerWorkgroup - 1) / meshletCountPerWorkgroup,
+			(meshletCount + meshletCountPerWorkgroup - 1) / meshletCountPerWorkgroup,
 			1,
 			1);
 		// don't use task shader here
@@ -546,12 +1046,32 @@ void MeshletApp::_DrawFrame()
 	{
 		std::cout << "clicked" << std::endl;
 	}
+	m_gui.CheckBox("Virtual geometry", m_useVirtualGeometry);
+	m_gui.SliderFloat("Pixel error", m_vgPixelError, 0.1f, 16.0f);
+	m_gui.CheckBox("Validate VG cut on CPU", m_validateVirtualGeometry);
+	if (m_validateVirtualGeometry && m_useVirtualGeometry)
+	{
+		m_gui.Text(m_vgValidationResult);
+	}
+	m_gui.CheckBox("CPU meshlet culling", m_cullMeshletsOnHost);
+	if (m_cullMeshletsOnHost && !m_useVirtualGeometry)
+	{
+		uint32_t visibleCount = 0;
+		for (uint32_t count : m_hostVisibleCounts)
+		{
+			visibleCount += count;
+		}
+		m_gui.Text(std::string("Visible meshlets: ") + std::to_string(visibleCount) +
+			", " + std::to_string(m_hostCullTime) + " ms (" + simd_math::GetInstructionSet() + ")");
+	}
 	m_gui.EndWindow();
 	m_gui.Apply(cmd->vkCommandBuffer);
 
-	m_program.UnbindFramebuffer(cmd.get());
+	drawProgram.UnbindFramebuffer(cmd.get());
 
 	m_program.EndFrame();
+	m_vgCullProgram.EndFrame();
+	m_vgDrawProgram.EndFrame();
 
 	VkSemaphore renderpassFinish = cmd->SubmitCommands();
 	MyDevice::GetInstance().PresentSwapchainImage({ renderpassFinish }, imageIndex.value());
@@ -12,6 +12,10 @@
 #include "utils.h"
 #include "pipeline_program.h"
 #include "my_gui.h"
+#include "virtual_geometry.h"
+#include "virtual_geometry_traversal.h"
+#include "simd_math.h"
+#include "mesh_file.h"
 
 class MeshletApp
 {
@@ -22,9 +26,13 @@ private:
 		Transform transform;
 		glm::mat4 modelMatrix;
 		std::vector<Meshlet::DeviceDataRef> vecMeshlet;
-		std::vector<uint32_t>      vecVertexRemap;
+		std::vector<uint32_t>      vecVertexRemap;		// empty if pCookedMesh is set
 		std::vector<uint8_t>       vecTriangleIndex;
+		const MeshFile::MeshView*  pCookedMesh = nullptr;	// meshlet vertex and triangle streams are decoded from it on upload
 		std::vector<MeshletBounds> vecMeshletBounds;
+		simd_math::SphereArrays    meshletSpheres; // SoA copy of bounds for host culling
+		simd_math::ConeArrays      meshletCones;
+		float                      maxScale = 1.0f;
 	};
 	struct VBO
 	{
@@ -68,6 +76,28 @@ private:
 		alignas(16) glm::vec4 nearFace;
 		alignas(16) glm::vec4 farFace;
 	};
+	// Device data of virtual geometry built from the first model
+	struct VirtualGeometryModel
+	{
+		uint32_t rootIndex = ~0u;
+		std::vector<VirtualGeometry::IntermediateNode> nodes;
+		std::vector<VirtualGeometry::ClusterGroupData> groups;
+		uint32_t clusterCount = 0;
+	};
+	struct VirtualGeometryCullPushConstant
+	{
+		float pixelError;
+		float pixelsPerUnit;
+		float nearClip;
+		uint32_t clusterCapacity;
+	};
+	// Camera and settings a frame was culled with, host traversal replays them to check the device cut
+	struct VirtualGeometryCullRecord
+	{
+		bool valid = false;
+		PersCamera camera{};
+		float pixelError = 0.0f;
+	};
 
 private:
 	double lastTime = 0.0;
@@ -77,8 +107,33 @@ private:
 	MyDevice* pDevice = nullptr;
 
 	std::vector<Model> m_models;
+	MeshFile m_meshFile;	// open until buffers are uploaded
 	std::vector<MeshletBoundsSBO> m_tBound;
 
+	// virtual geometry mode: cull hierarchy with vg_cull.comp and draw selected clusters indirectly,
+	// otherwise draw fixed meshlets of all models
+	bool m_useVirtualGeometry = false;
+	float m_vgPixelError = 1.0f;
+	VirtualGeometryModel m_vgModel;
+	std::vector<uint32_t> m_vgQueueReset; // node queue with only root node in it
+	uint32_t m_vgClusterCapacity = 0;	// one mesh workgroup for each selected cluster, within maxMeshWorkGroupCount[0]
+
+	// debug: read back the device cut of a frame once its commands are done and diff it with host traversal
+	bool m_validateVirtualGeometry = false;
+	VirtualGeometryTraversal m_vgTraversal;
+	std::vector<VirtualGeometryCullRecord> m_vgCullRecords;	// one for each frame in flight
+	std::string m_vgValidationResult;
+
+	// fixed meshlets mode: cull meshlets on host and upload only the visible ones,
+	// task shader tests them again, which is cheap since most culled meshlets are gone
+	bool m_cullMeshletsOnHost = false;
+	float m_hostCullTime = 0.0f;					// ms
+	std::vector<uint32_t> m_hostVisibleCounts;		// visible meshlets of each model in current frame
+	std::vector<uint8_t>  m_hostVisibleFlags;
+	std::vector<uint32_t> m_hostVisibleIndices;
+	std::vector<MeshletSBO> m_hostMeshletSBOs;
+	std::vector<MeshletBoundsSBO> m_hostBoundsSBOs;
+
 	// cameraUBO changes across frames, i create buffers for each frame
 	std::vector<std::unique_ptr<Buffer>>        m_cameraBuffers;
 	std::vector<std::unique_ptr<Buffer>>        m_frustumBuffers;
@@ -91,6 +146,18 @@ private:
 	std::vector<std::unique_ptr<Buffer>> m_meshUBOBuffers;
 	std::vector<std::unique_ptr<Buffer>> m_meshletBoundsBuffers;
 
+	// visible meshlets and their bounds written by host culling, frame * modelCount + model
+	std::vector<std::unique_ptr<Buffer>> m_hostCulledMeshletBuffers;
+	std::vector<std::unique_ptr<Buffer>> m_hostCulledBoundsBuffers;
+
+	// virtual geometry buffers, node queue, cluster list and indirect arguments are written by device each frame
+	std::unique_ptr<Buffer> m_vgNodeBuffer;
+	std::unique_ptr<Buffer> m_vgGroupBuffer;
+	std::unique_ptr<Buffer> m_vgGroupOffsetBuffer;
+	std::vector<std::unique_ptr<Buffer>> m_vgQueueBuffers;
+	std::vector<std::unique_ptr<Buffer>> m_vgClusterListBuffers;
+	std::vector<std::unique_ptr<Buffer>> m_vgIndirectBuffers;
+
 	// Samplers
 	VkSampler m_vkSampler = VK_NULL_HANDLE;
 
@@ -104,6 +171,8 @@ private:
 
 	//pipelines
 	GraphicsProgram m_program;
+	ComputeProgram  m_vgCullProgram;
+	GraphicsProgram m_vgDrawProgram;
 
 	// semaphores
 	std::vector<VkSemaphore>  m_swapchainImageAvailabilities;
@@ -126,6 +195,9 @@ private:
 	void _InitBuffers();
 	void _UninitBuffers();
 
+	void _InitVirtualGeometryBuffers();
+	void _UninitVirtualGeometryBuffers();
+
 	void _InitImagesAndViews();
 	void _UninitImagesAndViews();
 
@@ -139,6 +211,16 @@ private:
 	void _UpdateUniformBuffer();
 	void _DrawFrame();
 
+	// frustum and backface cull meshlets of all models with simd_math and fill buffers of current frame
+	void _CullMeshletsOnHost();
+
+	// traverse virtual geometry hierarchy on device, must be recorded outside render pass
+	void _CullVirtualGeometry(CommandSubmission* _pCmd);
+
+	// compare clusters selected by device in _frame with VirtualGeometryTraversal for the same camera,
+	// commands of _frame must be done
+	void _ValidateVirtualGeometryCut(uint32_t _frame);
+
 	void _ResizeWindow();
 	
 	VkImageLayout _GetImageLayout(ImageView* pImageView) const;
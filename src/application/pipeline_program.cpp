@@ -59,10 +59,27 @@ void DescriptorSetManager::_InitDescriptorSetLayouts()
 		{
 			uint32_t bindingId = binding.first;
 			const VkDescriptorSetLayoutBinding& vkBinding = binding.second;
+			const bool isRuntimeArray = (vkBinding.descriptorCount == 0); // reflection gives 0 for runtime array
 
+			if (isRuntimeArray)
+			{
+				VkPhysicalDeviceDescriptorIndexingProperties indexingProperties{};
+
+				// device only enables update after bind for sampled images, see MyDevice::_AddBindlessExtensionsAndFeatures
+				CHECK_TRUE(vkBinding.descriptorType == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+					|| vkBinding.descriptorType == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, "Only runtime arrays of textures can be bindless!");
+				MyDevice::GetInstance().GetPhysicalDeviceDescriptorIndexingProperties(indexingProperties);
+				CHECK_TRUE(indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages >= MAX_BINDLESS_DESCRIPTOR_COUNT
+					&& indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages >= MAX_BINDLESS_DESCRIPTOR_COUNT
+					&& indexingProperties.maxPerStageUpdateAfterBindResources >= MAX_BINDLESS_DESCRIPTOR_COUNT, "Bindless textures exceed device limits!");
+				CHECK_TRUE(vkBinding.descriptorType != VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+					|| (indexingProperties.maxDescriptorSetUpdateAfterBindSamplers >= MAX_BINDLESS_DESCRIPTOR_COUNT
+						&& indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers >= MAX_BINDLESS_DESCRIPTOR_COUNT), "Bindless samplers exceed device limits!");
+			}
+			uptrLayout->SetFollowingBindless(isRuntimeArray);
 			uptrLayout->PreAddBinding(
 				vkBinding.binding,
-				vkBinding.descriptorCount,
+				isRuntimeArray ? MAX_BINDLESS_DESCRIPTOR_COUNT : vkBinding.descriptorCount,
 				vkBinding.descriptorType,
 				vkBinding.stageFlags,
 				vkBinding.pImmutableSamplers);
@@ -947,6 +964,28 @@ void GraphicsProgram::DispatchWorkGroup(
 	m_uptrPipeline->Do(_pCmd->vkCommandBuffer, input);
 }
 
+void GraphicsProgram::DispatchWorkGroupIndirect(
+	CommandSubmission* _pCmd,
+	VkBuffer _indirectBuffer,
+	VkDeviceSize _offset)
+{
+	GraphicsPipeline::PipelineInput_MeshIndirect input{};
+	bool bPipelineInitlaized = (m_uptrPipeline.get() != nullptr);
+
+	if (!bPipelineInitlaized)
+	{
+		_InitPipeline();
+	}
+
+	input.indirectBuffer = _indirectBuffer;
+	input.indirectBufferOffset = _offset;
+	input.imageSize = m_pFramebuffer->GetImageSize();
+	input.pushConstants = m_pushConstants;
+	m_uptrDescriptorSetManager->GetCurrentDescriptorSets(input.vkDescriptorSets, input.optDynamicOffsets);
+	m_pushConstants.clear();
+	m_uptrPipeline->Do(_pCmd->vkCommandBuffer, input);
+}
+
 void GraphicsProgram::UnbindFramebuffer(CommandSubmission* _pCmd)
 {
 	_pCmd->EndRenderPass();
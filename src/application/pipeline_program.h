@@ -56,6 +56,8 @@ private:
 	};
 
 private:
+	static constexpr uint32_t MAX_BINDLESS_DESCRIPTOR_COUNT = 1024; // size of bindless binding, e.g. sampler2D textures[] in shader
+
 	// get by reflection:
 	std::unordered_map<std::string, std::pair<uint32_t, uint32_t>>	m_mapNameToSetBinding;		// name in shader -> set, binding
 	std::vector<std::map<uint32_t, VkDescriptorSetLayoutBinding>>	m_vkDescriptorSetBindingInfo; // m_vkDescriptorSetBindingInfo[set]
@@ -83,7 +85,8 @@ private:
 	// return true if the output is valid, return false if we cannot map the name
 	bool _GetDescriptorLocation(const std::string& _name, uint32_t& _set, uint32_t& _binding) const;
 
-	// create descriptor set layouts, init them this will be only done once
+	// create descriptor set layouts, init them this will be only done once,
+	// runtime arrays in shader are added as bindless bindings, bind any number of descriptors up to MAX_BINDLESS_DESCRIPTOR_COUNT to them
 	void _InitDescriptorSetLayouts();
 
 	// destroy descriptor set layout and descriptor sets, uninit them
@@ -256,6 +259,13 @@ public:
 		uint32_t _groupCountY, 
 		uint32_t _groupCountZ);
 
+	// dispatch mesh/task workgroups with counts stored in _indirectBuffer at _offset,
+	// as a VkDrawMeshTasksIndirectCommandEXT
+	void DispatchWorkGroupIndirect(
+		CommandSubmission* _pCmd,
+		VkBuffer _indirectBuffer,
+		VkDeviceSize _offset = 0);
+
 	// always call it before command submission if you call BindFramebuffer upfront 
 	void UnbindFramebuffer(CommandSubmission* _pCmd);
 
@@ -1,6 +1,7 @@
 #include "ray_query_app.h"
 #include "device.h"
 #include "shader.h"
+#include "mesh_file.h"
 #include "swapchain_pass.h"
 
 #define MAX_FRAME_COUNT 3
@@ -69,8 +70,8 @@ void RayQueryApp::_UninitSampler()
 void RayQueryApp::_InitModels()
 {
 	std::vector<StaticMesh> outMeshes;
-	MeshUtility::Load("E:/GitStorage/LearnVulkan/res/models/wahoo/wahoo.obj", outMeshes);
-	MeshUtility::Load("E:/GitStorage/LearnVulkan/res/models/ChessBoard/ChessBoard.obj", outMeshes);
+	MeshFile::LoadObjCooked("E:/GitStorage/LearnVulkan/res/models/wahoo/wahoo.obj", outMeshes);
+	MeshFile::LoadObjCooked("E:/GitStorage/LearnVulkan/res/models/ChessBoard/ChessBoard.obj", outMeshes);
 
 	for (auto const& mesh : outMeshes)
 	{
@@ -1,6 +1,7 @@
 #include "ray_tracing_app.h"
 #include "swapchain_pass.h"
 #include "shader.h"
+#include "mesh_file.h"
 #include "pipeline_program.h"
 #include "utility/glTF_loader.h"
 #include <random>
@@ -68,10 +69,10 @@ void RayTracingApp::_UninitSampler()
 void RayTracingApp::_InitModels()
 {
 	std::vector<StaticMesh> outMeshes;
-	MeshUtility::Load("E:/GitStorage/LearnVulkan/res/models/sphere/sphere.obj", outMeshes);
-	MeshUtility::Load("E:/GitStorage/LearnVulkan/res/models/bunny/bunny.obj", outMeshes);
-	MeshUtility::Load("E:/GitStorage/LearnVulkan/res/models/wahoo/wahoo.obj", outMeshes);
-	MeshUtility::Load("E:/GitStorage/LearnVulkan/res/models/ChessBoard/ChessBoard.obj", outMeshes);
+	MeshFile::LoadObjCooked("E:/GitStorage/LearnVulkan/res/models/sphere/sphere.obj", outMeshes);
+	MeshFile::LoadObjCooked("E:/GitStorage/LearnVulkan/res/models/bunny/bunny.obj", outMeshes);
+	MeshFile::LoadObjCooked("E:/GitStorage/LearnVulkan/res/models/wahoo/wahoo.obj", outMeshes);
+	MeshFile::LoadObjCooked("E:/GitStorage/LearnVulkan/res/models/ChessBoard/ChessBoard.obj", outMeshes);
 
 	for (auto const& mesh : outMeshes)
 	{
@@ -711,7 +712,7 @@ void RayTracingThousandsApp::_InitModels()
 	std::normal_distribution<float> dis(1.0f, 1.0f);
 	std::normal_distribution<float> disn(0.05f, 0.05f);
 	
-	MeshUtility::Load("E:/GitStorage/LearnVulkan/res/models/cube/cube.obj", outMeshes);
+	MeshFile::LoadObjCooked("E:/GitStorage/LearnVulkan/res/models/cube/cube.obj", outMeshes);
 
 	for (uint32_t n = 0; n < 2000; ++n)
 	{
@@ -1270,7 +1271,7 @@ void RayTracingAABBsApp::_InitModels()
 {
 	std::vector<StaticMesh> outMeshes;
 	Model modelChessBoard{};
-	MeshUtility::Load("E:/GitStorage/LearnVulkan/res/models/ChessBoard/ChessBoard.obj", outMeshes);
+	MeshFile::LoadObjCooked("E:/GitStorage/LearnVulkan/res/models/ChessBoard/ChessBoard.obj", outMeshes);
 
 	modelChessBoard.mesh = outMeshes[0];
 	modelChessBoard.transform.SetRotation(0, 0, 90);
@@ -38,15 +38,22 @@ void RayTracingReflectApp::_InitAccelerationStructures()
 
 	m_uptrAccelStruct = std::make_unique<RayTracingAccelerationStructure>();
 
+	std::vector<uint32_t> blasIndices;
+
+	// one BLAS per geometry, instances of the same mesh share it
 	for (size_t i = 0; i < m_rayTracingGeometryData.size(); ++i)
 	{
-		RayTracingAccelerationStructure::InstanceData curInstData{};
+		blasIndices.push_back(m_uptrAccelStruct->PreAddBLAS({ m_rayTracingGeometryData[i] }));
+	}
+	for (const auto& instance : m_rayTracingInstances)
+	{
+		RayTracingAccelerationStructure::InstanceData curInstData = instance;
 
-		curInstData.transformMatrix = m_rayTracingGeometryTransform[i];
-		curInstData.uBLASIndex = m_uptrAccelStruct->PreAddBLAS({ m_rayTracingGeometryData[i] }); // single BLAS can hold multiple geometries, but here i bind single geometry with one BLAS
+		curInstData.uBLASIndex = blasIndices[instance.uBLASIndex];
 
 		instData.push_back(curInstData);
 	}
+	m_TLASInstances = instData;
 
 	// add cloud
 	{
@@ -73,6 +80,7 @@ void RayTracingReflectApp::_UninitAccelerationStructures()
 		m_uptrAccelStruct->Uninit();
 		m_uptrAccelStruct.reset();
 	}
+	m_TLASInstances.clear();
 }
 
 void RayTracingReflectApp::_InitPipeline()
@@ -184,111 +192,143 @@ void RayTracingReflectApp::_DestroySemaphores()
 void RayTracingReflectApp::_CreateBuffers()
 {
 	glTFLoader gltfLoader{};
-	glTFLoader::SceneData glTFData{};
+	glTFLoader::InstancedSceneData glTFData{};
 	MyVDBLoader vdbLoader{};
 	MyVDBLoader::CompactData vdbData{};
-	std::vector<StaticMesh> meshes;
-	std::vector<glm::mat4> modelMatrices;
-	std::vector<glm::vec4> meshColors;
-	std::vector<std::string> materialNames;
+	std::vector<AddressData> meshAddrData;
+	std::vector<uint32_t> meshGeometryIndices; // index of m_rayTracingGeometryData of each glTF mesh, ~0u if no instance uses it
 	std::vector<AddressData> addrData;
-	
-	glTFData.pMeshColors = &meshColors;
-	glTFData.pModelMatrices = &modelMatrices;
-	glTFData.pStaticMeshes = &meshes;
-	glTFData.pMaterialNames = &materialNames;
+	std::vector<Material> mtls;
+	static const std::vector<std::string> mtlNames = {
+		"unknown",     // 0
+		"light",       // 1
+		"backWall",    // 2
+		"ceiling",     // 3
+		"floor",       // 4
+		"leftWall",    // 5
+		"rightWall",   // 6
+		"shortBox",    // 7
+		"tallBox",     // 8
+		"bunny"
+	};
+
 	gltfLoader.Load("E:/GitStorage/LearnVulkan/res/models/cornell_box/scene.gltf");
-	gltfLoader.GetSceneData(glTFData);
-	//MeshUtility::Load("E:/GitStorage/LearnVulkan/res/models/bunny/bunny.obj", meshes);
-	//meshColors.push_back(glm::vec4(1.0f));
-	//modelMatrices.push_back(glm::mat4(1.0));
-	//materialNames.push_back("bunny");
+	gltfLoader.GetInstancedSceneData(glTFData);
+	m_sceneGraph = gltfLoader.GetSceneGraph();
+	m_animations = gltfLoader.GetAnimations();
+
+	// images are decoded with mips by loader, indices of materials point to them
+	for (const auto& imageData : gltfLoader.GetImages())
+	{
+		std::unique_ptr<Texture> uptrTexture = std::make_unique<Texture>();
+
+		uptrTexture->SetPixels(imageData.pixels, imageData.width, imageData.height, imageData.mipLevels, imageData.srgb);
+		uptrTexture->Init();
+		m_uptrTextures.push_back(std::move(uptrTexture));
+	}
+	// textures[] needs at least one descriptor, materials without textures never sample it
+	if (m_uptrTextures.empty())
+	{
+		static const std::array<uint8_t, 4> whitePixel = { 255, 255, 255, 255 };
+		std::unique_ptr<Texture> uptrTexture = std::make_unique<Texture>();
+
+		uptrTexture->SetPixels(whitePixel, 1, 1, 1, false);
+		uptrTexture->Init();
+		m_uptrTextures.push_back(std::move(uptrTexture));
+	}
 	vdbLoader.Load("E:\\GitStorage\\LearnVulkan\\res\\models\\cloud\\Stratocumulus 1.vdb", vdbData);
 
-	// mesh data
-	for (size_t i = 0; i < meshes.size(); ++i)
+	meshAddrData.resize(glTFData.meshes.size());
+	meshGeometryIndices.resize(glTFData.meshes.size(), ~0u);
+
+	// instance data, address and material are indexed by gl_InstanceCustomIndexEXT, so they are per instance
+	for (const auto& instance : glTFData.instances)
 	{
-		Buffer::CreateInformation bufferInfo{};
-		RayTracingAccelerationStructure::TriangleData trigData{};
-		AddressData instanceAddressData{};
-		std::unique_ptr<Buffer> uptrVertexBuffer = std::make_unique<Buffer>();
-		std::unique_ptr<Buffer> uptrIndexBuffer = std::make_unique<Buffer>();
-		std::vector<Vertex> vertPositions;
+		const auto& gltfMtl = glTFData.materials[instance.materialIndex];
+		RayTracingAccelerationStructure::InstanceData instData{};
+		Material curMtl{};
 
-		if (materialNames[i] == "shortBox" || materialNames[i] == "tallBox") continue;
+		if (gltfMtl.name == "shortBox" || gltfMtl.name == "tallBox") continue;
 
-		bufferInfo.optMemoryProperty = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-		bufferInfo.optSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
-			| VK_BUFFER_USAGE_TRANSFER_DST_BIT
-			| VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
-			| VK_BUFFER_USAGE_2_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR;
-		bufferInfo.size = meshes[i].verts.size() * sizeof(Vertex);
-		uptrVertexBuffer->PresetCreateInformation(bufferInfo);
-		uptrVertexBuffer->Init();
-
-		bufferInfo.size = meshes[i].indices.size() * sizeof(uint32_t);
-		uptrIndexBuffer->PresetCreateInformation(bufferInfo);
-		uptrIndexBuffer->Init();
-
-		for (size_t j = 0; j < meshes[i].verts.size(); ++j)
+		curMtl.colorOrLight = gltfMtl.color;
+		curMtl.metallicRoughness = glm::vec4(gltfMtl.metallic, gltfMtl.roughness, 0.0f, 0.0f);
+		curMtl.textureIndices = glm::ivec4(gltfMtl.baseColorImage, gltfMtl.metallicRoughnessImage, -1, -1);
+		for (uint32_t j = 0; j < mtlNames.size(); ++j)
 		{
-			vertPositions.push_back({ glm::vec4(meshes[i].verts[j].position, 1.0f) , glm::vec4(meshes[i].verts[j].normal.value(), 0.0f)});
+			if (gltfMtl.name == mtlNames[j])
+			{
+				curMtl.materialType = glm::uvec4(j, 0, 0, 0);
+			}
 		}
-		uptrVertexBuffer->CopyFromHost(vertPositions.data());
-		uptrIndexBuffer->CopyFromHost(meshes[i].indices.data());
+		mtls.push_back(curMtl);
 
-		trigData.vkIndexType = VK_INDEX_TYPE_UINT32;
-		trigData.uIndexCount = static_cast<uint32_t>(meshes[i].indices.size());
-		trigData.uVertexCount = static_cast<uint32_t>(meshes[i].verts.size());
-		trigData.uVertexStride = static_cast<uint32_t>(sizeof(Vertex));
-		trigData.vkDeviceAddressIndex = uptrIndexBuffer->GetDeviceAddress();
-		trigData.vkDeviceAddressVertex = uptrVertexBuffer->GetDeviceAddress();
-		instanceAddressData.indexAddress = static_cast<uint64_t>(uptrIndexBuffer->GetDeviceAddress());
-		instanceAddressData.vertexAddress = static_cast<uint64_t>(uptrVertexBuffer->GetDeviceAddress());
+		// instances of the same mesh share its buffers and BLAS
+		if (meshGeometryIndices[instance.meshIndex] == ~0u)
+		{
+			const auto& mesh = glTFData.meshes[instance.meshIndex];
+			Buffer::CreateInformation bufferInfo{};
+			RayTracingAccelerationStructure::TriangleData trigData{};
+			std::unique_ptr<Buffer> uptrVertexBuffer = std::make_unique<Buffer>();
+			std::unique_ptr<Buffer> uptrIndexBuffer = std::make_unique<Buffer>();
+			const bool hasNormal = mesh.HasAttribute(VertexAttribute::NORMAL);
+			const bool hasUV = mesh.HasAttribute(VertexAttribute::UV);
+			const size_t vertexBufferSize = mesh.positions.size() * sizeof(Vertex);
+
+			bufferInfo.optMemoryProperty = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+			bufferInfo.optSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+				| VK_BUFFER_USAGE_TRANSFER_DST_BIT
+				| VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+				| VK_BUFFER_USAGE_2_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR;
+			bufferInfo.size = vertexBufferSize;
+			uptrVertexBuffer->PresetCreateInformation(bufferInfo);
+			uptrVertexBuffer->Init();
+
+			bufferInfo.size = mesh.indices.size() * sizeof(uint32_t);
+			uptrIndexBuffer->PresetCreateInformation(bufferInfo);
+			uptrIndexBuffer->Init();
+
+			uptrVertexBuffer->WriteFromHost(0, vertexBufferSize, [&](void* _pDst)
+				{
+					Vertex* pVertices = static_cast<Vertex*>(_pDst);
+					for (size_t j = 0; j < mesh.positions.size(); ++j)
+					{
+						const glm::vec2 uv = hasUV ? mesh.uvs[j] : glm::vec2(0.0f);
+
+						// BLAS reads xyz only, w carries uv so the vertex stays 32 bytes
+						pVertices[j].position = glm::vec4(mesh.positions[j], uv.x);
+						pVertices[j].normal = glm::vec4(hasNormal ? mesh.normals[j] : glm::vec3(0.0f), uv.y);
+					}
+				});
+			uptrIndexBuffer->CopyFromHost(mesh.indices.data());
+
+			trigData.vkIndexType = VK_INDEX_TYPE_UINT32;
+			trigData.uIndexCount = static_cast<uint32_t>(mesh.indices.size());
+			trigData.uVertexCount = static_cast<uint32_t>(mesh.positions.size());
+			trigData.uVertexStride = static_cast<uint32_t>(sizeof(Vertex));
+			trigData.vkDeviceAddressIndex = uptrIndexBuffer->GetDeviceAddress();
+			trigData.vkDeviceAddressVertex = uptrVertexBuffer->GetDeviceAddress();
+			meshAddrData[instance.meshIndex].indexAddress = static_cast<uint64_t>(uptrIndexBuffer->GetDeviceAddress());
+			meshAddrData[instance.meshIndex].vertexAddress = static_cast<uint64_t>(uptrVertexBuffer->GetDeviceAddress());
+
+			meshGeometryIndices[instance.meshIndex] = static_cast<uint32_t>(m_rayTracingGeometryData.size());
+			m_rayTracingGeometryData.push_back(std::move(trigData));
+			m_uptrModelVertexBuffers.push_back(std::move(uptrVertexBuffer));
+			m_uptrModelIndexBuffers.push_back(std::move(uptrIndexBuffer));
+		}
 
-		addrData.push_back(instanceAddressData);
+		addrData.push_back(meshAddrData[instance.meshIndex]);
 
-		m_rayTracingGeometryData.push_back(std::move(trigData));
-		m_rayTracingGeometryTransform.push_back(modelMatrices[i]);
-		m_uptrModelVertexBuffers.push_back(std::move(uptrVertexBuffer));
-		m_uptrModelIndexBuffers.push_back(std::move(uptrIndexBuffer));
+		// uBLASIndex holds index of geometry until BLASes are added in _InitAccelerationStructures
+		instData.uBLASIndex = meshGeometryIndices[instance.meshIndex];
+		instData.transformMatrix = instance.modelMatrix;
+		m_rayTracingInstances.push_back(instData);
+		m_rayTracingInstanceNodes.push_back(instance.node);
 	}
 
 	// material data
 	{
 		Buffer::CreateInformation bufferInfo{};
-		std::vector<Material> mtls;
-		static const std::vector<std::string> mtlNames = {
-			"unknown",     // 0
-			"light",       // 1
-			"backWall",    // 2
-			"ceiling",     // 3
-			"floor",       // 4
-			"leftWall",    // 5
-			"rightWall",   // 6
-			"shortBox",    // 7
-			"tallBox",     // 8
-			"bunny"
-		};
-		CHECK_TRUE(materialNames.size() == meshColors.size(), "Number of material names doesn't match number of material colors!");
-		for (size_t i = 0; i < materialNames.size(); ++i)
-		{
-			Material curMtl{};
-
-			if (materialNames[i] == "shortBox" || materialNames[i] == "tallBox") continue;
-
-			curMtl.colorOrLight = meshColors[i];
-			for (uint32_t j = 0; j < mtlNames.size(); ++j)
-			{
-				if (materialNames[i] == mtlNames[j])
-				{
-					curMtl.materialType = glm::uvec4(j, 0, 0, 0);
-				}
-			}
-
-			mtls.push_back(curMtl);
-		}
 
 		m_uptrMaterialBuffer = std::make_unique<Buffer>();
 		bufferInfo.optMemoryProperty = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
@@ -354,6 +394,12 @@ void RayTracingReflectApp::_CreateBuffers()
 
 void RayTracingReflectApp::_DestroyBuffers()
 {
+	for (auto& uptrTexture : m_uptrTextures)
+	{
+		uptrTexture->Uninit();
+	}
+	m_uptrTextures.clear();
+
 	if (m_uptrAABBBuffer)
 	{
 		m_uptrAABBBuffer->Uninit();
@@ -455,6 +501,30 @@ void RayTracingReflectApp::_UpdateUniformBuffer()
 	lastTime = currentTime;
 }
 
+void RayTracingReflectApp::_UpdateAnimation(CommandSubmission* _pCmd)
+{
+	const float time = static_cast<float>(MyDevice::GetInstance().GetTime());
+	std::span<const glm::mat4> worldMatrices;
+
+	for (auto& animation : m_animations)
+	{
+		const float duration = animation.GetEndTime() - animation.GetStartTime();
+		animation.Sample(animation.GetStartTime() + (duration > 0.0f ? std::fmod(time, duration) : 0.0f), m_sceneGraph);
+	}
+	m_sceneGraph.UpdateWorldMatrices();
+
+	worldMatrices = m_sceneGraph.GetWorldMatrices();
+	for (size_t i = 0; i < m_TLASInstances.size(); ++i)
+	{
+		m_TLASInstances[i].transformMatrix = worldMatrices[m_rayTracingInstanceNodes[i]];
+	}
+	m_uptrAccelStruct->UpdateTLAS(m_TLASInstances, _pCmd);
+	RayTracingAccelerationStructure::RecordPipelineBarrier(_pCmd);
+
+	// accumulated samples are from the old scene
+	m_rayTraceFrame = 0u;
+}
+
 void RayTracingReflectApp::_Init()
 {
 	MyDevice::GetInstance().Init();
@@ -506,8 +576,20 @@ void RayTracingReflectApp::_DrawFrame()
 	_UpdateUniformBuffer();
 	cmd->StartCommands({});
 
+	if (m_playAnimation && !m_animations.empty())
+	{
+		_UpdateAnimation(cmd);
+	}
+
 	{
 		auto& binder = m_uptrPipeline->GetDescriptorSetManager();
+		std::vector<VkDescriptorImageInfo> textureInfos;
+
+		textureInfos.reserve(m_uptrTextures.size());
+		for (const auto& uptrTexture : m_uptrTextures)
+		{
+			textureInfos.push_back(uptrTexture->GetVkDescriptorImageInfo());
+		}
 		binder.StartBind();
 		binder.BindDescriptor(0, 0, { m_uptrCameraBuffers[m_currentFrame]->GetDescriptorInfo() }, DescriptorSetManager::DESCRIPTOR_BIND_SETTING::CONSTANT_DESCRIPTOR_SET_PER_FRAME);
 		binder.BindDescriptor(0, 1, { m_uptrAccelStruct->vkAccelerationStructure }, DescriptorSetManager::DESCRIPTOR_BIND_SETTING::CONSTANT_DESCRIPTOR_SET_ACROSS_FRAMES);
@@ -515,6 +597,7 @@ void RayTracingReflectApp::_DrawFrame()
 		binder.BindDescriptor(0, 3, { m_uptrAddressBuffer->GetDescriptorInfo() }, DescriptorSetManager::DESCRIPTOR_BIND_SETTING::CONSTANT_DESCRIPTOR_SET_ACROSS_FRAMES);
 		binder.BindDescriptor(1, 0, { m_uptrMaterialBuffer->GetDescriptorInfo() }, DescriptorSetManager::DESCRIPTOR_BIND_SETTING::CONSTANT_DESCRIPTOR_SET_ACROSS_FRAMES);
 		binder.BindDescriptor(1, 1, { m_uptrNanoVDBBuffer->GetDescriptorInfo() }, DescriptorSetManager::DESCRIPTOR_BIND_SETTING::CONSTANT_DESCRIPTOR_SET_ACROSS_FRAMES);
+		binder.BindDescriptor(2, 0, textureInfos, DescriptorSetManager::DESCRIPTOR_BIND_SETTING::CONSTANT_DESCRIPTOR_SET_ACROSS_FRAMES);
 		binder.EndBind();
 		binder.EndFrame();
 	}
@@ -536,6 +619,10 @@ void RayTracingReflectApp::_DrawFrame()
 	gui.SliderFloat("sigma_a", m_coefficient.sigma_a, 0.001, 10);
 	gui.SliderFloat("sigma_s", m_coefficient.sigma_s, 0.001, 10);
 	gui.SliderFloat("g", m_coefficient.g, -0.999f, 0.999f);
+	if (!m_animations.empty())
+	{
+		gui.CheckBox("Play animation", m_playAnimation);
+	}
 	gui.FrameRateText();
 	std::stringstream ss;
 	ss << "camera position: " << m_camera.eye.x << ", " << m_camera.eye.y << ", " << m_camera.eye.z;
@@ -2,6 +2,7 @@
 #include "common.h"
 #include "acceleration_structure.h"
 #include "render_object/camera.h"
+#include "utility/animation.h"
 
 class RayTracingProgram;
 class CameraComponent;
@@ -10,6 +11,7 @@ class GUIPass;
 class Buffer;
 class Image;
 class ImageView;
+class Texture;
 class CommandSubmission;
 
 class RayTracingReflectApp
@@ -29,11 +31,13 @@ private:
 	{
 		glm::vec4 colorOrLight; // xyz: rgb, w: is_light
 		glm::uvec4 materialType;
+		glm::vec4 metallicRoughness; // x: metallic, y: roughness, factors are multiplied with textures
+		glm::ivec4 textureIndices;	// x: base color, y: metallic roughness, index of m_uptrTextures, -1 if none
 	};
 	struct Vertex
 	{
-		glm::vec4 position;
-		glm::vec4 normal;
+		glm::vec4 position;	// w: u of texture coordinate
+		glm::vec4 normal;	// w: v of texture coordinate
 	};
 	struct Coefficient
 	{
@@ -62,12 +66,18 @@ private:
 	std::vector<std::unique_ptr<Buffer>> m_uptrModelIndexBuffers;
 	std::vector<std::unique_ptr<Buffer>> m_uptrCameraBuffers;
 	std::unique_ptr<Buffer> m_uptrAABBBuffer;
+	std::vector<std::unique_ptr<Texture>> m_uptrTextures; // glTF images, bound to textures[] in rt_pbr.rchit
 	
 	std::vector<std::unique_ptr<Image>> m_uptrOutputImages;
 	std::vector<std::unique_ptr<ImageView>> m_uptrOutputViews;
 	std::vector<std::unique_ptr<CommandSubmission>> m_uptrCommands;
 	std::vector<RayTracingAccelerationStructure::TriangleData> m_rayTracingGeometryData;
-	std::vector<glm::mat4> m_rayTracingGeometryTransform;
+	std::vector<RayTracingAccelerationStructure::InstanceData> m_rayTracingInstances; // uBLASIndex is index of m_rayTracingGeometryData
+	std::vector<uint32_t> m_rayTracingInstanceNodes; // scene graph node of each instance
+	std::vector<RayTracingAccelerationStructure::InstanceData> m_TLASInstances; // instances in TLAS, transforms follow animation
+	SceneGraph m_sceneGraph;
+	std::vector<Animation> m_animations;
+	bool m_playAnimation = true;
 	std::vector<VkSemaphore> m_semaphores;
 	VkSampler m_vkSampler = VK_NULL_HANDLE;
 	uint32_t m_currentFrame = 0u;
@@ -98,6 +108,9 @@ private:
 
 	void _UpdateUniformBuffer();
 
+	// sample animations, move instances to their nodes and update TLAS
+	void _UpdateAnimation(CommandSubmission* _pCmd);
+
 	void _Init();
 	void _Uninit();
 
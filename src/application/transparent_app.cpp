@@ -1361,7 +1361,11 @@ void TransparentApp::_InitVertexInputs()
 
 		m_transModelVertBuffers.reserve(m_transModels.size());
 		m_transModelIndexBuffers.reserve(m_transModels.size());
+		m_transModelLodSelectors.reserve(m_transModels.size());
+		m_transModelLodLevels.reserve(m_transModels.size());
 		
+		// models share LOD chains of the same .obj
+		std::unordered_map<std::string, MeshOptimizer::LodChain> lodChains;
 		for (auto& transModel : m_transModels)
 		{
 			std::vector<StaticMesh> scene;
@@ -1381,7 +1385,20 @@ void TransparentApp::_InitVertexInputs()
 			CHECK_TRUE(MeshUtility::Load(transModel.objFilePath, scene), "Failed to load .obj file!");
 			
 			CHECK_TRUE(scene.size() > 0, "No model loaded!");
-			indices = scene[0].indices;
+			if (lodChains.find(transModel.objFilePath) == lodChains.end())
+			{
+				MeshOptimizer optimizer{};
+				optimizer.BuildLodChain(scene[0].verts, scene[0].indices, MeshOptimizer::LodChainSettings{}, lodChains[transModel.objFilePath]);
+			}
+			{
+				const MeshOptimizer::LodChain& lodChain = lodChains[transModel.objFilePath];
+				LodSelector lodSelector{};
+
+				lodSelector.Init(lodChain);
+				m_transModelLodSelectors.push_back(lodSelector);
+				m_transModelLodLevels.push_back(lodChain.levels);
+				indices = lodChain.indices;
+			}
 			vertices.resize(scene[0].verts.size(), TransparentVertex{});
 			for (int i = 0; i < vertices.size(); ++i)
 			{
@@ -1462,6 +1479,8 @@ void TransparentApp::_UninitVertexInputs()
 		indexBuffer.Uninit();
 	}
 	m_transModelIndexBuffers.clear();
+	m_transModelLodSelectors.clear();
+	m_transModelLodLevels.clear();
 
 	m_quadVertBuffer.Uninit();
 	m_quadIndexBuffer.Uninit();
@@ -1672,10 +1691,12 @@ void TransparentApp::_UpdateUniformBuffer()
 		m_vecModelBuffers[m_currentFrame][i].CopyFromHost(&modelTransform);
 	}
 	int len = m_transModels.size();
+	m_transModelLods.resize(m_transModels.size());
 	for (int i = 0; i < m_transModels.size(); ++i)
 	{
 		ModelTransform modelTransform{};
 		modelTransform.model = m_transModels[i].transform.GetModelMatrix();
+		m_transModelLods[i] = m_transModelLodSelectors[i].SelectLod(modelTransform.model, m_camera, m_lodPixelError);
 		modelTransform.modelInvTranspose = m_transModels[i].transform.GetModelInverseTransposeMatrix();
 		m_vecTransModelBuffers[m_currentFrame][i].CopyFromHost(&modelTransform);
 		m_vecMaterialBuffers[m_currentFrame][i].CopyFromHost(&m_transMaterials[i]);
@@ -1833,10 +1854,12 @@ void TransparentApp::_DrawFrame()
 	for (int i = 0; i < m_transModelVertBuffers.size(); ++i)
 	{
 		GraphicsPipeline::PipelineInput_DrawIndexed input;
+		const MeshOptimizer::LodLevel& lodLevel = m_transModelLodLevels[i][m_transModelLods[i]];
 
 		input.imageSize = MyDevice::GetInstance().GetSwapchainExtent();
 		input.indexBuffer = m_transModelIndexBuffers[i].vkBuffer;
-		input.indexCount = m_transModelIndexBuffers[i].GetBufferInformation().size / sizeof(uint32_t);
+		input.indexCount = lodLevel.indexCount;
+		input.optIndexBufferOffset = sizeof(uint32_t) * lodLevel.indexOffset;
 		input.vertexBuffers = { m_transModelVertBuffers[i].vkBuffer };
 		input.vkDescriptorSets =
 		{
@@ -1857,10 +1880,12 @@ void TransparentApp::_DrawFrame()
 	for (int i = 0; i < m_transModelVertBuffers.size(); ++i)
 	{
 		GraphicsPipeline::PipelineInput_DrawIndexed input;
+		const MeshOptimizer::LodLevel& lodLevel = m_transModelLodLevels[i][m_transModelLods[i]];
 
 		input.imageSize = MyDevice::GetInstance().GetSwapchainExtent();
 		input.indexBuffer = m_transModelIndexBuffers[i].vkBuffer;
-		input.indexCount = m_transModelIndexBuffers[i].GetBufferInformation().size / sizeof(uint32_t);
+		input.indexCount = lodLevel.indexCount;
+		input.optIndexBufferOffset = sizeof(uint32_t) * lodLevel.indexOffset;
 		input.vertexBuffers = { m_transModelVertBuffers[i].vkBuffer };
 		input.vkDescriptorSets =
 		{
@@ -8,6 +8,7 @@
 #include "transform.h"
 #include "geometry.h"
 #include "commandbuffer.h"
+#include "lod_selector.h"
 
 class TransparentApp
 {
@@ -63,6 +64,12 @@ private:
 	std::vector<Model> m_transModels;
 	std::vector<SimpleMaterial> m_transMaterials;
 
+	// transparent models are drawn with discrete LODs, all LODs are in the index buffer of the model
+	float m_lodPixelError = 1.0f;
+	std::vector<LodSelector> m_transModelLodSelectors;
+	std::vector<std::vector<MeshOptimizer::LodLevel>> m_transModelLodLevels;
+	std::vector<uint32_t> m_transModelLods;	// LOD of each model in current frame
+
 	// Descriptor sets
 	DescriptorSetLayout m_oitSampleDSetLayout;
 	std::vector<DescriptorSet> m_oitDSets;
@@ -184,6 +184,64 @@ void Buffer::CopyFromHost(const void* src, size_t bufferOffset, size_t size)
 	}
 }
 
+void Buffer::WriteFromHost(size_t bufferOffset, size_t size, const std::function<void(void*)>& fillFunc)
+{
+	CHECK_TRUE(bufferOffset + size <= static_cast<size_t>(m_bufferInformation.size), "Try to write too much data from host!");
+	if ((m_bufferInformation.memoryProperty & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+	{
+		if (m_mappedMemory == nullptr)
+		{
+			_MapHostMemory();
+		}
+		fillFunc(static_cast<uint8_t*>(m_mappedMemory) + bufferOffset);
+	}
+	else
+	{
+		CreateInformation stagBufInfo{};
+		Buffer stagBuf{};
+
+		stagBufInfo.optMemoryProperty = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		stagBufInfo.size = static_cast<VkDeviceSize>(size);
+		stagBufInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		stagBuf.PresetCreateInformation(stagBufInfo);
+		stagBuf.Init();
+		stagBuf.WriteFromHost(0, size, fillFunc);
+
+		CopyFromBuffer(&stagBuf, 0, bufferOffset, size);
+
+		stagBuf.Uninit();
+	}
+}
+
+void Buffer::CopyToHost(void* dst, size_t bufferOffset, size_t size)
+{
+	CHECK_TRUE(bufferOffset + size <= static_cast<size_t>(m_bufferInformation.size), "Try to copy too much data to host!");
+	if ((m_bufferInformation.memoryProperty & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+	{
+		if (m_mappedMemory == nullptr)
+		{
+			_MapHostMemory();
+		}
+		memcpy(dst, static_cast<const uint8_t*>(m_mappedMemory) + bufferOffset, size);
+	}
+	else
+	{
+		CreateInformation stagBufInfo{};
+		Buffer stagBuf{};
+
+		CHECK_TRUE((m_bufferInformation.usage & VK_BUFFER_USAGE_TRANSFER_SRC_BIT) != 0, "This buffer must have VK_BUFFER_USAGE_TRANSFER_SRC_BIT to copy to host!");
+		stagBufInfo.optMemoryProperty = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		stagBufInfo.size = static_cast<VkDeviceSize>(size);
+		stagBufInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		stagBuf.PresetCreateInformation(stagBufInfo);
+		stagBuf.Init();
+		stagBuf.CopyFromBuffer(this, bufferOffset, 0, size);
+		stagBuf.CopyToHost(dst, 0, size);
+
+		stagBuf.Uninit();
+	}
+}
+
 void Buffer::CopyFromBuffer(const Buffer& otherBuffer)
 {
 	CopyFromBuffer(&otherBuffer, 0, 0, m_bufferInformation.size);
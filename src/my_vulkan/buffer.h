@@ -68,6 +68,13 @@ public:
 	void CopyFromHost(const void* src);
 	// Copy from host, will use stagging buffer if necessary
 	void CopyFromHost(const void* src, size_t bufferOffset, size_t size);
+	// Let fillFunc write size bytes to mapped memory, of this buffer or of a stagging buffer if necessary,
+	// so data can be produced in place, e.g. decoded from file, instead of copied from a temporary
+	void WriteFromHost(size_t bufferOffset, size_t size, const std::function<void(void*)>& fillFunc);
+
+	// Copy to host, will use stagging buffer if necessary and wait until copy is done,
+	// device local buffer needs VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+	void CopyToHost(void* dst, size_t bufferOffset, size_t size);
 
 	// Copy from buffer, will wait until copy is done, use buffer's size as length
 	void CopyFromBuffer(const Buffer& otherBuffer);
@@ -24,7 +24,7 @@ void DescriptorSet::Init()
 	CHECK_TRUE(vkDescriptorSet == VK_NULL_HANDLE, "VkDescriptorSet is already created!");
 
 	auto pAllocator = MyDevice::GetInstance().GetDescriptorSetAllocator();
-	pAllocator->Allocate(m_pLayout->vkDescriptorSetLayout, vkDescriptorSet);
+	pAllocator->Allocate(m_pLayout->vkDescriptorSetLayout, vkDescriptorSet, m_requiredPoolFlags);
 }
 
 void DescriptorSet::StartUpdate()
@@ -251,6 +251,16 @@ void DescriptorSetLayout::Init()
 		bindingFlagsCreateInfo.bindingCount = static_cast<uint32_t>(m_bindingFlags.size());
 		bindingFlagsCreateInfo.pBindingFlags = m_bindingFlags.data();
 
+		// bindings updated after bind need sets from a pool created with the same flag
+		for (VkDescriptorBindingFlags flags : m_bindingFlags)
+		{
+			if ((flags & VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT) != 0)
+			{
+				createInfo.flags |= VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+				break;
+			}
+		}
+
 		(*ppNextChain) = &bindingFlagsCreateInfo;
 		ppNextChain = &(bindingFlagsCreateInfo.pNext);
 	}
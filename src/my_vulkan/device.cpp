@@ -518,11 +518,14 @@ void MyDevice::_AddRayQueryExtensionsAndFeatures(vkb::PhysicalDeviceSelector& _s
 
 void MyDevice::_AddBindlessExtensionsAndFeatures(vkb::PhysicalDeviceSelector& _selector) const
 {
-	// Bindless
+	// Bindless, runtime arrays of textures are partially bound and updated after bind,
+	// see DescriptorSetLayout::SetFollowingBindless
 	VkPhysicalDeviceVulkan12Features vulkan12Featrues{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
 
 	vulkan12Featrues.runtimeDescriptorArray = VK_TRUE;
 	vulkan12Featrues.descriptorBindingPartiallyBound = VK_TRUE;
+	vulkan12Featrues.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	vulkan12Featrues.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
 
 	_selector.add_required_extension_features(vulkan12Featrues);
 }
@@ -826,6 +829,24 @@ void MyDevice::GetPhysicalDeviceRayTracingProperties(VkPhysicalDeviceRayTracingP
 	vkGetPhysicalDeviceProperties2(vkPhysicalDevice, &prop2);
 }
 
+void MyDevice::GetPhysicalDeviceMeshShaderProperties(VkPhysicalDeviceMeshShaderPropertiesEXT& outProperties) const
+{
+	VkPhysicalDeviceProperties2 prop2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+	outProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_PROPERTIES_EXT;
+
+	prop2.pNext = &outProperties;
+	vkGetPhysicalDeviceProperties2(vkPhysicalDevice, &prop2);
+}
+
+void MyDevice::GetPhysicalDeviceDescriptorIndexingProperties(VkPhysicalDeviceDescriptorIndexingProperties& outProperties) const
+{
+	VkPhysicalDeviceProperties2 prop2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+	outProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+
+	prop2.pNext = &outProperties;
+	vkGetPhysicalDeviceProperties2(vkPhysicalDevice, &prop2);
+}
+
 VkCommandBuffer MyDevice::AllocateCommandBuffer(VkCommandPool inCommandPool, VkCommandBufferLevel inBufferLevel, const void* inNextPtr)
 {
 	VkCommandBufferAllocateInfo allocateInfo{};
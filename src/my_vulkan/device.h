@@ -135,6 +135,11 @@ public:
 
 	void GetPhysicalDeviceRayTracingProperties(VkPhysicalDeviceRayTracingPipelinePropertiesKHR& outProperties) const;
 
+	void GetPhysicalDeviceMeshShaderProperties(VkPhysicalDeviceMeshShaderPropertiesEXT& outProperties) const;
+
+	// Limits of bindless bindings, e.g. maxDescriptorSetUpdateAfterBindSampledImages
+	void GetPhysicalDeviceDescriptorIndexingProperties(VkPhysicalDeviceDescriptorIndexingProperties& outProperties) const;
+
 	// Thin wraps for device Vulkan functions
 	//---------------------------------------------
 	// Create a VkFence, _pCreateInfo is optional, if it's not nullptr, VkFence will be created based on it
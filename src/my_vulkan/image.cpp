@@ -270,7 +270,10 @@ void Image::TransitLayout(VkImageLayout newLayout)
 		aspect = VK_IMAGE_ASPECT_COLOR_BIT;
 	}
 
+	// whole image, _GetImageLayout needs all subresources to share one layout
 	barrierBuilder.SetAspect(aspect);
+	barrierBuilder.SetMipLevelRange(0, m_imageInformation.mipLevels);
+	barrierBuilder.SetArrayLayerRange(0, m_imageInformation.arrayLayers);
 	barrier = barrierBuilder.NewBarrier(vkImage, oldLayout, newLayout, VK_ACCESS_NONE, VK_ACCESS_NONE);
 
 	// one time submit command will wait to be done anyway
@@ -285,14 +288,6 @@ void Image::TransitLayout(VkImageLayout newLayout)
 
 void Image::CopyFromBuffer(const Buffer& stagingBuffer)
 {
-	CHECK_TRUE(vkImage != VK_NULL_HANDLE, "Image is not initialized!");
-
-	CommandSubmission cmdSubmit;
-	
-	cmdSubmit.Init();
-
-	cmdSubmit.StartOneTimeCommands({});
-
 	VkBufferImageCopy region{};
 	region.bufferOffset = 0;
 	region.bufferRowLength = 0;
@@ -308,11 +303,24 @@ void Image::CopyFromBuffer(const Buffer& stagingBuffer)
 	region.imageExtent.height = m_imageInformation.height;
 	region.imageExtent.depth = 1;
 
+	CopyFromBuffer(stagingBuffer, { region });
+}
+
+void Image::CopyFromBuffer(const Buffer& stagingBuffer, const std::vector<VkBufferImageCopy>& regions)
+{
+	CHECK_TRUE(vkImage != VK_NULL_HANDLE, "Image is not initialized!");
+
+	CommandSubmission cmdSubmit;
+	
+	cmdSubmit.Init();
+
+	cmdSubmit.StartOneTimeCommands({});
+
 	cmdSubmit.CopyBufferToImage(
 		stagingBuffer.vkBuffer,
 		vkImage,
 		_GetImageLayout(),
-		{ region });
+		regions);
 
 	cmdSubmit.SubmitCommands();
 }
@@ -496,14 +504,51 @@ Texture::~Texture()
 	assert(vkSampler == VK_NULL_HANDLE);
 }
 
+void Texture::SetPixels(std::span<const uint8_t> pixels, uint32_t width, uint32_t height, uint32_t mipLevels, bool srgb)
+{
+	m_pixels = pixels;
+	m_width = width;
+	m_height = height;
+	m_mipLevels = std::max(mipLevels, 1u);
+	m_srgb = srgb;
+}
+
 void Texture::Init()
 {
-	CHECK_TRUE(!m_filePath.empty(), "No image file!");
-	// load image
-	int texWidth, texHeight, texChannels;
-	stbi_uc* pixels = stbi_load(m_filePath.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-	CHECK_TRUE(pixels, "Failed to load texture image!");
-	VkDeviceSize imageSize = texWidth * texHeight * 4;
+	CHECK_TRUE(!m_filePath.empty() || !m_pixels.empty(), "No image file!");
+	stbi_uc* pFilePixels = nullptr;
+	std::vector<VkBufferImageCopy> regions;
+	VkDeviceSize imageSize = 0;
+
+	if (m_pixels.empty())
+	{
+		// load image
+		int texWidth, texHeight, texChannels;
+		pFilePixels = stbi_load(m_filePath.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+		CHECK_TRUE(pFilePixels, "Failed to load texture image!");
+		m_width = static_cast<uint32_t>(texWidth);
+		m_height = static_cast<uint32_t>(texHeight);
+		m_mipLevels = 1;
+		m_srgb = true;
+	}
+
+	// one copy per mip level
+	for (uint32_t level = 0; level < m_mipLevels; ++level)
+	{
+		VkBufferImageCopy region{};
+		region.bufferOffset = imageSize;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = level;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageExtent.width = std::max(m_width >> level, 1u);
+		region.imageExtent.height = std::max(m_height >> level, 1u);
+		region.imageExtent.depth = 1;
+		regions.push_back(region);
+
+		imageSize += static_cast<VkDeviceSize>(region.imageExtent.width) * region.imageExtent.height * 4;
+	}
+	CHECK_TRUE(pFilePixels != nullptr || m_pixels.size() >= imageSize, "Pixels are less than mip levels need!");
 
 	// copy host image to device
 	Buffer stagingBuffer;
@@ -513,20 +558,24 @@ void Texture::Init()
 	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
 	stagingBuffer.PresetCreateInformation(bufferInfo);
 	stagingBuffer.Init();
-	stagingBuffer.CopyFromHost(pixels);
+	stagingBuffer.CopyFromHost(pFilePixels != nullptr ? pFilePixels : m_pixels.data());
 
-	stbi_image_free(pixels);
+	if (pFilePixels != nullptr)
+	{
+		stbi_image_free(pFilePixels);
+	}
 
 	Image::CreateInformation imageInfo;
-	imageInfo.optWidth = static_cast<uint32_t>(texWidth);
-	imageInfo.optHeight = static_cast<uint32_t>(texHeight);
-	imageInfo.optFormat = VK_FORMAT_R8G8B8A8_SRGB;
+	imageInfo.optWidth = m_width;
+	imageInfo.optHeight = m_height;
+	imageInfo.optMipLevels = m_mipLevels;
+	imageInfo.optFormat = m_srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
 	imageInfo.optMemoryProperty = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
 	imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 	image.PresetCreateInformation(imageInfo);
 	image.Init();
 	image.TransitLayout(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	image.CopyFromBuffer(stagingBuffer);
+	image.CopyFromBuffer(stagingBuffer, regions);
 	//image.TransitionLayout(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 	image.TransitLayout(VK_IMAGE_LAYOUT_GENERAL);
 
@@ -550,7 +599,7 @@ void Texture::Init()
 	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 	samplerInfo.mipLodBias = 0.0f;
 	samplerInfo.minLod = 0.0f;
-	samplerInfo.maxLod = 0.0f;
+	samplerInfo.maxLod = static_cast<float>(m_mipLevels - 1);
 	VkPhysicalDeviceProperties properties{};
 	vkGetPhysicalDeviceProperties(MyDevice::GetInstance().vkPhysicalDevice, &properties);
 	// samplerInfo.anisotropyEnable = VK_TRUE;
@@ -566,6 +615,8 @@ void Texture::Uninit()
 	vkDestroySampler(MyDevice::GetInstance().vkDevice, vkSampler, nullptr);
 	vkSampler = VK_NULL_HANDLE;
 	m_filePath = "";
+	m_pixels = {};
+	m_mipLevels = 1;
 	imageView.Uninit();
 	image.Uninit();
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include "common.h"
+#include <span>
 
 class Buffer;
 class Image;
@@ -160,6 +161,9 @@ public:
 
 	void CopyFromBuffer(const Buffer& stagingBuffer);
 
+	// Copy regions of buffer into image, e.g. one region per mip level
+	void CopyFromBuffer(const Buffer& stagingBuffer, const std::vector<VkBufferImageCopy>& regions);
+
 	// Fill image range with clear color,
 	// if pCmd is nullptr, it will create a command buffer and wait till this action done,
 	// else, it will record the command in the command buffer, and user need to manage the synchronization
@@ -214,12 +218,20 @@ class Texture
 {
 private:
 	std::string m_filePath;
+	std::span<const uint8_t> m_pixels;
+	uint32_t m_width = 0;
+	uint32_t m_height = 0;
+	uint32_t m_mipLevels = 1;
+	bool m_srgb = true;
 public:
 	Image     image{};
 	ImageView imageView{};
 	VkSampler vkSampler = VK_NULL_HANDLE;
 	~Texture();
 	void SetFilePath(std::string path);
+	// Optional, use decoded RGBA8 pixels instead of image file, pixels must stay valid till Init.
+	// Mips are tightly packed one after another from level 0, level i is max(width >> i, 1) x max(height >> i, 1)
+	void SetPixels(std::span<const uint8_t> pixels, uint32_t width, uint32_t height, uint32_t mipLevels = 1, bool srgb = true);
 	void Init();
 	void Uninit();
 	VkDescriptorImageInfo GetVkDescriptorImageInfo() const;
@@ -388,6 +388,14 @@ void GraphicsPipeline::Do(VkCommandBuffer commandBuffer, const PipelineInput_Mes
 	vkCmdDrawMeshTasksEXT(commandBuffer, input.groupCountX, input.groupCountY, input.groupCountZ);
 }
 
+void GraphicsPipeline::Do(VkCommandBuffer commandBuffer, const PipelineInput_MeshIndirect& input)
+{
+	_DoCommon(commandBuffer, input.imageSize, input.vkDescriptorSets, input.optDynamicOffsets, input.pushConstants);
+
+	CHECK_TRUE(input.indirectBuffer != VK_NULL_HANDLE, "Indirect buffer must be assigned here.");
+	vkCmdDrawMeshTasksIndirectEXT(commandBuffer, input.indirectBuffer, input.indirectBufferOffset, 1, sizeof(VkDrawMeshTasksIndirectCommandEXT));
+}
+
 void GraphicsPipeline::Do(VkCommandBuffer commandBuffer, const PipelineInput_Draw& input)
 {
 	_DoCommon(commandBuffer, input.imageSize, input.vkDescriptorSets, input.optDynamicOffsets, input.pushConstants);
@@ -84,6 +84,19 @@ public:
 		uint32_t groupCountZ = 1;
 	};
 
+	// For mesh shader pipelines whose workgroup count is written by device,
+	// indirectBuffer holds VkDrawMeshTasksIndirectCommandEXT
+	struct PipelineInput_MeshIndirect
+	{
+		VkExtent2D imageSize{};
+		std::vector<VkDescriptorSet> vkDescriptorSets;
+		std::vector<uint32_t> optDynamicOffsets;
+		std::vector<std::pair<VkShaderStageFlags, const void*>> pushConstants;
+
+		VkBuffer		indirectBuffer = VK_NULL_HANDLE;
+		VkDeviceSize	indirectBufferOffset = 0;
+	};
+
 private:
 	std::vector<VkPipelineShaderStageCreateInfo> m_shaderStageInfos;
 	std::vector<VkVertexInputBindingDescription> m_vertBindingDescriptions;
@@ -139,6 +152,7 @@ public:
 
 	void Do(VkCommandBuffer commandBuffer, const PipelineInput_DrawIndexed& input);
 	void Do(VkCommandBuffer commandBuffer, const PipelineInput_Mesh& input);
+	void Do(VkCommandBuffer commandBuffer, const PipelineInput_MeshIndirect& input);
 	void Do(VkCommandBuffer commandBuffer, const PipelineInput_Draw& input);
 };
 
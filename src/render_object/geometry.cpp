@@ -1,4 +1,6 @@
 #include "geometry.h"
+#include <meshoptimizer.h>
+#include <algorithm>
 
 void Meshlet::GetTriangle(uint32_t _index, std::array<uint32_t, 3>& _outTriangle) const
 {
@@ -50,3 +52,134 @@ Meshlet Meshlet::GetFromDeviceData(const Meshlet::DeviceData& _data, const Meshl
 
 	return meshlet;
 }
+
+void StaticMeshStreams::ResizeVertices(size_t _vertexCount)
+{
+	positions.resize(_vertexCount);
+	if (HasAttribute(VertexAttribute::NORMAL))
+	{
+		normals.resize(_vertexCount);
+	}
+	if (HasAttribute(VertexAttribute::UV))
+	{
+		uvs.resize(_vertexCount);
+	}
+}
+
+Vertex StaticMeshStreams::GetVertex(size_t _index) const
+{
+	Vertex vertex{};
+
+	vertex.position = positions[_index];
+	if (HasAttribute(VertexAttribute::NORMAL))
+	{
+		vertex.normal = normals[_index];
+	}
+	if (HasAttribute(VertexAttribute::UV))
+	{
+		vertex.uv = uvs[_index];
+	}
+	return vertex;
+}
+
+void StaticMeshStreams::SetVertex(size_t _index, const Vertex& _vertex)
+{
+	positions[_index] = _vertex.position;
+	if (HasAttribute(VertexAttribute::NORMAL))
+	{
+		normals[_index] = _vertex.normal.value_or(glm::vec3(0.0f));
+	}
+	if (HasAttribute(VertexAttribute::UV))
+	{
+		uvs[_index] = _vertex.uv.value_or(glm::vec2(0.0f));
+	}
+}
+
+void StaticMeshStreams::RemapVertices(const std::vector<uint32_t>& _remap, size_t _newVertexCount)
+{
+	auto funcRemapStream = [&]<typename T>(std::vector<T>& _stream)
+		{
+			std::vector<T> dstStream(_newVertexCount);
+
+			meshopt_remapVertexBuffer(dstStream.data(), _stream.data(), _stream.size(), sizeof(T), _remap.data());
+			_stream = std::move(dstStream);
+		};
+
+	CHECK_TRUE(_remap.size() >= positions.size(), "Remap table is smaller than vertex count!");
+	funcRemapStream(positions);
+	if (HasAttribute(VertexAttribute::NORMAL))
+	{
+		funcRemapStream(normals);
+	}
+	if (HasAttribute(VertexAttribute::UV))
+	{
+		funcRemapStream(uvs);
+	}
+}
+
+void StaticMeshStreams::CopyAttributeToStrided(std::optional<VertexAttribute> _attribute, void* _outDst, size_t _dstStride) const
+{
+	const uint8_t* pSrc = reinterpret_cast<const uint8_t*>(positions.data());
+	uint8_t* pDst = static_cast<uint8_t*>(_outDst);
+	size_t elementSize = sizeof(glm::vec3);
+
+	if (_attribute.has_value())
+	{
+		CHECK_TRUE(HasAttribute(_attribute.value()), "Mesh doesn't have this attribute!");
+		switch (_attribute.value())
+		{
+		case VertexAttribute::NORMAL:
+			pSrc = reinterpret_cast<const uint8_t*>(normals.data());
+			elementSize = sizeof(glm::vec3);
+			break;
+		case VertexAttribute::UV:
+			pSrc = reinterpret_cast<const uint8_t*>(uvs.data());
+			elementSize = sizeof(glm::vec2);
+			break;
+		}
+	}
+
+	// streams are packed, copy them in one go if the destination is packed too
+	if (_dstStride == elementSize)
+	{
+		memcpy(pDst, pSrc, elementSize * positions.size());
+		return;
+	}
+	for (size_t i = 0; i < positions.size(); ++i)
+	{
+		memcpy(pDst + i * _dstStride, pSrc + i * elementSize, elementSize);
+	}
+}
+
+void StaticMeshStreams::FromStaticMesh(const StaticMesh& _mesh, StaticMeshStreams& _outMesh)
+{
+	// an attribute is present if any vertex has it, vertices without it get zero
+	_outMesh.attributeMask = 0;
+	if (std::any_of(_mesh.verts.begin(), _mesh.verts.end(), [](const Vertex& _vertex) { return _vertex.normal.has_value(); }))
+	{
+		_outMesh.attributeMask |= static_cast<uint32_t>(VertexAttribute::NORMAL);
+	}
+	if (std::any_of(_mesh.verts.begin(), _mesh.verts.end(), [](const Vertex& _vertex) { return _vertex.uv.has_value(); }))
+	{
+		_outMesh.attributeMask |= static_cast<uint32_t>(VertexAttribute::UV);
+	}
+	_outMesh.positions.clear();
+	_outMesh.normals.clear();
+	_outMesh.uvs.clear();
+	_outMesh.ResizeVertices(_mesh.verts.size());
+	for (size_t i = 0; i < _mesh.verts.size(); ++i)
+	{
+		_outMesh.SetVertex(i, _mesh.verts[i]);
+	}
+	_outMesh.indices = _mesh.indices;
+}
+
+void StaticMeshStreams::ToStaticMesh(StaticMesh& _outMesh) const
+{
+	_outMesh.verts.resize(positions.size());
+	for (size_t i = 0; i < positions.size(); ++i)
+	{
+		_outMesh.verts[i] = GetVertex(i);
+	}
+	_outMesh.indices = indices;
+}
@@ -21,6 +21,53 @@ struct StaticMesh final
 	std::vector<uint32_t> indices;
 };
 
+// Attributes other than position, bits of StaticMeshStreams::attributeMask
+enum class VertexAttribute : uint32_t
+{
+	NORMAL = 0x1,
+	UV = 0x2,
+};
+
+// Static mesh that stores each vertex attribute in its own tightly packed stream,
+// a vertex takes 32 bytes at most instead of sizeof(Vertex),
+// and positions can be passed to meshoptimizer with sizeof(glm::vec3) stride.
+// An attribute stream is either empty or as long as positions, attributeMask tells which ones are present
+struct StaticMeshStreams final
+{
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> uvs;
+	std::vector<uint32_t> indices;
+	uint32_t attributeMask = 0;
+
+	size_t GetVertexCount() const { return positions.size(); }
+
+	bool HasAttribute(VertexAttribute _attribute) const { return (attributeMask & static_cast<uint32_t>(_attribute)) != 0; }
+
+	// Resize every present stream, attributes of new vertices are zero
+	void ResizeVertices(size_t _vertexCount);
+
+	// Get vertex _index in Vertex form, attributes not present are left empty
+	Vertex GetVertex(size_t _index) const;
+
+	// Write vertex _index, attributes that _vertex doesn't have are written as zero
+	void SetVertex(size_t _index, const Vertex& _vertex);
+
+	// Reorder vertices with meshopt remap table, vertex i goes to _remap[i], ~0u means unused,
+	// _newVertexCount: vertex count after remap
+	void RemapVertices(const std::vector<uint32_t>& _remap, size_t _newVertexCount);
+
+	// Copy one attribute stream into an interleaved buffer, e.g. a VBO, position is copied if _attribute is empty
+	// _outDst: the first vertex's attribute, _dstStride: bytes between two vertices in the buffer
+	void CopyAttributeToStrided(std::optional<VertexAttribute> _attribute, void* _outDst, size_t _dstStride) const;
+
+	// Attribute is present if the first vertex has it, vertices missing a present attribute get zero
+	static void FromStaticMesh(const StaticMesh& _mesh, StaticMeshStreams& _outMesh);
+
+	// Previous vertices and indices in _outMesh are replaced
+	void ToStaticMesh(StaticMesh& _outMesh) const;
+};
+
 class Meshlet final
 {
 public:
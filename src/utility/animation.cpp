@@ -0,0 +1,344 @@
+#include "animation.h"
+#include "task_scheduler.h"
+
+namespace
+{
+	uint32_t _GetSortGroup(Animation::Path _path, Animation::Interpolation _interpolation)
+	{
+		if (_interpolation != Animation::Interpolation::LINEAR) return 2;
+		if (_path == Animation::Path::ROTATION) return 0;
+		if (_path == Animation::Path::TRANSLATION || _path == Animation::Path::SCALE) return 1;
+		return 2;
+	}
+
+	// cubic Hermite spline, tangents are already scaled by the time between keys
+	inline float _Hermite(float _p0, float _m0, float _p1, float _m1, float _t)
+	{
+		const float t2 = _t * _t;
+		const float t3 = t2 * _t;
+
+		return (2.0f * t3 - 3.0f * t2 + 1.0f) * _p0 + (t3 - 2.0f * t2 + _t) * _m0 + (-2.0f * t3 + 3.0f * t2) * _p1 + (t3 - t2) * _m1;
+	}
+}
+
+void Animation::PresetName(const std::string& inName)
+{
+	m_name = inName;
+}
+
+void Animation::PreAddChannel(const Channel& inChannel)
+{
+	m_channels.push_back(inChannel);
+}
+
+void Animation::PresetMinTracksPerTask(uint32_t inCount)
+{
+	m_minTracksPerTask = std::max(inCount, 1u);
+}
+
+void Animation::Init()
+{
+	std::vector<uint32_t> order(m_channels.size());
+
+	for (uint32_t i = 0; i < order.size(); ++i)
+	{
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [this](uint32_t _a, uint32_t _b)
+		{
+			return _GetSortGroup(m_channels[_a].path, m_channels[_a].interpolation) < _GetSortGroup(m_channels[_b].path, m_channels[_b].interpolation);
+		});
+
+	m_tracks.clear();
+	m_times.clear();
+	m_values.clear();
+	m_weights.clear();
+	m_nodeWeights.Clear();
+	m_rotationBatchSize = 0;
+	m_vecBatchSize = 0;
+	m_startTime = FLT_MAX;
+	m_endTime = -FLT_MAX;
+
+	for (uint32_t channelIndex : order)
+	{
+		const auto& channel = m_channels[channelIndex];
+		const uint32_t keyCount = static_cast<uint32_t>(channel.times.size());
+		const uint32_t valuesPerKey = (channel.interpolation == Interpolation::CUBIC_SPLINE) ? 3 : 1;
+		Track track{};
+
+		CHECK_TRUE(keyCount > 0, "Animation channel doesn't have keys!");
+		CHECK_TRUE(channel.values.size() % (static_cast<size_t>(keyCount) * valuesPerKey) == 0, "Values don't match keys of animation channel!");
+
+		track.node = channel.node;
+		track.path = channel.path;
+		track.interpolation = channel.interpolation;
+		track.keyOffset = static_cast<uint32_t>(m_times.size());
+		track.keyCount = keyCount;
+		track.valueOffset = static_cast<uint32_t>(m_values.size());
+		track.componentCount = static_cast<uint32_t>(channel.values.size() / (static_cast<size_t>(keyCount) * valuesPerKey));
+		switch (channel.path)
+		{
+		case Path::TRANSLATION:
+		case Path::SCALE:
+			CHECK_TRUE(track.componentCount == 3, "Translation and scale need 3 floats per key!");
+			break;
+		case Path::ROTATION:
+			CHECK_TRUE(track.componentCount == 4, "Rotation needs 4 floats per key!");
+			break;
+		case Path::WEIGHTS:
+		{
+			const auto* pRange = m_nodeWeights.Get(channel.node);
+			if (pRange == nullptr)
+			{
+				m_nodeWeights.Add(channel.node, { static_cast<uint32_t>(m_weights.size()), track.componentCount });
+				m_weights.resize(m_weights.size() + track.componentCount, 0.0f);
+				pRange = m_nodeWeights.Get(channel.node);
+			}
+			CHECK_TRUE(pRange->second == track.componentCount, "Weights tracks of one node have different counts!");
+			track.weightOffset = pRange->first;
+			break;
+		}
+		}
+
+		switch (_GetSortGroup(track.path, track.interpolation))
+		{
+		case 0: ++m_rotationBatchSize; break;
+		case 1: ++m_vecBatchSize; break;
+		default: break;
+		}
+
+		m_times.insert(m_times.end(), channel.times.begin(), channel.times.end());
+		m_values.insert(m_values.end(), channel.values.begin(), channel.values.end());
+		m_startTime = std::min(m_startTime, channel.times.front());
+		m_endTime = std::max(m_endTime, channel.times.back());
+		m_tracks.push_back(track);
+	}
+
+	if (m_tracks.empty())
+	{
+		m_startTime = 0.0f;
+		m_endTime = 0.0f;
+	}
+	m_cursors.assign(m_tracks.size(), 0);
+	m_quatFrom.Resize(m_rotationBatchSize);
+	m_quatTo.Resize(m_rotationBatchSize);
+	m_quatResult.Resize(m_rotationBatchSize);
+	m_quatFactors.resize(m_rotationBatchSize);
+	m_vecFrom.Resize(m_vecBatchSize);
+	m_vecTo.Resize(m_vecBatchSize);
+	m_vecResult.Resize(m_vecBatchSize);
+	m_vecFactors.resize(m_vecBatchSize);
+
+	m_channels.clear();
+}
+
+void Animation::Uninit()
+{
+	m_channels.clear();
+	m_tracks.clear();
+	m_times.clear();
+	m_values.clear();
+	m_cursors.clear();
+	m_weights.clear();
+	m_nodeWeights.Clear();
+	m_rotationBatchSize = 0;
+	m_vecBatchSize = 0;
+	m_startTime = 0.0f;
+	m_endTime = 0.0f;
+	m_quatFrom = {};
+	m_quatTo = {};
+	m_quatResult = {};
+	m_quatFactors.clear();
+	m_vecFrom = {};
+	m_vecTo = {};
+	m_vecResult = {};
+	m_vecFactors.clear();
+}
+
+void Animation::_FindKey(uint32_t inTrack, float inTime, uint32_t& outKey, float& outFactor)
+{
+	const Track& track = m_tracks[inTrack];
+	const float* pTimes = m_times.data() + track.keyOffset;
+	const uint32_t keyCount = track.keyCount;
+	uint32_t& cursor = m_cursors[inTrack];
+
+	if (keyCount == 1 || inTime <= pTimes[0])
+	{
+		outKey = 0;
+		outFactor = 0.0f;
+		return;
+	}
+	if (inTime >= pTimes[keyCount - 1])
+	{
+		outKey = keyCount - 2;
+		outFactor = 1.0f;
+		return;
+	}
+
+	// same interval or the next one when playing forward, search otherwise
+	if (!(pTimes[cursor] <= inTime && inTime < pTimes[cursor + 1]))
+	{
+		if (cursor + 2 < keyCount && pTimes[cursor + 1] <= inTime && inTime < pTimes[cursor + 2])
+		{
+			++cursor;
+		}
+		else
+		{
+			cursor = static_cast<uint32_t>(std::upper_bound(pTimes, pTimes + keyCount, inTime) - pTimes) - 1;
+		}
+	}
+
+	outKey = cursor;
+	outFactor = (inTime - pTimes[cursor]) / (pTimes[cursor + 1] - pTimes[cursor]);
+}
+
+const float* Animation::_GetValue(const Track& inTrack, uint32_t inKey) const
+{
+	return m_values.data() + inTrack.valueOffset + static_cast<size_t>(inKey) * inTrack.componentCount;
+}
+
+void Animation::_SampleTrack(const Track& inTrack, uint32_t inKey, float inFactor, SceneGraph& outGraph)
+{
+	const uint32_t componentCount = inTrack.componentCount;
+	const uint32_t nextKey = std::min(inKey + 1, inTrack.keyCount - 1);
+	float result[4]{};
+	float* pResult = (inTrack.path == Path::WEIGHTS) ? &m_weights[inTrack.weightOffset] : result;
+
+	switch (inTrack.interpolation)
+	{
+	case Interpolation::STEP:
+	{
+		const float* pValue = _GetValue(inTrack, inFactor >= 1.0f ? nextKey : inKey);
+		std::copy(pValue, pValue + componentCount, pResult);
+		break;
+	}
+	case Interpolation::LINEAR:
+	{
+		const float* pFrom = _GetValue(inTrack, inKey);
+		const float* pTo = _GetValue(inTrack, nextKey);
+		for (uint32_t i = 0; i < componentCount; ++i)
+		{
+			pResult[i] = pFrom[i] + (pTo[i] - pFrom[i]) * inFactor;
+		}
+		break;
+	}
+	case Interpolation::CUBIC_SPLINE:
+	{
+		// each key is in tangent, value and out tangent
+		const float* pTimes = m_times.data() + inTrack.keyOffset;
+		const float keyDuration = pTimes[nextKey] - pTimes[inKey];
+		const float* pFrom = m_values.data() + inTrack.valueOffset + static_cast<size_t>(inKey) * componentCount * 3;
+		const float* pTo = m_values.data() + inTrack.valueOffset + static_cast<size_t>(nextKey) * componentCount * 3;
+		for (uint32_t i = 0; i < componentCount; ++i)
+		{
+			pResult[i] = _Hermite(
+				pFrom[componentCount + i],
+				pFrom[componentCount * 2 + i] * keyDuration,
+				pTo[componentCount + i],
+				pTo[i] * keyDuration,
+				inFactor);
+		}
+		break;
+	}
+	}
+
+	switch (inTrack.path)
+	{
+	case Path::TRANSLATION:
+		outGraph.GetLocalTranslations()[inTrack.node] = glm::vec3(result[0], result[1], result[2]);
+		break;
+	case Path::SCALE:
+		outGraph.GetLocalScales()[inTrack.node] = glm::vec3(result[0], result[1], result[2]);
+		break;
+	case Path::ROTATION:
+		outGraph.GetLocalRotations()[inTrack.node] = glm::normalize(glm::quat(result[3], result[0], result[1], result[2]));
+		break;
+	case Path::WEIGHTS:
+		break;
+	}
+}
+
+void Animation::Sample(float inTime, SceneGraph& outGraph)
+{
+	auto& scheduler = MyTaskScheduler::GetInstance();
+	const uint32_t vecBatchBegin = m_rotationBatchSize;
+	const uint32_t otherBegin = m_rotationBatchSize + m_vecBatchSize;
+
+	// find keys, gather keys of batched tracks and sample the rest
+	scheduler.ParallelFor(
+		static_cast<uint32_t>(m_tracks.size()),
+		m_minTracksPerTask,
+		[&](uint32_t _begin, uint32_t _end, uint32_t _threadIndex)
+		{
+			for (uint32_t i = _begin; i < _end; ++i)
+			{
+				const Track& track = m_tracks[i];
+				uint32_t key = 0;
+				float factor = 0.0f;
+
+				_FindKey(i, inTime, key, factor);
+				if (i < vecBatchBegin)
+				{
+					const float* pFrom = _GetValue(track, key);
+					const float* pTo = _GetValue(track, std::min(key + 1, track.keyCount - 1));
+
+					m_quatFrom.Set(i, glm::quat(pFrom[3], pFrom[0], pFrom[1], pFrom[2]));
+					m_quatTo.Set(i, glm::quat(pTo[3], pTo[0], pTo[1], pTo[2]));
+					m_quatFactors[i] = factor;
+				}
+				else if (i < otherBegin)
+				{
+					const float* pFrom = _GetValue(track, key);
+					const float* pTo = _GetValue(track, std::min(key + 1, track.keyCount - 1));
+					const uint32_t slot = i - vecBatchBegin;
+
+					m_vecFrom.Set(slot, glm::vec3(pFrom[0], pFrom[1], pFrom[2]));
+					m_vecTo.Set(slot, glm::vec3(pTo[0], pTo[1], pTo[2]));
+					m_vecFactors[slot] = factor;
+				}
+				else
+				{
+					_SampleTrack(track, key, factor, outGraph);
+				}
+			}
+		});
+
+	// interpolate batches and scatter them to nodes
+	std::span<glm::quat> rotations = outGraph.GetLocalRotations();
+	scheduler.ParallelFor(
+		m_rotationBatchSize,
+		m_minTracksPerTask,
+		[&](uint32_t _begin, uint32_t _end, uint32_t _threadIndex)
+		{
+			simd_math::SlerpQuats(m_quatFrom, m_quatTo, m_quatFactors.data(), _begin, _end, m_quatResult);
+			for (uint32_t i = _begin; i < _end; ++i)
+			{
+				rotations[m_tracks[i].node] = m_quatResult.Get(i);
+			}
+		});
+
+	std::span<glm::vec3> translations = outGraph.GetLocalTranslations();
+	std::span<glm::vec3> scales = outGraph.GetLocalScales();
+	scheduler.ParallelFor(
+		m_vecBatchSize,
+		m_minTracksPerTask,
+		[&](uint32_t _begin, uint32_t _end, uint32_t _threadIndex)
+		{
+			simd_math::LerpVec3s(m_vecFrom, m_vecTo, m_vecFactors.data(), _begin, _end, m_vecResult);
+			for (uint32_t i = _begin; i < _end; ++i)
+			{
+				const Track& track = m_tracks[vecBatchBegin + i];
+				auto& target = (track.path == Path::TRANSLATION) ? translations[track.node] : scales[track.node];
+
+				target = m_vecResult.Get(i);
+			}
+		});
+}
+
+std::span<const float> Animation::GetWeights(uint32_t inNode) const
+{
+	const auto* pRange = m_nodeWeights.Get(inNode);
+
+	if (pRange == nullptr) return {};
+	return std::span<const float>(m_weights.data() + pRange->first, pRange->second);
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include "common.h"
+#include "scene_graph.h"
+#include "simd_math.h"
+#include <span>
+
+// Keyframe animation of scene graph nodes, one track per glTF channel.
+// Keys of all tracks live in shared arrays, linear rotation and linear translation/scale tracks are sampled in batches
+// with simd_math kernels, other tracks (step, cubic spline, weights) one by one.
+// Each track caches the key it hit last time, so playing forward rarely needs a binary search
+class Animation
+{
+public:
+	enum class Path
+	{
+		TRANSLATION,
+		ROTATION,
+		SCALE,
+		WEIGHTS,
+	};
+
+	enum class Interpolation
+	{
+		STEP,
+		LINEAR,
+		CUBIC_SPLINE,
+	};
+
+	struct Channel
+	{
+		uint32_t node = 0; // scene graph node
+		Path path = Path::TRANSLATION;
+		Interpolation interpolation = Interpolation::LINEAR;
+		std::vector<float> times;	// seconds, ascending
+		std::vector<float> values;	// keys one after another, 3 floats for translation and scale, 4 for rotation (x, y, z, w),
+									// morph target count for weights, a cubic spline key is in tangent, value and out tangent
+	};
+
+private:
+	struct Track
+	{
+		uint32_t node = 0;
+		Path path = Path::TRANSLATION;
+		Interpolation interpolation = Interpolation::LINEAR;
+		uint32_t keyOffset = 0;			// index of m_times
+		uint32_t keyCount = 0;
+		uint32_t valueOffset = 0;		// index of m_values
+		uint32_t componentCount = 0;	// floats per value
+		uint32_t weightOffset = 0;		// index of m_weights, weights only
+	};
+
+	std::vector<Channel> m_channels; // hold info temporarily, will be invalid after Init
+	std::string m_name;
+	uint32_t m_minTracksPerTask = 256;
+
+	// tracks are sorted: linear rotations, then linear translations and scales, then the rest
+	std::vector<Track> m_tracks;
+	uint32_t m_rotationBatchSize = 0;
+	uint32_t m_vecBatchSize = 0;
+	std::vector<float> m_times;
+	std::vector<float> m_values;
+	std::vector<uint32_t> m_cursors;	// first key of the interval each track sampled last time
+	float m_startTime = 0.0f;
+	float m_endTime = 0.0f;
+
+	// morph target weights of nodes, written by Sample
+	std::vector<float> m_weights;
+	ComponentPool<std::pair<uint32_t, uint32_t>> m_nodeWeights; // offset and count in m_weights
+
+	// keys gathered for batched tracks
+	simd_math::QuatArrays m_quatFrom;
+	simd_math::QuatArrays m_quatTo;
+	simd_math::QuatArrays m_quatResult;
+	std::vector<float> m_quatFactors;
+	simd_math::Vec3Arrays m_vecFrom;
+	simd_math::Vec3Arrays m_vecTo;
+	simd_math::Vec3Arrays m_vecResult;
+	std::vector<float> m_vecFactors;
+
+private:
+	// first key of the interval inTime falls in and how far it goes to the next key, clamped at both ends
+	void _FindKey(uint32_t inTrack, float inTime, uint32_t& outKey, float& outFactor);
+
+	const float* _GetValue(const Track& inTrack, uint32_t inKey) const;
+
+	// step, cubic spline and weights tracks
+	void _SampleTrack(const Track& inTrack, uint32_t inKey, float inFactor, SceneGraph& outGraph);
+
+public:
+	void PresetName(const std::string& inName);
+
+	void PreAddChannel(const Channel& inChannel);
+
+	// Minimum number of tracks a worker thread samples at a time, use 0xFFFFFFFF to sample on calling thread
+	void PresetMinTracksPerTask(uint32_t inCount);
+
+	void Init();
+
+	void Uninit();
+
+	const std::string& GetName() const { return m_name; }
+
+	float GetStartTime() const { return m_startTime; }
+
+	float GetEndTime() const { return m_endTime; }
+
+	uint32_t GetTrackCount() const { return static_cast<uint32_t>(m_tracks.size()); }
+
+	// Write local TRS of animated nodes at inTime, call SceneGraph::UpdateWorldMatrices after all animations are sampled,
+	// inTime is clamped to [start, end], wrap it to loop
+	void Sample(float inTime, SceneGraph& outGraph);
+
+	// Morph target weights of node written by the last Sample, empty if node doesn't have a weights track
+	std::span<const float> GetWeights(uint32_t inNode) const;
+};
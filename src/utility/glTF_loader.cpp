@@ -1,21 +1,49 @@
 #include "glTF_loader.h"
-#include <glm/gtc/quaternion.hpp>
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/quaternion.hpp>
-#define COMPONENT_IMPLEMENTATION
-#include "component.h"
-
-COMPONENT_DEFINITION(Component, glTFLoader::Camera);
-COMPONENT_DEFINITION(Component, glTFLoader::Mesh);
-COMPONENT_DEFINITION(Component, glTFLoader::Transform);
-COMPONENT_DEFINITION(Component, glTFLoader::Animation);
+#include <filesystem>
+#include <algorithm>
+#include <cctype>
+#include <array>
+#include "task_scheduler.h"
+#include "stb_image.h"
 
 void glTFLoader::_LoadFile(const std::string& _file, tinygltf::Model& _out)
 {
 	tinygltf::TinyGLTF tloader;
 	std::string strErr;
 	std::string strWarn;
-	bool bResult = tloader.LoadASCIIFromFile(&_out, &strErr, &strWarn, _file);
+	bool bResult = false;
+	std::filesystem::path filePath(_file);
+	std::string extension = filePath.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+	// don't let tinygltf decode images one after another, see _LoadImages
+	tloader.SetImageLoader(_KeepEncodedImage, nullptr);
+
+	if (extension == ".glb")
+	{
+		// map the file instead of reading it into memory, tinygltf copies the BIN chunk once into buffers[0]
+		common_utils::MappedFile file{};
+		if (file.Open(_file))
+		{
+			CHECK_TRUE(file.GetSize() <= std::numeric_limits<uint32_t>::max(), "GLB file is larger than 4GB!");
+			bResult = tloader.LoadBinaryFromMemory(
+				&_out,
+				&strErr,
+				&strWarn,
+				file.GetData(),
+				static_cast<unsigned int>(file.GetSize()),
+				filePath.parent_path().string());
+		}
+		else
+		{
+			strErr = "Failed to map file.";
+		}
+	}
+	else
+	{
+		bResult = tloader.LoadASCIIFromFile(&_out, &strErr, &strWarn, _file);
+	}
+
 	if (!strWarn.empty())
 	{
 		std::cout << "WARNING: " << strWarn << std::endl;
@@ -34,124 +62,227 @@ void glTFLoader::_LoadFile(const std::string& _file, tinygltf::Model& _out)
 	}
 }
 
-void glTFLoader::_LoadNodes(const tinygltf::Model& _root)
+void glTFLoader::_LoadIndices(const tinygltf::Model& _root, const tinygltf::Accessor& _accessor, std::vector<uint32_t>& _outIndices)
 {
-	m_nodes.reserve(_root.nodes.size());
-	for (size_t i = 0; i < _root.nodes.size(); ++i)
+	// index buffer views are tightly packed, narrow indices are widened right from the buffer
+	switch (_accessor.componentType)
 	{
-		std::unique_ptr<Node> uptrNode = std::make_unique<Node>();
-		const auto& curNode = _root.nodes[i];
-
-		// load transform
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+	{
+		_LoadAccessor(_root, _accessor, _outIndices);
+		break;
+	}
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+	{
+		std::span<const uint16_t> indices = _GetAccessorSpan<uint16_t>(_root, _accessor);
+		if (indices.size() == _accessor.count)
 		{
-			if (curNode.matrix.size() == 16)
-			{
-				glTFLoader::Transform transform{};
-				size_t index = 0;
-				glm::mat4 modelMatrix{};
+			_outIndices.assign(indices.begin(), indices.end());
+		}
+		else
+		{
+			std::vector<uint16_t> indices16;
+			_LoadAccessor(_root, _accessor, indices16);
+			_outIndices.assign(indices16.begin(), indices16.end());
+		}
+		break;
+	}
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+	{
+		std::span<const uint8_t> indices = _GetAccessorSpan<uint8_t>(_root, _accessor);
+		CHECK_TRUE(indices.size() == _accessor.count, "Indices of uint8_t should be tightly packed!");
+		_outIndices.assign(indices.begin(), indices.end());
+		break;
+	}
+	default:
+		CHECK_TRUE(false, "Type of index should be uint8_t, uint16_t or uint32_t.");
+		break;
+	}
+}
 
-				for (size_t col = 0; col < 4; ++col)
-				{
-					for (size_t row = 0; row < 4; ++row)
-					{
-						modelMatrix[col][row] = static_cast<float>(curNode.matrix[index]);
-						++index;
-					}
-				}
-				transform.m_transform = modelMatrix;
+void glTFLoader::_LoadSceneGraph(const tinygltf::Model& _root)
+{
+	std::vector<SceneGraph::NodeInformation> nodeInfos;
+	std::vector<uint32_t> inputNodes; // glTF node of each input of scene graph
+	std::vector<std::pair<uint32_t, uint32_t>> stack; // glTF node, input index of parent
 
-				uptrNode->AddComponent<glTFLoader::Transform>(transform);
-			}
-			else if (curNode.translation.size() == 3 || curNode.scale.size() == 3 || curNode.rotation.size() == 4)
+	m_graphNodes.assign(_root.nodes.size(), SceneGraph::INVALID_NODE);
+	m_meshComponents.Clear();
+	if (_root.scenes.size() == 0)
+	{
+		m_sceneGraph.Uninit();
+		return;
+	}
+
+	// nodes reachable from the first scene in depth first order
+	const auto& curScene = _root.scenes[0];
+	for (auto itr = curScene.nodes.rbegin(); itr != curScene.nodes.rend(); ++itr)
+	{
+		stack.push_back({ static_cast<uint32_t>(*itr), SceneGraph::INVALID_NODE });
+	}
+	while (!stack.empty())
+	{
+		auto [nodeIndex, parentInput] = stack.back();
+		stack.pop_back();
+		CHECK_TRUE(nodeIndex < _root.nodes.size(), "Do not have this node!");
+		CHECK_TRUE(m_graphNodes[nodeIndex] == SceneGraph::INVALID_NODE, "Node is referenced more than once!");
+
+		const auto& curNode = _root.nodes[nodeIndex];
+		SceneGraph::NodeInformation nodeInfo{};
+		const uint32_t inputIndex = static_cast<uint32_t>(nodeInfos.size());
+
+		// mark visited, replaced by scene graph node after Init
+		m_graphNodes[nodeIndex] = inputIndex;
+
+		nodeInfo.parent = parentInput;
+		if (curNode.matrix.size() == 16)
+		{
+			glm::mat4 modelMatrix{};
+			size_t index = 0;
+
+			for (size_t col = 0; col < 4; ++col)
 			{
-				glTFLoader::Transform transform{};
-				glTFLoader::Transform::SplitTransform splitTransform{};
-				if (curNode.translation.size() == 3)
-				{
-					splitTransform.translation = glm::vec3(
-						static_cast<float>(curNode.translation[0])
-						, static_cast<float>(curNode.translation[1])
-						, static_cast<float>(curNode.translation[2]));
-				}
-				if (curNode.scale.size() == 3)
-				{
-					splitTransform.scale = glm::vec3(
-						static_cast<float>(curNode.scale[0])
-						, static_cast<float>(curNode.scale[1])
-						, static_cast<float>(curNode.scale[2]));
-				}
-				else
-				{
-					splitTransform.scale = glm::vec3(1.0f, 1.0f, 1.0f);
-				}
-				if (curNode.rotation.size() == 4)
-				{
-					splitTransform.rotation = glm::quat(
-						static_cast<float>(curNode.rotation[3]),
-						static_cast<float>(curNode.rotation[0]),
-						static_cast<float>(curNode.rotation[1]),
-						static_cast<float>(curNode.rotation[2]));
-				}
-				else
+				for (size_t row = 0; row < 4; ++row)
 				{
-					splitTransform.rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+					modelMatrix[col][row] = static_cast<float>(curNode.matrix[index]);
+					++index;
 				}
-				transform.m_transform = splitTransform;
-
-				uptrNode->AddComponent<glTFLoader::Transform>(transform);
 			}
+			nodeInfo.optMatrix = modelMatrix;
 		}
-
-		// load mesh
-		if (curNode.mesh != -1)
+		else
 		{
-			glTFLoader::Mesh mesh{};
-			const auto& curMesh = _root.meshes[curNode.mesh];
+			if (curNode.translation.size() == 3)
+			{
+				nodeInfo.translation = glm::vec3(
+					static_cast<float>(curNode.translation[0]),
+					static_cast<float>(curNode.translation[1]),
+					static_cast<float>(curNode.translation[2]));
+			}
+			if (curNode.scale.size() == 3)
+			{
+				nodeInfo.scale = glm::vec3(
+					static_cast<float>(curNode.scale[0]),
+					static_cast<float>(curNode.scale[1]),
+					static_cast<float>(curNode.scale[2]));
+			}
+			if (curNode.rotation.size() == 4)
+			{
+				nodeInfo.rotation = glm::quat(
+					static_cast<float>(curNode.rotation[3]),
+					static_cast<float>(curNode.rotation[0]),
+					static_cast<float>(curNode.rotation[1]),
+					static_cast<float>(curNode.rotation[2]));
+			}
+		}
 
-			_LoadMesh(_root, curMesh, mesh);
+		nodeInfos.push_back(nodeInfo);
+		inputNodes.push_back(nodeIndex);
 
-			uptrNode->AddComponent<glTFLoader::Mesh>(mesh);
+		for (auto itr = curNode.children.rbegin(); itr != curNode.children.rend(); ++itr)
+		{
+			stack.push_back({ static_cast<uint32_t>(*itr), inputIndex });
 		}
-
-		m_nodes.push_back(std::move(uptrNode));
 	}
 
-	// fill node hierarchy
-	for (size_t i = 0; i < _root.nodes.size(); ++i)
+	m_sceneGraph.Uninit();
+	m_sceneGraph.PresetNodes(nodeInfos);
+	m_sceneGraph.Init();
+
+	// components are added in order of scene graph nodes
+	for (uint32_t node = 0; node < m_sceneGraph.GetNodeCount(); ++node)
 	{
-		auto& uptrNode = m_nodes[i];
-		const auto& curNode = _root.nodes[i];
+		const uint32_t nodeIndex = inputNodes[m_sceneGraph.GetInputIndex(node)];
+		const auto& curNode = _root.nodes[nodeIndex];
 
-		uptrNode->pChildren.reserve(curNode.children.size());
-		for (size_t j = 0; j < curNode.children.size(); ++j)
+		m_graphNodes[nodeIndex] = node;
+		if (curNode.mesh != -1)
 		{
-			size_t index = curNode.children[j];
-			uptrNode->pChildren.push_back(m_nodes[index].get());
-			m_nodes[index]->pParent = uptrNode.get();
+			CHECK_TRUE(static_cast<size_t>(curNode.mesh) < _root.meshes.size(), "Do not have this mesh!");
+			m_meshComponents.Add(node, static_cast<uint32_t>(curNode.mesh));
 		}
 	}
 }
 
-void glTFLoader::_LoadScene(const tinygltf::Model& _root)
+void glTFLoader::_LoadFloats(const tinygltf::Model& _root, const tinygltf::Accessor& _accessor, std::vector<float>& _outFloats)
 {
-	for (size_t i = 0; i < _root.scenes.size(); ++i)
+	CHECK_TRUE(_accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT, "Accessor does not use float type!");
+	switch (tinygltf::GetNumComponentsInType(static_cast<uint32_t>(_accessor.type)))
+	{
+	case 1:
+	{
+		_LoadAccessor(_root, _accessor, _outFloats);
+		break;
+	}
+	case 3:
 	{
-		const auto& curScene = _root.scenes[i];
-		std::unique_ptr<glTFLoader::Scene> uptrScene = std::make_unique<glTFLoader::Scene>();
+		std::vector<glm::vec3> vecs;
+		_LoadAccessor(_root, _accessor, vecs);
+		_outFloats.resize(vecs.size() * 3);
+		if (!vecs.empty()) memcpy(_outFloats.data(), vecs.data(), vecs.size() * sizeof(glm::vec3));
+		break;
+	}
+	case 4:
+	{
+		std::vector<glm::vec4> vecs;
+		_LoadAccessor(_root, _accessor, vecs);
+		_outFloats.resize(vecs.size() * 4);
+		if (!vecs.empty()) memcpy(_outFloats.data(), vecs.data(), vecs.size() * sizeof(glm::vec4));
+		break;
+	}
+	default:
+		CHECK_TRUE(false, "Accessor type is not supported!");
+		break;
+	}
+}
+
+void glTFLoader::_LoadAnimations(const tinygltf::Model& _root)
+{
+	m_animations.clear();
+	m_animations.reserve(_root.animations.size());
+	for (const auto& tanimation : _root.animations)
+	{
+		Animation animation{};
 
-		uptrScene->pNodes.reserve(curScene.nodes.size());
-		for (size_t j = 0; j < curScene.nodes.size(); ++j)
+		animation.PresetName(tanimation.name);
+		for (const auto& tchannel : tanimation.channels)
 		{
-			size_t index = curScene.nodes[j];
-			CHECK_TRUE(index < m_nodes.size(), "Do not have this node!");
-			uptrScene->pNodes.push_back(m_nodes[index].get());
+			const auto& tsampler = tanimation.samplers[tchannel.sampler];
+			const auto& tinput = _root.accessors[tsampler.input];
+			const auto& toutput = _root.accessors[tsampler.output];
+			Animation::Channel channel{};
+
+			if (tchannel.target_node < 0 || GetSceneGraphNode(static_cast<uint32_t>(tchannel.target_node)) == SceneGraph::INVALID_NODE) continue;
+			if (toutput.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT || tinput.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT)
+			{
+				std::cout << "WARNING: Skip animation channel of " << tchannel.target_path << " that is not float." << std::endl;
+				continue;
+			}
+
+			channel.node = GetSceneGraphNode(static_cast<uint32_t>(tchannel.target_node));
+			if (tchannel.target_path == "translation") channel.path = Animation::Path::TRANSLATION;
+			else if (tchannel.target_path == "rotation") channel.path = Animation::Path::ROTATION;
+			else if (tchannel.target_path == "scale") channel.path = Animation::Path::SCALE;
+			else if (tchannel.target_path == "weights") channel.path = Animation::Path::WEIGHTS;
+			else continue;
+
+			if (tsampler.interpolation == "STEP") channel.interpolation = Animation::Interpolation::STEP;
+			else if (tsampler.interpolation == "CUBICSPLINE") channel.interpolation = Animation::Interpolation::CUBIC_SPLINE;
+			else channel.interpolation = Animation::Interpolation::LINEAR;
+
+			_LoadFloats(_root, tinput, channel.times);
+			_LoadFloats(_root, toutput, channel.values);
+			if (channel.times.empty()) continue;
+
+			animation.PreAddChannel(channel);
 		}
+		animation.Init();
 
-		m_scenes.push_back(std::move(uptrScene));
+		m_animations.push_back(std::move(animation));
 	}
 }
 
-void glTFLoader::_LoadMesh(const tinygltf::Model& _root, const tinygltf::Mesh& _mesh, glTFLoader::Mesh& _outMesh)
+void glTFLoader::_LoadMesh(const tinygltf::Model& _root, const tinygltf::Mesh& _mesh, std::vector<Primitive>& _outPrimitives)
 {
 	for (size_t i = 0; i < _mesh.primitives.size(); ++i)
 	{
@@ -181,132 +312,321 @@ void glTFLoader::_LoadMesh(const tinygltf::Model& _root, const tinygltf::Mesh& _
 		if (curPrimitive.indices > -1)
 		{
 			const auto& taccessor = _root.accessors[curPrimitive.indices];
-			CHECK_TRUE(taccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT, "Type of index should be uint32_t.");
-			_LoadAccessor(_root, taccessor, primitive.indices);
+			_LoadIndices(_root, taccessor, primitive.indices);
 		}
 
-		if (curPrimitive.material > -1)
+		primitive.materialIndex = curPrimitive.material;
+
+		_outPrimitives.push_back(std::move(primitive));
+	}
+}
+
+void glTFLoader::_LoadMeshes(const tinygltf::Model& _root)
+{
+	m_meshPrimitives.clear();
+	m_meshPrimitives.resize(_root.meshes.size());
+
+	MyTaskScheduler::GetInstance().ParallelFor(
+		static_cast<uint32_t>(_root.meshes.size()),
+		1,
+		[&](uint32_t _begin, uint32_t _end, uint32_t _threadIndex)
+		{
+			for (uint32_t i = _begin; i < _end; ++i)
+			{
+				_LoadMesh(_root, _root.meshes[i], m_meshPrimitives[i]);
+			}
+		});
+}
+
+void glTFLoader::_LoadMaterials(const tinygltf::Model& _root)
+{
+	// image of glTF texture, samplers are not loaded
+	auto getImage = [&_root](int _texture)
+		{
+			if (_texture < 0 || _texture >= static_cast<int>(_root.textures.size())) return -1;
+			const int source = _root.textures[_texture].source;
+			return (source < static_cast<int>(_root.images.size())) ? source : -1;
+		};
+
+	m_materials.clear();
+	m_materials.reserve(_root.materials.size());
+	for (const auto& tmaterial : _root.materials)
+	{
+		const auto& tpbr = tmaterial.pbrMetallicRoughness;
+		Material material{};
+
+		material.name = tmaterial.name;
+		material.color = glm::vec4(
+			tpbr.baseColorFactor[0],
+			tpbr.baseColorFactor[1],
+			tpbr.baseColorFactor[2],
+			tpbr.baseColorFactor[3]);
+		material.metallic = static_cast<float>(tpbr.metallicFactor);
+		material.roughness = static_cast<float>(tpbr.roughnessFactor);
+		if (tmaterial.emissiveFactor.size() >= 3)
 		{
-			const auto& tmaterial = _root.materials[curPrimitive.material];
-			Material primitiveMaterial{};
-			
-			primitiveMaterial.name = tmaterial.name;
-			primitiveMaterial.color = glm::vec4(
-				tmaterial.pbrMetallicRoughness.baseColorFactor[0],
-				tmaterial.pbrMetallicRoughness.baseColorFactor[1],
-				tmaterial.pbrMetallicRoughness.baseColorFactor[2],
-				tmaterial.pbrMetallicRoughness.baseColorFactor[3]);
-
-			primitive.optMaterial = primitiveMaterial;
+			material.emissive = glm::vec3(
+				tmaterial.emissiveFactor[0],
+				tmaterial.emissiveFactor[1],
+				tmaterial.emissiveFactor[2]);
 		}
+		material.normalScale = static_cast<float>(tmaterial.normalTexture.scale);
+		material.occlusionStrength = static_cast<float>(tmaterial.occlusionTexture.strength);
+		material.alphaCutoff = (tmaterial.alphaMode == "MASK") ? static_cast<float>(tmaterial.alphaCutoff) : 0.0f;
+		material.alphaBlend = (tmaterial.alphaMode == "BLEND");
+		material.doubleSided = tmaterial.doubleSided;
+
+		material.baseColorImage = getImage(tpbr.baseColorTexture.index);
+		material.metallicRoughnessImage = getImage(tpbr.metallicRoughnessTexture.index);
+		material.normalImage = getImage(tmaterial.normalTexture.index);
+		material.occlusionImage = getImage(tmaterial.occlusionTexture.index);
+		material.emissiveImage = getImage(tmaterial.emissiveTexture.index);
+
+		m_materials.push_back(std::move(material));
+	}
+}
+
+bool glTFLoader::_KeepEncodedImage(
+	tinygltf::Image* _image,
+	const int _imageIndex,
+	std::string* _err,
+	std::string* _warn,
+	int _reqWidth,
+	int _reqHeight,
+	const unsigned char* _bytes,
+	int _size,
+	void* _userData)
+{
+	// keep encoded bytes as they are, width and height stay unknown till _DecodeImage
+	_image->image.assign(_bytes, _bytes + _size);
+	return true;
+}
+
+void glTFLoader::_DecodeImage(const tinygltf::Image& _image, ImageData& _outImage)
+{
+	int width = 0;
+	int height = 0;
+	int channels = 0;
+	stbi_uc* pPixels = nullptr;
 
-		_outMesh.primitives.push_back(std::move(primitive));
+	_outImage.name = _image.name.empty() ? _image.uri : _image.name;
+	if (!_image.image.empty() && _image.image.size() <= static_cast<size_t>(std::numeric_limits<int>::max()))
+	{
+		pPixels = stbi_load_from_memory(_image.image.data(), static_cast<int>(_image.image.size()), &width, &height, &channels, STBI_rgb_alpha);
 	}
+
+	if (pPixels == nullptr)
+	{
+		std::cout << "WARNING: Failed to decode image: " << _outImage.name << std::endl;
+		_outImage.width = 1;
+		_outImage.height = 1;
+		_outImage.pixels.assign(4, 255);
+		return;
+	}
+
+	_outImage.width = static_cast<uint32_t>(width);
+	_outImage.height = static_cast<uint32_t>(height);
+	_outImage.pixels.assign(pPixels, pPixels + static_cast<size_t>(width) * height * 4);
+	stbi_image_free(pPixels);
 }
 
-void glTFLoader::_FetchStaticMeshes(
-	const glTFLoader::Node* _pNode, 
-	const glm::mat4& _parentModelMatrix, 
-	std::vector<::StaticMesh>& _outStaticMeshes, 
-	std::vector<glm::mat4>& _outModelMatrices) const
+void glTFLoader::_GenerateMips(ImageData& _image)
 {
-	std::vector<const glTFLoader::Mesh*> meshThisNodeHolds;
-	glm::mat4 selfModelMatrix = _parentModelMatrix;
-	const glTFLoader::Transform* pSelfTransform = _pNode->GetComponent<glTFLoader::Transform>();
+	// sRGB to linear of every 8 bit value, and linear to sRGB at 12 bit precision
+	static const std::array<float, 256> s_toLinear = []()
+		{
+			std::array<float, 256> table{};
+			for (uint32_t i = 0; i < 256; ++i)
+			{
+				const float c = i / 255.0f;
+				table[i] = (c <= 0.04045f) ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			return table;
+		}();
+	static const std::array<uint8_t, 4096> s_toSrgb = []()
+		{
+			std::array<uint8_t, 4096> table{};
+			for (uint32_t i = 0; i < 4096; ++i)
+			{
+				const float c = i / 4095.0f;
+				const float srgb = (c <= 0.0031308f) ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+				table[i] = static_cast<uint8_t>(std::clamp(srgb, 0.0f, 1.0f) * 255.0f + 0.5f);
+			}
+			return table;
+		}();
+
+	uint32_t width = _image.width;
+	uint32_t height = _image.height;
+	size_t totalSize = 0;
 
-	// fill in self static meshes
-	if (pSelfTransform)
+	_image.mipLevels = 1;
+	while ((width >> _image.mipLevels) > 0 || (height >> _image.mipLevels) > 0)
 	{
-		selfModelMatrix = _parentModelMatrix * pSelfTransform->GetModelMatrix();
+		++_image.mipLevels;
 	}
+	for (uint32_t level = 0; level < _image.mipLevels; ++level)
+	{
+		totalSize += static_cast<size_t>(std::max(width >> level, 1u)) * std::max(height >> level, 1u) * 4;
+	}
+	_image.pixels.resize(totalSize);
 
-	_pNode->GetComponents<Mesh>(meshThisNodeHolds);
-	for (auto pMesh : meshThisNodeHolds)
+	size_t srcOffset = 0;
+	for (uint32_t level = 1; level < _image.mipLevels; ++level)
 	{
-		for (auto& primitive : pMesh->primitives)
+		const uint32_t dstWidth = std::max(width >> 1, 1u);
+		const uint32_t dstHeight = std::max(height >> 1, 1u);
+		const size_t dstOffset = srcOffset + static_cast<size_t>(width) * height * 4;
+		const uint8_t* pSrc = _image.pixels.data() + srcOffset;
+		uint8_t* pDst = _image.pixels.data() + dstOffset;
+
+		for (uint32_t y = 0; y < dstHeight; ++y)
 		{
-			StaticMesh staticMesh{};
-			size_t vertexCount = primitive.positions.size();
+			// odd edge is clamped
+			const uint8_t* pRow0 = pSrc + static_cast<size_t>(std::min(y * 2, height - 1)) * width * 4;
+			const uint8_t* pRow1 = pSrc + static_cast<size_t>(std::min(y * 2 + 1, height - 1)) * width * 4;
 
-			staticMesh.indices = primitive.indices;
-			
-			for (size_t i = 0; i < vertexCount; ++i)
+			for (uint32_t x = 0; x < dstWidth; ++x)
 			{
-				Vertex curVertex{};
-				curVertex.position = primitive.positions[i];
-				if (i < primitive.normals.size())
-				{
-					curVertex.normal = primitive.normals[i];
-				}
-				if (i < primitive.texcoords.size())
+				const size_t x0 = static_cast<size_t>(std::min(x * 2, width - 1)) * 4;
+				const size_t x1 = static_cast<size_t>(std::min(x * 2 + 1, width - 1)) * 4;
+				uint8_t* pPixel = pDst + (static_cast<size_t>(y) * dstWidth + x) * 4;
+
+				for (uint32_t c = 0; c < 4; ++c)
 				{
-					curVertex.uv = primitive.texcoords[i];
+					if (_image.srgb && c < 3)
+					{
+						const float linear = 0.25f * (s_toLinear[pRow0[x0 + c]] + s_toLinear[pRow0[x1 + c]] + s_toLinear[pRow1[x0 + c]] + s_toLinear[pRow1[x1 + c]]);
+						pPixel[c] = s_toSrgb[static_cast<uint32_t>(linear * 4095.0f + 0.5f)];
+					}
+					else
+					{
+						pPixel[c] = static_cast<uint8_t>((pRow0[x0 + c] + pRow0[x1 + c] + pRow1[x0 + c] + pRow1[x1 + c] + 2) / 4);
+					}
 				}
-				staticMesh.verts.push_back(curVertex);
 			}
-
-			_outStaticMeshes.push_back(staticMesh);
-			_outModelMatrices.push_back(selfModelMatrix);
 		}
+
+		srcOffset = dstOffset;
+		width = dstWidth;
+		height = dstHeight;
 	}
+}
 
-	// fill children static meshes
-	for (const auto pChild : _pNode->pChildren)
+void glTFLoader::_LoadImages(const tinygltf::Model& _root)
+{
+	m_images.clear();
+	m_images.resize(_root.images.size());
+	for (const auto& material : m_materials)
 	{
-		_FetchStaticMeshes(pChild, selfModelMatrix, _outStaticMeshes, _outModelMatrices);
+		if (material.baseColorImage >= 0) m_images[material.baseColorImage].srgb = true;
+		if (material.emissiveImage >= 0) m_images[material.emissiveImage].srgb = true;
 	}
+
+	// one image per task, decode and mips of an image take far longer than scheduling
+	MyTaskScheduler::GetInstance().ParallelFor(
+		static_cast<uint32_t>(m_images.size()),
+		1,
+		[&](uint32_t _begin, uint32_t _end, uint32_t _threadIndex)
+		{
+			for (uint32_t i = _begin; i < _end; ++i)
+			{
+				_DecodeImage(_root.images[i], m_images[i]);
+				_GenerateMips(m_images[i]);
+			}
+		});
 }
 
-void glTFLoader::_FetchSceneData(const glTFLoader::Node* _pNode, const glm::mat4& _parentModelMatrix, SceneData& _outputSceneData) const
+void glTFLoader::_GetPrimitiveStreams(const glTFLoader::Primitive& _primitive, ::StaticMeshStreams& _outMesh)
 {
-	std::vector<const glTFLoader::Mesh*> meshThisNodeHolds;
-	glm::mat4 selfModelMatrix = _parentModelMatrix;
-	const glTFLoader::Transform* pSelfTransform = _pNode->GetComponent<glTFLoader::Transform>();
+	const size_t vertexCount = _primitive.positions.size();
 
-	// fill in self static meshes
-	if (pSelfTransform)
+	_outMesh.attributeMask = 0;
+	_outMesh.positions = _primitive.positions;
+	_outMesh.normals.clear();
+	_outMesh.uvs.clear();
+	if (vertexCount > 0 && _primitive.normals.size() >= vertexCount)
+	{
+		_outMesh.attributeMask |= static_cast<uint32_t>(VertexAttribute::NORMAL);
+		_outMesh.normals.assign(_primitive.normals.begin(), _primitive.normals.begin() + vertexCount);
+	}
+	if (vertexCount > 0 && _primitive.texcoords.size() >= vertexCount)
 	{
-		selfModelMatrix = _parentModelMatrix * pSelfTransform->GetModelMatrix();
+		_outMesh.attributeMask |= static_cast<uint32_t>(VertexAttribute::UV);
+		_outMesh.uvs.assign(_primitive.texcoords.begin(), _primitive.texcoords.begin() + vertexCount);
 	}
+	_outMesh.indices = _primitive.indices;
+}
+
+void glTFLoader::Load(const std::string& _glTFPath)
+{
+	tinygltf::Model root;
+
+	_LoadFile(_glTFPath, root);
+
+	_LoadMaterials(root);
+
+	_LoadImages(root);
+
+	_LoadMeshes(root);
+
+	_LoadSceneGraph(root);
+
+	_LoadAnimations(root);
+}
 
-	_pNode->GetComponents<Mesh>(meshThisNodeHolds);
-	for (auto pMesh : meshThisNodeHolds)
+void glTFLoader::GetSceneSimpleMeshes(std::vector<::StaticMesh>& _staticMeshes, std::vector<glm::mat4>& _modelMatrices)
+{
+	std::span<const uint32_t> meshNodes = m_meshComponents.GetNodes();
+	std::span<const uint32_t> meshIndices = m_meshComponents.GetComponents();
+
+	for (size_t i = 0; i < meshNodes.size(); ++i)
 	{
-		for (auto& primitive : pMesh->primitives)
+		for (const auto& primitive : m_meshPrimitives[meshIndices[i]])
 		{
+			StaticMeshStreams meshStreams{};
 			StaticMesh staticMesh{};
-			size_t vertexCount = primitive.positions.size();
 
-			staticMesh.indices = primitive.indices;
+			_GetPrimitiveStreams(primitive, meshStreams);
+			meshStreams.ToStaticMesh(staticMesh);
 
-			for (size_t i = 0; i < vertexCount; ++i)
-			{
-				Vertex curVertex{};
-				curVertex.position = primitive.positions[i];
-				if (i < primitive.normals.size())
-				{
-					curVertex.normal = primitive.normals[i];
-				}
-				if (i < primitive.texcoords.size())
-				{
-					curVertex.uv = primitive.texcoords[i];
-				}
-				staticMesh.verts.push_back(curVertex);
-			}
+			_staticMeshes.push_back(std::move(staticMesh));
+			_modelMatrices.push_back(m_sceneGraph.GetWorldMatrix(meshNodes[i]));
+		}
+	}
+}
 
+void glTFLoader::GetSceneData(SceneData& _outputSceneData) const
+{
+	std::span<const uint32_t> meshNodes = m_meshComponents.GetNodes();
+	std::span<const uint32_t> meshIndices = m_meshComponents.GetComponents();
+
+	for (size_t i = 0; i < meshNodes.size(); ++i)
+	{
+		for (const auto& primitive : m_meshPrimitives[meshIndices[i]])
+		{
+			StaticMeshStreams meshStreams{};
+
+			_GetPrimitiveStreams(primitive, meshStreams);
 			if (_outputSceneData.pStaticMeshes != nullptr)
 			{
-				_outputSceneData.pStaticMeshes->push_back(staticMesh);
+				StaticMesh staticMesh{};
+
+				meshStreams.ToStaticMesh(staticMesh);
+				_outputSceneData.pStaticMeshes->push_back(std::move(staticMesh));
+			}
+			if (_outputSceneData.pStaticMeshStreams != nullptr)
+			{
+				_outputSceneData.pStaticMeshStreams->push_back(std::move(meshStreams));
 			}
 			if (_outputSceneData.pModelMatrices != nullptr)
 			{
-				_outputSceneData.pModelMatrices->push_back(selfModelMatrix);
+				_outputSceneData.pModelMatrices->push_back(m_sceneGraph.GetWorldMatrix(meshNodes[i]));
 			}
 			if (_outputSceneData.pMeshColors != nullptr)
 			{
-				if (primitive.optMaterial.has_value())
+				if (primitive.materialIndex > -1)
 				{
-					_outputSceneData.pMeshColors->push_back(primitive.optMaterial.value().color);
+					_outputSceneData.pMeshColors->push_back(m_materials[primitive.materialIndex].color);
 				}
 				else
 				{
@@ -315,9 +635,9 @@ void glTFLoader::_FetchSceneData(const glTFLoader::Node* _pNode, const glm::mat4
 			}
 			if (_outputSceneData.pMaterialNames != nullptr)
 			{
-				if (primitive.optMaterial.has_value())
+				if (primitive.materialIndex > -1)
 				{
-					_outputSceneData.pMaterialNames->push_back(primitive.optMaterial.value().name);
+					_outputSceneData.pMaterialNames->push_back(m_materials[primitive.materialIndex].name);
 				}
 				else
 				{
@@ -326,63 +646,78 @@ void glTFLoader::_FetchSceneData(const glTFLoader::Node* _pNode, const glm::mat4
 			}
 		}
 	}
-
-	// fill children static meshes
-	for (const auto pChild : _pNode->pChildren)
-	{
-		_FetchSceneData(pChild, selfModelMatrix, _outputSceneData);
-	}
 }
 
-void glTFLoader::Load(const std::string& _glTFPath)
+void glTFLoader::GetInstancedSceneData(InstancedSceneData& _outputSceneData) const
 {
-	tinygltf::Model root;
-
-	_LoadFile(_glTFPath, root);
-
-	_LoadNodes(root);
+	std::span<const uint32_t> meshNodes = m_meshComponents.GetNodes();
+	std::span<const uint32_t> meshIndices = m_meshComponents.GetComponents();
+	std::vector<uint32_t> firstMeshIndex(m_meshPrimitives.size(), ~0u); // first index in output meshes of primitives of each glTF mesh
+	std::vector<const Primitive*> uniquePrimitives;
+	bool needDefaultMaterial = false;
+	const uint32_t defaultMaterialIndex = static_cast<uint32_t>(m_materials.size());
+
+	_outputSceneData.meshes.clear();
+	_outputSceneData.materials.clear();
+	_outputSceneData.instances.clear();
+
+	// each referenced primitive becomes one mesh, instances point to it
+	for (size_t n = 0; n < meshNodes.size(); ++n)
+	{
+		const auto& primitives = m_meshPrimitives[meshIndices[n]];
+		uint32_t& firstIndex = firstMeshIndex[meshIndices[n]];
 
-	_LoadScene(root);
-}
+		if (firstIndex == ~0u)
+		{
+			firstIndex = static_cast<uint32_t>(uniquePrimitives.size());
+			for (const auto& primitive : primitives)
+			{
+				uniquePrimitives.push_back(&primitive);
+			}
+		}
 
-void glTFLoader::GetSceneSimpleMeshes(std::vector<::StaticMesh>& _staticMeshes, std::vector<glm::mat4>& _modelMatrices)
-{
-	if (m_scenes.size() == 0) return;
+		for (size_t i = 0; i < primitives.size(); ++i)
+		{
+			InstancedSceneData::Instance instance{};
 
-	glm::mat4 originModel = glm::mat4(1.0f);
+			instance.meshIndex = firstIndex + static_cast<uint32_t>(i);
+			instance.node = meshNodes[n];
+			instance.modelMatrix = m_sceneGraph.GetWorldMatrix(meshNodes[n]);
+			if (primitives[i].materialIndex > -1)
+			{
+				instance.materialIndex = static_cast<uint32_t>(primitives[i].materialIndex);
+			}
+			else
+			{
+				instance.materialIndex = defaultMaterialIndex;
+				needDefaultMaterial = true;
+			}
 
-	for (auto pNode : m_scenes[0]->pNodes)
-	{
-		_FetchStaticMeshes(pNode, originModel, _staticMeshes, _modelMatrices);
+			_outputSceneData.instances.push_back(instance);
+		}
 	}
-}
 
-void glTFLoader::GetSceneData(SceneData& _outputSceneData) const
-{
-	if (m_scenes.size() == 0) return;
-
-	glm::mat4 originModel = glm::mat4(1.0f);
-
-	for (auto pNode : m_scenes[0]->pNodes)
+	_outputSceneData.materials = m_materials;
+	if (needDefaultMaterial)
 	{
-		_FetchSceneData(pNode, originModel, _outputSceneData);
+		_outputSceneData.materials.push_back(Material{});
 	}
+
+	_outputSceneData.meshes.resize(uniquePrimitives.size());
+	MyTaskScheduler::GetInstance().ParallelFor(
+		static_cast<uint32_t>(uniquePrimitives.size()),
+		1,
+		[&](uint32_t _begin, uint32_t _end, uint32_t _threadIndex)
+		{
+			for (uint32_t i = _begin; i < _end; ++i)
+			{
+				_GetPrimitiveStreams(*uniquePrimitives[i], _outputSceneData.meshes[i]);
+			}
+		});
 }
 
-glm::mat4 glTFLoader::Transform::GetModelMatrix() const
+uint32_t glTFLoader::GetSceneGraphNode(uint32_t _glTFNode) const
 {
-	if (auto ptr = std::get_if<SplitTransform>(&m_transform))
-	{
-		auto T = glm::translate(glm::mat4(1.0f), ptr->translation);
-		auto R = glm::toMat4(ptr->rotation);
-		auto S = glm::scale(glm::mat4(1.0f), ptr->scale);
-
-		return T * R * S;
-	}
-	else if (auto ptr = std::get_if<glm::mat4>(&m_transform))
-	{
-		return *ptr;
-	}
-	CHECK_TRUE(false, "No model matrix!");
-	return glm::mat4(1.0f);
+	if (_glTFNode >= m_graphNodes.size()) return SceneGraph::INVALID_NODE;
+	return m_graphNodes[_glTFNode];
 }
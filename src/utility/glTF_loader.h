@@ -1,67 +1,54 @@
 #pragma once
 #include "common.h"
-#include "component.h"
-#include <variant>
+#include "scene_graph.h"
+#include "animation.h"
+#include <span>
 #include <tiny_gltf.h>
 #include "utils.h"
 class glTFLoader
 {
-private:
+public:
+	// glTF metallic-roughness material, factors are multiplied with textures
 	struct Material
 	{
 		std::string name;
-		glm::vec4 color;
-		// TODO
+		glm::vec4 color = glm::vec4(1.0f);		// base color factor
+		float metallic = 1.0f;
+		float roughness = 1.0f;
+		glm::vec3 emissive = glm::vec3(0.0f);
+		float normalScale = 1.0f;
+		float occlusionStrength = 1.0f;
+		float alphaCutoff = 0.0f;				// alpha below it is discarded, 0 if material is not alpha masked
+		bool alphaBlend = false;
+		bool doubleSided = false;
+
+		// index of images, -1 if material doesn't have the texture
+		int baseColorImage = -1;				// sRGB
+		int metallicRoughnessImage = -1;		// roughness in G, metallic in B
+		int normalImage = -1;
+		int occlusionImage = -1;				// occlusion in R
+		int emissiveImage = -1;					// sRGB
+	};
+
+	// glTF image decoded to RGBA8 with full mip chain, see Texture::SetPixels
+	struct ImageData
+	{
+		std::string name;					// name or uri of image
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t mipLevels = 0;
+		bool srgb = false;					// used as base color or emissive texture, mips are filtered in linear space then
+		std::vector<uint8_t> pixels;		// mips are tightly packed one after another from level 0
 	};
+
+private:
 	struct Primitive
 	{
 		std::vector<glm::vec3> positions;
 		std::vector<glm::vec3> normals;
 		std::vector<glm::vec2> texcoords;
 		std::vector<uint32_t>  indices;
-		std::optional<Material> optMaterial;
-	};
-
-	//node's components
-	struct Camera : public Component
-	{
-		COMPONENT_DECLARATION;
-		// TODO
-	};
-	struct Mesh : public Component
-	{
-		COMPONENT_DECLARATION;
-		std::vector<Primitive> primitives;
-	};
-	struct Transform : public Component
-	{
-		COMPONENT_DECLARATION;
-		struct SplitTransform
-		{
-			glm::vec3 translation;
-			glm::quat rotation;
-			glm::vec3 scale;
-		};
-
-		std::variant<glm::mat4, SplitTransform> m_transform;
-
-		glm::mat4 GetModelMatrix() const;
-	};
-	struct Animation : public Component
-	{
-		COMPONENT_DECLARATION;
-		// TODO
-	};
-
-	struct Node : public ComponentManager
-	{
-		Node* pParent;
-		std::vector<Node*> pChildren;
-	};
-
-	struct Scene
-	{
-		std::vector<Node*> pNodes;
+		int materialIndex = -1; // index of m_materials, -1 if primitive doesn't have material
 	};
 
 public:
@@ -69,39 +56,97 @@ public:
 	struct SceneData
 	{
 		std::vector<::StaticMesh>* pStaticMeshes = nullptr; // optional, get static mesh with glTF primitives
+		std::vector<::StaticMeshStreams>* pStaticMeshStreams = nullptr; // optional, same as pStaticMeshes with vertex attribute streams
 		std::vector<glm::mat4>* pModelMatrices = nullptr;   // optional, get model matrices of glTF primitives
 		std::vector<glm::vec4>* pMeshColors = nullptr;		// optional, get mesh color of glTF primitives
 		std::vector<std::string>* pMaterialNames = nullptr; // optional, get name of materials
 	};
 
+	// glTF scene with shared meshes, a mesh referenced by many nodes is converted once,
+	// build one BLAS per mesh and one RayTracingAccelerationStructure::InstanceData per instance
+	struct InstancedSceneData
+	{
+		struct Instance
+		{
+			uint32_t meshIndex = 0;		// index of meshes, e.g. InstanceData::uBLASIndex when BLAS i is built from meshes[i]
+			uint32_t materialIndex = 0;	// index of materials
+			uint32_t node = 0;			// scene graph node, refresh modelMatrix from its world matrix after animation
+			glm::mat4 modelMatrix = glm::mat4(1.0f); // InstanceData::transformMatrix
+		};
+
+		std::vector<::StaticMeshStreams> meshes;	// one per glTF primitive that the scene references, in order of first reference
+		std::vector<Material> materials;			// glTF materials, a default white one is appended if some primitive has no material
+		std::vector<Instance> instances;			// one per primitive of every mesh node, in order of scene graph nodes
+	};
+
 private:
-	std::vector<std::unique_ptr<Node>> m_nodes;
-	std::vector<std::unique_ptr<Scene>> m_scenes;
+	SceneGraph m_sceneGraph;					// nodes of the first scene
+	ComponentPool<uint32_t> m_meshComponents;	// index of m_meshPrimitives of each mesh node, keyed by scene graph node
+	std::vector<uint32_t> m_graphNodes;			// scene graph node of each glTF node, SceneGraph::INVALID_NODE if it is not in the scene
+	std::vector<std::vector<Primitive>> m_meshPrimitives; // primitives of each glTF mesh, shared by nodes
+	std::vector<Material> m_materials;
+	std::vector<ImageData> m_images;
+	std::vector<Animation> m_animations;		// channels target scene graph nodes
 
 private:
+	// .glb is memory mapped, other files are parsed as ASCII glTF
 	static void _LoadFile(const std::string& _file, tinygltf::Model& _out);
 
+	// start of accessor data in buffer and its byte stride, checks the accessor stays in buffer
+	template<class DataType>
+	static const uint8_t* _GetAccessorData(const tinygltf::Model& _root, const tinygltf::Accessor& _accessor, size_t& _outStride);
+
+	// view accessor in the buffer of _root without copy, empty if elements are not tightly packed or not aligned for DataType, use _LoadAccessor then
+	template<class DataType>
+	static std::span<const DataType> _GetAccessorSpan(const tinygltf::Model& _root, const tinygltf::Accessor& _accessor);
+
+	// bulk copy if elements are tightly packed, strided copy otherwise
 	template<class DataType>
 	static void _LoadAccessor(const tinygltf::Model& _root, const tinygltf::Accessor& _accessor, std::vector<DataType>& _outVec);
 
-	static void _LoadMesh(const tinygltf::Model& _root, const tinygltf::Mesh& _mesh, glTFLoader::Mesh& _outMesh);
+	// uint8_t and uint16_t indices are widened to uint32_t
+	static void _LoadIndices(const tinygltf::Model& _root, const tinygltf::Accessor& _accessor, std::vector<uint32_t>& _outIndices);
+
+	static void _LoadMesh(const tinygltf::Model& _root, const tinygltf::Mesh& _mesh, std::vector<Primitive>& _outPrimitives);
+
+	// load every glTF mesh once on worker threads
+	void _LoadMeshes(const tinygltf::Model& _root);
+
+	void _LoadMaterials(const tinygltf::Model& _root);
+
+	// tinygltf image loader that keeps encoded bytes in Image::image, so images are decoded later on worker threads
+	static bool _KeepEncodedImage(
+		tinygltf::Image* _image,
+		const int _imageIndex,
+		std::string* _err,
+		std::string* _warn,
+		int _reqWidth,
+		int _reqHeight,
+		const unsigned char* _bytes,
+		int _size,
+		void* _userData);
 
-	void _LoadNodes(const tinygltf::Model& _root);
+	// decode image to RGBA8, a white pixel if it cannot be decoded
+	static void _DecodeImage(const tinygltf::Image& _image, ImageData& _outImage);
 
-	void _LoadScene(const tinygltf::Model& _root);
+	// 2x2 box filter down to 1x1, color of sRGB image is averaged in linear space
+	static void _GenerateMips(ImageData& _image);
 
-	// recursively fetch primitives from this node and its parent nodes that can build static meshes
-	// return the static meshes built by these primitives and their model matrices
-	void _FetchStaticMeshes(
-		const glTFLoader::Node* _pNode,
-		const glm::mat4& _parentModelMatrix,
-		std::vector<::StaticMesh>& _outStaticMeshes,
-		std::vector<glm::mat4>& _outModelMatrices) const;
+	// decode images and generate their mips on worker threads, call after _LoadMaterials to know which images are sRGB
+	void _LoadImages(const tinygltf::Model& _root);
 
-	void _FetchSceneData(
-		const glTFLoader::Node* _pNode,
-		const glm::mat4& _parentModelMatrix,
-		SceneData& _outputSceneData) const;
+	// build scene graph from nodes of the first scene and attach meshes to it
+	void _LoadSceneGraph(const tinygltf::Model& _root);
+
+	// float accessor of any type, components are written one after another
+	static void _LoadFloats(const tinygltf::Model& _root, const tinygltf::Accessor& _accessor, std::vector<float>& _outFloats);
+
+	// channels of nodes out of scene graph are dropped, so are outputs that are not float
+	void _LoadAnimations(const tinygltf::Model& _root);
+
+	// primitive attributes are already streams, copy them as they are,
+	// an attribute is present if it has a value for every vertex
+	static void _GetPrimitiveStreams(const glTFLoader::Primitive& _primitive, ::StaticMeshStreams& _outMesh);
 
 public:
 	void Load(const std::string& _glTFPath);
@@ -110,22 +155,93 @@ public:
 
 	// Get scene data from glTF scene, see glTFLoader::SceneData for detail
 	void GetSceneData(SceneData& _outputSceneData) const;
+
+	// Get scene with unique meshes and their instances, meshes are converted in parallel
+	void GetInstancedSceneData(InstancedSceneData& _outputSceneData) const;
+
+	// Nodes of the first scene, world matrices are up to date after Load
+	const SceneGraph& GetSceneGraph() const { return m_sceneGraph; }
+
+	// Scene graph node of glTF node, SceneGraph::INVALID_NODE if it is not in the first scene
+	uint32_t GetSceneGraphNode(uint32_t _glTFNode) const;
+
+	// Images referenced by Material, upload them with Texture::SetPixels and bind them to a runtime array in shader
+	const std::vector<ImageData>& GetImages() const { return m_images; }
+
+	// Animations of glTF, sample them into a copy of GetSceneGraph
+	const std::vector<Animation>& GetAnimations() const { return m_animations; }
 };
 
 template<class DataType>
-void glTFLoader::_LoadAccessor(const tinygltf::Model& _root, const tinygltf::Accessor& _accessor, std::vector<DataType>& _outVec)
+const uint8_t* glTFLoader::_GetAccessorData(const tinygltf::Model& _root, const tinygltf::Accessor& _accessor, size_t& _outStride)
 {
+	CHECK_TRUE(_accessor.bufferView >= 0, "Accessor without buffer view is not supported!");
+	CHECK_TRUE(!_accessor.sparse.isSparse, "Sparse accessor is not supported!");
 	const auto& tbufferView = _root.bufferViews[_accessor.bufferView];
 	const auto& tbuffer = _root.buffers[tbufferView.buffer];
 	int byteStride = _accessor.ByteStride(tbufferView);
-	const uint8_t* pBufferDataSrc = &tbuffer.data.at(0) + tbufferView.byteOffset + _accessor.byteOffset;
+	CHECK_TRUE(byteStride > 0, "Stride of accessor is zero!");
 
-	CHECK_TRUE(byteStride > 0, "Stride of index buffer is zero!");
-	_outVec.resize(_accessor.count);
+	_outStride = static_cast<size_t>(byteStride);
+	const size_t byteOffset = tbufferView.byteOffset + _accessor.byteOffset;
+	if (_accessor.count == 0)
+	{
+		return tbuffer.data.data() + byteOffset;
+	}
+	const size_t byteEnd = byteOffset + (_accessor.count - 1) * _outStride + sizeof(DataType);
+	CHECK_TRUE(byteEnd <= tbuffer.data.size(), "Accessor is out of buffer!");
 
-	for (int i = 0; i < _accessor.count; ++i)
+	return tbuffer.data.data() + byteOffset;
+}
+
+template<class DataType>
+std::span<const DataType> glTFLoader::_GetAccessorSpan(const tinygltf::Model& _root, const tinygltf::Accessor& _accessor)
+{
+	size_t byteStride = 0;
+	const uint8_t* pData = _GetAccessorData<DataType>(_root, _accessor, byteStride);
+
+	if (byteStride != sizeof(DataType) || reinterpret_cast<uintptr_t>(pData) % alignof(DataType) != 0)
 	{
-		memcpy(&_outVec[i], pBufferDataSrc, sizeof(DataType));
+		return {};
+	}
+	return std::span<const DataType>(reinterpret_cast<const DataType*>(pData), _accessor.count);
+}
+
+template<class DataType>
+void glTFLoader::_LoadAccessor(const tinygltf::Model& _root, const tinygltf::Accessor& _accessor, std::vector<DataType>& _outVec)
+{
+	static_assert(std::is_trivially_copyable_v<DataType>);
+	size_t byteStride = 0;
+	const uint8_t* pBufferDataSrc = _GetAccessorData<DataType>(_root, _accessor, byteStride);
+	const size_t count = _accessor.count;
+
+	_outVec.resize(count);
+	if (count == 0) return;
+
+	DataType* pDst = _outVec.data();
+
+	// tightly packed, one copy
+	if (byteStride == sizeof(DataType))
+	{
+		memcpy(pDst, pBufferDataSrc, count * sizeof(DataType));
+		return;
+	}
+
+	// interleaved, copies have fixed size so they become plain vector loads and stores,
+	// unrolled to keep several of them in flight
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		memcpy(pDst + i,     pBufferDataSrc,                  sizeof(DataType));
+		memcpy(pDst + i + 1, pBufferDataSrc + byteStride,     sizeof(DataType));
+		memcpy(pDst + i + 2, pBufferDataSrc + byteStride * 2, sizeof(DataType));
+		memcpy(pDst + i + 3, pBufferDataSrc + byteStride * 3, sizeof(DataType));
+		pBufferDataSrc += byteStride * 4;
+	}
+	for (; i < count; ++i)
+	{
+		memcpy(pDst + i, pBufferDataSrc, sizeof(DataType));
 		pBufferDataSrc += byteStride;
 	}
-}
\ No newline at end of file
+}
+
@@ -0,0 +1,44 @@
+#include "lod_selector.h"
+#include "virtual_geometry_traversal.h"
+
+void LodSelector::Init(const MeshOptimizer::LodChain& inChain)
+{
+	CHECK_TRUE(!inChain.levels.empty(), "LOD chain should have LOD 0!");
+
+	m_levelErrors.clear();
+	m_levelErrors.reserve(inChain.levels.size());
+	for (const auto& level : inChain.levels)
+	{
+		m_levelErrors.push_back(level.error);
+	}
+	m_center = inChain.center;
+	m_radius = inChain.radius;
+}
+
+uint32_t LodSelector::GetLodCount() const
+{
+	return static_cast<uint32_t>(m_levelErrors.size());
+}
+
+uint32_t LodSelector::SelectLod(const glm::mat4& inModel, const PersCamera& inCamera, float inPixelError) const
+{
+	float scale2 = 0.0f;
+	float scale = 1.0f;
+	float threshold = 0.0f;
+	uint32_t lod = 0;
+
+	for (int col = 0; col < 3; ++col)
+	{
+		scale2 = std::max(scale2, glm::dot(glm::vec3(inModel[col]), glm::vec3(inModel[col])));
+	}
+	scale = std::sqrt(scale2);
+
+	// threshold is in world space, errors are in object space
+	threshold = VirtualGeometryTraversal::GetErrorThreshold(glm::vec3(inModel * glm::vec4(m_center, 1.0f)), m_radius * scale, inCamera, inPixelError);
+	while (lod + 1 < m_levelErrors.size() && m_levelErrors[lod + 1] * scale <= threshold)
+	{
+		++lod;
+	}
+
+	return lod;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "common.h"
+#include "camera.h"
+#include "my_mesh_optimizer.h"
+
+// Runtime LOD selection for instances of a mesh with a MeshOptimizer::LodChain.
+// An instance gets the coarsest LOD whose error projects to at most the pixel error on screen,
+// with the same threshold VirtualGeometryTraversal uses for clusters.
+// Scale of an instance is taken as the max scale of its model matrix
+class LodSelector
+{
+private:
+	std::vector<float> m_levelErrors;	// object space, grows with level
+	glm::vec3 m_center{};
+	float m_radius = 0.0f;
+
+public:
+	// Only errors and bounds are copied, inChain can be released after this
+	void Init(const MeshOptimizer::LodChain& inChain);
+
+	uint32_t GetLodCount() const;
+
+	// LOD of one instance
+	// inModel: object to world
+	// inPixelError: error tolerance in pixels on screen
+	uint32_t SelectLod(const glm::mat4& inModel, const PersCamera& inCamera, float inPixelError) const;
+};
@@ -0,0 +1,302 @@
+#include "mesh_codec.h"
+#include "utils.h"
+
+namespace
+{
+	// vertex codec works on strides that are multiples of 4, so positions take 4 components
+	struct QuantizedPosition
+	{
+		uint16_t x;
+		uint16_t y;
+		uint16_t z;
+		uint16_t w;
+	};
+
+	size_t _GetNormalStride(int _bits)
+	{
+		return _bits > 8 ? 4 * sizeof(int16_t) : 4 * sizeof(int8_t);
+	}
+
+	// octahedral mapping has no zero vector, degenerate normals are stored as +Z instead of NaN
+	glm::vec3 _GetSafeNormal(const glm::vec3& _normal)
+	{
+		const float length = glm::length(_normal);
+
+		return (length > 0.0f && std::isfinite(length)) ? _normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+	}
+
+	std::vector<uint8_t> _EncodeVertices(const void* _data, size_t _count, size_t _stride)
+	{
+		std::vector<uint8_t> encoded(meshopt_encodeVertexBufferBound(_count, _stride));
+
+		encoded.resize(meshopt_encodeVertexBuffer(encoded.data(), encoded.size(), _data, _count, _stride));
+		return encoded;
+	}
+
+	bool _DecodeVertices(void* _outData, size_t _count, size_t _stride, std::span<const uint8_t> _encoded)
+	{
+		return meshopt_decodeVertexBuffer(_outData, _count, _stride, _encoded.data(), _encoded.size()) == 0;
+	}
+
+	// decoded quantized streams before they are expanded to floats, only grows so later calls on the thread don't allocate
+	uint8_t* _GetScratch(size_t _size)
+	{
+		thread_local std::vector<uint8_t> scratch;
+
+		if (scratch.size() < _size)
+		{
+			scratch.resize(_size);
+		}
+		return scratch.data();
+	}
+}
+
+void MeshCodec::Encode(
+	const StaticMeshStreams& _mesh,
+	const Meshlet::DeviceData& _meshletData,
+	std::span<const Meshlet::DeviceDataRef> _meshlets,
+	std::span<const MeshletBounds> _bounds,
+	const Settings& _settings,
+	EncodedMesh& _outMesh)
+{
+	Header& header = _outMesh.header;
+	const size_t vertexCount = _mesh.positions.size();
+
+	CHECK_TRUE(_settings.normalBits >= 2 && _settings.normalBits <= 16, "Normal bits should be in [2, 16]!");
+	CHECK_TRUE(_meshlets.size() == _bounds.size(), "Each meshlet should have bounds!");
+	CHECK_TRUE(_mesh.indices.size() % 3 == 0, "Index codec needs a triangle list!");
+	CHECK_TRUE(!_mesh.HasAttribute(VertexAttribute::NORMAL) || _mesh.normals.size() == vertexCount, "Normal stream doesn't match positions!");
+	CHECK_TRUE(!_mesh.HasAttribute(VertexAttribute::UV) || _mesh.uvs.size() == vertexCount, "UV stream doesn't match positions!");
+
+	header = Header{};
+	header.vertexCount = static_cast<uint32_t>(vertexCount);
+	header.indexCount = static_cast<uint32_t>(_mesh.indices.size());
+	header.meshletVertexCount = static_cast<uint32_t>(_meshletData.meshletVertices.size());
+	header.meshletIndexCount = static_cast<uint32_t>(_meshletData.meshletIndices.size());
+	header.meshletCount = static_cast<uint32_t>(_meshlets.size());
+	header.normalBits = _settings.normalBits;
+	for (auto& stream : _outMesh.streams)
+	{
+		stream.clear();
+	}
+
+	if (vertexCount > 0)
+	{
+		if (_settings.quantizePositions)
+		{
+			std::vector<QuantizedPosition> quantized(vertexCount);
+			glm::vec3 boxMin = glm::vec3(FLT_MAX);
+			glm::vec3 boxMax = glm::vec3(-FLT_MAX);
+			float extent = 0.0f;
+
+			for (const auto& position : _mesh.positions)
+			{
+				boxMin = glm::min(boxMin, position);
+				boxMax = glm::max(boxMax, position);
+			}
+			// same scale on all axes so the grid is uniform
+			extent = std::max(std::max(boxMax.x - boxMin.x, boxMax.y - boxMin.y), boxMax.z - boxMin.z);
+			header.positionOffset = boxMin;
+			header.positionScale = extent > 0.0f ? extent / 65535.0f : 1.0f;
+			for (size_t i = 0; i < vertexCount; ++i)
+			{
+				const glm::vec3 normalized = extent > 0.0f ? (_mesh.positions[i] - boxMin) / extent : glm::vec3(0.0f);
+
+				quantized[i].x = static_cast<uint16_t>(meshopt_quantizeUnorm(normalized.x, 16));
+				quantized[i].y = static_cast<uint16_t>(meshopt_quantizeUnorm(normalized.y, 16));
+				quantized[i].z = static_cast<uint16_t>(meshopt_quantizeUnorm(normalized.z, 16));
+				quantized[i].w = 0;
+			}
+			_outMesh.streams[STREAM_POSITION] = _EncodeVertices(quantized.data(), vertexCount, sizeof(QuantizedPosition));
+			header.quantizedStreams |= 1u << STREAM_POSITION;
+		}
+		else
+		{
+			_outMesh.streams[STREAM_POSITION] = _EncodeVertices(_mesh.positions.data(), vertexCount, sizeof(glm::vec3));
+		}
+	}
+
+	if (vertexCount > 0 && _mesh.HasAttribute(VertexAttribute::NORMAL))
+	{
+		if (_settings.quantizeNormals)
+		{
+			const size_t stride = _GetNormalStride(_settings.normalBits);
+			std::vector<glm::vec4> normals(vertexCount);
+			std::vector<uint8_t> quantized(vertexCount * stride);
+
+			for (size_t i = 0; i < vertexCount; ++i)
+			{
+				normals[i] = glm::vec4(_GetSafeNormal(_mesh.normals[i]), 0.0f);
+			}
+			meshopt_encodeFilterOct(quantized.data(), vertexCount, stride, _settings.normalBits, &normals[0].x);
+			_outMesh.streams[STREAM_NORMAL] = _EncodeVertices(quantized.data(), vertexCount, stride);
+			header.quantizedStreams |= 1u << STREAM_NORMAL;
+		}
+		else
+		{
+			_outMesh.streams[STREAM_NORMAL] = _EncodeVertices(_mesh.normals.data(), vertexCount, sizeof(glm::vec3));
+		}
+	}
+
+	if (vertexCount > 0 && _mesh.HasAttribute(VertexAttribute::UV))
+	{
+		if (_settings.quantizeUVs)
+		{
+			std::vector<uint16_t> quantized(vertexCount * 2);
+
+			for (size_t i = 0; i < vertexCount; ++i)
+			{
+				quantized[2 * i + 0] = meshopt_quantizeHalf(_mesh.uvs[i].x);
+				quantized[2 * i + 1] = meshopt_quantizeHalf(_mesh.uvs[i].y);
+			}
+			_outMesh.streams[STREAM_UV] = _EncodeVertices(quantized.data(), vertexCount, 2 * sizeof(uint16_t));
+			header.quantizedStreams |= 1u << STREAM_UV;
+		}
+		else
+		{
+			_outMesh.streams[STREAM_UV] = _EncodeVertices(_mesh.uvs.data(), vertexCount, sizeof(glm::vec2));
+		}
+	}
+
+	if (!_mesh.indices.empty())
+	{
+		std::vector<uint8_t>& encoded = _outMesh.streams[STREAM_INDEX];
+
+		encoded.resize(meshopt_encodeIndexBufferBound(_mesh.indices.size(), vertexCount));
+		encoded.resize(meshopt_encodeIndexBuffer(encoded.data(), encoded.size(), _mesh.indices.data(), _mesh.indices.size()));
+	}
+
+	if (!_meshletData.meshletVertices.empty())
+	{
+		std::vector<uint8_t>& encoded = _outMesh.streams[STREAM_MESHLET_VERTEX];
+
+		// not a triangle list, but neighbouring meshlets share vertices so sequence deltas are small
+		encoded.resize(meshopt_encodeIndexSequenceBound(_meshletData.meshletVertices.size(), vertexCount));
+		encoded.resize(meshopt_encodeIndexSequence(encoded.data(), encoded.size(), _meshletData.meshletVertices.data(), _meshletData.meshletVertices.size()));
+	}
+
+	if (!_meshletData.meshletIndices.empty())
+	{
+		// 4 bytes for each element of vertex codec, tail is padded with zeros
+		std::vector<uint8_t> padded(common_utils::AlignUp(_meshletData.meshletIndices.size(), 4), 0);
+
+		memcpy(padded.data(), _meshletData.meshletIndices.data(), _meshletData.meshletIndices.size());
+		_outMesh.streams[STREAM_MESHLET_INDEX] = _EncodeVertices(padded.data(), padded.size() / 4, 4);
+	}
+
+	if (!_meshlets.empty())
+	{
+		_outMesh.streams[STREAM_MESHLET] = _EncodeVertices(_meshlets.data(), _meshlets.size(), sizeof(Meshlet::DeviceDataRef));
+		_outMesh.streams[STREAM_MESHLET_BOUNDS] = _EncodeVertices(_bounds.data(), _bounds.size(), sizeof(MeshletBounds));
+	}
+}
+
+size_t MeshCodec::GetDecodedSize(const Header& _header, Stream _stream)
+{
+	switch (_stream)
+	{
+	case STREAM_POSITION:		return _header.vertexCount * sizeof(glm::vec3);
+	case STREAM_NORMAL:			return _header.vertexCount * sizeof(glm::vec3);
+	case STREAM_UV:				return _header.vertexCount * sizeof(glm::vec2);
+	case STREAM_INDEX:			return _header.indexCount * sizeof(uint32_t);
+	case STREAM_MESHLET_VERTEX:	return _header.meshletVertexCount * sizeof(uint32_t);
+	case STREAM_MESHLET_INDEX:	return _header.meshletIndexCount * sizeof(uint8_t);
+	case STREAM_MESHLET:		return _header.meshletCount * sizeof(Meshlet::DeviceDataRef);
+	case STREAM_MESHLET_BOUNDS:	return _header.meshletCount * sizeof(MeshletBounds);
+	default:
+		CHECK_TRUE(false, "Unknown mesh stream!");
+		return 0;
+	}
+}
+
+bool MeshCodec::DecodeStream(const Header& _header, Stream _stream, std::span<const uint8_t> _encoded, void* _outData)
+{
+	const bool quantized = (_header.quantizedStreams & (1u << _stream)) != 0;
+	const size_t vertexCount = _header.vertexCount;
+
+	// empty streams are not encoded at all, don't decode attributes the mesh doesn't have
+	if (_encoded.empty()) return GetDecodedSize(_header, _stream) == 0;
+
+	switch (_stream)
+	{
+	case STREAM_POSITION:
+	{
+		if (!quantized) return _DecodeVertices(_outData, vertexCount, sizeof(glm::vec3), _encoded);
+
+		QuantizedPosition* pQuantized = reinterpret_cast<QuantizedPosition*>(_GetScratch(vertexCount * sizeof(QuantizedPosition)));
+		glm::vec3* pPositions = static_cast<glm::vec3*>(_outData);
+
+		if (!_DecodeVertices(pQuantized, vertexCount, sizeof(QuantizedPosition), _encoded)) return false;
+		for (size_t i = 0; i < vertexCount; ++i)
+		{
+			pPositions[i] = _header.positionOffset + glm::vec3(pQuantized[i].x, pQuantized[i].y, pQuantized[i].z) * _header.positionScale;
+		}
+		return true;
+	}
+	case STREAM_NORMAL:
+	{
+		if (!quantized) return _DecodeVertices(_outData, vertexCount, sizeof(glm::vec3), _encoded);
+
+		const size_t stride = _GetNormalStride(_header.normalBits);
+		uint8_t* pQuantized = _GetScratch(vertexCount * stride);
+		glm::vec3* pNormals = static_cast<glm::vec3*>(_outData);
+
+		if (!_DecodeVertices(pQuantized, vertexCount, stride, _encoded)) return false;
+		// filter writes normalized signed integers in place
+		meshopt_decodeFilterOct(pQuantized, vertexCount, stride);
+		for (size_t i = 0; i < vertexCount; ++i)
+		{
+			glm::vec3 normal{};
+
+			if (stride == 4 * sizeof(int8_t))
+			{
+				const int8_t* pSrc = reinterpret_cast<const int8_t*>(pQuantized + i * stride);
+				normal = glm::vec3(pSrc[0], pSrc[1], pSrc[2]);
+			}
+			else
+			{
+				const int16_t* pSrc = reinterpret_cast<const int16_t*>(pQuantized + i * stride);
+				normal = glm::vec3(pSrc[0], pSrc[1], pSrc[2]);
+			}
+			pNormals[i] = _GetSafeNormal(normal);
+		}
+		return true;
+	}
+	case STREAM_UV:
+	{
+		if (!quantized) return _DecodeVertices(_outData, vertexCount, sizeof(glm::vec2), _encoded);
+
+		uint16_t* pQuantized = reinterpret_cast<uint16_t*>(_GetScratch(vertexCount * 2 * sizeof(uint16_t)));
+		glm::vec2* pUVs = static_cast<glm::vec2*>(_outData);
+
+		if (!_DecodeVertices(pQuantized, vertexCount, 2 * sizeof(uint16_t), _encoded)) return false;
+		for (size_t i = 0; i < vertexCount; ++i)
+		{
+			pUVs[i] = glm::vec2(meshopt_dequantizeHalf(pQuantized[2 * i + 0]), meshopt_dequantizeHalf(pQuantized[2 * i + 1]));
+		}
+		return true;
+	}
+	case STREAM_INDEX:
+		return meshopt_decodeIndexBuffer(_outData, _header.indexCount, sizeof(uint32_t), _encoded.data(), _encoded.size()) == 0;
+	case STREAM_MESHLET_VERTEX:
+		return meshopt_decodeIndexSequence(_outData, _header.meshletVertexCount, sizeof(uint32_t), _encoded.data(), _encoded.size()) == 0;
+	case STREAM_MESHLET_INDEX:
+	{
+		const size_t paddedSize = common_utils::AlignUp(static_cast<size_t>(_header.meshletIndexCount), 4);
+
+		// padding doesn't fit in _outData
+		if (paddedSize == _header.meshletIndexCount) return _DecodeVertices(_outData, paddedSize / 4, 4, _encoded);
+
+		uint8_t* pPadded = _GetScratch(paddedSize);
+		if (!_DecodeVertices(pPadded, paddedSize / 4, 4, _encoded)) return false;
+		memcpy(_outData, pPadded, _header.meshletIndexCount);
+		return true;
+	}
+	case STREAM_MESHLET:
+		return _DecodeVertices(_outData, _header.meshletCount, sizeof(Meshlet::DeviceDataRef), _encoded);
+	case STREAM_MESHLET_BOUNDS:
+		return _DecodeVertices(_outData, _header.meshletCount, sizeof(MeshletBounds), _encoded);
+	default:
+		return false;
+	}
+}
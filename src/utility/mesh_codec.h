@@ -0,0 +1,74 @@
+#pragma once
+#include <meshoptimizer.h>
+#include <span>
+#include "common.h"
+#include "geometry.h"
+
+// Compress mesh streams with meshoptimizer codecs.
+// Vertex streams can be quantized before encoding: positions to 16 bits in the bounding box of mesh,
+// normals to octahedral and uvs to half floats, the rest is lossless.
+// Streams decode back to the raw layout of StaticMeshStreams and meshlet data,
+// so the output can be written to mapped memory of a staging buffer and copied to device as it is
+class MeshCodec
+{
+public:
+	enum Stream
+	{
+		STREAM_POSITION,		// glm::vec3
+		STREAM_NORMAL,			// glm::vec3
+		STREAM_UV,				// glm::vec2
+		STREAM_INDEX,			// uint32_t, triangle list
+		STREAM_MESHLET_VERTEX,	// uint32_t, Meshlet::DeviceData::meshletVertices
+		STREAM_MESHLET_INDEX,	// uint8_t, Meshlet::DeviceData::meshletIndices
+		STREAM_MESHLET,			// Meshlet::DeviceDataRef
+		STREAM_MESHLET_BOUNDS,	// MeshletBounds
+		STREAM_COUNT
+	};
+
+	struct Settings
+	{
+		// quantization is lossy, so each asset opts in, without it streams are only encoded losslessly
+		bool quantizePositions = false;	// 16 bits per component, error is 1/65535 of the longest side of bounding box
+		bool quantizeNormals = false;	// octahedral with normalBits per component
+		bool quantizeUVs = false;		// half floats, keep it off for uvs far outside [0, 1]
+		int normalBits = 8;				// in [2, 16], 8 is enough for shading, values above 8 take twice the bytes
+	};
+
+	// Everything needed to decode streams, plain data that can be written to file
+	struct Header
+	{
+		uint32_t vertexCount = 0;
+		uint32_t indexCount = 0;
+		uint32_t meshletVertexCount = 0;
+		uint32_t meshletIndexCount = 0;		// bytes
+		uint32_t meshletCount = 0;
+		uint32_t quantizedStreams = 0;		// bit i is set if stream i is quantized
+		int32_t normalBits = 0;
+		float positionScale = 1.0f;			// position = positionOffset + quantized * positionScale
+		glm::vec3 positionOffset{};
+		uint32_t padding = 0;
+	};
+
+	struct EncodedMesh
+	{
+		Header header;
+		std::array<std::vector<uint8_t>, STREAM_COUNT> streams; // empty if the mesh doesn't have the stream
+	};
+
+public:
+	// Encode mesh streams and optional meshlets, _meshlets and _bounds must have the same size
+	static void Encode(
+		const StaticMeshStreams& _mesh,
+		const Meshlet::DeviceData& _meshletData,
+		std::span<const Meshlet::DeviceDataRef> _meshlets,
+		std::span<const MeshletBounds> _bounds,
+		const Settings& _settings,
+		EncodedMesh& _outMesh);
+
+	// Bytes of the decoded stream
+	static size_t GetDecodedSize(const Header& _header, Stream _stream);
+
+	// Decode one stream to _outData that has room for GetDecodedSize bytes,
+	// return false if the encoded data is broken
+	static bool DecodeStream(const Header& _header, Stream _stream, std::span<const uint8_t> _encoded, void* _outData);
+};
@@ -0,0 +1,486 @@
+#include "mesh_file.h"
+#include "my_mesh_optimizer.h"
+#include "task_scheduler.h"
+#include <atomic>
+#include <filesystem>
+
+namespace
+{
+	// same order as MeshCodec::Stream, a compressed section is the encoded stream
+	enum MeshSection
+	{
+		SECTION_POSITION,
+		SECTION_NORMAL,
+		SECTION_UV,
+		SECTION_INDEX,
+		SECTION_MESHLET_VERTEX,
+		SECTION_MESHLET_INDEX,
+		SECTION_MESHLET,
+		SECTION_MESHLET_BOUNDS,
+		SECTION_COUNT
+	};
+	static_assert(SECTION_COUNT == MeshCodec::STREAM_COUNT, "Each section should be a codec stream!");
+
+	constexpr uint32_t MESH_FLAG_COMPRESSED = 1u;
+
+	// layout
+	// file header: magic | version | mesh count | padding | settings hash | source size | source write time | padding -> 48 bytes
+	// mesh headers: one MeshHeader for each mesh
+	// sections: each starts at a multiple of LVMESH_SECTION_ALIGNMENT bytes
+	struct FileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t meshCount;
+		uint32_t padding;
+		uint64_t settingsHash;		// MeshFile::HashCookSettings
+		uint64_t sourceSize;		// 0 if not cooked from a file
+		int64_t sourceWriteTime;
+		uint64_t padding1;
+	};
+
+	struct MeshHeader
+	{
+		uint32_t attributeMask;
+		uint32_t flags;				// MESH_FLAG_*
+		uint32_t padding[2];
+		MeshCodec::Header codec;	// valid if MESH_FLAG_COMPRESSED is set
+		std::array<uint64_t, SECTION_COUNT> sectionOffsets;	// bytes from the start of file
+		std::array<uint64_t, SECTION_COUNT> sectionSizes;	// bytes
+	};
+
+	// data is copied to device as it is, layout must not change silently
+	static_assert(sizeof(Meshlet::DeviceDataRef) == 4 * sizeof(uint32_t), "Meshlet ref should be tightly packed!");
+	static_assert(sizeof(MeshletBounds) == 11 * sizeof(float), "Meshlet bounds should be tightly packed!");
+	static_assert(sizeof(MeshCodec::Header) == 12 * sizeof(uint32_t), "Codec header should be tightly packed!");
+	static_assert(sizeof(FileHeader) % LVMESH_SECTION_ALIGNMENT == 0, "File header should keep sections aligned!");
+	static_assert(sizeof(MeshHeader) % LVMESH_SECTION_ALIGNMENT == 0, "Mesh header should keep sections aligned!");
+
+	// Size and last write time of a file, return false if it cannot be read
+	bool _GetFileStamp(const std::string& inFilePath, uint64_t& outSize, int64_t& outWriteTime)
+	{
+		std::error_code error{};
+		const uint64_t fileSize = std::filesystem::file_size(inFilePath, error);
+		if (error) return false;
+		const auto writeTime = std::filesystem::last_write_time(inFilePath, error);
+		if (error) return false;
+
+		outSize = fileSize;
+		outWriteTime = static_cast<int64_t>(writeTime.time_since_epoch().count());
+		return true;
+	}
+
+	// Mesh data to write, meshlets are built from the source mesh
+	struct CookedMesh
+	{
+		const StaticMeshStreams* pSource = nullptr;
+		Meshlet::DeviceData meshletData;
+		std::vector<Meshlet::DeviceDataRef> meshlets;
+		std::vector<MeshletBounds> meshletBounds;
+		MeshCodec::EncodedMesh encoded;
+	};
+
+	template<typename T>
+	std::span<const T> _GetSection(std::span<const uint8_t> inSection)
+	{
+		return std::span<const T>(reinterpret_cast<const T*>(inSection.data()), inSection.size() / sizeof(T));
+	}
+}
+
+size_t MeshFile::MeshView::GetSectionSize(MeshCodec::Stream _section) const
+{
+	const bool missingAttribute =
+		(_section == MeshCodec::STREAM_NORMAL && !HasAttribute(VertexAttribute::NORMAL))
+		|| (_section == MeshCodec::STREAM_UV && !HasAttribute(VertexAttribute::UV));
+
+	if (!compressed) return sections[_section].size();
+
+	return missingAttribute ? 0 : MeshCodec::GetDecodedSize(codec, _section);
+}
+
+bool MeshFile::MeshView::ReadSection(MeshCodec::Stream _section, void* _outData) const
+{
+	const size_t size = GetSectionSize(_section);
+
+	if (size == 0) return true;
+	if (compressed) return MeshCodec::DecodeStream(codec, _section, sections[_section], _outData);
+
+	memcpy(_outData, sections[_section].data(), size);
+	return true;
+}
+
+bool MeshFile::MeshView::GetStreams(StaticMeshStreams& _outMesh) const
+{
+	_outMesh.attributeMask = attributeMask;
+	_outMesh.positions.resize(GetSectionSize(MeshCodec::STREAM_POSITION) / sizeof(glm::vec3));
+	_outMesh.normals.resize(GetSectionSize(MeshCodec::STREAM_NORMAL) / sizeof(glm::vec3));
+	_outMesh.uvs.resize(GetSectionSize(MeshCodec::STREAM_UV) / sizeof(glm::vec2));
+	_outMesh.indices.resize(GetSectionSize(MeshCodec::STREAM_INDEX) / sizeof(uint32_t));
+
+	return ReadSection(MeshCodec::STREAM_POSITION, _outMesh.positions.data())
+		&& ReadSection(MeshCodec::STREAM_NORMAL, _outMesh.normals.data())
+		&& ReadSection(MeshCodec::STREAM_UV, _outMesh.uvs.data())
+		&& ReadSection(MeshCodec::STREAM_INDEX, _outMesh.indices.data());
+}
+
+uint64_t MeshFile::HashCookSettings(const CookSettings& inSettings)
+{
+	const MeshCodec::Settings& codec = inSettings.codecSettings;
+	// hash fields one by one, struct padding is not initialized
+	const std::array<uint32_t, 10> parameters = {
+		inSettings.buildMeshlets ? 1u : 0u,
+		inSettings.maxMeshletVertexCount,
+		inSettings.maxMeshletTriangleCount,
+		inSettings.minMeshletTriangleCount,
+		static_cast<uint32_t>(inSettings.meshletBuildMode),
+		inSettings.compress ? 1u : 0u,
+		codec.quantizePositions ? 1u : 0u,
+		codec.quantizeNormals ? 1u : 0u,
+		codec.quantizeUVs ? 1u : 0u,
+		static_cast<uint32_t>(codec.normalBits) };
+	uint64_t hash = common_utils::HashBytes(parameters.data(), sizeof(parameters));
+
+	hash = common_utils::HashBytes(&inSettings.meshletConeWeight, sizeof(float), hash);
+	return hash;
+}
+
+bool MeshFile::Cook(
+	std::span<const StaticMeshStreams> inMeshes,
+	const std::string& inMeshFilePath,
+	const CookSettings& inSettings)
+{
+	return _Cook(inMeshes, inMeshFilePath, inSettings, {});
+}
+
+bool MeshFile::_Cook(
+	std::span<const StaticMeshStreams> inMeshes,
+	const std::string& inMeshFilePath,
+	const CookSettings& inSettings,
+	const std::string& inSourceFilePath)
+{
+	std::vector<CookedMesh> cookedMeshes(inMeshes.size());
+	std::vector<MeshHeader> meshHeaders(inMeshes.size());
+	std::vector<uint8_t> bytes;
+	FileHeader fileHeader{};
+	size_t cursor = 0;
+
+	// meshlets of each mesh are built on worker threads
+	MyTaskScheduler::GetInstance().ParallelFor(static_cast<uint32_t>(inMeshes.size()), 1, [&](uint32_t inBegin, uint32_t inEnd, uint32_t inThreadIndex)
+		{
+			MeshOptimizer optimizer{};
+			MeshOptimizer::MeshletBuildSettings meshletSettings{};
+			MeshOptimizer::MeshletBatch batch{};
+
+			meshletSettings.mode = inSettings.meshletBuildMode;
+			meshletSettings.maxPrimitiveCount = inSettings.maxMeshletTriangleCount;
+			meshletSettings.minPrimitiveCount = inSettings.minMeshletTriangleCount;
+			meshletSettings.maxIndexCount = inSettings.maxMeshletVertexCount;
+			meshletSettings.coneWeight = inSettings.meshletConeWeight;
+			for (uint32_t i = inBegin; i < inEnd; ++i)
+			{
+				CookedMesh& cooked = cookedMeshes[i];
+				std::span<const uint32_t> range = inMeshes[i].indices;
+
+				cooked.pSource = &inMeshes[i];
+				if (inSettings.buildMeshlets && !inMeshes[i].indices.empty())
+				{
+					// bounds come out of the same pass
+					optimizer.BuildMeshletsBatch(inMeshes[i].positions, { &range, 1 }, meshletSettings, batch);
+					cooked.meshletData = std::move(batch.data);
+					cooked.meshlets = std::move(batch.meshlets);
+					cooked.meshletBounds = std::move(batch.bounds);
+				}
+				if (inSettings.compress)
+				{
+					MeshCodec::Encode(inMeshes[i], cooked.meshletData, cooked.meshlets, cooked.meshletBounds, inSettings.codecSettings, cooked.encoded);
+				}
+			}
+		});
+
+	// place sections after headers
+	cursor = sizeof(FileHeader) + sizeof(MeshHeader) * meshHeaders.size();
+	for (size_t i = 0; i < cookedMeshes.size(); ++i)
+	{
+		const CookedMesh& cooked = cookedMeshes[i];
+		const StaticMeshStreams& mesh = *cooked.pSource;
+		MeshHeader& header = meshHeaders[i];
+
+		CHECK_TRUE(!mesh.HasAttribute(VertexAttribute::NORMAL) || mesh.normals.size() == mesh.positions.size(), "Normal stream doesn't match positions!");
+		CHECK_TRUE(!mesh.HasAttribute(VertexAttribute::UV) || mesh.uvs.size() == mesh.positions.size(), "UV stream doesn't match positions!");
+		header.attributeMask = mesh.attributeMask;
+		if (inSettings.compress)
+		{
+			header.flags = MESH_FLAG_COMPRESSED;
+			header.codec = cooked.encoded.header;
+			for (size_t k = 0; k < SECTION_COUNT; ++k)
+			{
+				header.sectionSizes[k] = cooked.encoded.streams[k].size();
+			}
+		}
+		else
+		{
+			header.sectionSizes[SECTION_POSITION] = mesh.positions.size() * sizeof(glm::vec3);
+			header.sectionSizes[SECTION_NORMAL] = mesh.HasAttribute(VertexAttribute::NORMAL) ? mesh.normals.size() * sizeof(glm::vec3) : 0;
+			header.sectionSizes[SECTION_UV] = mesh.HasAttribute(VertexAttribute::UV) ? mesh.uvs.size() * sizeof(glm::vec2) : 0;
+			header.sectionSizes[SECTION_INDEX] = mesh.indices.size() * sizeof(uint32_t);
+			header.sectionSizes[SECTION_MESHLET_VERTEX] = cooked.meshletData.meshletVertices.size() * sizeof(uint32_t);
+			header.sectionSizes[SECTION_MESHLET_INDEX] = cooked.meshletData.meshletIndices.size() * sizeof(uint8_t);
+			header.sectionSizes[SECTION_MESHLET] = cooked.meshlets.size() * sizeof(Meshlet::DeviceDataRef);
+			header.sectionSizes[SECTION_MESHLET_BOUNDS] = cooked.meshletBounds.size() * sizeof(MeshletBounds);
+		}
+		for (size_t k = 0; k < SECTION_COUNT; ++k)
+		{
+			cursor = common_utils::AlignUp(cursor, LVMESH_SECTION_ALIGNMENT);
+			header.sectionOffsets[k] = cursor;
+			cursor += header.sectionSizes[k];
+		}
+	}
+
+	// fill the whole file and write it at once
+	fileHeader.magic = LVMESH_MAGIC;
+	fileHeader.version = LVMESH_VERSION;
+	fileHeader.meshCount = static_cast<uint32_t>(meshHeaders.size());
+	fileHeader.settingsHash = HashCookSettings(inSettings);
+	if (!inSourceFilePath.empty() && !_GetFileStamp(inSourceFilePath, fileHeader.sourceSize, fileHeader.sourceWriteTime))
+	{
+		return false;
+	}
+	bytes.resize(cursor, 0);
+	memcpy(bytes.data(), &fileHeader, sizeof(FileHeader));
+	if (!meshHeaders.empty())
+	{
+		memcpy(bytes.data() + sizeof(FileHeader), meshHeaders.data(), sizeof(MeshHeader) * meshHeaders.size());
+	}
+	for (size_t i = 0; i < cookedMeshes.size(); ++i)
+	{
+		const CookedMesh& cooked = cookedMeshes[i];
+		const StaticMeshStreams& mesh = *cooked.pSource;
+		const MeshHeader& header = meshHeaders[i];
+		std::array<const void*, SECTION_COUNT> sources = {
+			mesh.positions.data(),
+			mesh.normals.data(),
+			mesh.uvs.data(),
+			mesh.indices.data(),
+			cooked.meshletData.meshletVertices.data(),
+			cooked.meshletData.meshletIndices.data(),
+			cooked.meshlets.data(),
+			cooked.meshletBounds.data() };
+
+		if (inSettings.compress)
+		{
+			for (size_t k = 0; k < SECTION_COUNT; ++k)
+			{
+				sources[k] = cooked.encoded.streams[k].data();
+			}
+		}
+
+		for (size_t k = 0; k < SECTION_COUNT; ++k)
+		{
+			if (header.sectionSizes[k] == 0) continue;
+			memcpy(bytes.data() + header.sectionOffsets[k], sources[k], header.sectionSizes[k]);
+		}
+	}
+
+	return common_utils::WriteFile(inMeshFilePath, bytes.data(), bytes.size());
+}
+
+bool MeshFile::CookObj(
+	const std::string& inObjFilePath,
+	const std::string& inMeshFilePath,
+	const CookSettings& inSettings)
+{
+	std::vector<StaticMeshStreams> meshes;
+
+	if (!MeshUtility::LoadParallel(inObjFilePath, meshes)) return false;
+
+	return _Cook(meshes, inMeshFilePath, inSettings, inObjFilePath);
+}
+
+bool MeshFile::Open(const std::string& inMeshFilePath)
+{
+	const uint8_t* pData = nullptr;
+	size_t fileSize = 0;
+	FileHeader fileHeader{};
+
+	Close();
+	if (!m_file.Open(inMeshFilePath)) return false;
+
+	pData = m_file.GetData();
+	fileSize = m_file.GetSize();
+	if (fileSize < sizeof(FileHeader))
+	{
+		Close();
+		return false;
+	}
+
+	memcpy(&fileHeader, pData, sizeof(FileHeader));
+	if (fileHeader.magic != LVMESH_MAGIC || fileHeader.version != LVMESH_VERSION)
+	{
+		Close();
+		return false;
+	}
+	if (sizeof(FileHeader) + static_cast<size_t>(fileHeader.meshCount) * sizeof(MeshHeader) > fileSize)
+	{
+		Close();
+		return false;
+	}
+
+	std::vector<MeshHeader> headers(fileHeader.meshCount);
+
+	m_settingsHash = fileHeader.settingsHash;
+	m_sourceSize = fileHeader.sourceSize;
+	m_sourceWriteTime = fileHeader.sourceWriteTime;
+
+	for (uint32_t i = 0; i < fileHeader.meshCount; ++i)
+	{
+		MeshHeader& header = headers[i];
+
+		memcpy(&header, pData + sizeof(FileHeader) + i * sizeof(MeshHeader), sizeof(MeshHeader));
+		for (size_t k = 0; k < SECTION_COUNT; ++k)
+		{
+			if (header.sectionOffsets[k] % LVMESH_SECTION_ALIGNMENT != 0
+				|| header.sectionOffsets[k] > fileSize
+				|| header.sectionSizes[k] > fileSize - header.sectionOffsets[k])
+			{
+				Close();
+				return false;
+			}
+		}
+	}
+
+	// compressed sections are only viewed, they are decoded when read
+	m_meshes.resize(fileHeader.meshCount);
+	for (uint32_t i = 0; i < fileHeader.meshCount; ++i)
+	{
+		std::array<std::span<const uint8_t>, SECTION_COUNT> sections{};
+		MeshView& view = m_meshes[i];
+
+		for (size_t k = 0; k < SECTION_COUNT; ++k)
+		{
+			sections[k] = std::span<const uint8_t>(pData + headers[i].sectionOffsets[k], static_cast<size_t>(headers[i].sectionSizes[k]));
+		}
+		view.attributeMask = headers[i].attributeMask;
+		view.compressed = (headers[i].flags & MESH_FLAG_COMPRESSED) != 0;
+		view.sections = sections;
+		if (view.compressed)
+		{
+			view.codec = headers[i].codec;
+			continue;
+		}
+		view.positions = _GetSection<glm::vec3>(sections[SECTION_POSITION]);
+		view.normals = _GetSection<glm::vec3>(sections[SECTION_NORMAL]);
+		view.uvs = _GetSection<glm::vec2>(sections[SECTION_UV]);
+		view.indices = _GetSection<uint32_t>(sections[SECTION_INDEX]);
+		view.meshletVertices = _GetSection<uint32_t>(sections[SECTION_MESHLET_VERTEX]);
+		view.meshletIndices = _GetSection<uint8_t>(sections[SECTION_MESHLET_INDEX]);
+		view.meshlets = _GetSection<Meshlet::DeviceDataRef>(sections[SECTION_MESHLET]);
+		view.meshletBounds = _GetSection<MeshletBounds>(sections[SECTION_MESHLET_BOUNDS]);
+	}
+
+	for (const auto& view : m_meshes)
+	{
+		const size_t vertexCount = view.GetSectionSize(MeshCodec::STREAM_POSITION) / sizeof(glm::vec3);
+
+		if ((view.HasAttribute(VertexAttribute::NORMAL) && view.GetSectionSize(MeshCodec::STREAM_NORMAL) != vertexCount * sizeof(glm::vec3))
+			|| (view.HasAttribute(VertexAttribute::UV) && view.GetSectionSize(MeshCodec::STREAM_UV) != vertexCount * sizeof(glm::vec2))
+			|| view.GetSectionSize(MeshCodec::STREAM_MESHLET) / sizeof(Meshlet::DeviceDataRef) != view.GetSectionSize(MeshCodec::STREAM_MESHLET_BOUNDS) / sizeof(MeshletBounds))
+		{
+			Close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool MeshFile::OpenOrCookObj(
+	const std::string& inObjFilePath,
+	const std::string& inMeshFilePath,
+	const CookSettings& inSettings)
+{
+	if (Open(inMeshFilePath) && _IsCookedFrom(inSettings, inObjFilePath)) return true;
+	Close();
+	if (!CookObj(inObjFilePath, inMeshFilePath, inSettings)) return false;
+
+	return Open(inMeshFilePath);
+}
+
+bool MeshFile::LoadObjCooked(
+	const std::string& inObjFilePath,
+	std::vector<StaticMesh>& outMeshes,
+	const CookSettings& inSettings)
+{
+	MeshFile meshFile{};
+	std::string meshFilePath = inObjFilePath;
+	size_t extensionPos = meshFilePath.find_last_of('.');
+
+	if (extensionPos != std::string::npos && meshFilePath.find_first_of("/\\", extensionPos) == std::string::npos)
+	{
+		meshFilePath.resize(extensionPos);
+	}
+	meshFilePath += ".lvmesh";
+	if (!meshFile.OpenOrCookObj(inObjFilePath, meshFilePath, inSettings)) return false;
+
+	return meshFile.GetStaticMeshes(outMeshes);
+}
+
+void MeshFile::Close()
+{
+	m_meshes.clear();
+	m_settingsHash = 0;
+	m_sourceSize = 0;
+	m_sourceWriteTime = 0;
+	m_file.Close();
+}
+
+bool MeshFile::_IsCookedFrom(const CookSettings& inSettings, const std::string& inSourceFilePath) const
+{
+	uint64_t sourceSize = 0;
+	int64_t sourceWriteTime = 0;
+
+	if (m_settingsHash != HashCookSettings(inSettings)) return false;
+	if (!_GetFileStamp(inSourceFilePath, sourceSize, sourceWriteTime)) return true;
+
+	return sourceSize == m_sourceSize && sourceWriteTime == m_sourceWriteTime;
+}
+
+uint32_t MeshFile::GetMeshCount() const
+{
+	return static_cast<uint32_t>(m_meshes.size());
+}
+
+const MeshFile::MeshView& MeshFile::GetMesh(uint32_t inIndex) const
+{
+	CHECK_TRUE(inIndex < m_meshes.size(), "Mesh index is out of range!");
+	return m_meshes[inIndex];
+}
+
+bool MeshFile::GetStaticMeshes(std::vector<StaticMesh>& outMeshes) const
+{
+	const size_t firstMesh = outMeshes.size();
+	std::atomic<bool> readFailed = false;
+
+	// decoding is the expensive part, one task for each mesh
+	outMeshes.resize(firstMesh + m_meshes.size());
+	MyTaskScheduler::GetInstance().ParallelFor(static_cast<uint32_t>(m_meshes.size()), 1, [&](uint32_t inBegin, uint32_t inEnd, uint32_t inThreadIndex)
+		{
+			StaticMeshStreams streams{};
+
+			for (uint32_t i = inBegin; i < inEnd; ++i)
+			{
+				if (!m_meshes[i].GetStreams(streams))
+				{
+					readFailed = true;
+					continue;
+				}
+				streams.ToStaticMesh(outMeshes[firstMesh + i]);
+			}
+		});
+	if (readFailed)
+	{
+		outMeshes.resize(firstMesh);
+		return false;
+	}
+
+	return true;
+}
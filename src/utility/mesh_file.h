@@ -0,0 +1,127 @@
+#pragma once
+#include "common.h"
+#include "geometry.h"
+#include "utils.h"
+#include "my_mesh_optimizer.h"
+#include "mesh_codec.h"
+#include <span>
+#define LVMESH_MAGIC 0x534D564Cu // "LVMS"
+#define LVMESH_VERSION 4
+#define LVMESH_SECTION_ALIGNMENT 16 // byte alignment of every section in file
+
+// Cooked mesh file (.lvmesh), stores meshes that are ready to upload:
+// optimized vertex streams and indices, meshlets and their bounds.
+// The file is memory mapped when opened and meshes are viewed in place,
+// so each section of raw meshes can be passed to Buffer::CopyFromHost directly.
+// Sections of compressed meshes (see MeshCodec) stay encoded in the file and are decoded on read,
+// e.g. by MeshView::ReadSection in Buffer::WriteFromHost, straight into mapped memory.
+// Cook it once from .obj or any StaticMeshStreams, then open it instead of parsing source files
+class MeshFile
+{
+public:
+	struct CookSettings
+	{
+		bool buildMeshlets = true;
+		uint32_t maxMeshletVertexCount = 64;
+		uint32_t maxMeshletTriangleCount = 124;
+		uint32_t minMeshletTriangleCount = 0;	// FLEX and SPATIAL meshlets only, 0 means maxMeshletTriangleCount
+		MeshOptimizer::MeshletBuildMode meshletBuildMode = MeshOptimizer::MeshletBuildMode::DEFAULT;
+		float meshletConeWeight = 0.25f;	// see MeshOptimizer::MeshletBuildSettings::coneWeight, cones are used for backface culling in task shader
+		bool compress = false;				// encode sections with MeshCodec, meshlets and bounds are built before positions are quantized,
+											// off by default so the file can be viewed in place, apps turn it on to read less from disk
+		MeshCodec::Settings codecSettings;
+	};
+
+	// Mesh viewed in the mapped file, valid until the file is closed,
+	// typed spans are empty for compressed meshes, read their sections with ReadSection
+	struct MeshView
+	{
+		uint32_t attributeMask = 0;					// see VertexAttribute
+		bool compressed = false;
+		MeshCodec::Header codec{};					// valid if compressed
+		std::array<std::span<const uint8_t>, MeshCodec::STREAM_COUNT> sections{}; // raw or encoded bytes in the file
+		std::span<const glm::vec3> positions;
+		std::span<const glm::vec3> normals;			// empty if attributeMask doesn't have VertexAttribute::NORMAL
+		std::span<const glm::vec2> uvs;				// empty if attributeMask doesn't have VertexAttribute::UV
+		std::span<const uint32_t> indices;
+		std::span<const uint32_t> meshletVertices;	// Meshlet::DeviceData::meshletVertices
+		std::span<const uint8_t> meshletIndices;	// Meshlet::DeviceData::meshletIndices
+		std::span<const Meshlet::DeviceDataRef> meshlets;
+		std::span<const MeshletBounds> meshletBounds;
+
+		bool HasAttribute(VertexAttribute _attribute) const { return (attributeMask & static_cast<uint32_t>(_attribute)) != 0; }
+
+		// Bytes of the section once decoded, 0 if the mesh doesn't have it
+		size_t GetSectionSize(MeshCodec::Stream _section) const;
+
+		// Write the decoded section to _outData that has room for GetSectionSize bytes,
+		// return false if the encoded data is broken
+		bool ReadSection(MeshCodec::Stream _section, void* _outData) const;
+
+		// Copy or decode vertex streams and indices out of the file, return false if the encoded data is broken
+		bool GetStreams(StaticMeshStreams& _outMesh) const;
+	};
+
+private:
+	common_utils::MappedFile m_file;
+	uint64_t m_settingsHash = 0;	// HashCookSettings of the settings the file is cooked with
+	uint64_t m_sourceSize = 0;		// size of the source file in bytes, 0 if not cooked from a file
+	int64_t m_sourceWriteTime = 0;	// last write time of the source file
+	std::vector<MeshView> m_meshes;
+
+	static bool _Cook(
+		std::span<const StaticMeshStreams> inMeshes,
+		const std::string& inMeshFilePath,
+		const CookSettings& inSettings,
+		const std::string& inSourceFilePath);
+
+	// Whether the opened file is cooked with inSettings from the current inSourceFilePath,
+	// source is not checked if it doesn't exist
+	bool _IsCookedFrom(const CookSettings& inSettings, const std::string& inSourceFilePath) const;
+
+public:
+	// Stored in cooked files, OpenOrCookObj cooks again when it doesn't match
+	static uint64_t HashCookSettings(const CookSettings& inSettings);
+
+	// Write inMeshes as they are, so optimize them before cooking, meshlets are built if inSettings asks for them,
+	// return whether the whole file is written
+	static bool Cook(
+		std::span<const StaticMeshStreams> inMeshes,
+		const std::string& inMeshFilePath,
+		const CookSettings& inSettings);
+
+	// Load .obj with MeshUtility::LoadParallel and cook its shapes
+	static bool CookObj(
+		const std::string& inObjFilePath,
+		const std::string& inMeshFilePath,
+		const CookSettings& inSettings);
+
+	// Map the file and check every section, compressed meshes are not decoded here,
+	// return false if it's missing, from another version or broken
+	bool Open(const std::string& inMeshFilePath);
+
+	// Open inMeshFilePath, cook it from inObjFilePath first if it cannot be opened
+	// or it was cooked with other settings or from another version of the .obj
+	bool OpenOrCookObj(
+		const std::string& inObjFilePath,
+		const std::string& inMeshFilePath,
+		const CookSettings& inSettings);
+
+	// Drop-in for MeshUtility::Load, the cooked file is inObjFilePath with extension replaced by .lvmesh,
+	// it's cooked first if it cannot be opened or is stale, meshes are appended to outMeshes.
+	// Meshlets are not built by default since StaticMesh doesn't carry them
+	static bool LoadObjCooked(
+		const std::string& inObjFilePath,
+		std::vector<StaticMesh>& outMeshes,
+		const CookSettings& inSettings = CookSettings{ .buildMeshlets = false, .compress = true });
+
+	void Close();
+
+	uint32_t GetMeshCount() const;
+
+	const MeshView& GetMesh(uint32_t inIndex) const;
+
+	// Convert meshes to Vertex form and append them to outMeshes, compressed meshes are decoded on worker threads,
+	// return false if the encoded data is broken
+	bool GetStaticMeshes(std::vector<StaticMesh>& outMeshes) const;
+};
@@ -1,109 +1,344 @@
 #include "my_mesh_optimizer.h"
 #include "utils.h"
+#include <unordered_set>
+#include <unordered_map>
+
+namespace
+{
+	// Closest point on triangle abc to p, from Real-Time Collision Detection 5.1.5,
+	// returns barycentric coordinates of the point
+	glm::vec3 _ClosestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+	{
+		glm::vec3 ab = b - a;
+		glm::vec3 ac = c - a;
+		glm::vec3 ap = p - a;
+		float d1 = glm::dot(ab, ap);
+		float d2 = glm::dot(ac, ap);
+		if (d1 <= 0.0f && d2 <= 0.0f) return glm::vec3(1.0f, 0.0f, 0.0f);
+
+		glm::vec3 bp = p - b;
+		float d3 = glm::dot(ab, bp);
+		float d4 = glm::dot(ac, bp);
+		if (d3 >= 0.0f && d4 <= d3) return glm::vec3(0.0f, 1.0f, 0.0f);
+
+		float vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+		{
+			float v = d1 / (d1 - d3);
+			return glm::vec3(1.0f - v, v, 0.0f);
+		}
+
+		glm::vec3 cp = p - c;
+		float d5 = glm::dot(ab, cp);
+		float d6 = glm::dot(ac, cp);
+		if (d6 >= 0.0f && d5 <= d6) return glm::vec3(0.0f, 0.0f, 1.0f);
+
+		float vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+		{
+			float w = d2 / (d2 - d6);
+			return glm::vec3(1.0f - w, 0.0f, w);
+		}
+
+		float va = d3 * d6 - d5 * d4;
+		if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+		{
+			float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+			return glm::vec3(0.0f, 1.0f - w, w);
+		}
+
+		// degenerate triangle falls back to its first vertex
+		float denom = va + vb + vc;
+		if (denom <= 0.0f) return glm::vec3(1.0f, 0.0f, 0.0f);
+
+		float v = vb / denom;
+		float w = vc / denom;
+		return glm::vec3(1.0f - v - w, v, w);
+	}
+}
 
 void MeshOptimizer::_LockBoundary(
-	const std::vector<Vertex>& _vertex, 
+	const float* _position,
+	size_t _vertexCount,
+	size_t _stride,
 	const std::vector<uint32_t>& _index, 
 	std::vector<uint8_t>& _locks) const
 {
-	std::vector<uint32_t> remap(_vertex.size());
-	std::set<std::pair<uint32_t, uint32_t>> halfEdges;
-	std::set<uint32_t> shouldLock;
+	// half edge from -> to is packed as from in high 32 bits, to in low 32 bits
+	auto funcPackEdge = [](uint32_t from, uint32_t to) { return (static_cast<uint64_t>(from) << 32) | to; };
+	std::vector<uint32_t> remap(_vertexCount);
+	std::unordered_set<uint64_t> halfEdges;
+	std::vector<uint8_t> shouldLock(_vertexCount, 0u); // indexed by remapped vertex
 
-	meshopt_generatePositionRemap(remap.data(), reinterpret_cast<const float*>(_vertex.data()), _vertex.size(), sizeof(Vertex));
-	_locks.resize(_vertex.size(), 0u);
+	meshopt_generatePositionRemap(remap.data(), _position, _vertexCount, _stride);
+	_locks.resize(_vertexCount, 0u);
 	
 	CHECK_TRUE(_index.size() % 3 == 0, "Not a triangle based mesh!");
+	halfEdges.reserve(_index.size());
 	for (size_t offset = 0; offset < _index.size(); offset += 3)
 	{
 		uint32_t v0 = remap[_index[offset]];
 		uint32_t v1 = remap[_index[offset + 1]];
 		uint32_t v2 = remap[_index[offset + 2]];
 
-		halfEdges.insert({ v0, v1 });
-		halfEdges.insert({ v1, v2 });
-		halfEdges.insert({ v2, v0 });
+		halfEdges.insert(funcPackEdge(v0, v1));
+		halfEdges.insert(funcPackEdge(v1, v2));
+		halfEdges.insert(funcPackEdge(v2, v0));
 	}
 
-	for (const auto& item : halfEdges)
+	for (uint64_t edge : halfEdges)
 	{
+		uint32_t from = static_cast<uint32_t>(edge >> 32);
+		uint32_t to = static_cast<uint32_t>(edge);
+
 		// single edge
-		if (halfEdges.find({ item.second, item.first }) == halfEdges.end())
+		if (halfEdges.find(funcPackEdge(to, from)) == halfEdges.end())
 		{
-			shouldLock.insert(item.first);
-			shouldLock.insert(item.second);
+			shouldLock[from] = 1u;
+			shouldLock[to] = 1u;
 		}
 	}
 
-	for (size_t i = 0; i < _vertex.size(); ++i)
+	for (size_t i = 0; i < _vertexCount; ++i)
 	{
-		uint32_t mapped = remap[i];
-		if (shouldLock.find(mapped) != shouldLock.end())
+		if (shouldLock[remap[i]] != 0u)
 		{
 			_locks[i] |= meshopt_SimplifyVertex_Lock;
 		}
 	}
 }
 
-void MeshOptimizer::BuildMeshlets(
-	const std::vector<Vertex>& _vertex, 
-	const std::vector<uint32_t>& _index, 
+void MeshOptimizer::_BuildMeshlets(
+	const float* _position,
+	size_t _vertexCount,
+	size_t _stride,
+	std::span<const uint32_t> _index, 
+	const MeshletBuildSettings& _settings,
 	Meshlet::DeviceData& _outMeshletData, 
 	std::vector<Meshlet::DeviceDataRef>& _outMeshlet,
-	size_t _maxPrimitiveCount, // must be divisible by 4
-	size_t _maxIndexCount) const
+	std::vector<MeshletBounds>* _outBoundsPtr) const
 {
-	std::vector<Meshlet::DeviceDataRef> outMeshlets{};
-	std::vector<uint32_t> outMeshletVertices{};
-	std::vector<uint8_t> outMeshletTriangles{};
-	std::vector<meshopt_Meshlet> meshoptMeshlets{};
-	const float coneWeight = 0.0f;
-	size_t maxMeshlets = meshopt_buildMeshletsBound(_index.size(), _maxIndexCount, _maxPrimitiveCount);
+	// worst case buffers of meshopt_buildMeshlets, they only grow so later calls on the thread don't allocate
+	struct MeshletScratch
+	{
+		std::vector<meshopt_Meshlet> meshlets;
+		std::vector<uint32_t> vertices;
+		std::vector<uint8_t> triangles;
+	};
+	thread_local MeshletScratch scratch{};
+	const size_t vertexBase = _outMeshletData.meshletVertices.size();
+	const size_t indexBase = _outMeshletData.meshletIndices.size();
+	const size_t minPrimitiveCount = 
+		(_settings.mode == MeshletBuildMode::DEFAULT || _settings.minPrimitiveCount == 0) ? _settings.maxPrimitiveCount : _settings.minPrimitiveCount;
+	// meshlets can be as small as minPrimitiveCount, so bound has to count on it
+	size_t maxMeshlets = meshopt_buildMeshletsBound(_index.size(), _settings.maxIndexCount, minPrimitiveCount);
 	size_t meshletCount = 0;
 
-	meshoptMeshlets.resize(maxMeshlets, meshopt_Meshlet{});
-	outMeshletVertices.resize(maxMeshlets * _maxIndexCount, 0);
-	outMeshletTriangles.resize(maxMeshlets * _maxPrimitiveCount * 3, 0);
+	CHECK_TRUE(minPrimitiveCount <= _settings.maxPrimitiveCount, "Min triangle count of meshlets is larger than max!");
+	if (_index.empty()) return;
 
-	meshletCount = meshopt_buildMeshlets(
-		meshoptMeshlets.data(),
-		static_cast<unsigned int*>(outMeshletVertices.data()),
-		static_cast<unsigned char*>(outMeshletTriangles.data()),
-		_index.data(),
-		_index.size(),
-		reinterpret_cast<const float*>(_vertex.data()),
-		_vertex.size(),
-		sizeof(Vertex),
-		_maxIndexCount,
-		_maxPrimitiveCount,
-		coneWeight);
+	if (scratch.meshlets.size() < maxMeshlets)
+	{
+		scratch.meshlets.resize(maxMeshlets);
+	}
+	if (scratch.vertices.size() < maxMeshlets * _settings.maxIndexCount)
+	{
+		scratch.vertices.resize(maxMeshlets * _settings.maxIndexCount);
+	}
+	if (scratch.triangles.size() < maxMeshlets * _settings.maxPrimitiveCount * 3)
+	{
+		scratch.triangles.resize(maxMeshlets * _settings.maxPrimitiveCount * 3);
+	}
 
-	meshoptMeshlets.resize(meshletCount);
-	outMeshletVertices.resize(meshoptMeshlets.back().vertex_offset + meshoptMeshlets.back().vertex_count);
-	// This expression is performing an operation that ensures the result is rounded up to the next multiple of 4.
-	//outMeshletTriangles.resize(meshoptMeshlets.back().triangle_offset + ((meshoptMeshlets.back().triangle_count * 3 + 3) & ~3));
-	outMeshletTriangles.resize(meshoptMeshlets.back().triangle_offset + meshoptMeshlets.back().triangle_count * 3);
+	switch (_settings.mode)
+	{
+	case MeshletBuildMode::FLEX:
+		meshletCount = meshopt_buildMeshletsFlex(
+			scratch.meshlets.data(),
+			static_cast<unsigned int*>(scratch.vertices.data()),
+			static_cast<unsigned char*>(scratch.triangles.data()),
+			_index.data(),
+			_index.size(),
+			_position,
+			_vertexCount,
+			_stride,
+			_settings.maxIndexCount,
+			minPrimitiveCount,
+			_settings.maxPrimitiveCount,
+			_settings.coneWeight,
+			_settings.splitFactor);
+		break;
+	case MeshletBuildMode::SPATIAL:
+		meshletCount = meshopt_buildMeshletsSpatial(
+			scratch.meshlets.data(),
+			static_cast<unsigned int*>(scratch.vertices.data()),
+			static_cast<unsigned char*>(scratch.triangles.data()),
+			_index.data(),
+			_index.size(),
+			_position,
+			_vertexCount,
+			_stride,
+			_settings.maxIndexCount,
+			minPrimitiveCount,
+			_settings.maxPrimitiveCount,
+			_settings.fillWeight);
+		break;
+	default:
+		meshletCount = meshopt_buildMeshlets(
+			scratch.meshlets.data(),
+			static_cast<unsigned int*>(scratch.vertices.data()),
+			static_cast<unsigned char*>(scratch.triangles.data()),
+			_index.data(),
+			_index.size(),
+			_position,
+			_vertexCount,
+			_stride,
+			_settings.maxIndexCount,
+			_settings.maxPrimitiveCount,
+			_settings.coneWeight);
+		break;
+	}
+	if (meshletCount == 0) return;
+
+	const meshopt_Meshlet& lastMeshlet = scratch.meshlets[meshletCount - 1];
+	const size_t vertexCount = lastMeshlet.vertex_offset + lastMeshlet.vertex_count;
+	const size_t triangleByteCount = lastMeshlet.triangle_offset + lastMeshlet.triangle_count * 3;
+
+	_outMeshlet.reserve(_outMeshlet.size() + meshletCount);
+	if (_outBoundsPtr != nullptr)
+	{
+		_outBoundsPtr->reserve(_outBoundsPtr->size() + meshletCount);
+	}
 
-	// further optimize meshlets
-	for (const auto& m : meshoptMeshlets)
+	// further optimize meshlets, bounds are computed from optimized meshlets while they are still in cache
+	for (size_t i = 0; i < meshletCount; ++i)
 	{
+		const meshopt_Meshlet& m = scratch.meshlets[i];
 		Meshlet::DeviceDataRef outMeshlet{};
 
 		outMeshlet.triangleCount = m.triangle_count;
-		outMeshlet.indexOffset = m.triangle_offset + _outMeshletData.meshletIndices.size();
+		outMeshlet.indexOffset = m.triangle_offset + indexBase;
 		outMeshlet.vertexCount = m.vertex_count;
-		outMeshlet.vertexOffset = m.vertex_offset + _outMeshletData.meshletVertices.size();
+		outMeshlet.vertexOffset = m.vertex_offset + vertexBase;
 		meshopt_optimizeMeshlet(
-			static_cast<unsigned int*>(&outMeshletVertices[m.vertex_offset]),
-			static_cast<unsigned char*>(&outMeshletTriangles[m.triangle_offset]),
+			static_cast<unsigned int*>(&scratch.vertices[m.vertex_offset]),
+			static_cast<unsigned char*>(&scratch.triangles[m.triangle_offset]),
 			m.triangle_count,
 			m.vertex_count);
-		outMeshlets.push_back(outMeshlet);
+		_outMeshlet.push_back(outMeshlet);
+
+		if (_outBoundsPtr != nullptr)
+		{
+			meshopt_Bounds bounds = meshopt_computeMeshletBounds(
+				&scratch.vertices[m.vertex_offset],
+				&scratch.triangles[m.triangle_offset],
+				m.triangle_count,
+				_position,
+				_vertexCount,
+				_stride);
+			_outBoundsPtr->push_back(_ConvertBounds(bounds));
+		}
+	}
+
+	_outMeshletData.meshletVertices.insert(_outMeshletData.meshletVertices.end(), scratch.vertices.begin(), scratch.vertices.begin() + vertexCount);
+	_outMeshletData.meshletIndices.insert(_outMeshletData.meshletIndices.end(), scratch.triangles.begin(), scratch.triangles.begin() + triangleByteCount);
+}
+
+void MeshOptimizer::_BuildMeshletsBatch(
+	const float* _position,
+	size_t _vertexCount,
+	size_t _stride,
+	std::span<const std::span<const uint32_t>> _indexRanges,
+	const MeshletBuildSettings& _settings,
+	MeshletBatch& _outBatch) const
+{
+	size_t indexCount = 0;
+
+	_outBatch.data.meshletVertices.clear();
+	_outBatch.data.meshletIndices.clear();
+	_outBatch.meshlets.clear();
+	_outBatch.bounds.clear();
+	_outBatch.rangeFirstMeshlet.clear();
+
+	// a meshlet has at least one triangle, so index count gives the upper bound of everything
+	for (const auto& range : _indexRanges)
+	{
+		indexCount += range.size();
+	}
+	_outBatch.data.meshletVertices.reserve(indexCount);
+	_outBatch.data.meshletIndices.reserve(indexCount);
+	_outBatch.rangeFirstMeshlet.reserve(_indexRanges.size() + 1);
+
+	for (const auto& range : _indexRanges)
+	{
+		_outBatch.rangeFirstMeshlet.push_back(static_cast<uint32_t>(_outBatch.meshlets.size()));
+		_BuildMeshlets(_position, _vertexCount, _stride, range, _settings, _outBatch.data, _outBatch.meshlets, &_outBatch.bounds);
 	}
+	_outBatch.rangeFirstMeshlet.push_back(static_cast<uint32_t>(_outBatch.meshlets.size()));
+}
+
+void MeshOptimizer::BuildMeshletsBatch(
+	const std::vector<Vertex>& _vertex,
+	std::span<const std::span<const uint32_t>> _indexRanges,
+	const MeshletBuildSettings& _settings,
+	MeshletBatch& _outBatch) const
+{
+	_BuildMeshletsBatch(reinterpret_cast<const float*>(_vertex.data()), _vertex.size(), sizeof(Vertex), _indexRanges, _settings, _outBatch);
+}
+
+void MeshOptimizer::BuildMeshletsBatch(
+	const std::vector<glm::vec3>& _position,
+	std::span<const std::span<const uint32_t>> _indexRanges,
+	const MeshletBuildSettings& _settings,
+	MeshletBatch& _outBatch) const
+{
+	_BuildMeshletsBatch(reinterpret_cast<const float*>(_position.data()), _position.size(), sizeof(glm::vec3), _indexRanges, _settings, _outBatch);
+}
+
+void MeshOptimizer::BuildMeshlets(
+	const std::vector<Vertex>& _vertex, 
+	const std::vector<uint32_t>& _index, 
+	Meshlet::DeviceData& _outMeshletData, 
+	std::vector<Meshlet::DeviceDataRef>& _outMeshlet,
+	size_t _maxPrimitiveCount,
+	size_t _maxIndexCount) const
+{
+	MeshletBuildSettings settings{};
+
+	settings.maxPrimitiveCount = _maxPrimitiveCount;
+	settings.maxIndexCount = _maxIndexCount;
+	_BuildMeshlets(
+		reinterpret_cast<const float*>(_vertex.data()),
+		_vertex.size(),
+		sizeof(Vertex),
+		_index,
+		settings,
+		_outMeshletData,
+		_outMeshlet,
+		nullptr);
+}
 
-	_outMeshletData.meshletVertices.insert(_outMeshletData.meshletVertices.end(), outMeshletVertices.begin(), outMeshletVertices.end());
-	_outMeshletData.meshletIndices.insert(_outMeshletData.meshletIndices.end(), outMeshletTriangles.begin(), outMeshletTriangles.end());
-	_outMeshlet.insert(_outMeshlet.end(), outMeshlets.begin(), outMeshlets.end());
+void MeshOptimizer::BuildMeshlets(
+	const std::vector<glm::vec3>& _position,
+	const std::vector<uint32_t>& _index,
+	Meshlet::DeviceData& _outMeshletData,
+	std::vector<Meshlet::DeviceDataRef>& _outMeshlet,
+	size_t _maxPrimitiveCount,
+	size_t _maxIndexCount) const
+{
+	MeshletBuildSettings settings{};
+
+	settings.maxPrimitiveCount = _maxPrimitiveCount;
+	settings.maxIndexCount = _maxIndexCount;
+	_BuildMeshlets(
+		reinterpret_cast<const float*>(_position.data()),
+		_position.size(),
+		sizeof(glm::vec3),
+		_index,
+		settings,
+		_outMeshletData,
+		_outMeshlet,
+		nullptr);
 }
 
 void MeshOptimizer::BuildMeshlets(
@@ -123,8 +358,10 @@ void MeshOptimizer::BuildMeshlets(
 	}
 }
 
-float MeshOptimizer::SimplifyMesh(
-	const std::vector<Vertex>& inVertices, 
+float MeshOptimizer::_SimplifyMesh(
+	const float* _position,
+	size_t _vertexCount,
+	size_t _stride,
 	const std::vector<uint32_t>& inIndices, 
 	size_t inTargetIndexCount, 
 	std::vector<uint32_t>& inoutIndices) const
@@ -140,17 +377,17 @@ float MeshOptimizer::SimplifyMesh(
 		srcIndex.data(),
 		inIndices.data(),
 		inIndices.size(),
-		inVertices.data(),
-		inVertices.size(),
+		_position,
+		_vertexCount,
 		sizeof(glm::vec3),
-		sizeof(Vertex));
+		_stride);
 	newIndexSize = meshopt_simplify(
 		dstIndex.data(),
 		srcIndex.data(),
 		srcIndex.size(),
-		reinterpret_cast<const float*>(inVertices.data()),
-		inVertices.size(),
-		sizeof(Vertex),
+		_position,
+		_vertexCount,
+		_stride,
 		inTargetIndexCount,
 		FLT_MAX,
 		meshopt_SimplifyLockBorder | meshopt_SimplifyPermissive | meshopt_SimplifyErrorAbsolute | meshopt_SimplifySparse,
@@ -172,13 +409,13 @@ float MeshOptimizer::SimplifyMesh(
 		dstIndex = srcIndex;
 		subVertex.resize(dstIndex.size());
 		subLock.resize(dstIndex.size());
-		_LockBoundary(inVertices, srcIndex, lock);
+		_LockBoundary(_position, _vertexCount, _stride, srcIndex, lock);
 
 		for (size_t i = 0; i < dstIndex.size(); ++i)
 		{
 			uint32_t vId = dstIndex[i];
 
-			subVertex[i].pos = inVertices[vId].position;
+			memcpy(&subVertex[i].pos, reinterpret_cast<const uint8_t*>(_position) + vId * _stride, sizeof(glm::vec3));
 			subVertex[i].id = vId;
 
 			dstIndex[i] = static_cast<uint32_t>(i);
@@ -213,59 +450,60 @@ float MeshOptimizer::SimplifyMesh(
 }
 
 float MeshOptimizer::SimplifyMesh(
-	const std::vector<Vertex>& _vertex, 
-	const std::vector<uint32_t>& _index, 
-	size_t _targetIndexCount, 
-	std::vector<Vertex>& _outVertex, 
-	std::vector<uint32_t>& _outIndex) const
+	const std::vector<Vertex>& inVertices,
+	const std::vector<uint32_t>& inIndices,
+	size_t inTargetIndexCount,
+	std::vector<uint32_t>& inoutIndices) const
 {
-	struct FlatVertex
-	{
-		std::array<float, 8> data; // position, uv, normal
-	};
-	static const float weights[5] = { 1, 1, 1, 1, 1 };
+	return _SimplifyMesh(
+		reinterpret_cast<const float*>(inVertices.data()),
+		inVertices.size(),
+		sizeof(Vertex),
+		inIndices,
+		inTargetIndexCount,
+		inoutIndices);
+}
+
+float MeshOptimizer::SimplifyMesh(
+	const std::vector<glm::vec3>& inPositions,
+	const std::vector<uint32_t>& inIndices,
+	size_t inTargetIndexCount,
+	std::vector<uint32_t>& inoutIndices) const
+{
+	return _SimplifyMesh(
+		reinterpret_cast<const float*>(inPositions.data()),
+		inPositions.size(),
+		sizeof(glm::vec3),
+		inIndices,
+		inTargetIndexCount,
+		inoutIndices);
+}
 
+float MeshOptimizer::_SimplifyMeshWithAttributes(
+	std::vector<SimplifyVertex>& _vertex,
+	const std::vector<uint32_t>& _index,
+	size_t _targetIndexCount,
+	const std::array<float, 5>& _weights,
+	std::vector<uint32_t>& _outIndex,
+	SimplifyError* _outErrorPtr) const
+{
+	const float* weights = _weights.data();
 	float error = 0;
-	std::vector<FlatVertex> srcVerts;
-	std::vector<FlatVertex> dstVerts;
+	std::vector<SimplifyVertex> dstVerts;
 	std::vector<uint32_t> dstIndex;
-	bool hasUV = _vertex[0].uv.has_value();
-	bool hasNormal = _vertex[0].normal.has_value();
 	size_t indexCount = 0;
-	uint32_t indexOffset = _outVertex.size();
-	
-	// fill inVertices into flat format
-	srcVerts.resize(_vertex.size());
-	for (size_t i = 0; i < _vertex.size(); ++i)
-	{
-		FlatVertex& mvert = srcVerts[i];
-		mvert.data[0] = _vertex[i].position.x;
-		mvert.data[1] = _vertex[i].position.y;
-		mvert.data[2] = _vertex[i].position.z;
-		if (hasUV)
-		{
-			mvert.data[3] = _vertex[i].uv.value().x;
-			mvert.data[4] = _vertex[i].uv.value().y;
-		}
-		if (hasNormal)
-		{
-			mvert.data[5] = _vertex[i].normal.value().x;
-			mvert.data[6] = _vertex[i].normal.value().y;
-			mvert.data[7] = _vertex[i].normal.value().z;
-		}
-	}
 
 	// simplify
-	dstVerts = srcVerts;
+	dstVerts = _vertex;
 	dstIndex = _index;
 	indexCount = meshopt_simplifyWithUpdate(
 		dstIndex.data(),
 		dstIndex.size(),
 		reinterpret_cast<float*>(dstVerts.data()),
 		dstVerts.size(),
-		sizeof(FlatVertex),
+		sizeof(SimplifyVertex),
 		&dstVerts[0].data[3],
-		sizeof(FlatVertex),
+		sizeof(SimplifyVertex),
 		weights,
 		5,
 		NULL,
@@ -277,16 +515,16 @@ float MeshOptimizer::SimplifyMesh(
 	if (indexCount > _targetIndexCount)
 	{
 		// try simplify more aggressively
-		dstVerts = srcVerts;
+		dstVerts = _vertex;
 		dstIndex = _index;
 		indexCount = meshopt_simplifyWithUpdate(
 			dstIndex.data(),
 			dstIndex.size(),
 			reinterpret_cast<float*>(dstVerts.data()),
 			dstVerts.size(),
-			sizeof(FlatVertex),
+			sizeof(SimplifyVertex),
 			&dstVerts[0].data[3],
-			sizeof(FlatVertex),
+			sizeof(SimplifyVertex),
 			weights,
 			5,
 			NULL,
@@ -297,21 +535,68 @@ float MeshOptimizer::SimplifyMesh(
 	}
 	dstIndex.resize(indexCount);
 
+	if (_outErrorPtr != nullptr)
+	{
+		*_outErrorPtr = _MeasureSimplifyError(_vertex, _index, dstVerts, dstIndex, _weights, error);
+	}
+
 	// reduce unused vertices
-	std::swap(dstVerts, srcVerts);
 	size_t vertCount = meshopt_optimizeVertexFetch(
-		dstVerts.data(),
+		_vertex.data(),
 		dstIndex.data(),
 		dstIndex.size(),
-		srcVerts.data(),
-		srcVerts.size(),
-		sizeof(FlatVertex));
-	dstVerts.resize(vertCount);
+		dstVerts.data(),
+		dstVerts.size(),
+		sizeof(SimplifyVertex));
+	_vertex.resize(vertCount);
+	_outIndex = std::move(dstIndex);
+
+	return error;
+}
+
+float MeshOptimizer::_SimplifyMesh(
+	const std::vector<Vertex>& _vertex, 
+	const std::vector<uint32_t>& _index, 
+	size_t _targetIndexCount, 
+	const SimplifyAttributeWeights& _weights,
+	std::vector<Vertex>& _outVertex, 
+	std::vector<uint32_t>& _outIndex,
+	SimplifyError* _outErrorPtr) const
+{
+	float error = 0;
+	std::vector<SimplifyVertex> verts;
+	std::vector<uint32_t> dstIndex;
+	bool hasUV = _vertex[0].uv.has_value();
+	bool hasNormal = _vertex[0].normal.has_value();
+	uint32_t indexOffset = _outVertex.size();
+	
+	// fill inVertices into flat format
+	verts.resize(_vertex.size());
+	for (size_t i = 0; i < _vertex.size(); ++i)
+	{
+		SimplifyVertex& mvert = verts[i];
+		mvert.data[0] = _vertex[i].position.x;
+		mvert.data[1] = _vertex[i].position.y;
+		mvert.data[2] = _vertex[i].position.z;
+		if (hasUV)
+		{
+			mvert.data[3] = _vertex[i].uv.value().x;
+			mvert.data[4] = _vertex[i].uv.value().y;
+		}
+		if (hasNormal)
+		{
+			mvert.data[5] = _vertex[i].normal.value().x;
+			mvert.data[6] = _vertex[i].normal.value().y;
+			mvert.data[7] = _vertex[i].normal.value().z;
+		}
+	}
+
+	error = _SimplifyMeshWithAttributes(verts, _index, _targetIndexCount, _GetSimplifyWeights(_weights, hasUV, hasNormal), dstIndex, _outErrorPtr);
 
-	_outVertex.reserve(_outVertex.size() + dstVerts.size());
-	for (size_t i = 0; i < dstVerts.size(); ++i)
+	_outVertex.reserve(_outVertex.size() + verts.size());
+	for (size_t i = 0; i < verts.size(); ++i)
 	{
-		const auto& flatVert = dstVerts[i];
+		const auto& flatVert = verts[i];
 		Vertex vert{};
 		vert.position = glm::vec3(flatVert.data[0], flatVert.data[1], flatVert.data[2]);
 		if (hasUV)
@@ -335,6 +620,262 @@ float MeshOptimizer::SimplifyMesh(
     return error;
 }
 
+float MeshOptimizer::_SimplifyMesh(
+	const StaticMeshStreams& inMesh,
+	const std::vector<uint32_t>& inIndices,
+	size_t inTargetIndexCount,
+	const SimplifyAttributeWeights& inWeights,
+	StaticMeshStreams& outMesh,
+	SimplifyError* outErrorPtr) const
+{
+	float error = 0;
+	std::vector<SimplifyVertex> verts;
+	std::vector<uint32_t> dstIndex;
+	bool hasUV = inMesh.HasAttribute(VertexAttribute::UV);
+	bool hasNormal = inMesh.HasAttribute(VertexAttribute::NORMAL);
+	size_t indexOffset = outMesh.GetVertexCount();
+
+	if (indexOffset == 0)
+	{
+		outMesh.attributeMask = inMesh.attributeMask;
+	}
+	CHECK_TRUE(outMesh.attributeMask == inMesh.attributeMask, "Output mesh has different attributes!");
+
+	// streams are copied without per vertex branches
+	verts.resize(inMesh.GetVertexCount());
+	for (size_t i = 0; i < verts.size(); ++i)
+	{
+		memcpy(&verts[i].data[0], &inMesh.positions[i], sizeof(glm::vec3));
+	}
+	if (hasUV)
+	{
+		for (size_t i = 0; i < verts.size(); ++i)
+		{
+			memcpy(&verts[i].data[3], &inMesh.uvs[i], sizeof(glm::vec2));
+		}
+	}
+	if (hasNormal)
+	{
+		for (size_t i = 0; i < verts.size(); ++i)
+		{
+			memcpy(&verts[i].data[5], &inMesh.normals[i], sizeof(glm::vec3));
+		}
+	}
+
+	error = _SimplifyMeshWithAttributes(verts, inIndices, inTargetIndexCount, _GetSimplifyWeights(inWeights, hasUV, hasNormal), dstIndex, outErrorPtr);
+
+	outMesh.ResizeVertices(indexOffset + verts.size());
+	for (size_t i = 0; i < verts.size(); ++i)
+	{
+		const auto& flatVert = verts[i];
+		outMesh.positions[indexOffset + i] = glm::vec3(flatVert.data[0], flatVert.data[1], flatVert.data[2]);
+		if (hasUV)
+		{
+			outMesh.uvs[indexOffset + i] = glm::vec2(flatVert.data[3], flatVert.data[4]);
+		}
+		if (hasNormal)
+		{
+			outMesh.normals[indexOffset + i] = glm::normalize(glm::vec3(flatVert.data[5], flatVert.data[6], flatVert.data[7]));
+		}
+	}
+
+	outMesh.indices.reserve(outMesh.indices.size() + dstIndex.size());
+	for (auto index : dstIndex)
+	{
+		outMesh.indices.push_back(index + static_cast<uint32_t>(indexOffset));
+	}
+
+	return error;
+}
+
+float MeshOptimizer::SimplifyMesh(
+	const std::vector<Vertex>& inVertices,
+	const std::vector<uint32_t>& inIndices,
+	size_t inTargetIndexCount,
+	std::vector<Vertex>& outVertices,
+	std::vector<uint32_t>& outIndices) const
+{
+	return _SimplifyMesh(inVertices, inIndices, inTargetIndexCount, SimplifyAttributeWeights{}, outVertices, outIndices, nullptr);
+}
+
+float MeshOptimizer::SimplifyMesh(
+	const std::vector<Vertex>& inVertices,
+	const std::vector<uint32_t>& inIndices,
+	size_t inTargetIndexCount,
+	const SimplifyAttributeWeights& inWeights,
+	std::vector<Vertex>& outVertices,
+	std::vector<uint32_t>& outIndices,
+	SimplifyError& outError) const
+{
+	return _SimplifyMesh(inVertices, inIndices, inTargetIndexCount, inWeights, outVertices, outIndices, &outError);
+}
+
+float MeshOptimizer::SimplifyMesh(
+	const StaticMeshStreams& inMesh,
+	const std::vector<uint32_t>& inIndices,
+	size_t inTargetIndexCount,
+	StaticMeshStreams& outMesh) const
+{
+	return _SimplifyMesh(inMesh, inIndices, inTargetIndexCount, SimplifyAttributeWeights{}, outMesh, nullptr);
+}
+
+float MeshOptimizer::SimplifyMesh(
+	const StaticMeshStreams& inMesh,
+	const std::vector<uint32_t>& inIndices,
+	size_t inTargetIndexCount,
+	const SimplifyAttributeWeights& inWeights,
+	StaticMeshStreams& outMesh,
+	SimplifyError& outError) const
+{
+	return _SimplifyMesh(inMesh, inIndices, inTargetIndexCount, inWeights, outMesh, &outError);
+}
+
+std::array<float, 5> MeshOptimizer::_GetSimplifyWeights(const SimplifyAttributeWeights& _weights, bool _hasUV, bool _hasNormal) const
+{
+	const float uvWeight = _hasUV ? _weights.uv : 0.0f;
+	const float normalWeight = _hasNormal ? _weights.normal : 0.0f;
+
+	return { uvWeight, uvWeight, normalWeight, normalWeight, normalWeight };
+}
+
+MeshOptimizer::SimplifyError MeshOptimizer::_MeasureSimplifyError(
+	const std::vector<SimplifyVertex>& _srcVertex,
+	const std::vector<uint32_t>& _srcIndex,
+	const std::vector<SimplifyVertex>& _dstVertex,
+	const std::vector<uint32_t>& _dstIndex,
+	const std::array<float, 5>& _weights,
+	float _searchRadius) const
+{
+	auto funcPosition = [](const SimplifyVertex& v) { return glm::vec3(v.data[0], v.data[1], v.data[2]); };
+	SimplifyError result{};
+	glm::vec3 minPos = glm::vec3(FLT_MAX);
+	glm::vec3 maxPos = glm::vec3(-FLT_MAX);
+	std::vector<uint8_t> visited(_srcVertex.size(), 0u);
+	std::unordered_map<uint64_t, std::vector<uint32_t>> cells; // triangles overlapping each cell
+	const size_t triangleCount = _dstIndex.size() / 3;
+	float cellSize = 0.0f;
+
+	if (_srcIndex.empty()) return result;
+
+	for (uint32_t index : _srcIndex)
+	{
+		minPos = glm::min(minPos, funcPosition(_srcVertex[index]));
+		maxPos = glm::max(maxPos, funcPosition(_srcVertex[index]));
+	}
+
+	// the whole mesh is gone
+	if (triangleCount == 0)
+	{
+		result.geometric = glm::length(maxPos - minPos);
+		return result;
+	}
+
+	// about one triangle per cell, but no smaller than the error we expect
+	cellSize = std::max(glm::length(maxPos - minPos) / std::cbrt(static_cast<float>(triangleCount)), _searchRadius);
+	cellSize = std::max(cellSize, 1e-6f);
+
+	auto funcCell = [&](const glm::vec3& p) { return glm::ivec3(glm::floor((p - minPos) / cellSize)); };
+	auto funcPackCell = [](const glm::ivec3& c)
+		{
+			// 21 bits each, cells that wrap to the same key only cost extra tests
+			return (static_cast<uint64_t>(c.x & 0x1FFFFF) << 42) | (static_cast<uint64_t>(c.y & 0x1FFFFF) << 21) | static_cast<uint64_t>(c.z & 0x1FFFFF);
+		};
+
+	cells.reserve(triangleCount);
+	for (uint32_t t = 0; t < triangleCount; ++t)
+	{
+		const glm::vec3 a = funcPosition(_dstVertex[_dstIndex[t * 3]]);
+		const glm::vec3 b = funcPosition(_dstVertex[_dstIndex[t * 3 + 1]]);
+		const glm::vec3 c = funcPosition(_dstVertex[_dstIndex[t * 3 + 2]]);
+		const glm::ivec3 cellMin = funcCell(glm::min(a, glm::min(b, c)));
+		const glm::ivec3 cellMax = funcCell(glm::max(a, glm::max(b, c)));
+
+		for (int x = cellMin.x; x <= cellMax.x; ++x)
+		{
+			for (int y = cellMin.y; y <= cellMax.y; ++y)
+			{
+				for (int z = cellMin.z; z <= cellMax.z; ++z)
+				{
+					cells[funcPackCell(glm::ivec3(x, y, z))].push_back(t);
+				}
+			}
+		}
+	}
+
+	for (uint32_t index : _srcIndex)
+	{
+		if (visited[index] != 0u) continue;
+		visited[index] = 1u;
+
+		const SimplifyVertex& srcVertex = _srcVertex[index];
+		const glm::vec3 p = funcPosition(srcVertex);
+		const glm::ivec3 cell = funcCell(p);
+		float bestDistance2 = FLT_MAX;
+		uint32_t bestTriangle = 0;
+		glm::vec3 bestBarycentric{};
+		auto funcTestTriangle = [&](uint32_t t)
+			{
+				const glm::vec3 a = funcPosition(_dstVertex[_dstIndex[t * 3]]);
+				const glm::vec3 b = funcPosition(_dstVertex[_dstIndex[t * 3 + 1]]);
+				const glm::vec3 c = funcPosition(_dstVertex[_dstIndex[t * 3 + 2]]);
+				const glm::vec3 barycentric = _ClosestPointOnTriangle(p, a, b, c);
+				const glm::vec3 closest = a * barycentric.x + b * barycentric.y + c * barycentric.z;
+				const float distance2 = glm::dot(p - closest, p - closest);
+
+				if (distance2 < bestDistance2)
+				{
+					bestDistance2 = distance2;
+					bestTriangle = t;
+					bestBarycentric = barycentric;
+				}
+			};
+
+		// a triangle closer than cellSize overlaps one of the neighboring cells
+		for (int x = -1; x <= 1; ++x)
+		{
+			for (int y = -1; y <= 1; ++y)
+			{
+				for (int z = -1; z <= 1; ++z)
+				{
+					auto itr = cells.find(funcPackCell(cell + glm::ivec3(x, y, z)));
+					if (itr == cells.end()) continue;
+					for (uint32_t t : itr->second)
+					{
+						funcTestTriangle(t);
+					}
+				}
+			}
+		}
+
+		// nothing close enough in neighbors, rare, search all
+		if (bestDistance2 > cellSize * cellSize)
+		{
+			for (uint32_t t = 0; t < triangleCount; ++t)
+			{
+				funcTestTriangle(t);
+			}
+		}
+
+		// compare weighted attributes with the ones interpolated at the closest point
+		float attributeDistance2 = 0.0f;
+		for (size_t k = 0; k < _weights.size(); ++k)
+		{
+			const float interpolated = 
+				_dstVertex[_dstIndex[bestTriangle * 3]].data[3 + k] * bestBarycentric.x +
+				_dstVertex[_dstIndex[bestTriangle * 3 + 1]].data[3 + k] * bestBarycentric.y +
+				_dstVertex[_dstIndex[bestTriangle * 3 + 2]].data[3 + k] * bestBarycentric.z;
+			const float difference = (srcVertex.data[3 + k] - interpolated) * _weights[k];
+
+			attributeDistance2 += difference * difference;
+		}
+
+		result.geometric = std::max(result.geometric, std::sqrt(bestDistance2));
+		result.attribute = std::max(result.attribute, std::sqrt(attributeDistance2));
+	}
+
+	return result;
+}
+
 void MeshOptimizer::OptimizeMesh(std::vector<Vertex>& _vertex, std::vector<uint32_t>& _index) const
 {
 	std::vector<uint32_t> remap(std::max(_vertex.size(), _index.size()));
@@ -380,9 +921,76 @@ void MeshOptimizer::OptimizeMesh(std::vector<Vertex>& _vertex, std::vector<uint3
 	_index = std::move(dstIndices);
 }
 
-MeshletBounds MeshOptimizer::ComputeMeshletBounds(const std::vector<Vertex>& _vertex, const Meshlet& _meshlet) const
+void MeshOptimizer::OptimizeMesh(StaticMeshStreams& inoutMesh) const
+{
+	std::vector<meshopt_Stream> streams;
+	std::vector<uint32_t> remap(std::max(inoutMesh.GetVertexCount(), inoutMesh.indices.size()));
+	std::vector<uint32_t> dstIndices(inoutMesh.indices.size());
+	size_t vertexCount = 0;
+
+	streams.push_back({ inoutMesh.positions.data(), sizeof(glm::vec3), sizeof(glm::vec3) });
+	if (inoutMesh.HasAttribute(VertexAttribute::NORMAL))
+	{
+		streams.push_back({ inoutMesh.normals.data(), sizeof(glm::vec3), sizeof(glm::vec3) });
+	}
+	if (inoutMesh.HasAttribute(VertexAttribute::UV))
+	{
+		streams.push_back({ inoutMesh.uvs.data(), sizeof(glm::vec2), sizeof(glm::vec2) });
+	}
+	vertexCount = meshopt_generateVertexRemapMulti(
+		remap.data(),
+		inoutMesh.indices.data(),
+		inoutMesh.indices.size(),
+		inoutMesh.GetVertexCount(),
+		streams.data(),
+		streams.size());
+
+	inoutMesh.RemapVertices(remap, vertexCount);
+	meshopt_remapIndexBuffer(dstIndices.data(), inoutMesh.indices.data(), inoutMesh.indices.size(), remap.data());
+	inoutMesh.indices = std::move(dstIndices);
+
+	OptimizeMeshOrder(inoutMesh);
+}
+
+void MeshOptimizer::OptimizeMeshOrder(StaticMeshStreams& inoutMesh) const
+{
+	std::vector<uint32_t> remap(inoutMesh.GetVertexCount());
+	std::vector<uint32_t> dstIndices(inoutMesh.indices.size());
+	size_t indexCount = inoutMesh.indices.size();
+	size_t vertexCount = inoutMesh.GetVertexCount();
+
+	meshopt_optimizeVertexCache(dstIndices.data(), inoutMesh.indices.data(), indexCount, vertexCount);
+	meshopt_optimizeOverdraw(
+		inoutMesh.indices.data(),
+		dstIndices.data(),
+		indexCount,
+		reinterpret_cast<const float*>(inoutMesh.positions.data()),
+		vertexCount,
+		sizeof(glm::vec3),
+		1.0f
+	);
+
+	// fetch order is computed once and applied to each stream
+	vertexCount = meshopt_optimizeVertexFetchRemap(remap.data(), inoutMesh.indices.data(), indexCount, vertexCount);
+	inoutMesh.RemapVertices(remap, vertexCount);
+	meshopt_remapIndexBuffer(inoutMesh.indices.data(), inoutMesh.indices.data(), indexCount, remap.data());
+}
+
+MeshletBounds MeshOptimizer::_ConvertBounds(const meshopt_Bounds& _bounds) const
 {
 	MeshletBounds retBounds{};
+
+	retBounds.center = glm::vec3(_bounds.center[0], _bounds.center[1], _bounds.center[2]);
+	retBounds.radius = _bounds.radius;
+	retBounds.coneApex = glm::vec3(_bounds.cone_apex[0], _bounds.cone_apex[1], _bounds.cone_apex[2]);
+	retBounds.coneAxis = glm::vec3(_bounds.cone_axis[0], _bounds.cone_axis[1], _bounds.cone_axis[2]);
+	retBounds.coneCutoff = _bounds.cone_cutoff;
+
+	return retBounds;
+}
+
+MeshletBounds MeshOptimizer::ComputeMeshletBounds(const std::vector<Vertex>& _vertex, const Meshlet& _meshlet) const
+{
 	meshopt_Bounds bounds{};
 
 	bounds = meshopt_computeMeshletBounds(
@@ -392,13 +1000,8 @@ MeshletBounds MeshOptimizer::ComputeMeshletBounds(const std::vector<Vertex>& _ve
 		reinterpret_cast<const float*>(_vertex.data()),
 		_vertex.size(),
 		sizeof(Vertex));
-	retBounds.center = glm::vec3(bounds.center[0], bounds.center[1], bounds.center[2]);
-	retBounds.radius = bounds.radius;
-	retBounds.coneApex = glm::vec3(bounds.cone_apex[0], bounds.cone_apex[1], bounds.cone_apex[2]);
-	retBounds.coneAxis = glm::vec3(bounds.cone_axis[0], bounds.cone_axis[1], bounds.cone_axis[2]);
-	retBounds.coneCutoff = bounds.cone_cutoff;
 
-	return retBounds;
+	return _ConvertBounds(bounds);
 }
 
 MeshletBounds MeshOptimizer::ComputeMeshletBounds(
@@ -406,7 +1009,6 @@ MeshletBounds MeshOptimizer::ComputeMeshletBounds(
 	const Meshlet::DeviceData& _meshletData, 
 	const Meshlet::DeviceDataRef& _meshlet) const
 {
-	MeshletBounds retBounds{};
 	meshopt_Bounds bounds{};
 
 	bounds = meshopt_computeMeshletBounds(
@@ -416,19 +1018,30 @@ MeshletBounds MeshOptimizer::ComputeMeshletBounds(
 		reinterpret_cast<const float*>(_vertex.data()),
 		_vertex.size(),
 		sizeof(Vertex));
-	retBounds.center = glm::vec3(bounds.center[0], bounds.center[1], bounds.center[2]);
-	retBounds.radius = bounds.radius;
-	retBounds.coneApex = glm::vec3(bounds.cone_apex[0], bounds.cone_apex[1], bounds.cone_apex[2]);
-	retBounds.coneAxis = glm::vec3(bounds.cone_axis[0], bounds.cone_axis[1], bounds.cone_axis[2]);
-	retBounds.coneCutoff = bounds.cone_cutoff;
 
-	return retBounds;
+	return _ConvertBounds(bounds);
 }
 
-MeshletBounds MeshOptimizer::ComputeBounds(const std::vector<Vertex>& _vertex, const std::vector<uint32_t>& _index) const
+MeshletBounds MeshOptimizer::ComputeMeshletBounds(
+	const std::vector<glm::vec3>& _position,
+	const Meshlet::DeviceData& _meshletData,
+	const Meshlet::DeviceDataRef& _meshlet) const
 {
-	MeshletBounds retBounds{};
 	meshopt_Bounds bounds{};
+
+	bounds = meshopt_computeMeshletBounds(
+		&_meshletData.meshletVertices[_meshlet.vertexOffset],
+		&_meshletData.meshletIndices[_meshlet.indexOffset],
+		_meshlet.triangleCount,
+		reinterpret_cast<const float*>(_position.data()),
+		_position.size(),
+		sizeof(glm::vec3));
+
+	return _ConvertBounds(bounds);
+}
+
+MeshletBounds MeshOptimizer::ComputeBounds(const std::vector<Vertex>& _vertex, const std::vector<uint32_t>& _index) const
+{
 	std::vector<glm::vec3> pos;
 
 	pos.resize(_index.size());
@@ -436,20 +1049,109 @@ MeshletBounds MeshOptimizer::ComputeBounds(const std::vector<Vertex>& _vertex, c
 	{
 		pos[i] = _vertex[_index[i]].position;
 	}
+
+	return ComputeBounds(pos, {});
+}
+
+MeshletBounds MeshOptimizer::ComputeBounds(const std::vector<glm::vec3>& _position, const std::vector<uint32_t>& _index) const
+{
+	meshopt_Bounds bounds{};
+	std::vector<glm::vec3> pos;
+	const std::vector<glm::vec3>* pPositions = &_position;
+
+	// gather positions the indices use, an empty index means all positions
+	if (!_index.empty())
+	{
+		pos.resize(_index.size());
+		for (size_t i = 0; i < _index.size(); ++i)
+		{
+			pos[i] = _position[_index[i]];
+		}
+		pPositions = &pos;
+	}
 	bounds = meshopt_computeSphereBounds(
-		reinterpret_cast<const float*>(pos.data()), 
-		pos.size(), 
+		reinterpret_cast<const float*>(pPositions->data()), 
+		pPositions->size(), 
 		sizeof(glm::vec3), 
 		NULL, 
 		0);
 
-	retBounds.center = glm::vec3(bounds.center[0], bounds.center[1], bounds.center[2]);
-	retBounds.radius = bounds.radius;
-	retBounds.coneApex = glm::vec3(bounds.cone_apex[0], bounds.cone_apex[1], bounds.cone_apex[2]);
-	retBounds.coneAxis = glm::vec3(bounds.cone_axis[0], bounds.cone_axis[1], bounds.cone_axis[2]);
-	retBounds.coneCutoff = bounds.cone_cutoff;
+	return _ConvertBounds(bounds);
+}
 
-	return retBounds;
+void MeshOptimizer::_BuildLodChain(
+	const float* _position,
+	size_t _vertexCount,
+	size_t _stride,
+	const std::vector<uint32_t>& _index,
+	const LodChainSettings& _settings,
+	LodChain& _outChain) const
+{
+	const float extent = meshopt_simplifyScale(_position, _vertexCount, _stride);
+	const meshopt_Bounds bounds = meshopt_computeSphereBounds(_position, _vertexCount, _stride, nullptr, 0);
+	std::vector<uint32_t> srcIndex = _index;
+	std::vector<uint32_t> dstIndex(_index.size());
+	float accumulatedError = 0.0f;
+
+	CHECK_TRUE(_settings.maxLodCount > 0, "LOD chain should have LOD 0!");
+	CHECK_TRUE(_settings.triangleRatio > 0.0f && _settings.triangleRatio < 1.0f, "Triangle ratio should be in (0, 1)!");
+	CHECK_TRUE(_index.size() % 3 == 0, "LOD chain needs a triangle list!");
+
+	_outChain.indices = _index;
+	_outChain.levels.assign(1, LodLevel{ 0, static_cast<uint32_t>(_index.size()), 0.0f });
+	_outChain.center = glm::vec3(bounds.center[0], bounds.center[1], bounds.center[2]);
+	_outChain.radius = bounds.radius;
+
+	while (_outChain.levels.size() < _settings.maxLodCount)
+	{
+		const size_t targetTriangleCount = static_cast<size_t>(static_cast<float>(srcIndex.size() / 3) * _settings.triangleRatio);
+		float error = 0.0f;
+		size_t indexCount = 0;
+
+		if (targetTriangleCount < _settings.minTriangleCount) break;
+
+		indexCount = meshopt_simplify(
+			dstIndex.data(),
+			srcIndex.data(),
+			srcIndex.size(),
+			_position,
+			_vertexCount,
+			_stride,
+			targetTriangleCount * 3,
+			_settings.maxError,
+			0,
+			&error);
+
+		// simplifier is stuck, e.g. on the error limit, later levels would be the same
+		if (indexCount == 0 || indexCount * 10 > srcIndex.size() * 9) break;
+
+		// error is relative to the previous level, summing keeps it an upper bound of the deviation from LOD 0
+		accumulatedError += error * extent;
+		if (accumulatedError > _settings.maxError * extent) break;
+
+		meshopt_optimizeVertexCache(dstIndex.data(), dstIndex.data(), indexCount, _vertexCount);
+		_outChain.levels.push_back(LodLevel{ static_cast<uint32_t>(_outChain.indices.size()), static_cast<uint32_t>(indexCount), accumulatedError });
+		_outChain.indices.insert(_outChain.indices.end(), dstIndex.begin(), dstIndex.begin() + indexCount);
+		srcIndex.assign(dstIndex.begin(), dstIndex.begin() + indexCount);
+	}
+}
+
+void MeshOptimizer::BuildLodChain(
+	const std::vector<Vertex>& inVertices,
+	const std::vector<uint32_t>& inIndices,
+	const LodChainSettings& inSettings,
+	LodChain& outChain) const
+{
+	_BuildLodChain(reinterpret_cast<const float*>(inVertices.data()), inVertices.size(), sizeof(Vertex), inIndices, inSettings, outChain);
+}
+
+void MeshOptimizer::BuildLodChain(
+	const std::vector<glm::vec3>& inPositions,
+	const std::vector<uint32_t>& inIndices,
+	const LodChainSettings& inSettings,
+	LodChain& outChain) const
+{
+	_BuildLodChain(reinterpret_cast<const float*>(inPositions.data()), inPositions.size(), sizeof(glm::vec3), inIndices, inSettings, outChain);
 }
 
 void MeshOptimizer::GeneratePositionRemap(const std::vector<Vertex>& _vertex, std::vector<uint32_t>& _outPositionRemap) const
@@ -457,3 +1159,9 @@ void MeshOptimizer::GeneratePositionRemap(const std::vector<Vertex>& _vertex, st
 	_outPositionRemap.resize(_vertex.size());
 	meshopt_generatePositionRemap(_outPositionRemap.data(), reinterpret_cast<const float*>(_vertex.data()), _vertex.size(), sizeof(Vertex));
 }
+
+void MeshOptimizer::GeneratePositionRemap(const std::vector<glm::vec3>& _position, std::vector<uint32_t>& _outPositionRemap) const
+{
+	_outPositionRemap.resize(_position.size());
+	meshopt_generatePositionRemap(_outPositionRemap.data(), reinterpret_cast<const float*>(_position.data()), _position.size(), sizeof(glm::vec3));
+}
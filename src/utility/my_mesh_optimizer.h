@@ -1,17 +1,184 @@
 #pragma once
 #include <meshoptimizer.h>
 #include <functional>
+// meshopt_buildMeshletsFlex, meshopt_buildMeshletsSpatial and meshopt_simplifyWithUpdate are in 0.25
+#if MESHOPTIMIZER_VERSION < 250
+#error "meshoptimizer 0.25 or later is required, check out tag v0.25 in external/meshoptimizer"
+#endif
+#include <span>
 #include "common.h"
 #include "geometry.h"
 
 // Wrapper class for meshoptimizer lib
 class MeshOptimizer
 {
+public:
+	enum class MeshletBuildMode
+	{
+		DEFAULT,	// fill meshlets up to the limits, for mesh shaders
+		FLEX,		// meshlets may stop between min and max triangle count to stay compact
+		SPATIAL,	// split triangles top-down with SAH like a BVH, for ray tracing clusters and streaming pages
+	};
+
+	struct MeshletBuildSettings
+	{
+		MeshletBuildMode mode = MeshletBuildMode::DEFAULT;
+		size_t maxPrimitiveCount = 124;	// must be divisible by 4
+		size_t minPrimitiveCount = 0;	// FLEX and SPATIAL only, meshlets have at least this many triangles when possible, 0 means maxPrimitiveCount
+		size_t maxIndexCount = 64;		// max vertex count of each meshlet
+		float coneWeight = 0.0f;		// DEFAULT and FLEX only, in [0, 1], higher value gives tighter cones for backface culling but less compact meshlets, 0.25 is a good start
+		float splitFactor = 0.0f;		// FLEX only, split a meshlet when its radius grows past splitFactor * average radius, 0 disables it, 2.0 is a good start
+		float fillWeight = 0.5f;		// SPATIAL only, in [0, 1], higher value prefers full meshlets over lower SAH cost
+	};
+
+	// Meshlets of many index ranges, meshlets[i] and bounds[i] describe the same meshlet,
+	// meshlets of range r are [rangeFirstMeshlet[r], rangeFirstMeshlet[r + 1])
+	struct MeshletBatch
+	{
+		Meshlet::DeviceData data;
+		std::vector<Meshlet::DeviceDataRef> meshlets;
+		std::vector<MeshletBounds> bounds;
+		std::vector<uint32_t> rangeFirstMeshlet;
+	};
+
+	// Weights of attributes relative to position in attribute-aware simplification,
+	// attributes the mesh doesn't have are ignored
+	struct SimplifyAttributeWeights
+	{
+		float uv = 1.0f;
+		float normal = 1.0f;
+	};
+
+	// Error measured against the original mesh after simplification,
+	// for each original vertex the closest point on simplified triangles is found
+	struct SimplifyError
+	{
+		float geometric = 0.0f;	// max distance from original vertices to simplified surface
+		float attribute = 0.0f;	// max difference of weighted attributes between original vertices and their closest points
+	};
+
+	struct LodChainSettings
+	{
+		uint32_t maxLodCount = 6;		// LOD 0 included
+		float triangleRatio = 0.5f;		// each LOD targets this fraction of triangles of the previous one
+		uint32_t minTriangleCount = 64;	// no LOD has fewer triangles
+		float maxError = 0.05f;			// relative to mesh extent, the chain stops before a LOD goes above it
+	};
+
+	// One level of LodChain
+	struct LodLevel
+	{
+		uint32_t indexOffset = 0;	// first index in LodChain::indices
+		uint32_t indexCount = 0;
+		float error = 0.0f;			// deviation from LOD 0 in object space, errors of previous levels are included
+	};
+
+	// Discrete LODs sharing the vertex buffer of LOD 0, so only the index buffer grows
+	struct LodChain
+	{
+		std::vector<uint32_t> indices;	// all levels back to back
+		std::vector<LodLevel> levels;	// levels[0] is the input mesh, error grows with level
+		glm::vec3 center{};				// bounding sphere of the mesh, used to project errors on screen
+		float radius = 0.0f;
+	};
+
 private:
+	// vertex passed to meshopt_simplifyWithUpdate
+	struct SimplifyVertex
+	{
+		std::array<float, 8> data; // position, uv, normal
+	};
+
+private:
+	// Positions are read from _position with _stride bytes between vertices,
+	// so that Vertex and packed position streams share the same code
 	void _LockBoundary(
-		const std::vector<Vertex>& _vertex, 
+		const float* _position,
+		size_t _vertexCount,
+		size_t _stride,
 		const std::vector<uint32_t>& _index, 
 		std::vector<uint8_t>& _locks) const;
+
+	// Meshlets and their bounds are appended to outputs, bounds are skipped if _outBoundsPtr is nullptr,
+	// scratch buffers of meshoptimizer are kept per thread and reused by later calls
+	void _BuildMeshlets(
+		const float* _position,
+		size_t _vertexCount,
+		size_t _stride,
+		std::span<const uint32_t> _index,
+		const MeshletBuildSettings& _settings,
+		Meshlet::DeviceData& _outMeshletData,
+		std::vector<Meshlet::DeviceDataRef>& _outMeshlet,
+		std::vector<MeshletBounds>* _outBoundsPtr) const;
+
+	void _BuildMeshletsBatch(
+		const float* _position,
+		size_t _vertexCount,
+		size_t _stride,
+		std::span<const std::span<const uint32_t>> _indexRanges,
+		const MeshletBuildSettings& _settings,
+		MeshletBatch& _outBatch) const;
+
+	float _SimplifyMesh(
+		const float* _position,
+		size_t _vertexCount,
+		size_t _stride,
+		const std::vector<uint32_t>& _index,
+		size_t _targetIndexCount,
+		std::vector<uint32_t>& _outIndex) const;
+
+	// Simplify with attributes, _vertex is replaced by the vertices that simplified mesh uses,
+	// _outIndex is replaced by the simplified indices of them,
+	// error is measured only if _outErrorPtr is not nullptr since it's not free
+	// _weights: uv weights, then normal weights
+	float _SimplifyMeshWithAttributes(
+		std::vector<SimplifyVertex>& _vertex,
+		const std::vector<uint32_t>& _index,
+		size_t _targetIndexCount,
+		const std::array<float, 5>& _weights,
+		std::vector<uint32_t>& _outIndex,
+		SimplifyError* _outErrorPtr) const;
+
+	float _SimplifyMesh(
+		const std::vector<Vertex>& _vertex,
+		const std::vector<uint32_t>& _index,
+		size_t _targetIndexCount,
+		const SimplifyAttributeWeights& _weights,
+		std::vector<Vertex>& _outVertex,
+		std::vector<uint32_t>& _outIndex,
+		SimplifyError* _outErrorPtr) const;
+
+	float _SimplifyMesh(
+		const StaticMeshStreams& _mesh,
+		const std::vector<uint32_t>& _index,
+		size_t _targetIndexCount,
+		const SimplifyAttributeWeights& _weights,
+		StaticMeshStreams& _outMesh,
+		SimplifyError* _outErrorPtr) const;
+
+	// Weights passed to meshoptimizer, zero for missing attributes
+	std::array<float, 5> _GetSimplifyWeights(const SimplifyAttributeWeights& _weights, bool _hasUV, bool _hasNormal) const;
+
+	// Closest points are searched in a hashed grid of simplified triangles,
+	// _searchRadius is a guess of the error, e.g. the error meshoptimizer reports, it only affects speed
+	SimplifyError _MeasureSimplifyError(
+		const std::vector<SimplifyVertex>& _srcVertex,
+		const std::vector<uint32_t>& _srcIndex,
+		const std::vector<SimplifyVertex>& _dstVertex,
+		const std::vector<uint32_t>& _dstIndex,
+		const std::array<float, 5>& _weights,
+		float _searchRadius) const;
+
+	MeshletBounds _ConvertBounds(const meshopt_Bounds& _bounds) const;
+
+	void _BuildLodChain(
+		const float* _position,
+		size_t _vertexCount,
+		size_t _stride,
+		const std::vector<uint32_t>& _index,
+		const LodChainSettings& _settings,
+		LodChain& _outChain) const;
+
 public:
 	// Build meshlets from vertices and indices,
 	// _outMeshletData, _outMeshlet don't need 
@@ -37,6 +204,28 @@ public:
 		std::vector<Meshlet>& _outMeshlet,
 		size_t _maxPrimitiveCount = 124,
 		size_t _maxIndexCount = 64) const;
+	// _position: position stream of the whole mesh, e.g. StaticMeshStreams::positions
+	void BuildMeshlets(
+		const std::vector<glm::vec3>& _position,
+		const std::vector<uint32_t>& _index,
+		Meshlet::DeviceData& _outMeshletData,
+		std::vector<Meshlet::DeviceDataRef>& _outMeshlet,
+		size_t _maxPrimitiveCount = 124,
+		size_t _maxIndexCount = 64) const;
+
+	// Build meshlets of every index range and compute their bounds (cones included) in the same pass,
+	// e.g. one range per cluster group or per mesh sharing a vertex buffer,
+	// meshlets of a range never cross the range, _outBatch is cleared first
+	void BuildMeshletsBatch(
+		const std::vector<Vertex>& _vertex,
+		std::span<const std::span<const uint32_t>> _indexRanges,
+		const MeshletBuildSettings& _settings,
+		MeshletBatch& _outBatch) const;
+	void BuildMeshletsBatch(
+		const std::vector<glm::vec3>& _position,
+		std::span<const std::span<const uint32_t>> _indexRanges,
+		const MeshletBuildSettings& _settings,
+		MeshletBatch& _outBatch) const;
 
 	// Simplify mesh/meshlet while leaving border intact,
 	// use original vertices to draw simplified mesh
@@ -51,6 +240,11 @@ public:
 		const std::vector<uint32_t>& inIndices,
 		size_t inTargetIndexCount,
 		std::vector<uint32_t>& outIndices) const;
+	float SimplifyMesh(
+		const std::vector<glm::vec3>& inPositions,
+		const std::vector<uint32_t>& inIndices,
+		size_t inTargetIndexCount,
+		std::vector<uint32_t>& outIndices) const;
 
 	// Simplify mesh/meshlet while leaving border intact, 
 	// generate a new set of vertices used to draw simplified mesh
@@ -67,12 +261,59 @@ public:
 		size_t inTargetIndexCount,
 		std::vector<Vertex>& outVertices,
 		std::vector<uint32_t>& outIndices) const;
+	// inMesh: vertex streams of the original mesh, its indices are not used
+	// outMesh: simplified vertices are appended to its streams and indices to its indices,
+	//          attribute mask is taken from inMesh if outMesh is empty
+	float SimplifyMesh(
+		const StaticMeshStreams& inMesh,
+		const std::vector<uint32_t>& inIndices,
+		size_t inTargetIndexCount,
+		StaticMeshStreams& outMesh) const;
+
+	// Same as above with uv and normal weighted by inWeights,
+	// geometric and attribute error are measured separately and written to outError
+	float SimplifyMesh(
+		const std::vector<Vertex>& inVertices,
+		const std::vector<uint32_t>& inIndices,
+		size_t inTargetIndexCount,
+		const SimplifyAttributeWeights& inWeights,
+		std::vector<Vertex>& outVertices,
+		std::vector<uint32_t>& outIndices,
+		SimplifyError& outError) const;
+	float SimplifyMesh(
+		const StaticMeshStreams& inMesh,
+		const std::vector<uint32_t>& inIndices,
+		size_t inTargetIndexCount,
+		const SimplifyAttributeWeights& inWeights,
+		StaticMeshStreams& outMesh,
+		SimplifyError& outError) const;
+
+	// Build discrete LODs for meshes that are not virtualized, each LOD is simplified from the previous one,
+	// only positions are considered and mesh borders may move.
+	// Pick a LOD at runtime with LodSelector
+	// outChain: previous content is replaced
+	void BuildLodChain(
+		const std::vector<Vertex>& inVertices,
+		const std::vector<uint32_t>& inIndices,
+		const LodChainSettings& inSettings,
+		LodChain& outChain) const;
+	void BuildLodChain(
+		const std::vector<glm::vec3>& inPositions,
+		const std::vector<uint32_t>& inIndices,
+		const LodChainSettings& inSettings,
+		LodChain& outChain) const;
 
 	// Optimize mesh by reordering vertex and index to GPU friendly layout
 	// removes duplicated vertices
 	void OptimizeMesh(
 		std::vector<Vertex>& inoutVertices, 
 		std::vector<uint32_t>& inoutIndices) const;
+	// streams are deduplicated together, every stream is read with its own packed stride
+	void OptimizeMesh(StaticMeshStreams& inoutMesh) const;
+
+	// Reorder triangles and vertices for vertex cache, overdraw and vertex fetch,
+	// use this instead of OptimizeMesh if vertices are already unique
+	void OptimizeMeshOrder(StaticMeshStreams& inoutMesh) const;
 
 	// Compute meshlet bounds for culling
 	MeshletBounds ComputeMeshletBounds(
@@ -82,11 +323,19 @@ public:
 		const std::vector<Vertex>& inVertices,
 		const Meshlet::DeviceData& inMeshletData,
 		const Meshlet::DeviceDataRef& inMeshletDataRef) const;
+	MeshletBounds ComputeMeshletBounds(
+		const std::vector<glm::vec3>& inPositions,
+		const Meshlet::DeviceData& inMeshletData,
+		const Meshlet::DeviceDataRef& inMeshletDataRef) const;
 
 	// Compute boundary of cluster of mesh
 	MeshletBounds ComputeBounds(
 		const std::vector<Vertex>& inVertices,
 		const std::vector<uint32_t>& inIndices) const;
+	// inIndices can be empty to compute bounds of all inPositions
+	MeshletBounds ComputeBounds(
+		const std::vector<glm::vec3>& inPositions,
+		const std::vector<uint32_t>& inIndices) const;
 
 	// Remove duplicate vertices based on inFuncEqual
 	template<typename T>
@@ -147,4 +396,7 @@ public:
 	void GeneratePositionRemap(
 		const std::vector<Vertex>& inVertices,
 		std::vector<uint32_t>& outPositionRemap) const;
+	void GeneratePositionRemap(
+		const std::vector<glm::vec3>& inPositions,
+		std::vector<uint32_t>& outPositionRemap) const;
 };
\ No newline at end of file
@@ -0,0 +1,149 @@
+#include "scene_graph.h"
+#include "task_scheduler.h"
+
+void SceneGraph::PresetNodes(std::span<const NodeInformation> inNodes)
+{
+	m_nodeInfos.assign(inNodes.begin(), inNodes.end());
+}
+
+void SceneGraph::PresetMinNodesPerTask(uint32_t inCount)
+{
+	m_minNodesPerTask = std::max(inCount, 1u);
+}
+
+void SceneGraph::Init()
+{
+	const uint32_t nodeCount = static_cast<uint32_t>(m_nodeInfos.size());
+	std::vector<uint32_t> depths(nodeCount, INVALID_NODE);
+	std::vector<uint32_t> path;
+	uint32_t levelCount = 0;
+
+	// depth of each input node, walk up until a node with known depth
+	for (uint32_t i = 0; i < nodeCount; ++i)
+	{
+		uint32_t cur = i;
+
+		path.clear();
+		while (cur != INVALID_NODE && depths[cur] == INVALID_NODE)
+		{
+			CHECK_TRUE(path.size() < nodeCount, "Scene graph has a cycle!");
+			path.push_back(cur);
+			cur = m_nodeInfos[cur].parent;
+			CHECK_TRUE(cur == INVALID_NODE || cur < nodeCount, "Parent of node is out of range!");
+		}
+
+		uint32_t depth = (cur == INVALID_NODE) ? 0 : depths[cur] + 1;
+		for (auto itr = path.rbegin(); itr != path.rend(); ++itr)
+		{
+			depths[*itr] = depth++;
+		}
+		levelCount = std::max(levelCount, depths[i] + 1);
+	}
+
+	// counting sort by depth, input order is kept inside a level
+	m_levelOffsets.assign(static_cast<size_t>(levelCount) + 1, 0);
+	for (uint32_t i = 0; i < nodeCount; ++i)
+	{
+		++m_levelOffsets[depths[i] + 1];
+	}
+	for (uint32_t i = 0; i < levelCount; ++i)
+	{
+		m_levelOffsets[i + 1] += m_levelOffsets[i];
+	}
+
+	std::vector<uint32_t> nextSlots(m_levelOffsets.begin(), m_levelOffsets.end() - 1);
+	m_inputIndices.resize(nodeCount);
+	m_nodeIndices.resize(nodeCount);
+	for (uint32_t i = 0; i < nodeCount; ++i)
+	{
+		const uint32_t node = nextSlots[depths[i]]++;
+		m_inputIndices[node] = i;
+		m_nodeIndices[i] = node;
+	}
+
+	m_parents.resize(nodeCount);
+	m_translations.resize(nodeCount);
+	m_rotations.resize(nodeCount);
+	m_scales.resize(nodeCount);
+	m_useLocalMatrix.resize(nodeCount);
+	m_localMatrices.resize(nodeCount);
+	m_worldMatrices.resize(nodeCount);
+	for (uint32_t node = 0; node < nodeCount; ++node)
+	{
+		const auto& nodeInfo = m_nodeInfos[m_inputIndices[node]];
+
+		m_parents[node] = (nodeInfo.parent == INVALID_NODE) ? INVALID_NODE : m_nodeIndices[nodeInfo.parent];
+		m_translations[node] = nodeInfo.translation;
+		m_rotations[node] = nodeInfo.rotation;
+		m_scales[node] = nodeInfo.scale;
+		m_useLocalMatrix[node] = nodeInfo.optMatrix.has_value() ? 1 : 0;
+		m_localMatrices[node] = nodeInfo.optMatrix.value_or(glm::mat4(1.0f));
+	}
+
+	m_nodeInfos.clear();
+
+	UpdateWorldMatrices();
+}
+
+void SceneGraph::Uninit()
+{
+	m_nodeInfos.clear();
+	m_parents.clear();
+	m_levelOffsets.clear();
+	m_inputIndices.clear();
+	m_nodeIndices.clear();
+	m_translations.clear();
+	m_rotations.clear();
+	m_scales.clear();
+	m_useLocalMatrix.clear();
+	m_localMatrices.clear();
+	m_worldMatrices.clear();
+}
+
+uint32_t SceneGraph::GetLevelCount() const
+{
+	return m_levelOffsets.empty() ? 0 : static_cast<uint32_t>(m_levelOffsets.size() - 1);
+}
+
+void SceneGraph::GetLevelRange(uint32_t inLevel, uint32_t& outBegin, uint32_t& outEnd) const
+{
+	CHECK_TRUE(inLevel < GetLevelCount(), "Level is out of range!");
+	outBegin = m_levelOffsets[inLevel];
+	outEnd = m_levelOffsets[inLevel + 1];
+}
+
+void SceneGraph::UpdateWorldMatrices()
+{
+	const uint32_t levelCount = GetLevelCount();
+
+	// parents are in previous levels, so nodes of one level are independent
+	for (uint32_t level = 0; level < levelCount; ++level)
+	{
+		const uint32_t levelBegin = m_levelOffsets[level];
+		const uint32_t levelEnd = m_levelOffsets[level + 1];
+
+		MyTaskScheduler::GetInstance().ParallelFor(
+			levelEnd - levelBegin,
+			m_minNodesPerTask,
+			[&](uint32_t _begin, uint32_t _end, uint32_t _threadIndex)
+			{
+				for (uint32_t node = levelBegin + _begin; node < levelBegin + _end; ++node)
+				{
+					if (m_useLocalMatrix[node] == 0)
+					{
+						// T * R * S without building three matrices
+						glm::mat3 rotation = glm::mat3_cast(m_rotations[node]);
+						glm::mat4& local = m_localMatrices[node];
+
+						local[0] = glm::vec4(rotation[0] * m_scales[node].x, 0.0f);
+						local[1] = glm::vec4(rotation[1] * m_scales[node].y, 0.0f);
+						local[2] = glm::vec4(rotation[2] * m_scales[node].z, 0.0f);
+						local[3] = glm::vec4(m_translations[node], 1.0f);
+					}
+
+					const uint32_t parent = m_parents[node];
+					m_worldMatrices[node] = (parent == INVALID_NODE) ? m_localMatrices[node] : m_worldMatrices[parent] * m_localMatrices[node];
+				}
+			});
+	}
+}
@@ -0,0 +1,183 @@
+#pragma once
+#include "common.h"
+#include <span>
+
+// Components of one type keyed by node index, at most one per node.
+// Components are packed in an array so systems can iterate them without touching nodes
+template<class ComponentType>
+class ComponentPool
+{
+private:
+	std::vector<uint32_t> m_nodeToSlot;			// ~0u if node doesn't have the component
+	std::vector<uint32_t> m_nodes;				// node of each component
+	std::vector<ComponentType> m_components;
+
+public:
+	// Add component to the node, replace the one it already has
+	void Add(uint32_t _node, const ComponentType& _component);
+
+	bool Has(uint32_t _node) const;
+
+	// Return nullptr if node doesn't have the component
+	ComponentType* Get(uint32_t _node);
+
+	const ComponentType* Get(uint32_t _node) const;
+
+	// Last component is moved into the hole, return whether node had the component
+	bool Remove(uint32_t _node);
+
+	void Clear();
+
+	uint32_t GetCount() const { return static_cast<uint32_t>(m_components.size()); }
+
+	// nodes[i] owns components[i]
+	std::span<const uint32_t> GetNodes() const { return m_nodes; }
+
+	std::span<ComponentType> GetComponents() { return m_components; }
+
+	std::span<const ComponentType> GetComponents() const { return m_components; }
+};
+
+// Transform hierarchy stored in flat arrays.
+// Nodes are sorted by depth so parents come before children and each depth is a contiguous range,
+// local transforms are SoA of translation, rotation and scale, and world matrices are updated level by level,
+// nodes of one level run on worker threads
+class SceneGraph
+{
+public:
+	static constexpr uint32_t INVALID_NODE = ~0u;
+
+	struct NodeInformation
+	{
+		uint32_t parent = INVALID_NODE;			// index in input array, INVALID_NODE for root
+		glm::vec3 translation = glm::vec3(0.0f);
+		glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+		glm::vec3 scale = glm::vec3(1.0f);
+		std::optional<glm::mat4> optMatrix;		// local matrix used as it is, TRS is ignored
+	};
+
+private:
+	std::vector<NodeInformation> m_nodeInfos; // hold info temporarily, will be invalid after Init
+	uint32_t m_minNodesPerTask = 1024;
+
+	std::vector<uint32_t> m_parents;			// INVALID_NODE for root
+	std::vector<uint32_t> m_levelOffsets;		// nodes of level i are [m_levelOffsets[i], m_levelOffsets[i + 1])
+	std::vector<uint32_t> m_inputIndices;		// input index of each node
+	std::vector<uint32_t> m_nodeIndices;		// node index of each input
+
+	std::vector<glm::vec3> m_translations;
+	std::vector<glm::quat> m_rotations;
+	std::vector<glm::vec3> m_scales;
+	std::vector<uint8_t> m_useLocalMatrix;		// 1 if node is built with optMatrix
+	std::vector<glm::mat4> m_localMatrices;
+	std::vector<glm::mat4> m_worldMatrices;
+
+public:
+	// Nodes can be in any order as long as parents form a forest
+	void PresetNodes(std::span<const NodeInformation> inNodes);
+
+	// Minimum number of nodes a worker thread updates at a time, use 0xFFFFFFFF to update on calling thread
+	void PresetMinNodesPerTask(uint32_t inCount);
+
+	// Sort nodes and update world matrices once
+	void Init();
+
+	void Uninit();
+
+	uint32_t GetNodeCount() const { return static_cast<uint32_t>(m_parents.size()); }
+
+	uint32_t GetLevelCount() const;
+
+	// Nodes of the level are [begin, end)
+	void GetLevelRange(uint32_t inLevel, uint32_t& outBegin, uint32_t& outEnd) const;
+
+	uint32_t GetParent(uint32_t inNode) const { return m_parents[inNode]; }
+
+	// Node built from inNodes[inInputIndex] in PresetNodes
+	uint32_t GetNodeIndex(uint32_t inInputIndex) const { return m_nodeIndices[inInputIndex]; }
+
+	uint32_t GetInputIndex(uint32_t inNode) const { return m_inputIndices[inNode]; }
+
+	// Local transforms can be written directly, e.g. by animation, then call UpdateWorldMatrices,
+	// nodes built with optMatrix ignore them
+	std::span<glm::vec3> GetLocalTranslations() { return m_translations; }
+
+	std::span<glm::quat> GetLocalRotations() { return m_rotations; }
+
+	std::span<glm::vec3> GetLocalScales() { return m_scales; }
+
+	// Rebuild local matrices from TRS and propagate them down the hierarchy
+	void UpdateWorldMatrices();
+
+	std::span<const glm::mat4> GetWorldMatrices() const { return m_worldMatrices; }
+
+	const glm::mat4& GetWorldMatrix(uint32_t inNode) const { return m_worldMatrices[inNode]; }
+};
+
+template<class ComponentType>
+void ComponentPool<ComponentType>::Add(uint32_t _node, const ComponentType& _component)
+{
+	if (_node >= m_nodeToSlot.size())
+	{
+		m_nodeToSlot.resize(static_cast<size_t>(_node) + 1, ~0u);
+	}
+
+	uint32_t& slot = m_nodeToSlot[_node];
+	if (slot != ~0u)
+	{
+		m_components[slot] = _component;
+		return;
+	}
+
+	slot = static_cast<uint32_t>(m_components.size());
+	m_nodes.push_back(_node);
+	m_components.push_back(_component);
+}
+
+template<class ComponentType>
+bool ComponentPool<ComponentType>::Has(uint32_t _node) const
+{
+	return _node < m_nodeToSlot.size() && m_nodeToSlot[_node] != ~0u;
+}
+
+template<class ComponentType>
+ComponentType* ComponentPool<ComponentType>::Get(uint32_t _node)
+{
+	if (!Has(_node)) return nullptr;
+	return &m_components[m_nodeToSlot[_node]];
+}
+
+template<class ComponentType>
+const ComponentType* ComponentPool<ComponentType>::Get(uint32_t _node) const
+{
+	if (!Has(_node)) return nullptr;
+	return &m_components[m_nodeToSlot[_node]];
+}
+
+template<class ComponentType>
+bool ComponentPool<ComponentType>::Remove(uint32_t _node)
+{
+	if (!Has(_node)) return false;
+
+	const uint32_t slot = m_nodeToSlot[_node];
+	const uint32_t lastSlot = static_cast<uint32_t>(m_components.size() - 1);
+	if (slot != lastSlot)
+	{
+		m_components[slot] = std::move(m_components[lastSlot]);
+		m_nodes[slot] = m_nodes[lastSlot];
+		m_nodeToSlot[m_nodes[slot]] = slot;
+	}
+	m_components.pop_back();
+	m_nodes.pop_back();
+	m_nodeToSlot[_node] = ~0u;
+
+	return true;
+}
+
+template<class ComponentType>
+void ComponentPool<ComponentType>::Clear()
+{
+	m_nodeToSlot.clear();
+	m_nodes.clear();
+	m_components.clear();
+}
@@ -0,0 +1,547 @@
+#include "simd_math.h"
+#include <bit>
+#if defined(LV_SIMD_AVX2)
+#include <immintrin.h>
+#elif defined(LV_SIMD_SSE)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// Thin wrappers so kernels are written once for both instruction sets,
+	// masks are floats with all bits set in lanes where the comparison holds
+#if defined(LV_SIMD_AVX2)
+	constexpr size_t LANE_COUNT = 8;
+	using FloatN = __m256;
+
+	inline FloatN _Load(const float* _p) { return _mm256_loadu_ps(_p); }
+	inline void _Store(float* _p, FloatN _v) { _mm256_storeu_ps(_p, _v); }
+	inline FloatN _Set1(float _v) { return _mm256_set1_ps(_v); }
+	inline FloatN _Add(FloatN _a, FloatN _b) { return _mm256_add_ps(_a, _b); }
+	inline FloatN _Sub(FloatN _a, FloatN _b) { return _mm256_sub_ps(_a, _b); }
+	inline FloatN _Mul(FloatN _a, FloatN _b) { return _mm256_mul_ps(_a, _b); }
+	inline FloatN _Div(FloatN _a, FloatN _b) { return _mm256_div_ps(_a, _b); }
+	inline FloatN _Min(FloatN _a, FloatN _b) { return _mm256_min_ps(_a, _b); }
+	inline FloatN _Max(FloatN _a, FloatN _b) { return _mm256_max_ps(_a, _b); }
+	inline FloatN _Sqrt(FloatN _a) { return _mm256_sqrt_ps(_a); }
+	inline FloatN _Greater(FloatN _a, FloatN _b) { return _mm256_cmp_ps(_a, _b, _CMP_GT_OQ); }
+	inline FloatN _GreaterEqual(FloatN _a, FloatN _b) { return _mm256_cmp_ps(_a, _b, _CMP_GE_OQ); }
+	inline FloatN _Or(FloatN _a, FloatN _b) { return _mm256_or_ps(_a, _b); }
+	inline FloatN _Select(FloatN _mask, FloatN _a, FloatN _b) { return _mm256_blendv_ps(_b, _a, _mask); } // _a where mask is set
+	inline uint32_t _MoveMask(FloatN _mask) { return static_cast<uint32_t>(_mm256_movemask_ps(_mask)); }
+#elif defined(LV_SIMD_SSE)
+	constexpr size_t LANE_COUNT = 4;
+	using FloatN = __m128;
+
+	inline FloatN _Load(const float* _p) { return _mm_loadu_ps(_p); }
+	inline void _Store(float* _p, FloatN _v) { _mm_storeu_ps(_p, _v); }
+	inline FloatN _Set1(float _v) { return _mm_set1_ps(_v); }
+	inline FloatN _Add(FloatN _a, FloatN _b) { return _mm_add_ps(_a, _b); }
+	inline FloatN _Sub(FloatN _a, FloatN _b) { return _mm_sub_ps(_a, _b); }
+	inline FloatN _Mul(FloatN _a, FloatN _b) { return _mm_mul_ps(_a, _b); }
+	inline FloatN _Div(FloatN _a, FloatN _b) { return _mm_div_ps(_a, _b); }
+	inline FloatN _Min(FloatN _a, FloatN _b) { return _mm_min_ps(_a, _b); }
+	inline FloatN _Max(FloatN _a, FloatN _b) { return _mm_max_ps(_a, _b); }
+	inline FloatN _Sqrt(FloatN _a) { return _mm_sqrt_ps(_a); }
+	inline FloatN _Greater(FloatN _a, FloatN _b) { return _mm_cmpgt_ps(_a, _b); }
+	inline FloatN _GreaterEqual(FloatN _a, FloatN _b) { return _mm_cmpge_ps(_a, _b); }
+	inline FloatN _Or(FloatN _a, FloatN _b) { return _mm_or_ps(_a, _b); }
+	inline FloatN _Select(FloatN _mask, FloatN _a, FloatN _b) { return _mm_or_ps(_mm_and_ps(_mask, _a), _mm_andnot_ps(_mask, _b)); }
+	inline uint32_t _MoveMask(FloatN _mask) { return static_cast<uint32_t>(_mm_movemask_ps(_mask)); }
+#endif
+
+	// Scalar versions, used for the tail of arrays and when there is no SIMD
+	glm::vec4 _MergeSphere(const glm::vec4& _sphere1, const glm::vec4& _sphere2)
+	{
+		const glm::vec3 offset = glm::vec3(_sphere2) - glm::vec3(_sphere1);
+		const float distance = glm::length(offset);
+		float radius = 0.0f;
+
+		// one sphere already contains the other
+		if (distance + _sphere2.w <= _sphere1.w) return _sphere1;
+		if (distance + _sphere1.w <= _sphere2.w) return _sphere2;
+
+		radius = (distance + _sphere1.w + _sphere2.w) * 0.5f;
+		return glm::vec4(glm::vec3(_sphere1) + offset * ((radius - _sphere1.w) / distance), radius);
+	}
+
+	bool _IsSphereOutside(const std::array<glm::vec4, 6>& _planes, const glm::vec3& _center, float _radius)
+	{
+		for (const auto& plane : _planes)
+		{
+			if (glm::dot(glm::vec3(plane), _center) + plane.w > _radius) return true;
+		}
+		return false;
+	}
+
+	bool _IsConeBackfacing(const simd_math::ConeArrays& _cones, size_t _index, const glm::vec3& _eye)
+	{
+		// dot(normalize(v), axis) >= cutoff without the division
+		const glm::vec3 view = glm::vec3(_cones.apexX[_index], _cones.apexY[_index], _cones.apexZ[_index]) - _eye;
+		const glm::vec3 axis = glm::vec3(_cones.axisX[_index], _cones.axisY[_index], _cones.axisZ[_index]);
+
+		return glm::dot(view, axis) >= _cones.cutoff[_index] * glm::length(view);
+	}
+
+	// t that makes nlerp follow slerp, _cosAngle is |dot| of the quaternions
+	inline float _CorrectSlerpFactor(float _cosAngle, float _t)
+	{
+		const float ca = 1.0904f + _cosAngle * (-3.2452f + _cosAngle * (3.55645f - _cosAngle * 1.43519f));
+		const float cb = 0.848013f + _cosAngle * (-1.06021f + _cosAngle * 0.215638f);
+		const float k = ca * (_t - 0.5f) * (_t - 0.5f) + cb;
+
+		return _t + _t * (_t - 0.5f) * (_t - 1.0f) * k;
+	}
+}
+
+namespace simd_math
+{
+	void SphereArrays::Resize(size_t _count)
+	{
+		centerX.resize(_count);
+		centerY.resize(_count);
+		centerZ.resize(_count);
+		radius.resize(_count);
+	}
+
+	void SphereArrays::Set(size_t _index, const glm::vec4& _sphere)
+	{
+		centerX[_index] = _sphere.x;
+		centerY[_index] = _sphere.y;
+		centerZ[_index] = _sphere.z;
+		radius[_index] = _sphere.w;
+	}
+
+	glm::vec4 SphereArrays::Get(size_t _index) const
+	{
+		return glm::vec4(centerX[_index], centerY[_index], centerZ[_index], radius[_index]);
+	}
+
+	void ConeArrays::Resize(size_t _count)
+	{
+		apexX.resize(_count);
+		apexY.resize(_count);
+		apexZ.resize(_count);
+		axisX.resize(_count);
+		axisY.resize(_count);
+		axisZ.resize(_count);
+		cutoff.resize(_count);
+	}
+
+	void ConeArrays::Set(size_t _index, const glm::vec3& _apex, const glm::vec3& _axis, float _cutoff)
+	{
+		apexX[_index] = _apex.x;
+		apexY[_index] = _apex.y;
+		apexZ[_index] = _apex.z;
+		axisX[_index] = _axis.x;
+		axisY[_index] = _axis.y;
+		axisZ[_index] = _axis.z;
+		cutoff[_index] = _cutoff;
+	}
+
+	void Vec3Arrays::Resize(size_t _count)
+	{
+		x.resize(_count);
+		y.resize(_count);
+		z.resize(_count);
+	}
+
+	void Vec3Arrays::Set(size_t _index, const glm::vec3& _vec)
+	{
+		x[_index] = _vec.x;
+		y[_index] = _vec.y;
+		z[_index] = _vec.z;
+	}
+
+	void QuatArrays::Resize(size_t _count)
+	{
+		x.resize(_count);
+		y.resize(_count);
+		z.resize(_count);
+		w.resize(_count);
+	}
+
+	void QuatArrays::Set(size_t _index, const glm::quat& _quat)
+	{
+		x[_index] = _quat.x;
+		y[_index] = _quat.y;
+		z[_index] = _quat.z;
+		w[_index] = _quat.w;
+	}
+
+	const char* GetInstructionSet()
+	{
+#if defined(LV_SIMD_AVX2)
+		return "AVX2";
+#elif defined(LV_SIMD_SSE)
+		return "SSE";
+#else
+		return "Scalar";
+#endif
+	}
+
+	glm::vec4 MergeSphere(const glm::vec4& _a, const glm::vec4& _b)
+	{
+		return _MergeSphere(_a, _b);
+	}
+
+	void MergeSpheres(const SphereArrays& _a, const SphereArrays& _b, SphereArrays& _outMerged)
+	{
+		const size_t count = _a.Size();
+		size_t i = 0;
+
+		CHECK_TRUE(_b.Size() == count, "Sphere arrays have different sizes!");
+		_outMerged.Resize(count);
+
+#if defined(LV_SIMD_AVX2) || defined(LV_SIMD_SSE)
+		const FloatN half = _Set1(0.5f);
+		const FloatN minDistance = _Set1(FLT_MIN);
+		for (; i + LANE_COUNT <= count; i += LANE_COUNT)
+		{
+			const FloatN x1 = _Load(&_a.centerX[i]);
+			const FloatN y1 = _Load(&_a.centerY[i]);
+			const FloatN z1 = _Load(&_a.centerZ[i]);
+			const FloatN r1 = _Load(&_a.radius[i]);
+			const FloatN x2 = _Load(&_b.centerX[i]);
+			const FloatN y2 = _Load(&_b.centerY[i]);
+			const FloatN z2 = _Load(&_b.centerZ[i]);
+			const FloatN r2 = _Load(&_b.radius[i]);
+			const FloatN dx = _Sub(x2, x1);
+			const FloatN dy = _Sub(y2, y1);
+			const FloatN dz = _Sub(z2, z1);
+			const FloatN distance = _Sqrt(_Add(_Add(_Mul(dx, dx), _Mul(dy, dy)), _Mul(dz, dz)));
+			const FloatN radius = _Mul(_Add(_Add(distance, r1), r2), half);
+			const FloatN t = _Div(_Sub(radius, r1), _Max(distance, minDistance));
+			const FloatN firstContains = _GreaterEqual(r1, _Add(distance, r2));
+			const FloatN secondContains = _GreaterEqual(r2, _Add(distance, r1));
+
+			// merged sphere unless one of them contains the other, the first one wins if both do
+			_Store(&_outMerged.centerX[i], _Select(firstContains, x1, _Select(secondContains, x2, _Add(x1, _Mul(dx, t)))));
+			_Store(&_outMerged.centerY[i], _Select(firstContains, y1, _Select(secondContains, y2, _Add(y1, _Mul(dy, t)))));
+			_Store(&_outMerged.centerZ[i], _Select(firstContains, z1, _Select(secondContains, z2, _Add(z1, _Mul(dz, t)))));
+			_Store(&_outMerged.radius[i], _Select(firstContains, r1, _Select(secondContains, r2, radius)));
+		}
+#endif
+
+		for (; i < count; ++i)
+		{
+			_outMerged.Set(i, _MergeSphere(_a.Get(i), _b.Get(i)));
+		}
+	}
+
+	glm::vec4 ComputeEnclosingSphere(const SphereArrays& _spheres)
+	{
+		const size_t count = _spheres.Size();
+		glm::vec3 boxMin = glm::vec3(FLT_MAX);
+		glm::vec3 boxMax = glm::vec3(-FLT_MAX);
+		glm::vec3 boxCenter{};
+		float boxRadius = 0.0f;
+		size_t i = 0;
+
+		CHECK_TRUE(count > 0, "No sphere to enclose!");
+
+#if defined(LV_SIMD_AVX2) || defined(LV_SIMD_SSE)
+		if (count >= LANE_COUNT)
+		{
+			FloatN minX = _Set1(FLT_MAX);
+			FloatN minY = _Set1(FLT_MAX);
+			FloatN minZ = _Set1(FLT_MAX);
+			FloatN maxX = _Set1(-FLT_MAX);
+			FloatN maxY = _Set1(-FLT_MAX);
+			FloatN maxZ = _Set1(-FLT_MAX);
+			std::array<float, LANE_COUNT> lanes{};
+
+			for (; i + LANE_COUNT <= count; i += LANE_COUNT)
+			{
+				const FloatN radius = _Load(&_spheres.radius[i]);
+				const FloatN x = _Load(&_spheres.centerX[i]);
+				const FloatN y = _Load(&_spheres.centerY[i]);
+				const FloatN z = _Load(&_spheres.centerZ[i]);
+
+				minX = _Min(minX, _Sub(x, radius));
+				minY = _Min(minY, _Sub(y, radius));
+				minZ = _Min(minZ, _Sub(z, radius));
+				maxX = _Max(maxX, _Add(x, radius));
+				maxY = _Max(maxY, _Add(y, radius));
+				maxZ = _Max(maxZ, _Add(z, radius));
+			}
+
+			// reduce lanes
+			auto funcReduce = [&](FloatN _v, auto _funcOp, float _init)
+				{
+					float result = _init;
+					_Store(lanes.data(), _v);
+					for (float lane : lanes)
+					{
+						result = _funcOp(result, lane);
+					}
+					return result;
+				};
+			auto funcMin = [](float _a, float _b) { return std::min(_a, _b); };
+			auto funcMax = [](float _a, float _b) { return std::max(_a, _b); };
+			boxMin = glm::vec3(funcReduce(minX, funcMin, FLT_MAX), funcReduce(minY, funcMin, FLT_MAX), funcReduce(minZ, funcMin, FLT_MAX));
+			boxMax = glm::vec3(funcReduce(maxX, funcMax, -FLT_MAX), funcReduce(maxY, funcMax, -FLT_MAX), funcReduce(maxZ, funcMax, -FLT_MAX));
+		}
+#endif
+
+		for (; i < count; ++i)
+		{
+			const glm::vec4 sphere = _spheres.Get(i);
+			boxMin = glm::min(boxMin, glm::vec3(sphere) - sphere.w);
+			boxMax = glm::max(boxMax, glm::vec3(sphere) + sphere.w);
+		}
+		boxCenter = (boxMin + boxMax) * 0.5f;
+
+		i = 0;
+#if defined(LV_SIMD_AVX2) || defined(LV_SIMD_SSE)
+		if (count >= LANE_COUNT)
+		{
+			const FloatN centerX = _Set1(boxCenter.x);
+			const FloatN centerY = _Set1(boxCenter.y);
+			const FloatN centerZ = _Set1(boxCenter.z);
+			FloatN maxRadius = _Set1(0.0f);
+			std::array<float, LANE_COUNT> lanes{};
+
+			for (; i + LANE_COUNT <= count; i += LANE_COUNT)
+			{
+				const FloatN dx = _Sub(_Load(&_spheres.centerX[i]), centerX);
+				const FloatN dy = _Sub(_Load(&_spheres.centerY[i]), centerY);
+				const FloatN dz = _Sub(_Load(&_spheres.centerZ[i]), centerZ);
+				const FloatN distance = _Sqrt(_Add(_Add(_Mul(dx, dx), _Mul(dy, dy)), _Mul(dz, dz)));
+
+				maxRadius = _Max(maxRadius, _Add(distance, _Load(&_spheres.radius[i])));
+			}
+			_Store(lanes.data(), maxRadius);
+			for (float lane : lanes)
+			{
+				boxRadius = std::max(boxRadius, lane);
+			}
+		}
+#endif
+
+		for (; i < count; ++i)
+		{
+			const glm::vec4 sphere = _spheres.Get(i);
+			boxRadius = std::max(boxRadius, glm::distance(boxCenter, glm::vec3(sphere)) + sphere.w);
+		}
+
+		return glm::vec4(boxCenter, boxRadius);
+	}
+
+	size_t CullSpheres(
+		const SphereArrays& _spheres,
+		const std::array<glm::vec4, 6>& _planes,
+		float _radiusScale,
+		size_t _begin,
+		size_t _end,
+		uint8_t* _outVisible)
+	{
+		size_t visibleCount = 0;
+		size_t i = _begin;
+
+#if defined(LV_SIMD_AVX2) || defined(LV_SIMD_SSE)
+		FloatN planeX[6];
+		FloatN planeY[6];
+		FloatN planeZ[6];
+		FloatN planeW[6];
+		const FloatN radiusScale = _Set1(_radiusScale);
+
+		for (size_t p = 0; p < _planes.size(); ++p)
+		{
+			planeX[p] = _Set1(_planes[p].x);
+			planeY[p] = _Set1(_planes[p].y);
+			planeZ[p] = _Set1(_planes[p].z);
+			planeW[p] = _Set1(_planes[p].w);
+		}
+
+		for (; i + LANE_COUNT <= _end; i += LANE_COUNT)
+		{
+			const FloatN x = _Load(&_spheres.centerX[i]);
+			const FloatN y = _Load(&_spheres.centerY[i]);
+			const FloatN z = _Load(&_spheres.centerZ[i]);
+			const FloatN radius = _Mul(_Load(&_spheres.radius[i]), radiusScale);
+			FloatN outside = _Set1(0.0f);
+			uint32_t outsideMask = 0;
+
+			for (size_t p = 0; p < _planes.size(); ++p)
+			{
+				const FloatN distance = _Add(_Add(_Mul(planeX[p], x), _Mul(planeY[p], y)), _Add(_Mul(planeZ[p], z), planeW[p]));
+				outside = _Or(outside, _Greater(distance, radius));
+			}
+
+			outsideMask = _MoveMask(outside);
+			for (size_t lane = 0; lane < LANE_COUNT; ++lane)
+			{
+				_outVisible[i + lane] = static_cast<uint8_t>(((outsideMask >> lane) & 1u) ^ 1u);
+			}
+			visibleCount += LANE_COUNT - std::popcount(outsideMask);
+		}
+#endif
+
+		for (; i < _end; ++i)
+		{
+			const bool outside = _IsSphereOutside(
+				_planes,
+				glm::vec3(_spheres.centerX[i], _spheres.centerY[i], _spheres.centerZ[i]),
+				_spheres.radius[i] * _radiusScale);
+
+			_outVisible[i] = outside ? 0u : 1u;
+			visibleCount += outside ? 0 : 1;
+		}
+
+		return visibleCount;
+	}
+
+	size_t CullCones(
+		const ConeArrays& _cones,
+		const glm::vec3& _eye,
+		size_t _begin,
+		size_t _end,
+		uint8_t* _inoutVisible)
+	{
+		size_t visibleCount = 0;
+		size_t i = _begin;
+
+#if defined(LV_SIMD_AVX2) || defined(LV_SIMD_SSE)
+		const FloatN eyeX = _Set1(_eye.x);
+		const FloatN eyeY = _Set1(_eye.y);
+		const FloatN eyeZ = _Set1(_eye.z);
+
+		for (; i + LANE_COUNT <= _end; i += LANE_COUNT)
+		{
+			const FloatN viewX = _Sub(_Load(&_cones.apexX[i]), eyeX);
+			const FloatN viewY = _Sub(_Load(&_cones.apexY[i]), eyeY);
+			const FloatN viewZ = _Sub(_Load(&_cones.apexZ[i]), eyeZ);
+			const FloatN dot = _Add(_Add(_Mul(viewX, _Load(&_cones.axisX[i])), _Mul(viewY, _Load(&_cones.axisY[i]))), _Mul(viewZ, _Load(&_cones.axisZ[i])));
+			const FloatN length = _Sqrt(_Add(_Add(_Mul(viewX, viewX), _Mul(viewY, viewY)), _Mul(viewZ, viewZ)));
+			const uint32_t backfacingMask = _MoveMask(_GreaterEqual(dot, _Mul(_Load(&_cones.cutoff[i]), length)));
+
+			for (size_t lane = 0; lane < LANE_COUNT; ++lane)
+			{
+				_inoutVisible[i + lane] &= static_cast<uint8_t>(((backfacingMask >> lane) & 1u) ^ 1u);
+				visibleCount += _inoutVisible[i + lane];
+			}
+		}
+#endif
+
+		for (; i < _end; ++i)
+		{
+			if (_inoutVisible[i] != 0u && _IsConeBackfacing(_cones, i, _eye))
+			{
+				_inoutVisible[i] = 0u;
+			}
+			visibleCount += _inoutVisible[i];
+		}
+
+		return visibleCount;
+	}
+
+	void LerpVec3s(
+		const Vec3Arrays& _a,
+		const Vec3Arrays& _b,
+		const float* _t,
+		size_t _begin,
+		size_t _end,
+		Vec3Arrays& _outVecs)
+	{
+		size_t i = _begin;
+
+#if defined(LV_SIMD_AVX2) || defined(LV_SIMD_SSE)
+		for (; i + LANE_COUNT <= _end; i += LANE_COUNT)
+		{
+			const FloatN t = _Load(&_t[i]);
+			const FloatN ax = _Load(&_a.x[i]);
+			const FloatN ay = _Load(&_a.y[i]);
+			const FloatN az = _Load(&_a.z[i]);
+
+			_Store(&_outVecs.x[i], _Add(ax, _Mul(_Sub(_Load(&_b.x[i]), ax), t)));
+			_Store(&_outVecs.y[i], _Add(ay, _Mul(_Sub(_Load(&_b.y[i]), ay), t)));
+			_Store(&_outVecs.z[i], _Add(az, _Mul(_Sub(_Load(&_b.z[i]), az), t)));
+		}
+#endif
+
+		for (; i < _end; ++i)
+		{
+			_outVecs.x[i] = _a.x[i] + (_b.x[i] - _a.x[i]) * _t[i];
+			_outVecs.y[i] = _a.y[i] + (_b.y[i] - _a.y[i]) * _t[i];
+			_outVecs.z[i] = _a.z[i] + (_b.z[i] - _a.z[i]) * _t[i];
+		}
+	}
+
+	void SlerpQuats(
+		const QuatArrays& _a,
+		const QuatArrays& _b,
+		const float* _t,
+		size_t _begin,
+		size_t _end,
+		QuatArrays& _outQuats)
+	{
+		size_t i = _begin;
+
+#if defined(LV_SIMD_AVX2) || defined(LV_SIMD_SSE)
+		const FloatN zero = _Set1(0.0f);
+		const FloatN one = _Set1(1.0f);
+		const FloatN half = _Set1(0.5f);
+		for (; i + LANE_COUNT <= _end; i += LANE_COUNT)
+		{
+			const FloatN ax = _Load(&_a.x[i]);
+			const FloatN ay = _Load(&_a.y[i]);
+			const FloatN az = _Load(&_a.z[i]);
+			const FloatN aw = _Load(&_a.w[i]);
+			const FloatN bx = _Load(&_b.x[i]);
+			const FloatN by = _Load(&_b.y[i]);
+			const FloatN bz = _Load(&_b.z[i]);
+			const FloatN bw = _Load(&_b.w[i]);
+			const FloatN t = _Load(&_t[i]);
+			const FloatN dot = _Add(_Add(_Mul(ax, bx), _Mul(ay, by)), _Add(_Mul(az, bz), _Mul(aw, bw)));
+
+			// flip b to take the shorter arc
+			const FloatN flip = _Greater(zero, dot);
+			const FloatN cosAngle = _Select(flip, _Sub(zero, dot), dot);
+			const FloatN ca = _Add(_Set1(1.0904f), _Mul(cosAngle, _Add(_Set1(-3.2452f), _Mul(cosAngle, _Sub(_Set1(3.55645f), _Mul(cosAngle, _Set1(1.43519f)))))));
+			const FloatN cb = _Add(_Set1(0.848013f), _Mul(cosAngle, _Add(_Set1(-1.06021f), _Mul(cosAngle, _Set1(0.215638f)))));
+			const FloatN tCentered = _Sub(t, half);
+			const FloatN k = _Add(_Mul(ca, _Mul(tCentered, tCentered)), cb);
+			const FloatN correctedT = _Add(t, _Mul(_Mul(t, tCentered), _Mul(_Sub(t, one), k)));
+			const FloatN weightA = _Sub(one, correctedT);
+			const FloatN weightB = _Select(flip, _Sub(zero, correctedT), correctedT);
+
+			const FloatN x = _Add(_Mul(ax, weightA), _Mul(bx, weightB));
+			const FloatN y = _Add(_Mul(ay, weightA), _Mul(by, weightB));
+			const FloatN z = _Add(_Mul(az, weightA), _Mul(bz, weightB));
+			const FloatN w = _Add(_Mul(aw, weightA), _Mul(bw, weightB));
+			const FloatN invLength = _Div(one, _Sqrt(_Add(_Add(_Mul(x, x), _Mul(y, y)), _Add(_Mul(z, z), _Mul(w, w)))));
+
+			_Store(&_outQuats.x[i], _Mul(x, invLength));
+			_Store(&_outQuats.y[i], _Mul(y, invLength));
+			_Store(&_outQuats.z[i], _Mul(z, invLength));
+			_Store(&_outQuats.w[i], _Mul(w, invLength));
+		}
+#endif
+
+		for (; i < _end; ++i)
+		{
+			const glm::quat a = _a.Get(i);
+			const glm::quat b = _b.Get(i);
+			const float dot = glm::dot(a, b);
+			const float correctedT = _CorrectSlerpFactor(std::abs(dot), _t[i]);
+			const float weightB = (dot < 0.0f) ? -correctedT : correctedT;
+
+			_outQuats.Set(i, glm::normalize(a * (1.0f - correctedT) + b * weightB));
+		}
+	}
+
+	size_t CompactIndices(const uint8_t* _visible, size_t _count, uint32_t* _outIndices)
+	{
+		size_t written = 0;
+
+		// branchless, the slot is overwritten until a visible index moves it forward
+		for (size_t i = 0; i < _count; ++i)
+		{
+			_outIndices[written] = static_cast<uint32_t>(i);
+			written += (_visible[i] != 0u) ? 1 : 0;
+		}
+
+		return written;
+	}
+}
@@ -0,0 +1,142 @@
+#pragma once
+#include "common.h"
+#include <array>
+
+// Batched bounds and culling kernels over SoA arrays.
+// AVX2 path is compiled when the compiler targets AVX2 (see LV_ENABLE_AVX2 in CMakeLists.txt),
+// SSE path on other x86 builds and scalar code everywhere else,
+// all paths give the same result up to float rounding
+#if defined(__AVX2__)
+#define LV_SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LV_SIMD_SSE
+#endif
+
+namespace simd_math
+{
+	// Spheres, all arrays have the same size
+	struct SphereArrays
+	{
+		std::vector<float> centerX;
+		std::vector<float> centerY;
+		std::vector<float> centerZ;
+		std::vector<float> radius;
+
+		size_t Size() const { return radius.size(); }
+
+		void Resize(size_t _count);
+
+		void Set(size_t _index, const glm::vec4& _sphere);
+
+		glm::vec4 Get(size_t _index) const;
+	};
+
+	// Normal cones of meshlets, a meshlet faces away from the eye if dot(normalize(apex - eye), axis) >= cutoff,
+	// all arrays have the same size
+	struct ConeArrays
+	{
+		std::vector<float> apexX;
+		std::vector<float> apexY;
+		std::vector<float> apexZ;
+		std::vector<float> axisX;
+		std::vector<float> axisY;
+		std::vector<float> axisZ;
+		std::vector<float> cutoff;
+
+		size_t Size() const { return cutoff.size(); }
+
+		void Resize(size_t _count);
+
+		void Set(size_t _index, const glm::vec3& _apex, const glm::vec3& _axis, float _cutoff);
+	};
+
+	// 3D vectors, all arrays have the same size
+	struct Vec3Arrays
+	{
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<float> z;
+
+		size_t Size() const { return x.size(); }
+
+		void Resize(size_t _count);
+
+		void Set(size_t _index, const glm::vec3& _vec);
+
+		glm::vec3 Get(size_t _index) const { return glm::vec3(x[_index], y[_index], z[_index]); }
+	};
+
+	// Quaternions, all arrays have the same size
+	struct QuatArrays
+	{
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<float> z;
+		std::vector<float> w;
+
+		size_t Size() const { return w.size(); }
+
+		void Resize(size_t _count);
+
+		void Set(size_t _index, const glm::quat& _quat);
+
+		glm::quat Get(size_t _index) const { return glm::quat(w[_index], x[_index], y[_index], z[_index]); }
+	};
+
+	// "AVX2", "SSE" or "Scalar"
+	const char* GetInstructionSet();
+
+	// Smallest sphere that encloses both spheres, scalar
+	glm::vec4 MergeSphere(const glm::vec4& _a, const glm::vec4& _b);
+
+	// _outMerged[i] is the smallest sphere that encloses _a[i] and _b[i], _outMerged can be _a or _b
+	void MergeSpheres(const SphereArrays& _a, const SphereArrays& _b, SphereArrays& _outMerged);
+
+	// Sphere around the center of the bounding box of all spheres that encloses them,
+	// not the minimal one but cheap, _spheres must not be empty
+	glm::vec4 ComputeEnclosingSphere(const SphereArrays& _spheres);
+
+	// Test spheres [_begin, _end) against planes, _outVisible[i] is 1 if sphere i is not completely outside any plane, 0 otherwise,
+	// return count of visible spheres in the range
+	// _planes: dot(plane, vec4(p, 1)) > 0 means outside, see Frustum
+	// _radiusScale: radius is multiplied by it, e.g. max scale of model when planes are moved to object space
+	size_t CullSpheres(
+		const SphereArrays& _spheres,
+		const std::array<glm::vec4, 6>& _planes,
+		float _radiusScale,
+		size_t _begin,
+		size_t _end,
+		uint8_t* _outVisible);
+
+	// Clear _inoutVisible[i] of cones [_begin, _end) that face away from _eye,
+	// return count of visible cones left in the range
+	size_t CullCones(
+		const ConeArrays& _cones,
+		const glm::vec3& _eye,
+		size_t _begin,
+		size_t _end,
+		uint8_t* _inoutVisible);
+
+	// _outVecs[i] = mix(_a[i], _b[i], _t[i]) for i in [_begin, _end), _outVecs must be as large as inputs
+	void LerpVec3s(
+		const Vec3Arrays& _a,
+		const Vec3Arrays& _b,
+		const float* _t,
+		size_t _begin,
+		size_t _end,
+		Vec3Arrays& _outVecs);
+
+	// _outQuats[i] = slerp(_a[i], _b[i], _t[i]) for i in [_begin, _end) along the shorter arc, inputs must be normalized,
+	// slerp is approximated by nlerp with a corrected t (see "Approximating slerp", Arseny Kapoulkine),
+	// angle error stays below 1e-3 radians, output is normalized, _outQuats must be as large as inputs
+	void SlerpQuats(
+		const QuatArrays& _a,
+		const QuatArrays& _b,
+		const float* _t,
+		size_t _begin,
+		size_t _end,
+		QuatArrays& _outQuats);
+
+	// Write indices of nonzero elements of _visible[0, _count) to _outIndices in order, return how many are written
+	size_t CompactIndices(const uint8_t* _visible, size_t _count, uint32_t* _outIndices);
+}
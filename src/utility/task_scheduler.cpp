@@ -1 +1,71 @@
-#include "task_scheduler.h"
\ No newline at end of file
+#include "task_scheduler.h"
+#include <algorithm>
+
+std::unique_ptr<MyTaskScheduler> MyTaskScheduler::s_uptrInstance = nullptr;
+
+MyTaskScheduler::MyTaskScheduler()
+{
+}
+
+MyTaskScheduler::~MyTaskScheduler()
+{
+	if (m_initialized) Uninit();
+}
+
+void MyTaskScheduler::Init()
+{
+	if (m_initialized) return;
+	m_scheduler.Initialize();
+	m_initialized = true;
+}
+
+void MyTaskScheduler::Uninit()
+{
+	if (!m_initialized) return;
+	m_scheduler.WaitforAllAndShutdown();
+	m_initialized = false;
+}
+
+uint32_t MyTaskScheduler::GetThreadCount() const
+{
+	return m_initialized ? m_scheduler.GetNumTaskThreads() : 1u;
+}
+
+void MyTaskScheduler::ParallelFor(
+	uint32_t inCount,
+	uint32_t inMinRange,
+	const std::function<void(uint32_t, uint32_t, uint32_t)>& inFunc)
+{
+	if (inCount == 0) return;
+
+	// not worth waking up other threads, a worker running this inline keeps its own thread index
+	// so it doesn't share per-thread scratch with another worker
+	if (!m_initialized || inCount <= inMinRange || GetThreadCount() == 1)
+	{
+		const uint32_t threadIndex = m_initialized ? m_scheduler.GetThreadNum() : 0u;
+
+		inFunc(0, inCount, threadIndex < GetThreadCount() ? threadIndex : 0u);
+		return;
+	}
+
+	enki::TaskSet taskSet(
+		inCount,
+		[&inFunc](enki::TaskSetPartition range, uint32_t threadIndex)
+		{
+			inFunc(range.start, range.end, threadIndex);
+		});
+	taskSet.m_MinRange = std::max(inMinRange, 1u);
+
+	m_scheduler.AddTaskSetToPipe(&taskSet);
+	m_scheduler.WaitforTask(&taskSet);
+}
+
+MyTaskScheduler& MyTaskScheduler::GetInstance()
+{
+	if (s_uptrInstance.get() == nullptr)
+	{
+		s_uptrInstance = std::make_unique<MyTaskScheduler>();
+		s_uptrInstance->Init();
+	}
+	return *s_uptrInstance;
+}
@@ -1,10 +1,46 @@
 #pragma once
 #include <enkiTS/src/TaskScheduler.h>
+#include <memory>
+#include <functional>
 
-class MyTaskScheduler
+// Wrapper class for enkiTS task scheduler, one scheduler is shared by the whole application
+class MyTaskScheduler final
 {
+private:
+	static std::unique_ptr<MyTaskScheduler> s_uptrInstance;
+
+	enki::TaskScheduler m_scheduler;
+	bool				m_initialized = false;
+
+private:
+	MyTaskScheduler();
+	MyTaskScheduler(const MyTaskScheduler& _other) = delete;
+
 public:
+	~MyTaskScheduler();
+
+	// initialize worker threads, one for each hardware thread
+	void Init();
 
+	void Uninit();
+
+	// number of threads that may run tasks, including the calling thread
+	uint32_t GetThreadCount() const;
+
+	// Split [0, inCount) into ranges and run inFunc(begin, end, threadIndex) on worker threads,
+	// returns when all ranges are done, the calling thread also takes part in the work.
+	// It is safe to call this inside another ParallelFor
+	// inCount: number of items to process
+	// inMinRange: minimum number of items in each range, use larger value for cheap items
+	// inFunc: process items in [begin, end), threadIndex < GetThreadCount()
+	void ParallelFor(
+		uint32_t inCount,
+		uint32_t inMinRange,
+		const std::function<void(uint32_t, uint32_t, uint32_t)>& inFunc);
+
+	static MyTaskScheduler& GetInstance();
+
+	friend std::unique_ptr<MyTaskScheduler> std::make_unique<MyTaskScheduler>();
 };
 
 class RunPinnedTaskLoopTask
@@ -29,4 +65,4 @@ public:
 
 public:
 	void Execute();
-};
\ No newline at end of file
+};
@@ -1,12 +1,31 @@
+#if defined(_WIN32)
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	ifndef WIN32_LEAN_AND_MEAN
+#		define WIN32_LEAN_AND_MEAN
+#	endif
+#	include <windows.h>
+#else
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
 #include "utils.h"
+#include "my_mesh_optimizer.h"
+#include "task_scheduler.h"
 #include <meshoptimizer.h>
 #include <tiny_obj_loader.h>
+#include <experimental/tinyobj_loader_opt.h>
+#undef atoll // tinyobj_loader_opt maps it to _atoi64 on Windows
 #include <tiny_gltf.h>
 #include <numeric>
+#include <algorithm>
 #include "transform.h"
 #include <fstream>
 
-bool MeshUtility::Load(const std::string& objFile, std::vector<StaticMesh>& outMesh)
+bool MeshUtility::Load(const std::string& objFile, std::vector<StaticMeshStreams>& outMesh)
 {
 	bool bSuccess = false;
 	tinyobj::attrib_t attrib;
@@ -17,84 +36,213 @@ bool MeshUtility::Load(const std::string& objFile, std::vector<StaticMesh>& outM
 	
 	for (const auto& shape : shapes)
 	{
-		StaticMesh mesh{};
-		for (const auto& index : shape.mesh.indices)
+		StaticMeshStreams mesh{};
+		const size_t indexCount = shape.mesh.indices.size();
+
+		// an attribute is present if any face corner has it, corners without it get zero
+		if (std::any_of(shape.mesh.indices.begin(), shape.mesh.indices.end(), [](const tinyobj::index_t& _index) { return _index.normal_index != -1; }))
+		{
+			mesh.attributeMask |= static_cast<uint32_t>(VertexAttribute::NORMAL);
+		}
+		if (std::any_of(shape.mesh.indices.begin(), shape.mesh.indices.end(), [](const tinyobj::index_t& _index) { return _index.texcoord_index != -1; }))
+		{
+			mesh.attributeMask |= static_cast<uint32_t>(VertexAttribute::UV);
+		}
+		mesh.ResizeVertices(indexCount);
+		mesh.indices.resize(indexCount);
+
+		for (size_t i = 0; i < indexCount; ++i)
 		{
-			Vertex vertex{};
-			vertex.position = {
+			const auto& index = shape.mesh.indices[i];
+
+			mesh.positions[i] = {
 				attrib.vertices[3 * index.vertex_index + 0],
 				attrib.vertices[3 * index.vertex_index + 1],
 				attrib.vertices[3 * index.vertex_index + 2]
 			};
-			if (index.texcoord_index != -1)
+			if (mesh.HasAttribute(VertexAttribute::UV) && index.texcoord_index != -1)
 			{
-				vertex.uv = {
+				mesh.uvs[i] = {
 					attrib.texcoords[2 * index.texcoord_index + 0],
 					1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
 				};
 			}
-			if (index.normal_index != -1)
+			if (mesh.HasAttribute(VertexAttribute::NORMAL) && index.normal_index != -1)
 			{
-				vertex.normal = {
+				mesh.normals[i] = {
 					attrib.normals[3 * index.normal_index + 0],
 					attrib.normals[3 * index.normal_index + 1],
 					attrib.normals[3 * index.normal_index + 2],
 				};
 			}
-			mesh.indices.push_back(static_cast<uint32_t>(mesh.verts.size()));
-			mesh.verts.push_back(vertex);
+			mesh.indices[i] = static_cast<uint32_t>(i);
 		}
 		// apply optimizer
 		_OptimizeMesh(mesh);
-		outMesh.push_back(mesh);
+		outMesh.push_back(std::move(mesh));
 	}
 	bSuccess = true;
 	return bSuccess;
 }
 
-void MeshUtility::_OptimizeMesh(StaticMesh& mesh)
+bool MeshUtility::Load(const std::string& objFile, std::vector<StaticMesh>& outMesh)
 {
-	std::vector<uint32_t> remap(std::max(mesh.indices.size(), mesh.verts.size()));
-	std::vector<uint32_t> dstIndices(mesh.indices.size());
-	std::vector<Vertex> dstVerts(mesh.verts.size());
-	size_t indexCount = mesh.indices.size();
-	size_t vertexCount = meshopt_generateVertexRemapCustom(
-		remap.data(),
-		mesh.indices.data(),
-		mesh.indices.size(),
-		reinterpret_cast<const float*>(mesh.verts.data()),
-		mesh.verts.size(),
-		sizeof(Vertex),
-		[&](unsigned int l, unsigned int r) {
-			const Vertex& lv = mesh.verts[l];
-			const Vertex& rv = mesh.verts[r];
-			return lv == rv;
+	std::vector<StaticMeshStreams> meshStreams;
+
+	if (!Load(objFile, meshStreams)) return false;
+
+	for (const auto& streams : meshStreams)
+	{
+		StaticMesh mesh{};
+
+		streams.ToStaticMesh(mesh);
+		outMesh.push_back(std::move(mesh));
+	}
+	return true;
+}
+
+bool MeshUtility::LoadParallel(const std::string& objFile, std::vector<StaticMeshStreams>& outMesh)
+{
+	// key of a face corner, attributes a shape doesn't have are set to -1
+	struct IndexTriple
+	{
+		int position;
+		int texcoord;
+		int normal;
+		bool operator==(const IndexTriple& other) const
+		{
+			return position == other.position && texcoord == other.texcoord && normal == other.normal;
 		}
-	);
-	dstIndices.resize(indexCount);
-	dstVerts.resize(vertexCount);
-	meshopt_remapVertexBuffer(dstVerts.data(), mesh.verts.data(), mesh.verts.size(), sizeof(Vertex), remap.data());
-	meshopt_remapIndexBuffer(dstIndices.data(), mesh.indices.data(), indexCount, remap.data());
-	meshopt_optimizeVertexCache(mesh.indices.data(), dstIndices.data(), indexCount, vertexCount);
-	meshopt_optimizeOverdraw(
-		dstIndices.data(),
-		mesh.indices.data(),
-		indexCount,
-		reinterpret_cast<const float*>(dstVerts.data()),
-		vertexCount,
-		sizeof(Vertex),
-		1.0f
-	);
-	vertexCount = meshopt_optimizeVertexFetch(
-		mesh.verts.data(),
-		dstIndices.data(),
-		indexCount,
-		dstVerts.data(),
-		vertexCount,
-		sizeof(Vertex)
-	);
-	mesh.verts.resize(vertexCount);
-	mesh.indices = std::move(dstIndices);
+	};
+	struct IndexTripleHash
+	{
+		size_t operator()(const IndexTriple& triple) const
+		{
+			return static_cast<size_t>(common_utils::HashBytes(&triple, sizeof(IndexTriple)));
+		}
+	};
+	MyTaskScheduler& scheduler = MyTaskScheduler::GetInstance();
+	common_utils::MappedFile file{};
+	tinyobj_opt::attrib_t attrib;
+	std::vector<tinyobj_opt::shape_t> shapes;
+	std::vector<tinyobj_opt::material_t> materials;
+	tinyobj_opt::LoadOption option{};
+	std::vector<size_t> faceIndexOffsets;
+	std::vector<StaticMeshStreams> shapeMeshes;
+
+	if (!file.Open(objFile)) return false;
+	option.req_num_threads = static_cast<int>(scheduler.GetThreadCount());
+	option.triangulate = true;
+	if (!tinyobj_opt::parseObj(&attrib, &shapes, &materials, reinterpret_cast<const char*>(file.GetData()), file.GetSize(), option)) return false;
+
+	// shapes point to faces, index offset of each face is the prefix sum of face sizes
+	faceIndexOffsets.resize(attrib.face_num_verts.size() + 1, 0);
+	for (size_t i = 0; i < attrib.face_num_verts.size(); ++i)
+	{
+		faceIndexOffsets[i + 1] = faceIndexOffsets[i] + static_cast<size_t>(attrib.face_num_verts[i]);
+	}
+
+	shapeMeshes.resize(shapes.size());
+	scheduler.ParallelFor(static_cast<uint32_t>(shapes.size()), 1, [&](uint32_t inBegin, uint32_t inEnd, uint32_t inThreadIndex)
+		{
+			MeshOptimizer optimizer{};
+
+			for (uint32_t i = inBegin; i < inEnd; ++i)
+			{
+				const auto& shape = shapes[i];
+				const size_t indexBegin = faceIndexOffsets[shape.face_offset];
+				const size_t indexCount = faceIndexOffsets[shape.face_offset + shape.length] - indexBegin;
+				StaticMeshStreams& mesh = shapeMeshes[i];
+				std::unordered_map<IndexTriple, uint32_t, IndexTripleHash> vertexMap;
+				std::vector<IndexTriple> uniqueTriples;
+
+				if (indexCount == 0) continue;
+
+				// an attribute is present if any face corner has it, corners without it get zero
+				for (size_t k = indexBegin; k < indexBegin + indexCount; ++k)
+				{
+					if (attrib.indices[k].normal_index >= 0)
+					{
+						mesh.attributeMask |= static_cast<uint32_t>(VertexAttribute::NORMAL);
+					}
+					if (attrib.indices[k].texcoord_index >= 0)
+					{
+						mesh.attributeMask |= static_cast<uint32_t>(VertexAttribute::UV);
+					}
+				}
+
+				// deduplicate face corners, attribute values are only read for unique ones
+				mesh.indices.resize(indexCount);
+				vertexMap.reserve(indexCount);
+				uniqueTriples.reserve(indexCount);
+				for (size_t k = 0; k < indexCount; ++k)
+				{
+					const auto& index = attrib.indices[indexBegin + k];
+					IndexTriple triple{ index.vertex_index, -1, -1 };
+
+					if (mesh.HasAttribute(VertexAttribute::UV))
+					{
+						triple.texcoord = std::max(index.texcoord_index, -1);
+					}
+					if (mesh.HasAttribute(VertexAttribute::NORMAL))
+					{
+						triple.normal = std::max(index.normal_index, -1);
+					}
+
+					auto [it, inserted] = vertexMap.try_emplace(triple, static_cast<uint32_t>(uniqueTriples.size()));
+					if (inserted)
+					{
+						uniqueTriples.push_back(triple);
+					}
+					mesh.indices[k] = it->second;
+				}
+
+				mesh.ResizeVertices(uniqueTriples.size());
+				for (size_t k = 0; k < uniqueTriples.size(); ++k)
+				{
+					const auto& triple = uniqueTriples[k];
+
+					mesh.positions[k] = {
+						attrib.vertices[3 * triple.position + 0],
+						attrib.vertices[3 * triple.position + 1],
+						attrib.vertices[3 * triple.position + 2]
+					};
+					if (mesh.HasAttribute(VertexAttribute::UV) && triple.texcoord >= 0)
+					{
+						mesh.uvs[k] = {
+							attrib.texcoords[2 * triple.texcoord + 0],
+							1.0f - attrib.texcoords[2 * triple.texcoord + 1]
+						};
+					}
+					if (mesh.HasAttribute(VertexAttribute::NORMAL) && triple.normal >= 0)
+					{
+						mesh.normals[k] = {
+							attrib.normals[3 * triple.normal + 0],
+							attrib.normals[3 * triple.normal + 1],
+							attrib.normals[3 * triple.normal + 2],
+						};
+					}
+				}
+
+				// vertices are unique already, only reorder them
+				optimizer.OptimizeMeshOrder(mesh);
+			}
+		});
+
+	outMesh.reserve(outMesh.size() + shapeMeshes.size());
+	for (auto& mesh : shapeMeshes)
+	{
+		if (mesh.indices.empty()) continue;
+		outMesh.push_back(std::move(mesh));
+	}
+	return true;
+}
+
+void MeshUtility::_OptimizeMesh(StaticMeshStreams& mesh)
+{
+	MeshOptimizer optimizer{};
+
+	optimizer.OptimizeMesh(mesh);
 }
 
 void MeshUtility::_OptimizeMeshToVertexCacheStage(StaticMesh& mesh)
@@ -149,3 +297,110 @@ std::string common_utils::GetFileExtension(const std::string& _filePath)
 
 	return ret;
 }
+
+bool common_utils::WriteFile(const std::string& _filePath, const void* _data, size_t _size)
+{
+	std::ofstream file(_filePath, std::ios::binary | std::ios::trunc);
+
+	if (!file.is_open()) return false;
+	file.write(reinterpret_cast<const char*>(_data), _size);
+	file.close();
+
+	return file.good();
+}
+
+uint64_t common_utils::HashBytes(const void* _data, size_t _size, uint64_t _seed)
+{
+	const uint64_t prime = 1099511628211ull;
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(_data);
+	uint64_t hashValue = _seed;
+
+	for (size_t i = 0; i < _size; ++i)
+	{
+		hashValue ^= bytes[i];
+		hashValue *= prime;
+	}
+
+	return hashValue;
+}
+
+common_utils::MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool common_utils::MappedFile::Open(const std::string& _filePath)
+{
+	Close();
+#if defined(_WIN32)
+	LARGE_INTEGER fileSize{};
+	HANDLE hFile = CreateFileA(_filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if (hFile == INVALID_HANDLE_VALUE) return false;
+	if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(hFile);
+		return false;
+	}
+
+	HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (hMapping == NULL)
+	{
+		CloseHandle(hFile);
+		return false;
+	}
+
+	void* pView = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+	if (pView == nullptr)
+	{
+		CloseHandle(hMapping);
+		CloseHandle(hFile);
+		return false;
+	}
+
+	m_hFile = hFile;
+	m_hMapping = hMapping;
+	m_pData = static_cast<const uint8_t*>(pView);
+	m_size = static_cast<size_t>(fileSize.QuadPart);
+#else
+	struct stat fileStat{};
+	int fd = open(_filePath.c_str(), O_RDONLY);
+
+	if (fd < 0) return false;
+	if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	void* pView = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	if (pView == MAP_FAILED)
+	{
+		close(fd);
+		return false;
+	}
+
+	m_fd = fd;
+	m_pData = static_cast<const uint8_t*>(pView);
+	m_size = static_cast<size_t>(fileStat.st_size);
+#endif
+	return true;
+}
+
+void common_utils::MappedFile::Close()
+{
+	if (m_pData == nullptr) return;
+#if defined(_WIN32)
+	UnmapViewOfFile(m_pData);
+	CloseHandle(static_cast<HANDLE>(m_hMapping));
+	CloseHandle(static_cast<HANDLE>(m_hFile));
+	m_hMapping = nullptr;
+	m_hFile = nullptr;
+#else
+	munmap(const_cast<uint8_t*>(m_pData), m_size);
+	close(m_fd);
+	m_fd = -1;
+#endif
+	m_pData = nullptr;
+	m_size = 0;
+}
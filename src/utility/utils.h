@@ -6,11 +6,22 @@
 class MeshUtility
 {
 private:
-	static void _OptimizeMesh(StaticMesh& mesh);
+	static void _OptimizeMesh(StaticMeshStreams& mesh);
 	static void _OptimizeMeshToVertexCacheStage(StaticMesh& mesh);
 
 public:
+	// Load each shape of .obj file as an optimized mesh, vertices are stored in attribute streams
+	static bool Load(const std::string& objFile, std::vector<StaticMeshStreams>& outMesh);
+
+	// Same as above, converted to Vertex form
 	static bool Load(const std::string& objFile, std::vector<StaticMesh>& outMesh);
+
+	// Faster Load for large .obj files:
+	// the file is mapped and parsed by tinyobj_loader_opt on multiple threads,
+	// face corners are deduplicated by their position/texcoord/normal index triple
+	// (so equal values with different indices in the file stay apart)
+	// and shapes are optimized on worker threads, empty shapes are skipped
+	static bool LoadParallel(const std::string& objFile, std::vector<StaticMeshStreams>& outMesh);
 };
 
 namespace common_utils
@@ -38,9 +49,44 @@ namespace common_utils
 	// Read file from file path
 	void ReadFile(const std::string& _filePath, std::vector<uint8_t>& _output);
 
+	// Write bytes to file, overwrite the file if it exists, return whether all bytes are written
+	bool WriteFile(const std::string& _filePath, const void* _data, size_t _size);
+
 	// Get extension name from file path
 	std::string GetFileExtension(const std::string& _filePath);
 
+	// FNV-1a hash of bytes, pass the result of the last call as _seed to hash data in pieces
+	uint64_t HashBytes(const void* _data, size_t _size, uint64_t _seed = 14695981039346656037ull);
+
+	// Read only file mapped into memory, the mapping is released when the object is destroyed
+	class MappedFile final
+	{
+	private:
+		const uint8_t* m_pData = nullptr;
+		size_t m_size = 0;
+#if defined(_WIN32)
+		void* m_hFile = nullptr;
+		void* m_hMapping = nullptr;
+#else
+		int m_fd = -1;
+#endif
+
+	public:
+		MappedFile() = default;
+		MappedFile(const MappedFile& _other) = delete;
+		MappedFile& operator=(const MappedFile& _other) = delete;
+		~MappedFile();
+
+		// Map the whole file, return false if file cannot be opened or is empty
+		bool Open(const std::string& _filePath);
+
+		void Close();
+
+		const uint8_t* GetData() const { return m_pData; }
+
+		size_t GetSize() const { return m_size; }
+	};
+
 	// Used for unordered_... when std::pair as key
 	// e.g. unordered_map<pair<T1, T2>, int, common_utils::PairHash>
 	struct PairHash
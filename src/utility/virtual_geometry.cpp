@@ -1,50 +1,208 @@
 #include "virtual_geometry.h"
 #include "my_mesh_optimizer.h"
 #include "utils.h"
+#include "task_scheduler.h"
+#include "simd_math.h"
 #include <unordered_set>
+#include <unordered_map>
 #include <functional>
 #include <numeric>
 #include <algorithm>
+#include <chrono>
+#include <limits>
+#include <glm/gtc/packing.hpp>
 
 namespace
 {
-	glm::vec4 _MergeBounds(const glm::vec4& inSphere1, const glm::vec4& inSphere2)
+	constexpr uint32_t s_compactEncodingFlag = 0x80000000u;	// in the first word of ClusterGroupData
+	constexpr uint32_t s_compactWideVertexFlag = 0x1u;
+	constexpr uint32_t s_compactHeaderSize = 9;
+	constexpr uint32_t s_compactClusterStride = 4;
+	constexpr uint32_t s_cacheVertexWordCount = 9;	// words of a vertex in cache file
+
+	// Largest fp16 not larger than a non-negative value
+	uint16_t _PackHalfRoundDown(float inValue)
 	{
-		glm::vec4 result{};
+		uint16_t result = glm::packHalf1x16(std::min(inValue, 65504.0f));
+		if (result > 0 && glm::unpackHalf1x16(result) > inValue) --result;
+		return result;
+	}
 
-		// center
-		result.x = (inSphere1.x + inSphere2.x) * 0.5f;
-		result.y = (inSphere1.y + inSphere2.y) * 0.5f;
-		result.z = (inSphere1.z + inSphere2.z) * 0.5f;
+	// Smallest fp16 not smaller than a non-negative value, infinity if it's out of range
+	uint16_t _PackHalfRoundUp(float inValue)
+	{
+		if (inValue > 65504.0f) return 0x7C00;
+		uint16_t result = glm::packHalf1x16(inValue);
+		if (glm::unpackHalf1x16(result) < inValue) ++result;
+		return result;
+	}
 
-		// radius
-		result.w =
-			std::max(inSphere1.w, inSphere2.w)
-			+ glm::distance(glm::vec3(result.x, result.y, result.z), glm::vec3(inSphere1.x, inSphere1.y, inSphere1.z));
+	// Stable LSD radix sort on 64-bit keys, byte passes that don't change the order are skipped
+	template<typename T, typename GetKeyFunc>
+	void _RadixSort(std::vector<T>& inoutItems, GetKeyFunc inGetKey)
+	{
+		std::array<std::array<uint32_t, 256>, 8> histograms{};
+		std::vector<T> scratch;
 
-		return result;
+		for (const auto& item : inoutItems)
+		{
+			uint64_t key = inGetKey(item);
+			for (uint32_t pass = 0; pass < 8; ++pass)
+			{
+				histograms[pass][(key >> (pass * 8)) & 0xFF]++;
+			}
+		}
+
+		scratch.resize(inoutItems.size());
+		for (uint32_t pass = 0; pass < 8; ++pass)
+		{
+			auto& histogram = histograms[pass];
+			uint32_t offset = 0;
+
+			// all items fall into one bucket
+			if (std::find(histogram.begin(), histogram.end(), static_cast<uint32_t>(inoutItems.size())) != histogram.end()) continue;
+
+			for (auto& count : histogram)
+			{
+				uint32_t bucketSize = count;
+				count = offset;
+				offset += bucketSize;
+			}
+			for (const auto& item : inoutItems)
+			{
+				scratch[histogram[(inGetKey(item) >> (pass * 8)) & 0xFF]++] = item;
+			}
+			std::swap(inoutItems, scratch);
+		}
+	}
+
+	// Sphere that encloses all input spheres, exact solution is expensive,
+	// so take the smaller one of merging spheres and the sphere around center of their bounding box.
+	// Groups and hierarchy nodes have a few children and stay on scalar code, copying to SoA kernels
+	// only pays off for larger inputs like the partition cost of hierarchy build
+	glm::vec4 _ComputeEnclosingSphere(std::span<const glm::vec4> inSpheres)
+	{
+		constexpr size_t minSimdSphereCount = 16;
+
+		if (inSpheres.size() < minSimdSphereCount)
+		{
+			glm::vec4 merged = inSpheres[0];
+			glm::vec3 boxMin = glm::vec3(inSpheres[0]) - inSpheres[0].w;
+			glm::vec3 boxMax = glm::vec3(inSpheres[0]) + inSpheres[0].w;
+			glm::vec3 boxCenter{};
+			float boxRadius = 0.0f;
+
+			for (size_t i = 1; i < inSpheres.size(); ++i)
+			{
+				merged = simd_math::MergeSphere(merged, inSpheres[i]);
+				boxMin = glm::min(boxMin, glm::vec3(inSpheres[i]) - inSpheres[i].w);
+				boxMax = glm::max(boxMax, glm::vec3(inSpheres[i]) + inSpheres[i].w);
+			}
+			boxCenter = (boxMin + boxMax) * 0.5f;
+			for (const auto& sphere : inSpheres)
+			{
+				boxRadius = std::max(boxRadius, glm::distance(boxCenter, glm::vec3(sphere)) + sphere.w);
+			}
+
+			return boxRadius < merged.w ? glm::vec4(boxCenter, boxRadius) : merged;
+		}
+
+		// hierarchy is built on worker threads, each one keeps its own arrays
+		thread_local simd_math::SphereArrays spheres{};
+		thread_local simd_math::SphereArrays lower{};
+		thread_local simd_math::SphereArrays upper{};
+		size_t count = inSpheres.size();
+		glm::vec4 boxSphere{};
+		glm::vec4 merged{};
+
+		auto funcCopyRange = [&](size_t inBegin, size_t inCount, simd_math::SphereArrays& outSpheres)
+			{
+				outSpheres.Resize(inCount);
+				std::copy_n(spheres.centerX.begin() + inBegin, inCount, outSpheres.centerX.begin());
+				std::copy_n(spheres.centerY.begin() + inBegin, inCount, outSpheres.centerY.begin());
+				std::copy_n(spheres.centerZ.begin() + inBegin, inCount, outSpheres.centerZ.begin());
+				std::copy_n(spheres.radius.begin() + inBegin, inCount, outSpheres.radius.begin());
+			};
+
+		spheres.Resize(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			spheres.Set(i, inSpheres[i]);
+		}
+		boxSphere = simd_math::ComputeEnclosingSphere(spheres);
+
+		// merge sphere i with sphere i + half while there are enough spheres, the odd one waits for the next round
+		while (count >= minSimdSphereCount)
+		{
+			const size_t half = count / 2;
+
+			funcCopyRange(0, half, lower);
+			funcCopyRange(half, half, upper);
+			simd_math::MergeSpheres(lower, upper, lower);
+			if (count % 2 == 1)
+			{
+				spheres.Set(half, spheres.Get(count - 1));
+			}
+			std::copy(lower.centerX.begin(), lower.centerX.end(), spheres.centerX.begin());
+			std::copy(lower.centerY.begin(), lower.centerY.end(), spheres.centerY.begin());
+			std::copy(lower.centerZ.begin(), lower.centerZ.end(), spheres.centerZ.begin());
+			std::copy(lower.radius.begin(), lower.radius.end(), spheres.radius.begin());
+			count = half + count % 2;
+		}
+		merged = spheres.Get(0);
+		for (size_t i = 1; i < count; ++i)
+		{
+			merged = simd_math::MergeSphere(merged, spheres.Get(i));
+		}
+
+		return boxSphere.w < merged.w ? boxSphere : merged;
 	}
 }
 
 const std::vector<Vertex>& VirtualGeometry::_GetCompleteVertices(uint32_t inLod) const
 {
-	return m_pBaseMesh->verts;
+	return inLod == 0 ? m_pBaseMesh->verts : m_meshlets[inLod].vertices;
+}
+
+void VirtualGeometry::MeshletLevel::GetIndices(uint32_t inMeshletId, std::vector<uint32_t>& outIndices) const
+{
+	const auto& range = ranges[inMeshletId];
+	for (uint32_t i = 0; i < range.triangleCount * 3; ++i)
+	{
+		uint8_t localIndex = pools.meshletIndices[range.indexOffset + i];
+		outIndices.push_back(pools.meshletVertices[range.vertexOffset + localIndex]);
+	}
+}
+
+void VirtualGeometry::MeshletLevel::ReleasePools()
+{
+	vertices.clear();
+	vertices.shrink_to_fit();
+	pools.meshletVertices.clear();
+	pools.meshletVertices.shrink_to_fit();
+	pools.meshletIndices.clear();
+	pools.meshletIndices.shrink_to_fit();
+	ranges.clear();
+	ranges.shrink_to_fit();
 }
 
 void VirtualGeometry::_AddMyMeshlet(
 	uint32_t inLod, 
 	float inError, 
-	const std::vector<Meshlet>& inNewMeshlets, 
-	const std::vector<uint32_t>& inChildren, 
+	const Meshlet::DeviceData& inNewMeshletData,
+	const std::vector<Meshlet::DeviceDataRef>& inNewMeshlets, 
+	const std::vector<MeshletBounds>& inNewBounds,
+	uint32_t inChildGroup, 
 	uint32_t* outFirstIndexPtr, 
 	uint32_t* outNumAddedPtr)
 {
-	auto& vectorToAdd = m_meshlets[inLod];
-	uint32_t firstIndex = vectorToAdd.size();
+	auto& levelToAdd = m_meshlets[inLod];
+	uint32_t firstIndex = levelToAdd.Size();
 	uint32_t numAdded = inNewMeshlets.size();
+	uint32_t vertexBase = levelToAdd.pools.meshletVertices.size();
+	uint32_t indexBase = levelToAdd.pools.meshletIndices.size();
 	float tinyClusterMaxError = 0.0f;	// maximum of all childrens' cluster error
 	float clusterError = 0.0f;			// all children have the same cluster error
-	MeshOptimizer optimizer{};
 	
 	if (outFirstIndexPtr != nullptr)
 	{
@@ -58,45 +216,53 @@ void VirtualGeometry::_AddMyMeshlet(
 	// find maximum error of tiny clusters
 	if (inLod > 0)
 	{
-		uint32_t finerLOD = inLod - 1;
-		for (size_t i = 0; i < inChildren.size(); ++i)
+		const auto& finerLevel = m_meshlets[inLod - 1];
+		for (auto childId : m_groups[inLod - 1][inChildGroup])
 		{
-			const MyMeshlet& parentMeshlet = m_meshlets[finerLOD][inChildren[i]];
-			tinyClusterMaxError = std::max(tinyClusterMaxError, parentMeshlet.clusterError);
+			tinyClusterMaxError = std::max(tinyClusterMaxError, finerLevel.clusterError[childId]);
 		}
 	}
 	clusterError = inError + tinyClusterMaxError;
 
-	// fill in new myMeshlets
+	// append pools of new meshlets
+	levelToAdd.pools.meshletVertices.insert(
+		levelToAdd.pools.meshletVertices.end(), 
+		inNewMeshletData.meshletVertices.begin(), 
+		inNewMeshletData.meshletVertices.end());
+	levelToAdd.pools.meshletIndices.insert(
+		levelToAdd.pools.meshletIndices.end(), 
+		inNewMeshletData.meshletIndices.begin(), 
+		inNewMeshletData.meshletIndices.end());
+
+	// fill in new meshlets
 	for (uint32_t i = 0; i < numAdded; ++i)
 	{
-		MyMeshlet myMeshlet{};
-		std::vector<uint32_t> indices;
-
-		inNewMeshlets[i].GetIndices(indices);
-		auto bounds = optimizer.ComputeBounds(_GetCompleteVertices(inLod), indices);
-		
-		myMeshlet.firstLove = firstIndex;
-		myMeshlet.loverCount = numAdded;
-		myMeshlet.lod = inLod;
-		myMeshlet.meshlet = inNewMeshlets[i];
-		myMeshlet.children = inChildren;
-		myMeshlet.boundingSphere = glm::vec4(bounds.center, bounds.radius);
-		myMeshlet.clusterError = clusterError;
-		myMeshlet.groupError = FLT_MAX; // to be filled later by its parent(Larger clusters)
-
-		vectorToAdd.push_back(myMeshlet);
+		Meshlet::DeviceDataRef range = inNewMeshlets[i];
+
+		range.vertexOffset += vertexBase;
+		range.indexOffset += indexBase;
+		levelToAdd.ranges.push_back(range);
+
+		const auto& bounds = inNewBounds[i];
+
+		levelToAdd.firstLove.push_back(firstIndex);
+		levelToAdd.loverCount.push_back(numAdded);
+		levelToAdd.parent.push_back(~0u);
+		levelToAdd.childGroup.push_back(inChildGroup);
+		levelToAdd.boundingSphere.push_back(glm::vec4(bounds.center, bounds.radius));
+		levelToAdd.clusterError.push_back(clusterError);
+		levelToAdd.groupError.push_back(FLT_MAX); // to be filled later by its parent(Larger clusters)
+		levelToAdd.groupIndex.push_back(~0u);
 	}
 
 	// update children(Tiny clusters)
 	if (inLod > 0)
 	{
-		uint32_t finerLOD = inLod - 1;
-		for (size_t i = 0; i < inChildren.size(); ++i)
+		auto& finerLevel = m_meshlets[inLod - 1];
+		for (auto childId : m_groups[inLod - 1][inChildGroup])
 		{
-			MyMeshlet& childMeshlet = m_meshlets[finerLOD][inChildren[i]];
-			childMeshlet.parent = firstIndex;
-			childMeshlet.groupError = clusterError; // all children have the same group error
+			finerLevel.parent[childId] = firstIndex;
+			finerLevel.groupError[childId] = clusterError; // all children have the same group error
 		}
 	}
 }
@@ -107,126 +273,116 @@ void VirtualGeometry::_PrepareMETIS(
 	std::vector<idx_t>& outAdjncy, 
 	std::vector<idx_t>& outAdjwgt) const
 {
-	const uint32_t n = m_meshlets[inLod].size();
-	outXadj.clear();
-	outAdjncy.clear();
-	outAdjwgt.clear();
-	outXadj.resize(n + 1);
-	outAdjncy.reserve(8 * n);
-	outAdjwgt.reserve(8 * n);
-
-	outXadj.push_back(static_cast<idx_t>(outAdjncy.size()));
-	for (uint32_t i = 0; i < n; ++i)
+	struct EdgeEntry
 	{
-		const auto& curMeshlet = m_meshlets[inLod][i];
-		for (const auto& p : curMeshlet.adjacentWeight)
-		{
-			outAdjncy.push_back(static_cast<idx_t>(p.first));		// index of the adjacent meshlet
-			outAdjwgt.push_back(static_cast<idx_t>(p.second));	// number of shared edges
-		}
-		outXadj.push_back(static_cast<idx_t>(outAdjncy.size()));
-	}
-}
-
-void VirtualGeometry::_FindMeshletsBorder(uint32_t inLod)
-{
+		uint64_t edge;		// smaller vertex in high 32 bits, larger vertex in low 32 bits
+		uint32_t meshletId;
+	};
+	const auto& level = m_meshlets[inLod];
+	const uint32_t n = static_cast<uint32_t>(level.Size());
 	MeshOptimizer optimizer{};
-	std::vector<uint32_t> remapIndex(_GetCompleteVertices(inLod).size()); // remap the index based on position
-	
+	std::vector<uint32_t> remapIndex; // remap the index based on position
+	std::vector<EdgeEntry> edges;
+	std::vector<uint64_t> meshletPairs; // meshlet pair that shares a border edge, 2 entries for each direction
+	std::vector<uint32_t> edgeOwners;	// meshlets that have the current edge on their border
+	size_t edgeCount = 0;
+
 	optimizer.GeneratePositionRemap(_GetCompleteVertices(inLod), remapIndex);
 
-	// for each meshlet of this LOD find its border
-	for (size_t i = 0; i < m_meshlets[inLod].size(); ++i)
+	// collect edges of all triangles in one table
+	edgeCount = level.pools.meshletIndices.size();
+	edges.reserve(edgeCount);
+	for (uint32_t i = 0; i < n; ++i)
 	{
-		std::unordered_map<std::pair<uint32_t, uint32_t>, uint32_t, common_utils::PairHash> edgeSeen;
-		MyMeshlet& myMeshlet = m_meshlets[inLod][i];
-		const Meshlet& meshlet = myMeshlet.meshlet;
-		 
-		// iterate all triangle of current meshlet
-		for (uint32_t j = 0; j < meshlet.index.size() / 3; ++j)
+		const auto& range = level.ranges[i];
+		for (uint32_t j = 0; j < range.triangleCount; ++j)
 		{
 			std::array<uint32_t, 3> indices;
-			std::array<std::pair<uint32_t, uint32_t>, 3> edge;
-
-			meshlet.GetTriangle(j, indices);
-			edge[0] = { remapIndex[indices[0]], remapIndex[indices[1]] };
-			edge[1] = { remapIndex[indices[1]], remapIndex[indices[2]] };
-			edge[2] = { remapIndex[indices[2]], remapIndex[indices[0]] };
 
 			for (int k = 0; k < 3; ++k)
 			{
-				auto& currentEdge = edge[k];
-				uint32_t head = std::min(currentEdge.first, currentEdge.second);
-				uint32_t tail = std::max(currentEdge.first, currentEdge.second);
-
-				currentEdge = { head, tail };
-				if (edgeSeen.find(currentEdge) == edgeSeen.end())
-				{
-					edgeSeen.insert({ currentEdge, 1 });
-				}
-				else
-				{
-					edgeSeen[currentEdge] += 1;
-				}
+				uint8_t localIndex = level.pools.meshletIndices[range.indexOffset + j * 3 + k];
+				indices[k] = level.pools.meshletVertices[range.vertexOffset + localIndex];
 			}
-		}
-
-		// find edges shows up only once as border of current meshlet
-		for (const auto& edgeAndCount : edgeSeen)
-		{
-			if (edgeAndCount.second == 1)
+			for (int k = 0; k < 3; ++k)
 			{
-				myMeshlet.boundaries.insert(edgeAndCount.first);
+				uint32_t v0 = remapIndex[indices[k]];
+				uint32_t v1 = remapIndex[indices[(k + 1) % 3]];
+				uint64_t head = std::min(v0, v1);
+				uint64_t tail = std::max(v0, v1);
+
+				edges.push_back({ (head << 32) | tail, i });
 			}
 		}
 	}
-}
 
-void VirtualGeometry::_RecordMeshletConnections(uint32_t inLod)
-{
-	std::unordered_map<
-		std::pair<uint32_t, uint32_t>, 
-		std::vector<uint32_t>, 
-		common_utils::PairHash> edgeMeshlet; // edge to meshlets that have the edge
+	// sort is stable, so entries of the same edge stay ordered by meshlet
+	_RadixSort(edges, [](const EdgeEntry& inEntry) { return inEntry.edge; });
 
-	// fill edge meshlet map
-	for (uint32_t i = 0; i < m_meshlets[inLod].size(); ++i)
+	// an edge that shows up only once in a meshlet is on its border,
+	// meshlets sharing a border edge are connected
+	for (size_t begin = 0; begin < edges.size();)
 	{
-		const auto& currentMeshlet = m_meshlets[inLod][i];
-		for (const auto& edge : currentMeshlet.boundaries)
+		size_t end = begin;
+
+		edgeOwners.clear();
+		while (end < edges.size() && edges[end].edge == edges[begin].edge)
 		{
-			if (edgeMeshlet.find(edge) == edgeMeshlet.end())
+			size_t meshletEnd = end;
+			while (meshletEnd < edges.size() 
+				&& edges[meshletEnd].edge == edges[begin].edge 
+				&& edges[meshletEnd].meshletId == edges[end].meshletId)
 			{
-				edgeMeshlet.insert({ edge, { i } });
+				++meshletEnd;
 			}
-			else
+			if (meshletEnd - end == 1)
 			{
-				edgeMeshlet[edge].push_back(i);
+				edgeOwners.push_back(edges[end].meshletId);
 			}
+			end = meshletEnd;
 		}
-	}
 
-	// for each edge, update meshlets connected to it
-	for (const auto& p : edgeMeshlet)
-	{
-		for (uint32_t i = 0; i < p.second.size(); ++i)
+		for (size_t i = 0; i < edgeOwners.size(); ++i)
 		{
-			uint32_t meshletId = p.second[i];
-			auto& meshlet = m_meshlets[inLod][meshletId];
-			for (uint32_t j = 0; j < p.second.size(); ++j)
+			for (size_t j = i + 1; j < edgeOwners.size(); ++j)
 			{
-				if (j == i) continue;
-				uint32_t meshletId2 = p.second[j];
-				if (meshlet.adjacentWeight.find(meshletId2) == meshlet.adjacentWeight.end())
-				{
-					meshlet.adjacentWeight.insert({ meshletId2, 1 });
-				}
-				else
-				{
-					meshlet.adjacentWeight[meshletId2]++;
-				}
+				uint64_t a = edgeOwners[i];
+				uint64_t b = edgeOwners[j];
+				meshletPairs.push_back((a << 32) | b);
+				meshletPairs.push_back((b << 32) | a);
 			}
 		}
+		begin = end;
+	}
+	edges.clear();
+	edges.shrink_to_fit();
+
+	// number of shared edges of a meshlet pair is the length of its run in sorted pairs
+	_RadixSort(meshletPairs, [](uint64_t inPair) { return inPair; });
+
+	outXadj.assign(n + 1, 0);
+	outAdjncy.clear();
+	outAdjwgt.clear();
+	outAdjncy.reserve(meshletPairs.size());
+	outAdjwgt.reserve(meshletPairs.size());
+	for (size_t begin = 0; begin < meshletPairs.size();)
+	{
+		size_t end = begin + 1;
+		uint32_t from = static_cast<uint32_t>(meshletPairs[begin] >> 32);
+		uint32_t to = static_cast<uint32_t>(meshletPairs[begin]);
+
+		while (end < meshletPairs.size() && meshletPairs[end] == meshletPairs[begin])
+		{
+			++end;
+		}
+		outAdjncy.push_back(static_cast<idx_t>(to));				// index of the adjacent meshlet
+		outAdjwgt.push_back(static_cast<idx_t>(end - begin));	// number of shared edges
+		outXadj[from + 1]++;
+		begin = end;
+	}
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		outXadj[i + 1] += outXadj[i];
 	}
 }
 
@@ -239,7 +395,7 @@ bool VirtualGeometry::_DivideMeshletGroup(
 	std::vector<idx_t> adjncy;
 	std::vector<idx_t> adjwgt;
 	std::vector<idx_t> part;
-	idx_t nvtxs = m_meshlets[inLod].size();
+	idx_t nvtxs = m_meshlets[inLod].Size();
 	//idx_t nparts = std::max(static_cast<idx_t>(m_meshlets[inLod].size() / 4), 1);
 	idx_t nparts = static_cast<idx_t>(inGroupCount);
 	idx_t edgecut = 0;
@@ -290,61 +446,220 @@ bool VirtualGeometry::_DivideMeshletGroup(
 float VirtualGeometry::_SimplifyGroupTriangles(
 	uint32_t inSrcLod, 
 	const std::vector<uint32_t>& inClusterGroup,
-	std::vector<uint32_t>& inoutIndex) const
+	std::vector<Vertex>& outVertices,
+	std::vector<uint32_t>& outIndex) const
 {
+	const auto& srcVertices = _GetCompleteVertices(inSrcLod);
 	std::vector<uint32_t> meshletIndex;
+	std::vector<Vertex> localVertices;
+	std::unordered_map<Vertex, uint32_t> localIds;
 	MeshOptimizer optimizer{};
-	float error = 0.0f;
+	MeshOptimizer::SimplifyError error{};
 
 	for (size_t i = 0; i < inClusterGroup.size(); ++i)
 	{
-		const auto& meshlet = m_meshlets[inSrcLod][inClusterGroup[i]].meshlet;
-		meshlet.GetIndices(meshletIndex);
+		m_meshlets[inSrcLod].GetIndices(inClusterGroup[i], meshletIndex);
 	}
 
-	error = optimizer.SimplifyMesh(
-		_GetCompleteVertices(inSrcLod),
+	// simplify on a local buffer, cost follows group size instead of LOD size,
+	// and equal vertices are welded so borders of previous groups are not seen as open edges
+	for (auto& index : meshletIndex)
+	{
+		auto [it, inserted] = localIds.try_emplace(srcVertices[index], static_cast<uint32_t>(localVertices.size()));
+		if (inserted)
+		{
+			localVertices.push_back(srcVertices[index]);
+		}
+		index = it->second;
+	}
+
+	optimizer.SimplifyMesh(
+		localVertices,
 		meshletIndex,
-		meshletIndex.size() / 2,
-		inoutIndex);
+		static_cast<size_t>(meshletIndex.size() * m_settings.simplifyRatio),
+		m_settings.simplifyWeights,
+		outVertices,
+		outIndex,
+		error);
 
-	return error;
+	return std::max(error.geometric, error.attribute * m_settings.attributeErrorScale);
 }
 
 void VirtualGeometry::_BuildMeshletFromGroup(
 	const std::vector<Vertex>& _vertex,
 	const std::vector<uint32_t>& _index, 
-	std::vector<Meshlet>& _meshlet) const
+	Meshlet::DeviceData& _meshletData,
+	std::vector<Meshlet::DeviceDataRef>& _meshlet,
+	std::vector<MeshletBounds>& _bounds) const
 {
 	MeshOptimizer optimizer{};
-	optimizer.BuildMeshlets(_vertex, _index, _meshlet);
+	MeshOptimizer::MeshletBuildSettings settings{};
+	MeshOptimizer::MeshletBatch batch{};
+	std::span<const uint32_t> range = _index;
+
+	settings.mode = m_settings.clusterBuildMode;
+	settings.maxPrimitiveCount = m_settings.maxClusterTriangleCount;
+	settings.minPrimitiveCount = m_settings.minClusterTriangleCount;
+	settings.maxIndexCount = m_settings.maxClusterVertexCount;
+	optimizer.BuildMeshletsBatch(_vertex, { &range, 1 }, settings, batch);
+
+	_meshletData = std::move(batch.data);
+	_meshlet = std::move(batch.meshlets);
+	_bounds = std::move(batch.bounds);
+}
+
+void VirtualGeometry::_BuildClusterGroups(uint32_t inLod)
+{
+	auto& level = m_meshlets[inLod];
+	const auto& lodVertices = _GetCompleteVertices(inLod);
+	std::unordered_map<Vertex, uint32_t> groupVertexIds; // device vertex of each distinct vertex in the group
+
+	level.firstGroupData = static_cast<uint32_t>(m_deviceGroups.size());
+
+	for (size_t j = 0; j < m_groups[inLod].size(); ++j)
+	{
+		const auto& currentGroup = m_groups[inLod][j];
+		HierarchyNode newNode{};
+		ClusterGroupData deviceGroup{};
+		std::vector<glm::vec4> clusterSpheres(currentGroup.size());
+		Meshlet::DeviceData clusterCompactData{};
+		std::vector<Meshlet::DeviceDataRef> clusterCompactRefs(currentGroup.size());
+		uint32_t clusterCount = static_cast<uint32_t>(currentGroup.size());
+
+		newNode.isClusterGroup = true;
+		for (uint32_t k = 0; k < clusterCount; ++k)
+		{
+			const uint32_t clusterId = currentGroup[k];
+			const auto& range = level.ranges[clusterId];
+			auto& compactRef = clusterCompactRefs[k];
+
+			// a group is never finer than its clusters, so errors grow from child to parent
+			newNode.error = std::max({ newNode.error, level.groupError[clusterId], level.clusterError[clusterId] });
+			clusterSpheres[k] = level.boundingSphere[clusterId];
+
+			compactRef.vertexOffset = clusterCompactData.meshletVertices.size();
+			compactRef.vertexCount = range.vertexCount;
+			compactRef.indexOffset = clusterCompactData.meshletIndices.size();
+			compactRef.triangleCount = range.triangleCount;
+			clusterCompactData.meshletVertices.insert(
+				clusterCompactData.meshletVertices.end(),
+				level.pools.meshletVertices.begin() + range.vertexOffset,
+				level.pools.meshletVertices.begin() + range.vertexOffset + range.vertexCount);
+			clusterCompactData.meshletIndices.insert(
+				clusterCompactData.meshletIndices.end(),
+				level.pools.meshletIndices.begin() + range.indexOffset,
+				level.pools.meshletIndices.begin() + range.indexOffset + range.triangleCount * 3);
+		}
+		newNode.bounding = _ComputeEnclosingSphere(clusterSpheres);
+
+		// parents simplified from this group take its sphere, so a parent tests its error with the same threshold
+		// the traversal uses to decide whether to descend into this group, and one of them is always drawn.
+		// Parents are grouped with their spheres later, so a coarser group never has a larger threshold
+		const uint32_t firstParent = level.parent[currentGroup[0]];
+		if (firstParent != ~0u)
+		{
+			auto& coarserLevel = m_meshlets[inLod + 1];
+			const uint32_t parentCount = coarserLevel.loverCount[firstParent];
+
+			for (uint32_t p = firstParent; p < firstParent + parentCount; ++p)
+			{
+				newNode.bounding = simd_math::MergeSphere(newNode.bounding, coarserLevel.boundingSphere[p]);
+				newNode.error = std::max(newNode.error, coarserLevel.clusterError[p]);
+			}
+			for (uint32_t p = firstParent; p < firstParent + parentCount; ++p)
+			{
+				coarserLevel.boundingSphere[p] = newNode.bounding;
+				coarserLevel.clusterError[p] = newNode.error;
+			}
+		}
+
+		// group gets its own range of device vertices, so a page only touches vertices it draws
+		groupVertexIds.clear();
+		for (auto& vertexIndex : clusterCompactData.meshletVertices)
+		{
+			const Vertex& vertex = lodVertices[vertexIndex];
+			auto [it, inserted] = groupVertexIds.try_emplace(vertex, static_cast<uint32_t>(m_deviceVertices.size()));
+			if (inserted)
+			{
+				m_deviceVertices.push_back(vertex);
+			}
+			vertexIndex = it->second;
+		}
+
+		// header must be allocated before cluster data can be filled
+		deviceGroup._SetMeshletCompactData(clusterCompactData.meshletVertices, clusterCompactData.meshletIndices);
+		deviceGroup._SetClusterCount(clusterCount);
+		deviceGroup.m_lod = inLod;
+		deviceGroup.m_childrenGroupDataIndex.resize(clusterCount, ~0u);
+		for (uint32_t k = 0; k < clusterCount; ++k)
+		{
+			const uint32_t clusterId = currentGroup[k];
+			const auto& clusterCompactRef = clusterCompactRefs[k];
+
+			// finer LOD is always built before this one
+			if (inLod > 0)
+			{
+				deviceGroup.m_childrenGroupDataIndex[k] = m_meshlets[inLod - 1].firstGroupData + level.childGroup[clusterId];
+			}
+
+			deviceGroup._SetClusterData(
+				k,
+				clusterCompactRef.vertexOffset,
+				clusterCompactRef.vertexCount,
+				clusterCompactRef.indexOffset / 3,
+				clusterCompactRef.triangleCount,
+				glm::vec3(level.boundingSphere[clusterId]),
+				level.boundingSphere[clusterId].w,
+				level.clusterError[clusterId]);
+		}
+		if (m_settings.clusterGroupEncoding == ClusterGroupData::Encoding::COMPACT)
+		{
+			deviceGroup._EncodeCompact();
+		}
+		newNode.children[0] = m_deviceGroups.size();
+		newNode.groupLod = inLod;
+		newNode.groupIndex = j;
+
+		m_hierarchy.push_back(newNode);
+		m_deviceGroups.push_back(std::move(deviceGroup));
+	}
 }
 
 void VirtualGeometry::_SplitMeshLODs()
 {
-	int maxLOD = 31;
+	const int maxLOD = static_cast<int>(m_settings.maxLod);
 	MeshOptimizer optimizer{};
+	std::ostream progressLog(m_settings.printProgress ? std::cout.rdbuf() : nullptr); // discards output if progress is not printed
+	uint32_t groupsBuilt = 0; // LODs whose cluster groups are already built
 	//std::vector<std::vector<uint32_t>> meshletGroups;
+	m_meshlets.clear();
 	m_meshlets.resize(maxLOD + 1);
-
-	std::cout << "Start build virtual geometry..." << std::endl;
-	std::cout << "===============================" << std::endl;
+	m_groups.clear();
+	m_hierarchy.clear();
+	m_deviceGroups.clear();
+	m_deviceNodes.clear();
+	m_deviceVertices.clear();
+
+	progressLog << "Start build virtual geometry..." << std::endl;
+	progressLog << "===============================" << std::endl;
 	//_BuildVirtualIndexMap();
 	for (int i = 0; i < (maxLOD + 1); ++i)
 	{
 		// Build meshlets for current LOD
 		if (i == 0)
 		{
-			std::vector<Meshlet> meshlets{};
+			Meshlet::DeviceData meshletData{};
+			std::vector<Meshlet::DeviceDataRef> meshlets{};
+			std::vector<MeshletBounds> meshletBounds{};
 			uint32_t firstIndx;
 			uint32_t numAdded;
 
-			std::cout << "Start build LOD " << i << " meshlets...";
-			optimizer.BuildMeshlets(m_pBaseMesh->verts, m_pBaseMesh->indices, meshlets);
-			_AddMyMeshlet(i, 0.0f, meshlets, {}, &firstIndx, &numAdded);
-			std::cout << "triangle count: " << m_pBaseMesh->indices.size() / 3;
-			std::cout << ", vertex count: " << _GetCompleteVertices(i).size() << std::endl;
-			std::cout << "DONE, meshlets added: " << numAdded << std::endl;
+			progressLog << "Start build LOD " << i << " meshlets...";
+			_BuildMeshletFromGroup(m_pBaseMesh->verts, m_pBaseMesh->indices, meshletData, meshlets, meshletBounds);
+			_AddMyMeshlet(i, 0.0f, meshletData, meshlets, meshletBounds, ~0u, &firstIndx, &numAdded);
+			progressLog << "triangle count: " << m_pBaseMesh->indices.size() / 3;
+			progressLog << ", vertex count: " << _GetCompleteVertices(i).size() << std::endl;
+			progressLog << "DONE, meshlets added: " << numAdded << std::endl;
 		}
 		else
 		{
@@ -354,74 +669,81 @@ void VirtualGeometry::_SplitMeshLODs()
 			uint32_t numAdded = 0u;
 			uint32_t subNumAdded;
 			uint32_t numTrig = 0u;
-			std::vector<std::vector<uint32_t>> groupIndices;
-			std::vector<float> simplifyError;
+			const auto& srcGroups = m_groups.back();
+			const size_t groupCount = srcGroups.size();
+			std::vector<std::vector<Vertex>> groupVertices(groupCount);
+			std::vector<std::vector<uint32_t>> groupIndices(groupCount);
+			std::vector<Meshlet::DeviceData> groupMeshletData(groupCount);
+			std::vector<std::vector<Meshlet::DeviceDataRef>> groupMeshlets(groupCount);
+			std::vector<std::vector<MeshletBounds>> groupBounds(groupCount);
+			std::vector<float> simplifyError(groupCount, 0.0f);
+			auto funcProcessGroups = [&](uint32_t inBegin, uint32_t inEnd, uint32_t inThreadIndex)
+				{
+					for (uint32_t j = inBegin; j < inEnd; ++j)
+					{
+						// For each group of meshlets, build a new list of triangles approximating the original group
+						simplifyError[j] = _SimplifyGroupTriangles(i - 1, srcGroups[j], groupVertices[j], groupIndices[j]);
 
-			std::cout << "Start build LOD " << i << " meshlets...";
-			
-			// simplify triangles in group
-			for (const auto& group : m_groups.back())
+						// For each simplified group, break them apart into new meshlets
+						_BuildMeshletFromGroup(groupVertices[j], groupIndices[j], groupMeshletData[j], groupMeshlets[j], groupBounds[j]);
+					}
+				};
+
+			progressLog << "Start build LOD " << i << " meshlets...";
+
+			// groups only read meshlets of the finer LOD and each one writes to its own slot
+			if (m_settings.parallelBuild)
+			{
+				MyTaskScheduler::GetInstance().ParallelFor(static_cast<uint32_t>(groupCount), 1, funcProcessGroups);
+			}
+			else
 			{
-				std::vector<uint32_t> simplifiedIndex;
-				float error = 0.0f;
+				funcProcessGroups(0, static_cast<uint32_t>(groupCount), 0);
+			}
 
-				// For each group of meshlets, build a new list of triangles approximating the original group
-				error = _SimplifyGroupTriangles(i - 1, group, simplifiedIndex);
+			for (const auto& simplifiedIndex : groupIndices)
+			{
 				numTrig += simplifiedIndex.size() / 3;
-				groupIndices.push_back(simplifiedIndex);
-				simplifyError.push_back(error);
 			}
 
-			// remove redundant vertices
-			//uint32_t maxVerticesIndex = 0;
-			////std::cout << "vertex count before simplify: " << _GetIncompleteVertices(i).size() << std::endl;
-			//for (auto& simplifiedIndex : groupIndices)
-			//{
-			//	std::vector<uint32_t> newIndex(simplifiedIndex.size());
-			//	
-			//	optimizer.RemapIndex(_GetIncompleteVertices(i), simplifiedIndex, newIndex, sizeof(Vertex));
-			//	simplifiedIndex = newIndex;
-			//	maxVerticesIndex = std::max(maxVerticesIndex, *std::max_element(simplifiedIndex.begin(), simplifiedIndex.end()));
-			//}
-			//_GetIncompleteVertices(i).resize(maxVerticesIndex + 1);
-			std::cout << "triangle count: " << numTrig << std::endl;
-
-			// build meshlets from simplified triangles
-			for (size_t j = 0; j < groupIndices.size(); ++j)
+			// merge meshlets in group order, so the result doesn't depend on thread scheduling,
+			// vertices of each group are appended to this LOD, meshlets point to them after offset
+			for (size_t j = 0; j < groupCount; ++j)
 			{
-				std::vector<Meshlet> meshlets{};
-				const auto& simplifiedIndices = groupIndices[j];
-				float error = simplifyError[j];
+				auto& lodVertices = m_meshlets[i].vertices;
+				const uint32_t vertexBase = static_cast<uint32_t>(lodVertices.size());
 
-				_BuildMeshletFromGroup(_GetCompleteVertices(i), simplifiedIndices, meshlets);
-				_AddMyMeshlet(i, error, meshlets, m_groups.back()[j], &firstIndx, &subNumAdded);
+				lodVertices.insert(lodVertices.end(), groupVertices[j].begin(), groupVertices[j].end());
+				for (auto& vertexIndex : groupMeshletData[j].meshletVertices)
+				{
+					vertexIndex += vertexBase;
+				}
+				_AddMyMeshlet(i, simplifyError[j], groupMeshletData[j], groupMeshlets[j], groupBounds[j], static_cast<uint32_t>(j), &firstIndx, &subNumAdded);
 				numAdded += subNumAdded;
 			}
-			std::cout << "DONE, meshlets added: " << numAdded << std::endl;
+			progressLog << "triangle count: " << numTrig;
+			progressLog << ", vertex count: " << _GetCompleteVertices(i).size() << std::endl;
+			progressLog << "DONE, meshlets added: " << numAdded << std::endl;
+
+			// group errors of the finer LOD are known now, pack its groups and drop its pools
+			_BuildClusterGroups(i - 1);
+			m_meshlets[i - 1].ReleasePools();
+			groupsBuilt = i;
 		}
 
 		// if LOD reaches max we don't need to group meshlet any more, break;
-		if (m_meshlets[i].size() == 1)
+		if (m_meshlets[i].Size() == 1)
 		{
 			m_groups.push_back({ { 0 } });
-			m_meshlets[i][0].groupIndex = 0;
+			m_meshlets[i].groupIndex[0] = 0;
 			break;
 		}
 
-		// For each meshlet, find the set of all edges making up the triangles within the meshlet
-		std::cout << "Start find meshlets' border...";
-		_FindMeshletsBorder(i);
-		std::cout << "DONE" << std::endl;
-
-		// For each meshlet, find the set of connected meshlets(sharing an edge)
-		std::cout << "Start record connections...";
-		_RecordMeshletConnections(i);
-		std::cout << "DONE" << std::endl;
-
-		// Divide meshlets into groups of roughly 8
+		// Divide meshlets into groups of roughly clustersPerGroup
 		//meshletGroups.clear();
-		std::cout << "Start LOD " << i << " meshlets partition...";
-		uint32_t groupCount = m_meshlets[i].size() / 8;
+		progressLog << "Start LOD " << i << " meshlets partition...";
+		auto partitionStart = std::chrono::steady_clock::now();
+		uint32_t groupCount = m_meshlets[i].Size() / m_settings.clustersPerGroup;
 		groupCount = groupCount > 0 ? groupCount : 1;
 		m_groups.push_back({});
 		auto divideSuccess = _DivideMeshletGroup(i, groupCount, m_groups.back());
@@ -431,7 +753,7 @@ void VirtualGeometry::_SplitMeshLODs()
 		{
 			for (auto meshletId : m_groups.back()[groupId])
 			{
-				m_meshlets[i][meshletId].groupIndex = groupId;
+				m_meshlets[i].groupIndex[meshletId] = groupId;
 			}
 		}
 
@@ -442,79 +764,78 @@ void VirtualGeometry::_SplitMeshLODs()
 			std::cout << "ERROR: Cannot divide meshlet groups, break!" << std::endl;
 			break;
 		}
-		std::cout << "DONE, divides meshlets into " << m_groups.back().size() << " groups.\r\n" << std::endl;
+		progressLog << "DONE, divides meshlets into " << m_groups.back().size() << " groups in "
+			<< std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - partitionStart).count() << " ms.\r\n" << std::endl;
 	}
-	std::cout << "===============================\r\n" << std::endl;
+
+	// groups of the coarsest LOD have no parent to wait for
+	for (uint32_t lod = groupsBuilt; lod < m_groups.size(); ++lod)
+	{
+		_BuildClusterGroups(lod);
+		m_meshlets[lod].ReleasePools();
+	}
+	progressLog << "===============================\r\n" << std::endl;
 }
 
 void VirtualGeometry::_BuildHierarchy()
 {
 	std::vector<HierarchyNode>& treeNodes = m_hierarchy;
-	std::vector<ClusterGroupData>& deviceGroups = m_deviceGroups;
 	std::vector<IntermediateNode>& deviceNodes = m_deviceNodes;
 	std::vector<std::vector<uint32_t>> LODClusterID; // leaf index of each LOD
 	std::vector<uint32_t> LODRoots;
-	uint32_t processedGroup = 0;
 
-	treeNodes.clear();
-	deviceGroups.clear();
 	deviceNodes.clear();
 
-	// build base node from cluster groups
+	// leaf nodes are built from cluster groups in _BuildClusterGroups
 	LODClusterID.resize(m_groups.size());
+	for (uint32_t i = 0; i < static_cast<uint32_t>(treeNodes.size()); ++i)
+	{
+		const auto& treeNode = treeNodes[i];
+		if (!treeNode.isClusterGroup) continue;
+		LODClusterID[treeNode.groupLod].push_back(i);
+	}
+
+	// allocate hierarchy of each LOD first, so that they can be built at the same time
 	for (size_t i = 0; i < LODClusterID.size(); ++i)
 	{
-		size_t clusterGroupsCount = m_groups[i].size();
-		
-		LODClusterID[i].resize(clusterGroupsCount);
-		for (size_t j = 0; j < clusterGroupsCount; ++j)
-		{
-			const auto& currentGroup = m_groups[i][j];
-			HierarchyNode newNode{};
-			ClusterGroupData deviceGroup{};
-			Meshlet::DeviceData clusterCompactData{};
-			uint32_t clusterCount = 0;
-
-			LODClusterID[i][j] = treeNodes.size();
-			newNode.isClusterGroup = true;
-			newNode.bounding = m_meshlets[i][currentGroup[0]].boundingSphere;
-			for (auto clusterId : currentGroup)
-			{
-				const auto& currentCluster = m_meshlets[i][clusterId];
-				Meshlet::DeviceDataRef clusterCompactRef{};
-
-				newNode.error = std::max(newNode.error, currentCluster.groupError);
-				newNode.bounding = _MergeBounds(newNode.bounding, currentCluster.boundingSphere);
-				Meshlet::CompressToDeviceData(currentCluster.meshlet, clusterCompactData, clusterCompactRef);
-				deviceGroup._SetClusterData(
-					clusterCount, 
-					clusterCompactRef.vertexOffset, 
-					clusterCompactRef.vertexCount, 
-					clusterCompactRef.indexOffset / 3,
-					clusterCompactRef.triangleCount,
-					glm::vec3(currentCluster.boundingSphere),
-					currentCluster.boundingSphere.w,
-					currentCluster.clusterError);
-				++clusterCount;
-			}
-			newNode.children[0] = processedGroup;
-			newNode.groupLod = i;
-			newNode.groupIndex = j;
-			deviceGroup._SetClusterCount(clusterCount);
-			deviceGroup._SetMeshletCompactData(clusterCompactData.meshletVertices, clusterCompactData.meshletIndices);
+		const uint32_t leafCount = static_cast<uint32_t>(LODClusterID[i].size());
 
-			++processedGroup;
-			treeNodes.push_back(newNode);
-			deviceGroups.push_back(deviceGroup);
+		if (leafCount == 0) continue;
+		if (leafCount == 1)
+		{
+			LODRoots.push_back(LODClusterID[i][0]);
+			continue;
 		}
+		LODRoots.push_back(static_cast<uint32_t>(treeNodes.size()));
+		treeNodes.resize(treeNodes.size() + _GetHierarchyNodeCount(leafCount));
 	}
 
 	// build hierarchy for each LOD
-	for (size_t i = 0; i < LODClusterID.size(); ++i)
+	auto funcBuildLODs = [&](uint32_t inBegin, uint32_t inEnd, uint32_t inThreadIndex)
+		{
+			uint32_t rootIndex = 0;
+
+			for (uint32_t i = 0; i < inBegin; ++i)
+			{
+				if (!LODClusterID[i].empty()) ++rootIndex;
+			}
+			for (uint32_t i = inBegin; i < inEnd; ++i)
+			{
+				if (LODClusterID[i].empty()) continue;
+				if (LODClusterID[i].size() > 1)
+				{
+					_BuildHierarchyRange(LODClusterID[i], LODRoots[rootIndex], treeNodes);
+				}
+				++rootIndex;
+			}
+		};
+	if (m_settings.parallelBuild)
+	{
+		MyTaskScheduler::GetInstance().ParallelFor(static_cast<uint32_t>(LODClusterID.size()), 1, funcBuildLODs);
+	}
+	else
 	{
-		if (LODClusterID[i].size() == 0) continue;
-		uint32_t lodRootId = _BuildHierarchyHelper(LODClusterID[i], treeNodes);
-		LODRoots.push_back(lodRootId);
+		funcBuildLODs(0, static_cast<uint32_t>(LODClusterID.size()), 0);
 	}
 
 	// build top hierarchy with LOD trees
@@ -540,213 +861,344 @@ void VirtualGeometry::_BuildHierarchy()
 	}
 }
 
-uint32_t VirtualGeometry::_BuildHierarchyHelper(std::vector<uint32_t>& _bottomNodeIndex, std::vector<HierarchyNode>& _fullTree) const
+uint32_t VirtualGeometry::_BuildHierarchyHelper(std::span<uint32_t> _bottomNodeIndex, std::vector<HierarchyNode>& _fullTree) const
 {
 	CHECK_TRUE(_bottomNodeIndex.size() > 0, "Empty tree is not allowed!");
 
 	// if there is only one node
 	if (_bottomNodeIndex.size() == 1) return _bottomNodeIndex[0];
 
-	// if there is only one child layer
-	if (_bottomNodeIndex.size() <= VG_HIERARCHY_MAX_CHILD)
-	{
-		HierarchyNode newParentNode{};
-		uint32_t firstChildIndex = _bottomNodeIndex[0];
-		uint32_t newNodeIndex = _fullTree.size();
+	const uint32_t rootIndex = static_cast<uint32_t>(_fullTree.size());
 
-		// use first bottom node as start
-		newParentNode = _fullTree[firstChildIndex];
-		newParentNode.children = {firstChildIndex , ~0u, ~0u, ~0u }; // to be filled
-		newParentNode.isClusterGroup = false;
-		
-		for (size_t i = 1; i < _bottomNodeIndex.size(); ++i)
-		{
-			uint32_t childIndex = _bottomNodeIndex[i];
-			const HierarchyNode& child = _fullTree[childIndex];
+	_fullTree.resize(_fullTree.size() + _GetHierarchyNodeCount(static_cast<uint32_t>(_bottomNodeIndex.size())));
+	_BuildHierarchyRange(_bottomNodeIndex, rootIndex, _fullTree);
 
-			_MergeHierarchyNode(child, newParentNode);
-			newParentNode.children[i] = childIndex;
-		}
+	return rootIndex;
+}
 
-		_fullTree.push_back(newParentNode);
-		return newNodeIndex;
+uint32_t VirtualGeometry::_GetHierarchyNodeCount(uint32_t _bottomNodeCount) const
+{
+	if (_bottomNodeCount <= 1) return 0;
+
+	// bottom nodes are spread evenly, children get either count or count + 1 of them
+	const uint32_t childCount = std::min(m_settings.hierarchyBranchingFactor, _bottomNodeCount);
+	const uint32_t count = _bottomNodeCount / childCount;
+	const uint32_t largerChildCount = _bottomNodeCount % childCount;
+
+	return 1
+		+ largerChildCount * _GetHierarchyNodeCount(count + 1)
+		+ (childCount - largerChildCount) * _GetHierarchyNodeCount(count);
+}
+
+void VirtualGeometry::_BuildHierarchyRange(
+	std::span<uint32_t> _bottomNodeIndex,
+	uint32_t _nodeIndex,
+	std::vector<HierarchyNode>& _fullTree) const
+{
+	// subtrees smaller than this are not worth a task
+	const uint32_t minParallelBottomNodes = 256;
+	const uint32_t bottomNodeCount = static_cast<uint32_t>(_bottomNodeIndex.size());
+	const uint32_t childCount = std::min(m_settings.hierarchyBranchingFactor, bottomNodeCount);
+	std::array<uint32_t, VG_HIERARCHY_MAX_CHILD + 1> childBegins{};
+	std::array<glm::vec4, VG_HIERARCHY_MAX_CHILD> childSpheres{};
+	HierarchyNode newNode{};
+	uint32_t nextNodeIndex = _nodeIndex + 1;
+
+	// same split as _GetHierarchyNodeCount
+	for (uint32_t i = 0; i < childCount; ++i)
+	{
+		childBegins[i + 1] = childBegins[i] + bottomNodeCount / childCount + (i < bottomNodeCount % childCount ? 1 : 0);
 	}
+	_PartitionHierarchyNodes(_fullTree, std::span<const uint32_t>(childBegins.data(), childCount + 1), _bottomNodeIndex);
 
-	// if there are more layers
+	// a child with one bottom node is the bottom node itself, others take nodes after this one in order
+	for (uint32_t i = 0; i < childCount; ++i)
 	{
-		uint32_t maxSubNodeCount = VG_HIERARCHY_MAX_CHILD;	// maximum possible leaf count of each subtree
-		uint32_t baseSubNodeCount;							// baseline leaf count of each subtree
-		uint32_t leftSubNodeCount; // if following subtree only hold baseSubNodeCount how many node will remain
-		uint32_t maxExtraHold;
-		HierarchyNode newNode{};
-		uint32_t result = 0;
-		size_t offset = 0; // offset of _bottomNodeIndex for subtree
+		const uint32_t childBottomNodeCount = childBegins[i + 1] - childBegins[i];
 
-		while (maxSubNodeCount * VG_HIERARCHY_MAX_CHILD <= _bottomNodeIndex.size())
+		if (childBottomNodeCount == 1)
 		{
-			maxSubNodeCount *= VG_HIERARCHY_MAX_CHILD;
+			newNode.children[i] = _bottomNodeIndex[childBegins[i]];
+			continue;
 		}
-		baseSubNodeCount = maxSubNodeCount / VG_HIERARCHY_MAX_CHILD;
-		leftSubNodeCount = _bottomNodeIndex.size() - baseSubNodeCount * VG_HIERARCHY_MAX_CHILD;
-		maxExtraHold = maxSubNodeCount - baseSubNodeCount;
+		newNode.children[i] = nextNodeIndex;
+		nextNodeIndex += _GetHierarchyNodeCount(childBottomNodeCount);
+	}
 
-		std::array<uint32_t, VG_HIERARCHY_MAX_CHILD> subNodeCounts{}; // how many leaf nodes each child should handle
-		for (size_t i = 0; i < VG_HIERARCHY_MAX_CHILD; ++i)
+	// each subtree writes to its own nodes, tree is not resized here
+	auto funcBuildChildren = [&](uint32_t inBegin, uint32_t inEnd, uint32_t inThreadIndex)
 		{
-			if (leftSubNodeCount > maxExtraHold)
+			for (uint32_t i = inBegin; i < inEnd; ++i)
 			{
-				subNodeCounts[i] = maxSubNodeCount;
-				leftSubNodeCount -= (maxExtraHold - baseSubNodeCount);
+				if (childBegins[i + 1] - childBegins[i] == 1) continue;
+				_BuildHierarchyRange(
+					_bottomNodeIndex.subspan(childBegins[i], childBegins[i + 1] - childBegins[i]),
+					newNode.children[i],
+					_fullTree);
 			}
-			else
-			{
-				subNodeCounts[i] = baseSubNodeCount + leftSubNodeCount;
-				leftSubNodeCount = 0;
-			}
-		}
-		_OptimizeHierarchyNodeGroups(_fullTree, subNodeCounts, _bottomNodeIndex);
-
-		// build each subtree
-		for (size_t i = 0; i < VG_HIERARCHY_MAX_CHILD; ++i)
-		{
-			std::vector<uint32_t> subBottomNodes(
-				_bottomNodeIndex.cbegin() + offset, 
-				_bottomNodeIndex.cbegin() + offset + subNodeCounts[i]);
-			const uint32_t childId = _BuildHierarchyHelper(subBottomNodes, _fullTree);
-			const HierarchyNode& child = _fullTree[childId];
+		};
+	if (m_settings.parallelBuild && bottomNodeCount >= minParallelBottomNodes)
+	{
+		MyTaskScheduler::GetInstance().ParallelFor(childCount, 1, funcBuildChildren);
+	}
+	else
+	{
+		funcBuildChildren(0, childCount, 0);
+	}
 
-			if (i == 0)
-			{
-				newNode.bounding = child.bounding;
-				newNode.error = child.error;
-				newNode.isClusterGroup = false;
-			}
-			else
-			{
-				_MergeHierarchyNode(child, newNode);
-			}
-			newNode.children[i] = childId;
-			offset += subNodeCounts[i];
-		}
-		result = _fullTree.size();
-		_fullTree.push_back(newNode);
+	for (uint32_t i = 0; i < childCount; ++i)
+	{
+		const HierarchyNode& child = _fullTree[newNode.children[i]];
 
-		return result;
+		childSpheres[i] = child.bounding;
+		newNode.error = std::max(newNode.error, child.error);
 	}
-
-	return 0;
+	newNode.bounding = _ComputeEnclosingSphere(std::span<const glm::vec4>(childSpheres.data(), childCount));
+	newNode.isClusterGroup = false;
+	_fullTree[_nodeIndex] = newNode;
 }
 
-void VirtualGeometry::_OptimizeHierarchyNodeGroups(
-	const std::vector<HierarchyNode>& _fullTree, 
-	const std::array<uint32_t, VG_HIERARCHY_MAX_CHILD>& _groupSize,
-	std::vector<uint32_t>& _nodeIndices) const
+void VirtualGeometry::_PartitionHierarchyNodes(
+	const std::vector<HierarchyNode>& _fullTree,
+	std::span<const uint32_t> _childBegins,
+	std::span<uint32_t> _nodeIndices) const
 {
-	uint32_t levelCount = 1;
-	auto funcSortByAxis =
-		[&](uint32_t axis, uint32_t beginOffset, uint32_t endOffset)
+	// only one child range, nothing to split
+	if (_childBegins.size() <= 2) return;
+
+	const size_t half = (_childBegins.size() - 1) / 2; // child ranges in the first half
+	const uint32_t begin = _childBegins.front();
+	const uint32_t split = _childBegins[half];
+	const uint32_t end = _childBegins.back();
+	auto itBegin = _nodeIndices.begin() + begin;
+	auto itSplit = _nodeIndices.begin() + split;
+	auto itEnd = _nodeIndices.begin() + end;
+	std::vector<glm::vec4> spheres;
+	float minCost = std::numeric_limits<float>::max();
+	int bestAxis = 0;
+
+	// node index breaks ties, so the order doesn't depend on the sort implementation
+	auto funcPartitionByAxis = [&](int inAxis)
 		{
-			std::function<bool(uint32_t, uint32_t)> funcCmp;
-			switch (axis)
-			{
-			case 0:
-				funcCmp = [&](uint32_t l, uint32_t r)->bool
-					{
-						return _fullTree[l].bounding.x < _fullTree[r].bounding.x;
-					};
-				break;
-			case 1:
-				funcCmp = [&](uint32_t l, uint32_t r)->bool
-					{
-						return _fullTree[l].bounding.y < _fullTree[r].bounding.y;
-					};
-				break;
-			case 2:
-				funcCmp = [&](uint32_t l, uint32_t r)->bool
-					{
-						return _fullTree[l].bounding.z < _fullTree[r].bounding.z;
-					};
-				break;
-			default:
-				CHECK_TRUE(false, "No such axis!");
-			}
-			std::sort(_nodeIndices.begin() + beginOffset, _nodeIndices.begin() + endOffset, funcCmp);
+			std::nth_element(itBegin, itSplit, itEnd, [&](uint32_t inLhs, uint32_t inRhs)
+				{
+					float lhs = _fullTree[inLhs].bounding[inAxis];
+					float rhs = _fullTree[inRhs].bounding[inAxis];
+					return lhs != rhs ? lhs < rhs : inLhs < inRhs;
+				});
 		};
-	
-	auto funcCalculateCost = [](
-		const std::vector<VirtualGeometry::HierarchyNode>& inFullTree,
-		const std::vector<uint32_t>& inNodeIndices,
-		uint32_t inBegin,
-		uint32_t inEnd)
+	auto funcCalculateCost = [&](std::span<const uint32_t> inNodes)
 		{
-			auto mergedSphere = inFullTree[inNodeIndices[inBegin]].bounding;
-
-			for (uint32_t i = inBegin + 1; i < inEnd; ++i)
+			spheres.clear();
+			for (auto nodeIndex : inNodes)
 			{
-				mergedSphere = _MergeBounds(mergedSphere, inFullTree[inNodeIndices[i]].bounding);
+				spheres.push_back(_fullTree[nodeIndex].bounding);
 			}
+			float radius = _ComputeEnclosingSphere(spheres).w;
 
-			return mergedSphere.w * mergedSphere.w; // we want to calculate area
+			return radius * radius * static_cast<float>(inNodes.size());
 		};
 
-	while ((1 << levelCount) < VG_HIERARCHY_MAX_CHILD)
+	spheres.reserve(end - begin);
+	for (int axis = 0; axis < 3; ++axis)
 	{
-		levelCount++;
-	}
-	CHECK_TRUE((1 << levelCount) == VG_HIERARCHY_MAX_CHILD, "");
+		float cost = 0.0f;
 
-	for (uint32_t level = 0; level < levelCount; ++level)
+		funcPartitionByAxis(axis);
+		cost = funcCalculateCost(_nodeIndices.subspan(begin, split - begin))
+			+ funcCalculateCost(_nodeIndices.subspan(split, end - split));
+		if (cost < minCost)
+		{
+			minCost = cost;
+			bestAxis = axis;
+		}
+	}
+	if (bestAxis != 2)
 	{
-		const uint32_t bucketCount = 1 << level;
-		const uint32_t groupPerBucket = VG_HIERARCHY_MAX_CHILD >> level;
+		funcPartitionByAxis(bestAxis);
+	}
+
+	_PartitionHierarchyNodes(_fullTree, _childBegins.subspan(0, half + 1), _nodeIndices);
+	_PartitionHierarchyNodes(_fullTree, _childBegins.subspan(half), _nodeIndices);
+}
 
-		// sort each bucket
-		uint32_t bucketNodeOffset = 0;
-		for (uint32_t i = 0; i < bucketCount; ++i)
+uint64_t VirtualGeometry::_ComputeCacheKey() const
+{
+	// parallelBuild and printProgress don't change the result
+	const std::array<uint32_t, 12> buildParameters = {
+		VG_CACHE_VERSION,
+		VG_HIERARCHY_MAX_CHILD,
+		VG_MAX_CLUSTER_GROUP_SIZE,
+		VG_MAX_CLUSTER_INDEX,
+		m_settings.maxLod,
+		m_settings.clustersPerGroup,
+		m_settings.maxClusterVertexCount,
+		m_settings.maxClusterTriangleCount,
+		m_settings.minClusterTriangleCount,
+		static_cast<uint32_t>(m_settings.clusterBuildMode),
+		m_settings.hierarchyBranchingFactor,
+		static_cast<uint32_t>(m_settings.clusterGroupEncoding) };
+	uint64_t key = common_utils::HashBytes(buildParameters.data(), sizeof(buildParameters));
+
+	key = common_utils::HashBytes(&m_settings.simplifyRatio, sizeof(float), key);
+	key = common_utils::HashBytes(&m_settings.simplifyWeights.uv, sizeof(float), key);
+	key = common_utils::HashBytes(&m_settings.simplifyWeights.normal, sizeof(float), key);
+	key = common_utils::HashBytes(&m_settings.attributeErrorScale, sizeof(float), key);
+
+	// hash attributes one by one, Vertex has padding and optional flags that we don't want to hash
+	for (const auto& vertex : m_pBaseMesh->verts)
+	{
+		key = common_utils::HashBytes(&vertex.position, sizeof(glm::vec3), key);
+		if (vertex.normal.has_value())
 		{
-			const uint32_t offset = groupPerBucket * i;
-			uint32_t sizes[2] = {};
-			uint32_t beginOffset; // begin of current bucket stride
-			uint32_t endOffset;	// end of current bucket stride
-			float minCost = std::numeric_limits<float>::max();
-			uint32_t bestAxis = 0;
+			key = common_utils::HashBytes(&vertex.normal.value(), sizeof(glm::vec3), key);
+		}
+		if (vertex.uv.has_value())
+		{
+			key = common_utils::HashBytes(&vertex.uv.value(), sizeof(glm::vec2), key);
+		}
+	}
+	key = common_utils::HashBytes(m_pBaseMesh->indices.data(), m_pBaseMesh->indices.size() * sizeof(uint32_t), key);
 
-			for (uint32_t j = 0; j < (groupPerBucket / 2); ++j)
-			{
-				sizes[0] += _groupSize[offset + j];
-				sizes[1] += _groupSize[offset + j + (groupPerBucket / 2)];
-			}
-			
-			beginOffset = bucketNodeOffset;
-			endOffset = beginOffset + (sizes[0] + sizes[1]);
-			bucketNodeOffset = endOffset;
-
-			// try to sort axis by x, y, z to find which sort will give us the best division
-			// which produces minimal bounding spheres
-			for (uint32_t axis = 0; axis < 3; ++axis)
-			{
-				float cost;
-				
-				funcSortByAxis(axis, beginOffset, endOffset);
-				cost = funcCalculateCost(_fullTree, _nodeIndices, beginOffset, beginOffset + sizes[0])
-					+ funcCalculateCost(_fullTree, _nodeIndices, beginOffset + sizes[0], endOffset);
+	return key;
+}
 
-				if (cost < minCost)
-				{
-					bestAxis = axis;
-					minCost = cost;
-				}
-			}
+// Cache file layout, all in uint32_t:
+// magic | version | key low | key high | root index | node count | group count
+// node data: 16 * node count
+// for each group: lod | data count | child count | data | children
+// vertex count | for each vertex: attribute flags (bit 0 normal, bit 1 uv) | position | normal | uv -> 9 words
+bool VirtualGeometry::_LoadCache(const std::string& inCachePath)
+{
+	static_assert(sizeof(IntermediateNode) == 16 * sizeof(uint32_t), "Intermediate node should be tightly packed!");
+	const uint32_t headerSize = 7;
+	const uint64_t key = _ComputeCacheKey();
+	common_utils::MappedFile file{};
+	const uint32_t* pWords = nullptr;
+	size_t wordCount = 0;
+	size_t cursor = headerSize;
+	uint32_t nodeCount = 0;
+	uint32_t groupCount = 0;
+
+	if (!file.Open(inCachePath)) return false;
+	pWords = reinterpret_cast<const uint32_t*>(file.GetData());
+	wordCount = file.GetSize() / sizeof(uint32_t);
+	if (wordCount < headerSize) return false;
+	if (pWords[0] != VG_CACHE_MAGIC || pWords[1] != VG_CACHE_VERSION) return false;
+	if (pWords[2] != static_cast<uint32_t>(key) || pWords[3] != static_cast<uint32_t>(key >> 32)) return false;
+
+	nodeCount = pWords[5];
+	groupCount = pWords[6];
+	if (cursor + static_cast<size_t>(nodeCount) * 16 > wordCount) return false;
+
+	// nodes are stored exactly as device layout, copy them in one go
+	m_deviceNodes.resize(nodeCount);
+	memcpy(m_deviceNodes.data(), pWords + cursor, nodeCount * sizeof(IntermediateNode));
+	cursor += static_cast<size_t>(nodeCount) * 16;
+
+	m_deviceGroups.clear();
+	m_deviceGroups.resize(groupCount);
+	for (uint32_t i = 0; i < groupCount; ++i)
+	{
+		ClusterGroupData& deviceGroup = m_deviceGroups[i];
+		uint32_t dataCount = 0;
+		uint32_t childCount = 0;
+
+		if (cursor + 3 > wordCount) return false;
+		deviceGroup.m_lod = pWords[cursor];
+		dataCount = pWords[cursor + 1];
+		childCount = pWords[cursor + 2];
+		cursor += 3;
+		if (cursor + static_cast<size_t>(dataCount) + childCount > wordCount) return false;
+
+		deviceGroup.m_data.assign(pWords + cursor, pWords + cursor + dataCount);
+		cursor += dataCount;
+		deviceGroup.m_childrenGroupDataIndex.assign(pWords + cursor, pWords + cursor + childCount);
+		cursor += childCount;
+	}
 
-			funcSortByAxis(bestAxis, beginOffset, endOffset);
+	if (cursor + 1 > wordCount) return false;
+	m_deviceVertices.resize(pWords[cursor]);
+	cursor += 1;
+	if (cursor + m_deviceVertices.size() * s_cacheVertexWordCount > wordCount) return false;
+	for (auto& vertex : m_deviceVertices)
+	{
+		const uint32_t flags = pWords[cursor];
+		std::array<float, s_cacheVertexWordCount - 1> attributes;
+
+		memcpy(attributes.data(), pWords + cursor + 1, sizeof(attributes));
+		vertex = Vertex{};
+		vertex.position = glm::vec3(attributes[0], attributes[1], attributes[2]);
+		if (flags & 0x1)
+		{
+			vertex.normal = glm::vec3(attributes[3], attributes[4], attributes[5]);
 		}
+		if (flags & 0x2)
+		{
+			vertex.uv = glm::vec2(attributes[6], attributes[7]);
+		}
+		cursor += s_cacheVertexWordCount;
 	}
+	m_rootIndex = pWords[4];
+
+	// host side build data is not cached
+	m_meshlets.clear();
+	m_groups.clear();
+	m_hierarchy.clear();
+
+	return true;
 }
 
-void VirtualGeometry::_MergeHierarchyNode(const HierarchyNode& _node1, HierarchyNode& _merged) const
+void VirtualGeometry::_SaveCache(const std::string& inCachePath) const
 {
-	_merged.bounding = _MergeBounds(_node1.bounding, _merged.bounding);
-	_merged.error = std::max(_node1.error, _merged.error);
+	const uint64_t key = _ComputeCacheKey();
+	std::vector<uint32_t> words{
+		VG_CACHE_MAGIC,
+		VG_CACHE_VERSION,
+		static_cast<uint32_t>(key),
+		static_cast<uint32_t>(key >> 32),
+		m_rootIndex,
+		static_cast<uint32_t>(m_deviceNodes.size()),
+		static_cast<uint32_t>(m_deviceGroups.size()) };
+	size_t totalCount = words.size() + m_deviceNodes.size() * 16;
+
+	for (const auto& deviceGroup : m_deviceGroups)
+	{
+		totalCount += 3 + deviceGroup.m_data.size() + deviceGroup.m_childrenGroupDataIndex.size();
+	}
+	totalCount += 1 + m_deviceVertices.size() * s_cacheVertexWordCount;
+	words.reserve(totalCount);
+
+	for (const auto& deviceNode : m_deviceNodes)
+	{
+		words.insert(words.end(), deviceNode.m_data.begin(), deviceNode.m_data.end());
+	}
+	for (const auto& deviceGroup : m_deviceGroups)
+	{
+		words.push_back(deviceGroup.m_lod);
+		words.push_back(static_cast<uint32_t>(deviceGroup.m_data.size()));
+		words.push_back(static_cast<uint32_t>(deviceGroup.m_childrenGroupDataIndex.size()));
+		words.insert(words.end(), deviceGroup.m_data.begin(), deviceGroup.m_data.end());
+		words.insert(words.end(), deviceGroup.m_childrenGroupDataIndex.begin(), deviceGroup.m_childrenGroupDataIndex.end());
+	}
+	words.push_back(static_cast<uint32_t>(m_deviceVertices.size()));
+	for (const auto& vertex : m_deviceVertices)
+	{
+		const glm::vec3 normal = vertex.normal.value_or(glm::vec3(0.0f));
+		const glm::vec2 uv = vertex.uv.value_or(glm::vec2(0.0f));
+		const std::array<float, s_cacheVertexWordCount - 1> attributes = {
+			vertex.position.x, vertex.position.y, vertex.position.z, normal.x, normal.y, normal.z, uv.x, uv.y };
+		const size_t attributeOffset = words.size() + 1;
+
+		words.push_back((vertex.normal.has_value() ? 0x1u : 0u) | (vertex.uv.has_value() ? 0x2u : 0u));
+		words.resize(words.size() + attributes.size());
+		memcpy(words.data() + attributeOffset, attributes.data(), sizeof(attributes));
+	}
+
+	if (!common_utils::WriteFile(inCachePath, words.data(), words.size() * sizeof(uint32_t)))
+	{
+		std::cout << "WARNING: Failed to write virtual geometry cache: " << inCachePath << std::endl;
+	}
 }
 
 void VirtualGeometry::PresetStaticMesh(const StaticMesh& _original)
@@ -754,20 +1206,177 @@ void VirtualGeometry::PresetStaticMesh(const StaticMesh& _original)
 	m_pBaseMesh = &_original;
 }
 
+void VirtualGeometry::PresetBuildSettings(const BuildSettings& inSettings)
+{
+	CHECK_TRUE(inSettings.clustersPerGroup > 0 && inSettings.clustersPerGroup <= VG_MAX_CLUSTER_GROUP_SIZE, "Invalid cluster count of groups!");
+	CHECK_TRUE(inSettings.maxClusterVertexCount > 0 && inSettings.maxClusterVertexCount <= VG_MAX_CLUSTER_INDEX, "Invalid vertex count of clusters!");
+	CHECK_TRUE(inSettings.maxClusterTriangleCount > 0 && inSettings.maxClusterTriangleCount <= 124
+		&& inSettings.maxClusterTriangleCount % 4 == 0, "Invalid triangle count of clusters!");
+	CHECK_TRUE(inSettings.minClusterTriangleCount <= inSettings.maxClusterTriangleCount, "Min triangle count of clusters is larger than max!");
+	CHECK_TRUE(inSettings.simplifyRatio > 0.0f && inSettings.simplifyRatio < 1.0f, "Simplify ratio must be in (0, 1)!");
+	CHECK_TRUE(inSettings.simplifyWeights.uv >= 0.0f && inSettings.simplifyWeights.normal >= 0.0f && inSettings.attributeErrorScale >= 0.0f,
+		"Attribute weights of simplification must not be negative!");
+	CHECK_TRUE(inSettings.hierarchyBranchingFactor >= 2 && inSettings.hierarchyBranchingFactor <= VG_HIERARCHY_MAX_CHILD, "Invalid branching factor of hierarchy!");
+	m_settings = inSettings;
+}
+
+void VirtualGeometry::PresetCacheFile(const std::string& inCachePath)
+{
+	m_cachePath = inCachePath;
+}
+
 void VirtualGeometry::Init()
 {
+	if (!m_cachePath.empty() && _LoadCache(m_cachePath))
+	{
+		if (m_settings.printProgress)
+		{
+			std::cout << "Loaded virtual geometry from cache: " << m_cachePath << std::endl;
+		}
+		return;
+	}
+
 	_SplitMeshLODs();
 	_BuildHierarchy();
+
+	if (!m_cachePath.empty())
+	{
+		_SaveCache(m_cachePath);
+	}
+}
+
+void VirtualGeometry::BuildBatch(
+	std::span<const StaticMesh* const> inMeshes,
+	const BuildSettings& inSettings,
+	BatchDeviceData& outData,
+	std::span<const std::string> inCachePaths)
+{
+	const uint32_t meshCount = static_cast<uint32_t>(inMeshes.size());
+	std::vector<VirtualGeometry> builders(meshCount);
+	BuildSettings meshSettings = inSettings;
+	size_t nodeCount = 0;
+	size_t groupCount = 0;
+	size_t vertexCount = 0;
+
+	CHECK_TRUE(inCachePaths.empty() || inCachePaths.size() == inMeshes.size(), "Need one cache path for each mesh!");
+
+	// logs of concurrent builds would interleave
+	meshSettings.printProgress = false;
+	for (uint32_t i = 0; i < meshCount; ++i)
+	{
+		builders[i].PresetStaticMesh(*inMeshes[i]);
+		builders[i].PresetBuildSettings(meshSettings);
+		if (!inCachePaths.empty())
+		{
+			builders[i].PresetCacheFile(inCachePaths[i]);
+		}
+	}
+
+	// meshes don't share anything, with parallelBuild groups of a large mesh can still go to idle threads
+	MyTaskScheduler::GetInstance().ParallelFor(meshCount, 1, [&](uint32_t inBegin, uint32_t inEnd, uint32_t inThreadIndex)
+		{
+			for (uint32_t i = inBegin; i < inEnd; ++i)
+			{
+				auto& builder = builders[i];
+
+				builder.Init();
+
+				// only device data is merged, drop build data early to keep peak memory low
+				builder.m_meshlets.clear();
+				builder.m_groups.clear();
+				builder.m_hierarchy.clear();
+			}
+		});
+
+	for (const auto& builder : builders)
+	{
+		nodeCount += builder.m_deviceNodes.size();
+		groupCount += builder.m_deviceGroups.size();
+		vertexCount += builder.m_deviceVertices.size();
+	}
+	outData.rootIndices.clear();
+	outData.hierarchyNodes.clear();
+	outData.clusterGroupData.clear();
+	outData.vertices.clear();
+	outData.rootIndices.reserve(meshCount);
+	outData.hierarchyNodes.reserve(nodeCount);
+	outData.clusterGroupData.reserve(groupCount);
+	outData.vertices.reserve(vertexCount);
+
+	// merge in mesh order so the result doesn't depend on thread scheduling
+	for (auto& builder : builders)
+	{
+		const uint32_t nodeOffset = static_cast<uint32_t>(outData.hierarchyNodes.size());
+		const uint32_t groupOffset = static_cast<uint32_t>(outData.clusterGroupData.size());
+		const uint32_t vertexOffset = static_cast<uint32_t>(outData.vertices.size());
+
+		outData.rootIndices.push_back(builder.m_rootIndex + nodeOffset);
+		for (auto& node : builder.m_deviceNodes)
+		{
+			if (node.IsLeaf())
+			{
+				node.m_data[1] += groupOffset;
+			}
+			else
+			{
+				for (uint32_t k = 0; k < VG_HIERARCHY_MAX_CHILD; ++k)
+				{
+					if (node.m_data[k] == ~0u) continue;
+					node.m_data[k] += nodeOffset;
+				}
+			}
+			outData.hierarchyNodes.push_back(node);
+		}
+		for (auto& group : builder.m_deviceGroups)
+		{
+			for (auto& childGroup : group.m_childrenGroupDataIndex)
+			{
+				if (childGroup == ~0u) continue;
+				childGroup += groupOffset;
+			}
+			group._RebaseVertices(vertexOffset);
+			outData.clusterGroupData.push_back(std::move(group));
+		}
+		outData.vertices.insert(outData.vertices.end(), builder.m_deviceVertices.begin(), builder.m_deviceVertices.end());
+		builder.m_deviceNodes.clear();
+		builder.m_deviceGroups.clear();
+		builder.m_deviceVertices.clear();
+	}
 }
 
 void VirtualGeometry::GetMeshletsAtLOD(uint32_t _lod, std::vector<Meshlet>& _meshlet) const
 {
-	CHECK_TRUE(_lod < m_meshlets.size(), "Don't have this LOD");
-	_meshlet.reserve(m_meshlets[_lod].size());
-	for (const auto& myMeshlet : m_meshlets[_lod])
+	bool lodFound = false;
+
+	for (const auto& deviceGroup : m_deviceGroups)
 	{
-		_meshlet.push_back(myMeshlet.meshlet);
+		if (deviceGroup.GetLod() != _lod) continue;
+		lodFound = true;
+		for (uint32_t clusterId = 0; clusterId < deviceGroup.GetClusterCount(); ++clusterId)
+		{
+			Meshlet meshlet{};
+			uint32_t vertexCount = deviceGroup.GetClusterVertexCount(clusterId);
+			uint32_t triangleCount = deviceGroup.GetClusterTriangleCount(clusterId);
+
+			meshlet.vertices.resize(vertexCount);
+			meshlet.index.resize(triangleCount * 3);
+			for (uint32_t k = 0; k < vertexCount; ++k)
+			{
+				meshlet.vertices[k] = deviceGroup.GetClusterMeshVertex(clusterId, static_cast<uint8_t>(k));
+			}
+			for (uint32_t k = 0; k < triangleCount; ++k)
+			{
+				deviceGroup.GetClusterTriangleIndices(clusterId, k, meshlet.index[3 * k], meshlet.index[3 * k + 1], meshlet.index[3 * k + 2]);
+			}
+			_meshlet.push_back(std::move(meshlet));
+		}
 	}
+	CHECK_TRUE(lodFound, "Don't have this LOD");
+}
+
+void VirtualGeometry::GetVirtualGeometryVertices(std::vector<Vertex>& outVertices) const
+{
+	outVertices = m_deviceVertices;
 }
 
 void VirtualGeometry::GetVirtualGeometryDeviceData(
@@ -780,17 +1389,25 @@ void VirtualGeometry::GetVirtualGeometryDeviceData(
 	outClusterGroupData = m_deviceGroups;
 }
 
+void VirtualGeometry::GetVirtualGeometryDeviceData(
+	uint32_t& outRootNodeIndex,
+	std::span<const VirtualGeometry::IntermediateNode>& outHierarchyNodes,
+	std::span<const VirtualGeometry::ClusterGroupData>& outClusterGroupData) const
+{
+	outRootNodeIndex = m_rootIndex;
+	outHierarchyNodes = m_deviceNodes;
+	outClusterGroupData = m_deviceGroups;
+}
+
 void VirtualGeometry::IntermediateNode::_SetError(float inError)
 {
-	m_data[8] = inError;
+	memcpy(m_data.data() + 12, &inError, sizeof(float));
 }
 
 void VirtualGeometry::IntermediateNode::_SetBoundingSphere(const glm::vec3& inCenter, float inRadius)
 {
-	m_data[4] = inCenter.x;
-	m_data[5] = inCenter.y;
-	m_data[6] = inCenter.z;
-	m_data[7] = inRadius;
+	std::array<float, 4> xyzw = { inCenter.x, inCenter.y, inCenter.z, inRadius };
+	memcpy(m_data.data() + 8, xyzw.data(), sizeof(xyzw));
 }
 
 void VirtualGeometry::IntermediateNode::_SetChildrenNodesOrClusterGroup(
@@ -805,7 +1422,7 @@ void VirtualGeometry::IntermediateNode::_SetChildrenNodesOrClusterGroup(
 	}
 	else
 	{
-		m_data[0] = ~0;
+		std::fill(m_data.begin(), m_data.begin() + VG_HIERARCHY_MAX_CHILD, ~0u);
 		m_data[1] = std::get<uint32_t>(inChildren);
 	}
 }
@@ -813,7 +1430,7 @@ void VirtualGeometry::IntermediateNode::_SetChildrenNodesOrClusterGroup(
 float VirtualGeometry::IntermediateNode::GetError() const
 {
 	float result;
-	memcpy(&result, (m_data.data() + 8), sizeof(float));
+	memcpy(&result, (m_data.data() + 12), sizeof(float));
 	return result;
 }
 
@@ -821,9 +1438,9 @@ void VirtualGeometry::IntermediateNode::GetBoundingSphere(glm::vec3& outCenter,
 {
 	std::array<float, 3> xyz;
 
-	memcpy(xyz.data(), (m_data.data() + 4), sizeof(xyz));
+	memcpy(xyz.data(), (m_data.data() + 8), sizeof(xyz));
 	outCenter = glm::vec3(xyz[0], xyz[1], xyz[2]);
-	memcpy(&outRadius, (m_data.data() + 7), sizeof(float));
+	memcpy(&outRadius, (m_data.data() + 11), sizeof(float));
 }
 
 void VirtualGeometry::IntermediateNode::GetChildren(std::array<uint32_t, VG_HIERARCHY_MAX_CHILD>& outChildren) const
@@ -864,13 +1481,42 @@ uint32_t VirtualGeometry::ClusterGroupData::GetClusterChildGroupDataIndex(uint32
 	return m_childrenGroupDataIndex.at(inClusterId);
 }
 
+uint32_t VirtualGeometry::ClusterGroupData::GetLod() const
+{
+	return m_lod;
+}
+
 uint32_t VirtualGeometry::ClusterGroupData::_GetClusterDataOffset(uint32_t inClusterId) const
 {
 	CHECK_TRUE(inClusterId < GetClusterCount(), "Cluster ID out of range!");
 
+	if (GetEncoding() == Encoding::COMPACT)
+	{
+		return s_compactHeaderSize + inClusterId * s_compactClusterStride;
+	}
 	return 1 + inClusterId * 9;
 }
 
+uint32_t VirtualGeometry::ClusterGroupData::_GetVertexDataOffset() const
+{
+	if (GetEncoding() == Encoding::COMPACT)
+	{
+		return s_compactHeaderSize + GetClusterCount() * s_compactClusterStride;
+	}
+	return 289;
+}
+
+uint32_t VirtualGeometry::ClusterGroupData::_GetTriangleDataOffset() const
+{
+	uint32_t vertexWordCount = GetVertexCount();
+
+	if (GetEncoding() == Encoding::COMPACT && (m_data[2] & s_compactWideVertexFlag) == 0)
+	{
+		vertexWordCount = (vertexWordCount + 1) / 2;
+	}
+	return _GetVertexDataOffset() + vertexWordCount;
+}
+
 void VirtualGeometry::ClusterGroupData::_SetClusterCount(uint32_t inClusterCount)
 {
 	inClusterCount = inClusterCount & 0x000000FF;
@@ -893,11 +1539,8 @@ void VirtualGeometry::ClusterGroupData::_SetClusterData(
 	m_data[offset + 2] = inVertexCount;
 	m_data[offset + 1] = inTriangleOffset;
 	m_data[offset + 3] = inTriangleCount;
-	m_data[offset + 4] = inBoundingCenter.x;
-	m_data[offset + 5] = inBoundingCenter.y;
-	m_data[offset + 6] = inBoundingCenter.z;
-	m_data[offset + 7] = inRadius;
-	m_data[offset + 8] = inClusterError;
+	std::array<float, 5> floatData = { inBoundingCenter.x, inBoundingCenter.y, inBoundingCenter.z, inRadius, inClusterError };
+	memcpy(m_data.data() + offset + 4, floatData.data(), sizeof(floatData));
 }
 
 void VirtualGeometry::ClusterGroupData::_SetMeshletCompactData(
@@ -921,9 +1564,126 @@ void VirtualGeometry::ClusterGroupData::_SetMeshletCompactData(
 	}
 }
 
+void VirtualGeometry::ClusterGroupData::_RebaseVertices(uint32_t inVertexOffset)
+{
+	// compact indices are relative to base vertex
+	if (GetEncoding() == Encoding::COMPACT)
+	{
+		m_data[1] += inVertexOffset;
+		return;
+	}
+
+	const uint32_t vertexDataOffset = _GetVertexDataOffset();
+	for (uint32_t i = 0; i < GetVertexCount(); ++i)
+	{
+		m_data[vertexDataOffset + i] += inVertexOffset;
+	}
+}
+
+void VirtualGeometry::ClusterGroupData::_EncodeCompact()
+{
+	if (GetEncoding() == Encoding::COMPACT) return;
+
+	const uint32_t clusterCount = GetClusterCount();
+	const uint32_t vertexCount = GetVertexCount();
+	const uint32_t triangleDataOffset = _GetTriangleDataOffset();
+	const uint32_t triangleWordCount = static_cast<uint32_t>(m_data.size()) - triangleDataOffset;
+	const uint32_t* pVertices = m_data.data() + _GetVertexDataOffset();
+	uint32_t baseVertex = vertexCount > 0 ? ~0u : 0;
+	uint32_t maxVertex = 0;
+	bool wideVertex = false;
+	glm::vec3 boundsMin{ std::numeric_limits<float>::max() };
+	glm::vec3 boundsMax{ std::numeric_limits<float>::lowest() };
+	glm::vec3 extent{};
+	std::vector<glm::vec4> spheres(clusterCount);
+	std::vector<uint32_t> compact;
+	uint32_t vertexDataOffset = s_compactHeaderSize + clusterCount * s_compactClusterStride;
+	uint32_t vertexWordCount = 0;
+
+	for (uint32_t i = 0; i < vertexCount; ++i)
+	{
+		baseVertex = std::min(baseVertex, pVertices[i]);
+		maxVertex = std::max(maxVertex, pVertices[i]);
+	}
+	wideVertex = (maxVertex - baseVertex) > 0xFFFF;
+	vertexWordCount = wideVertex ? vertexCount : (vertexCount + 1) / 2;
+
+	for (uint32_t k = 0; k < clusterCount; ++k)
+	{
+		glm::vec3 center{};
+		float radius = 0.0f;
+
+		GetClusterBoundingSphere(k, center, radius);
+		spheres[k] = glm::vec4(center, radius);
+		boundsMin = glm::min(boundsMin, center);
+		boundsMax = glm::max(boundsMax, center);
+	}
+	if (clusterCount == 0)
+	{
+		boundsMin = boundsMax = glm::vec3(0.0f);
+	}
+	extent = boundsMax - boundsMin;
+
+	compact.resize(vertexDataOffset + vertexWordCount + triangleWordCount, 0);
+	compact[0] = s_compactEncodingFlag | (clusterCount << 24) | vertexCount;
+	compact[1] = baseVertex;
+	compact[2] = wideVertex ? s_compactWideVertexFlag : 0;
+	memcpy(compact.data() + 3, &boundsMin, sizeof(glm::vec3));
+	memcpy(compact.data() + 6, &extent, sizeof(glm::vec3));
+
+	for (uint32_t k = 0; k < clusterCount; ++k)
+	{
+		const uint32_t rawOffset = _GetClusterDataOffset(k);
+		const uint32_t vertexOffset = m_data[rawOffset + 0];
+		const uint32_t triangleOffset = m_data[rawOffset + 1];
+		const uint32_t clusterVertexCount = m_data[rawOffset + 2];
+		const uint32_t clusterTriangleCount = m_data[rawOffset + 3];
+		uint32_t* pCluster = compact.data() + s_compactHeaderSize + k * s_compactClusterStride;
+		std::array<uint32_t, 3> quantized{};
+		glm::vec3 dequantized{};
+
+		CHECK_TRUE(vertexOffset <= 0xFFFF && triangleOffset <= 0xFFFF, "Cluster group is too large to encode compactly!");
+		CHECK_TRUE(clusterVertexCount <= 0xFF && clusterTriangleCount <= 0xFF, "Cluster is too large to encode compactly!");
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			float t = extent[axis] > 0.0f ? (spheres[k][axis] - boundsMin[axis]) / extent[axis] : 0.0f;
+			quantized[axis] = static_cast<uint32_t>(glm::clamp(t, 0.0f, 1.0f) * 65535.0f + 0.5f);
+			dequantized[axis] = boundsMin[axis] + extent[axis] * (static_cast<float>(quantized[axis]) / 65535.0f);
+		}
+
+		pCluster[0] = vertexOffset | (clusterVertexCount << 16) | (clusterTriangleCount << 24);
+		pCluster[1] = triangleOffset | (static_cast<uint32_t>(_PackHalfRoundDown(GetClusterError(k))) << 16);
+		pCluster[2] = quantized[0] | (quantized[1] << 16);
+		// grow radius by how far the quantized center drifts, sphere still bounds the cluster
+		pCluster[3] = quantized[2] | (static_cast<uint32_t>(_PackHalfRoundUp(spheres[k].w + glm::length(glm::vec3(spheres[k]) - dequantized))) << 16);
+	}
+
+	for (uint32_t i = 0; i < vertexCount; ++i)
+	{
+		uint32_t relative = pVertices[i] - baseVertex;
+
+		if (wideVertex)
+		{
+			compact[vertexDataOffset + i] = relative;
+		}
+		else
+		{
+			compact[vertexDataOffset + i / 2] |= relative << ((i % 2) * 16);
+		}
+	}
+	std::copy(m_data.begin() + triangleDataOffset, m_data.end(), compact.begin() + vertexDataOffset + vertexWordCount);
+
+	m_data = std::move(compact);
+}
+
+VirtualGeometry::ClusterGroupData::Encoding VirtualGeometry::ClusterGroupData::GetEncoding() const
+{
+	return (m_data[0] & s_compactEncodingFlag) != 0 ? Encoding::COMPACT : Encoding::RAW;
+}
+
 uint32_t VirtualGeometry::ClusterGroupData::GetClusterCount() const
 {
-	uint32_t result = m_data[0] >> 24;
+	uint32_t result = (m_data[0] >> 24) & 0x7F;
 	return result;
 }
 
@@ -935,22 +1695,44 @@ uint32_t VirtualGeometry::ClusterGroupData::GetVertexCount() const
 
 uint32_t VirtualGeometry::ClusterGroupData::GetClusterVertexCount(uint32_t inClusterId) const
 {
-	uint32_t offset = _GetClusterDataOffset(inClusterId) + 2;
-	return m_data[offset];
+	uint32_t offset = _GetClusterDataOffset(inClusterId);
+
+	if (GetEncoding() == Encoding::COMPACT)
+	{
+		return (m_data[offset] >> 16) & 0xFF;
+	}
+	return m_data[offset + 2];
 }
 
 uint32_t VirtualGeometry::ClusterGroupData::GetClusterTriangleCount(uint32_t inClusterId) const
 {
-	uint32_t offset = _GetClusterDataOffset(inClusterId) + 3;
-	return m_data[offset];
+	uint32_t offset = _GetClusterDataOffset(inClusterId);
+
+	if (GetEncoding() == Encoding::COMPACT)
+	{
+		return m_data[offset] >> 24;
+	}
+	return m_data[offset + 3];
 }
 
 uint32_t VirtualGeometry::ClusterGroupData::GetClusterMeshVertex(uint32_t inClusterId, uint8_t inLocalIndex) const
 {
-	uint32_t vertexCount = GetVertexCount();
 	uint32_t offset = _GetClusterDataOffset(inClusterId);
+	uint32_t vertexDataOffset = _GetVertexDataOffset();
+
+	if (GetEncoding() == Encoding::COMPACT)
+	{
+		uint32_t groupLocalIndex = (m_data[offset] & 0xFFFF) + static_cast<uint32_t>(inLocalIndex);
+
+		if ((m_data[2] & s_compactWideVertexFlag) != 0)
+		{
+			return m_data[1] + m_data[vertexDataOffset + groupLocalIndex];
+		}
+		return m_data[1] + ((m_data[vertexDataOffset + groupLocalIndex / 2] >> ((groupLocalIndex % 2) * 16)) & 0xFFFF);
+	}
+
 	uint32_t clusterVertexOffset = m_data[offset];
-	uint32_t vertexIndex = m_data[clusterVertexOffset + static_cast<uint32_t>(inLocalIndex) + 289];
+	uint32_t vertexIndex = m_data[clusterVertexOffset + static_cast<uint32_t>(inLocalIndex) + vertexDataOffset];
 	return vertexIndex;
 }
 
@@ -962,8 +1744,10 @@ void VirtualGeometry::ClusterGroupData::GetClusterTriangleIndices(
 	uint8_t& outZ) const
 {
 	uint32_t triangleStrideInBytes = 3; // each triangle use 3 uint8_t
-	uint32_t clusterTriangleOffset = m_data[_GetClusterDataOffset(inClusterId) + 1];
-	uint32_t triangleDataStart = 289 + GetVertexCount(); // each vertex use 1 uint32_t, plus 289 uint32_t header
+	uint32_t clusterTriangleOffset = GetEncoding() == Encoding::COMPACT
+		? (m_data[_GetClusterDataOffset(inClusterId) + 1] & 0xFFFF)
+		: m_data[_GetClusterDataOffset(inClusterId) + 1];
+	uint32_t triangleDataStart = _GetTriangleDataOffset();
 	uint32_t byteOffset = triangleStrideInBytes * (clusterTriangleOffset + inTriangleIndex);
 	const std::array<uint32_t, 4> byteMasks = { 0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000 };
 	std::array<uint8_t*, 3> triangleIndices = { &outX, &outY, &outZ };
@@ -978,17 +1762,41 @@ void VirtualGeometry::ClusterGroupData::GetClusterTriangleIndices(
 
 void VirtualGeometry::ClusterGroupData::GetClusterBoundingSphere(uint32_t inClusterId, glm::vec3& outCenter, float& outRadius) const
 {
-	uint32_t offset = _GetClusterDataOffset(inClusterId) + 4;
+	uint32_t offset = _GetClusterDataOffset(inClusterId);
+
+	if (GetEncoding() == Encoding::COMPACT)
+	{
+		glm::vec3 boundsMin{};
+		glm::vec3 extent{};
+		glm::vec3 quantized{
+			static_cast<float>(m_data[offset + 2] & 0xFFFF),
+			static_cast<float>(m_data[offset + 2] >> 16),
+			static_cast<float>(m_data[offset + 3] & 0xFFFF) };
+
+		memcpy(&boundsMin, m_data.data() + 3, sizeof(glm::vec3));
+		memcpy(&extent, m_data.data() + 6, sizeof(glm::vec3));
+		outCenter = boundsMin + extent * (quantized / 65535.0f);
+		outRadius = glm::unpackHalf1x16(static_cast<uint16_t>(m_data[offset + 3] >> 16));
+		return;
+	}
+
 	std::array<float, 3> xyz;
-	memcpy(xyz.data(), (m_data.data() + offset), sizeof(xyz));
+	memcpy(xyz.data(), (m_data.data() + offset + 4), sizeof(xyz));
 	outCenter = glm::vec3(xyz[0], xyz[1], xyz[2]);
-	memcpy(&outRadius, (m_data.data() + offset + 3), sizeof(float));
+	memcpy(&outRadius, (m_data.data() + offset + 7), sizeof(float));
 }
 
 float VirtualGeometry::ClusterGroupData::GetClusterError(uint32_t inClusterId) const
 {
-	uint32_t offset = _GetClusterDataOffset(inClusterId) + 8;
-	return m_data[offset];
+	uint32_t offset = _GetClusterDataOffset(inClusterId);
+	float result;
+
+	if (GetEncoding() == Encoding::COMPACT)
+	{
+		return glm::unpackHalf1x16(static_cast<uint16_t>(m_data[offset + 1] >> 16));
+	}
+	memcpy(&result, m_data.data() + offset + 8, sizeof(float));
+	return result;
 }
 
 
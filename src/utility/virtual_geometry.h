@@ -4,10 +4,14 @@
 #include <metis/include/metis.h>
 #include "common.h"
 #include "geometry.h"
+#include "my_mesh_optimizer.h"
 #include <variant>
-#define VG_HIERARCHY_MAX_CHILD 4
+#include <span>
+#define VG_HIERARCHY_MAX_CHILD 8 // child slots of a hierarchy node, BuildSettings::hierarchyBranchingFactor decides how many are used
 #define VG_MAX_CLUSTER_GROUP_SIZE 16
 #define VG_MAX_CLUSTER_INDEX 64
+#define VG_CACHE_MAGIC 0x4756564Cu // "LVVG"
+#define VG_CACHE_VERSION 9 // increase this when build algorithm or device data layout changes
 
 class VirtualGeometry
 {
@@ -32,51 +36,64 @@ class VirtualGeometry
 	// child meshlets with their mates independently.
 
 private:
-	struct MyMeshlet
+	// All meshlets(clusters) of one LOD in structure of arrays,
+	// meshlet i uses ranges[i] of the shared vertex and index pools
+	struct MeshletLevel
 	{
-		uint32_t lod = 0;
-		
-		// index pointing to error information of the meshlet
-		Meshlet meshlet;
-		
-		// edges on the boundary, built with virtual indices of 2 ends
-		std::set<std::pair<uint32_t, uint32_t>> boundaries;
-		
-		// index of adjacent meshlets in array -> number of shared edges
-		std::unordered_map<uint32_t, uint32_t> adjacentWeight;
-		
+		// vertex and local index pools of all meshlets in this LOD,
+		// released once the coarser LOD is formed and cluster groups of this LOD are built
+		Meshlet::DeviceData pools;
+		std::vector<Meshlet::DeviceDataRef> ranges;
+
+		// vertices pools point to, simplified groups of the finer LOD append their own vertices,
+		// so simplification may move them; empty for LOD0 which uses vertices of the base mesh
+		std::vector<Vertex> vertices;
+
 		// I call meshlets built from the same simplified triangle group as couples,
 		// when converting to smaller pieces all couples must do the same
 		// firstLove is index of the first node of the couple vector
 		// since couples are stored consecutively I only store the loverCount addition to firstLove
-		uint32_t firstLove;
-		uint32_t loverCount;
-		
+		std::vector<uint32_t> firstLove;
+		std::vector<uint32_t> loverCount;
+
 		// one of parents whose LOD is higher(larger pieces),
 		// that is, a meshlet built from simplified triangle which is generated by
-		// this meshlet and its mates 
-		uint32_t parent = ~0;
-		
-		// child meshlets whose LOD is lower, that is, the original meshlet of the group this meshlet built from, 
-		// LOD0 meshlets don't have children
-		std::vector<uint32_t> children;
+		// this meshlet and its mates
+		std::vector<uint32_t> parent;
+
+		// group in the finer LOD this meshlet is built from, its meshlets are the children of this meshlet,
+		// couples share the same child group, LOD0 meshlets don't have children -> ~0u
+		std::vector<uint32_t> childGroup;
 
 		// Describes error of a meshlet(cluster)
 		// use for culling and decide LOD
-		glm::vec4 boundingSphere;	// xyz: position, w: radius
-		float clusterError;			// all couples should have the same cluster error
-		float groupError;			// all siblings should have the same group error
-		uint32_t groupIndex;		// group index that shared by siblings
+		std::vector<glm::vec4> boundingSphere;	// xyz: position, w: radius
+		std::vector<float> clusterError;		// all couples should have the same cluster error
+		std::vector<float> groupError;			// all siblings should have the same group error
+		std::vector<uint32_t> groupIndex;		// group index that shared by siblings
+
+		// groups of one LOD are built together, group j is ClusterGroupData[firstGroupData + j]
+		uint32_t firstGroupData = ~0u;
+
+		size_t Size() const { return ranges.size(); }
+
+		// Push indices of the original mesh that build triangles of meshlet inMeshletId into outIndices
+		void GetIndices(uint32_t inMeshletId, std::vector<uint32_t>& outIndices) const;
+
+		// Free vertices, vertex and index pools
+		void ReleasePools();
 	};
 
 	struct HierarchyNode
 	{
-		glm::vec4 bounding; // xyz: center | w: radius
-		std::array<uint32_t, VG_HIERARCHY_MAX_CHILD> children = { ~0u, ~0u, ~0u, ~0u };
-		float error;
+		glm::vec4 bounding{}; // xyz: center | w: radius
+		std::array<uint32_t, VG_HIERARCHY_MAX_CHILD> children;
+		float error = 0.0f;
 		bool isClusterGroup = false;
 		uint32_t groupLod = ~0u;
 		uint32_t groupIndex = ~0u;
+
+		HierarchyNode() { children.fill(~0u); }
 	};
 
 public:
@@ -86,10 +103,10 @@ public:
 	{
 	private:
 		// layout
-		// child0: 4 bytes   | child1 or clusterGroupIdx: 4 bytes | child2: 4 bytes | child3: 4 bytes -> [0-3]
-		// center.x: 4 bytes | center.y: 4 bytes | center.z: 4 bytes | radius: 4 bytes -> [4-7]
-		// error: 4 bytes    | padding: 12 bytes -> [8-11]
-		std::array<uint32_t, 12> m_data; // data to copy to device
+		// child0: 4 bytes   | child1 or clusterGroupIdx: 4 bytes | child2 - child7: 24 bytes, ~0u if not used -> [0-7]
+		// center.x: 4 bytes | center.y: 4 bytes | center.z: 4 bytes | radius: 4 bytes -> [8-11]
+		// error: 4 bytes    | padding: 12 bytes -> [12-15]
+		std::array<uint32_t, 16> m_data; // data to copy to device
 
 	private:
 		void _SetError(float inError);
@@ -115,18 +132,43 @@ public:
 	// use GetDataToCopyToDevice() to copy neccessary data to push to device
 	class ClusterGroupData
 	{
+	public:
+		enum class Encoding
+		{
+			RAW,		// full precision, the layout device shaders read
+			COMPACT,	// quantized, for storage and streaming
+		};
+
 	private:
-		// layout
+		// RAW layout
 		// clusterCount + vertexCount: 1 bytes + 3 bytes-> [0]
 		// clusterData is 36 bytes each -> vertex offset 4 bytes | triangle offset 4 bytes | vertex count 4 bytes | triangle count 4 bytes | bounding 16 bytes | error 4 byptes
 		// clusterData: 32 * 36 bytes -> [1 - 288]
 		// vertex data: arbitrary size -> [289 - ... 289 + vertexCount - 1];
 		// triangle data: arbitrary size -> [... - end]
+		//
+		// COMPACT layout
+		// compact flag + clusterCount + vertexCount: 1 bit + 7 bits + 3 bytes -> [0]
+		// base vertex, the smallest vertex index of the group -> [1]
+		// flags, bit 0 means vertex data uses 32 bits per vertex -> [2]
+		// group bounds min and extent, 6 floats -> [3 - 8]
+		// clusterData is 16 bytes each -> [9 - 9 + 4 * clusterCount - 1]
+		//     vertex offset 2 bytes | vertex count 1 byte | triangle count 1 byte
+		//     triangle offset 2 bytes | error fp16
+		//     center x 2 bytes | center y 2 bytes, quantized in group bounds
+		//     center z 2 bytes | radius fp16
+		// vertex data: vertex index - base vertex, 2 bytes each unless flag bit 0 is set
+		// triangle data: same as RAW
+		// error is rounded down and radius is rounded up (covering quantized center),
+		// so culling stays conservative but the LOD cut is only exact with RAW, which device shaders read
 		std::vector<uint32_t> m_data;					// data to copy to device
 		std::vector<uint32_t> m_childrenGroupDataIndex;	// index of children ClusterGroupData in the array of ClusterGroupData
+		uint32_t m_lod = ~0u;							// LOD of clusters in this group
 
 	private:
 		uint32_t _GetClusterDataOffset(uint32_t inClusterId) const;
+		uint32_t _GetVertexDataOffset() const;
+		uint32_t _GetTriangleDataOffset() const;
 		void _SetClusterCount(uint32_t inClusterCount);
 		void _SetClusterData(
 			uint32_t inIndex,
@@ -141,8 +183,15 @@ public:
 			const std::vector<uint32_t>& inVertexRemap,
 			const std::vector<uint8_t>& inLocalIndices);
 
+		// Add inVertexOffset to all vertex indices, used when vertex arrays are merged
+		void _RebaseVertices(uint32_t inVertexOffset);
+
+		// Re-encode RAW data as COMPACT, getters return the same counts and indices afterwards
+		void _EncodeCompact();
+
 	public:
 		// device side functions
+		Encoding GetEncoding() const;
 		uint32_t GetClusterCount() const;
 		uint32_t GetVertexCount() const;
 		uint32_t GetClusterVertexCount(uint32_t inClusterId) const;
@@ -162,20 +211,53 @@ public:
 		
 		// host side functions
 		void GetDataToCopyToDevice(const void*& outSrcPtr, size_t& outSize) const;
+		// group that holds the finer clusters this cluster is simplified from, ~0u for LOD0 clusters
 		uint32_t GetClusterChildGroupDataIndex(uint32_t inClusterId) const;
+		uint32_t GetLod() const;
 
 		friend class VirtualGeometry;
 	};
 
+	// Parameters of the build, everything except parallelBuild and printProgress changes the output
+	struct BuildSettings
+	{
+		uint32_t maxLod = 31;
+		uint32_t hierarchyBranchingFactor = 4;	// children of a hierarchy node, in [2, VG_HIERARCHY_MAX_CHILD]
+		uint32_t clustersPerGroup = 8;			// target cluster count of groups in METIS partition, no more than VG_MAX_CLUSTER_GROUP_SIZE
+		uint32_t maxClusterVertexCount = 64;	// no more than VG_MAX_CLUSTER_INDEX
+		uint32_t maxClusterTriangleCount = 124;	// divisible by 4, no more than 124 which mesh shaders are compiled with
+		uint32_t minClusterTriangleCount = 0;	// FLEX and SPATIAL clusters only, 0 means maxClusterTriangleCount
+		MeshOptimizer::MeshletBuildMode clusterBuildMode = MeshOptimizer::MeshletBuildMode::DEFAULT; // SPATIAL gives tighter cluster spheres for hierarchy culling
+		float simplifyRatio = 0.5f;				// target index count of a simplified group relative to the group, in (0, 1)
+		MeshOptimizer::SimplifyAttributeWeights simplifyWeights{};	// uv and normal weights in group simplification
+		float attributeErrorScale = 0.0f;		// group error is max(geometric error, attribute error * this), 0 selects LODs by geometry only
+		ClusterGroupData::Encoding clusterGroupEncoding = ClusterGroupData::Encoding::RAW;
+		bool parallelBuild = false;				// build cluster groups and hierarchy on worker threads, output is the same
+		bool printProgress = true;
+	};
+
+	// Device data of many meshes in shared arrays,
+	// rootIndices[i] is the root node of mesh i, node and group indices point into the shared arrays
+	struct BatchDeviceData
+	{
+		std::vector<uint32_t> rootIndices;
+		std::vector<IntermediateNode> hierarchyNodes;
+		std::vector<ClusterGroupData> clusterGroupData;
+		std::vector<Vertex> vertices;
+	};
+
 private:
 	const StaticMesh* m_pBaseMesh = nullptr;
 	// std::vector<std::vector<Vertex>> m_lodVerts; seems won't work LOD0 meshlets are built from m_pBaseMesh, higher LOD meshlets are built from simplified triangles of lower LOD meshlets
-	std::vector<std::vector<MyMeshlet>> m_meshlets;	// meshlets of different LODs
+	std::vector<MeshletLevel> m_meshlets;	// meshlets of different LODs
 	std::vector<std::vector<std::vector<uint32_t>>> m_groups; // m_groups[LOD][groupId][meshletId]
 	uint32_t m_rootIndex;
 	std::vector<HierarchyNode> m_hierarchy;
 	std::vector<IntermediateNode> m_deviceNodes;
 	std::vector<ClusterGroupData> m_deviceGroups;
+	std::vector<Vertex> m_deviceVertices;	// vertices of each cluster group are stored together, in group order
+	BuildSettings m_settings;
+	std::string m_cachePath;	  // file that stores build result, empty if we don't use cache
 
 private:
 	// Get vertices when the current LOD of vertices are incomplete
@@ -184,27 +266,32 @@ private:
 	// Get vertices when the current LOD of vertices are complete
 	const std::vector<Vertex>& _GetCompleteVertices(uint32_t _lod) const;
 
-	// Add MyMeshlet objects, note it will also update children MyMeshlet's parent attribute
+	// Add meshlets to the LOD, note it will also update children meshlets' parent attribute
 	// _lod: LOD of new meshlets
 	// _error: error when simplifiy triangles to serve as the input to build new meshlets
-	// _newMeshlets: meshlets built from simplified triangles
-	// outChildren: index of meshlets from the group before triangle simplification
-	// _pFirstIndex: output, if not nullptr, fill first index of newly added MyMeshlet objects
-	// _pNumAdded: output, if not nullptr, fill number of MyMeshlet objects added
+	// _newMeshletData, _newMeshlets: meshlets built from simplified triangles
+	// _newBounds: bounds of _newMeshlets, computed when they are built
+	// _childGroup: index of the group in finer LOD before triangle simplification, ~0u for LOD0
+	// _pFirstIndex: output, if not nullptr, fill first index of newly added meshlets
+	// _pNumAdded: output, if not nullptr, fill number of meshlets added
 	void _AddMyMeshlet(
 		uint32_t _lod,
 		float _error,
-		const std::vector<Meshlet>& _newMeshlets, 
-		const std::vector<uint32_t>& _children,
+		const Meshlet::DeviceData& _newMeshletData,
+		const std::vector<Meshlet::DeviceDataRef>& _newMeshlets,
+		const std::vector<MeshletBounds>& _newBounds,
+		uint32_t _childGroup,
 		uint32_t* _pFirstIndex = nullptr,
 		uint32_t* _pNumAdded = nullptr);
 
 	// Fill structure used in METIS,
-	// _xadj, _adjncy describes a meshlet connection graph,
+	// _xadj, _adjncy describes a meshlet connection graph in CSR form,
 	// _xadj[i] is the beginning index of _adjncy that describes the connection of meshlet i
 	// note that _xadj is 1 more longer than meshlet list because it needs last element to 
 	// identify the end of last connection information of the last meshlet
-	// _adjwgt describes weight of each connection
+	// _adjwgt describes weight of each connection, i.e. number of border edges 2 meshlets share
+	// Edges of all meshlets are packed into 64-bit keys and radix sorted in one table,
+	// an edge used only once by a meshlet is on its border
 	// _lod: LOD of meshlets of the graph
 	void _PrepareMETIS(
 		uint32_t _lod, 
@@ -212,12 +299,6 @@ private:
 		std::vector<idx_t>& _adjncy, 
 		std::vector<idx_t>& _adjwgt) const;
 
-	// Find borders of meshlets of a specific LOD
-	void _FindMeshletsBorder(uint32_t _lod);
-
-	// Find how many edges shared by meshlet pair, fill adjacentWeight
-	void _RecordMeshletConnections(uint32_t _lod);
-
 	// Divide meshlets into groups based on edges they shader
 	// _lod: lod of meshlets to group
 	// _meshletGroups: array of indices of meshlets in a group
@@ -227,13 +308,19 @@ private:
 		uint32_t _groupCount,
 		std::vector<std::vector<uint32_t>>& _meshletGroups) const;
 
-	// Simplify triangles in meshlet groups, return error compared to the original mesh
+	// Simplify triangles in meshlet groups, return error compared to the original mesh,
+	// geometric and attribute error are measured separately and combined with attributeErrorScale.
+	// Vertices the group uses are copied to a local buffer and welded first,
+	// so copies of the same border vertex from different groups of the source LOD become one.
+	// Group border is locked, inner vertices and their attributes may be moved by simplification
 	// _srcLod: LOD of meshlets to simplify, which is one level lower than result LOD
 	// _meshletGroup: indices of meshlets in this lod that forms a group
-	// _outIndex: indices that build simplified triangles
+	// _outVertices: local vertices of the simplified group, only those used by _outIndex
+	// _outIndex: indices of _outVertices that build simplified triangles
 	float _SimplifyGroupTriangles(
 		uint32_t _srcLod,
 		const std::vector<uint32_t>& _meshletGroup,
+		std::vector<Vertex>& _outVertices,
 		std::vector<uint32_t>& _outIndex) const;
 
 	// Build new meshlets from simplified triangles in the group,
@@ -241,16 +328,26 @@ private:
 	// _index: new set of index generated by _SimplifyGroupTriangle
 	// _meshletData: local index points to the vertex in meshlet
 	// _meshlet: output meshlet
+	// _bounds: output bounds of each meshlet, computed in the same pass
 	void _BuildMeshletFromGroup(
 		const std::vector<Vertex>& _verts,
 		const std::vector<uint32_t>& _index,
-		std::vector<Meshlet>& _meshlet) const;
+		Meshlet::DeviceData& _meshletData,
+		std::vector<Meshlet::DeviceDataRef>& _meshlet,
+		std::vector<MeshletBounds>& _bounds) const;
+
+	// Build ClusterGroupData and leaf hierarchy nodes of groups in the LOD,
+	// call this when group errors are filled, i.e. the coarser LOD is formed,
+	// after this the meshlet pools and vertices of the LOD are no longer needed.
+	// Vertices a group uses are deduplicated and appended to m_deviceVertices as one range
+	void _BuildClusterGroups(uint32_t _lod);
 
 	// Split original mesh into meshlets of different LODs
 	void _SplitMeshLODs();
 
-	// Build hierarchy for culling, the number of children will not exceed 4 for each node
-	// We first build hierarchy for each of the LODs
+	// Build hierarchy for culling, the number of children is hierarchyBranchingFactor at most,
+	// leaf nodes are already built by _BuildClusterGroups
+	// We first build hierarchy for each of the LODs (on worker threads with parallelBuild)
 	// and then build hierarchy with root node of these LOD trees:
 	//                  root
 	//          /      /   \      \
@@ -261,34 +358,82 @@ private:
 
 	// Build hierarchy from _fullTree pointed by _bottomNodeIndex
 	// Adds new nodes into _fullTree and return root node index of the added new hierarchy
-	// _bottomNodeIndex: input, indices of the bottom level nodes, may be reordered for better
+	// _bottomNodeIndex: input, indices of the bottom level nodes, reordered in place for better
 	//					 node grouping
 	// _fullTree: output, new hierarchy nodes will be added to this
 	uint32_t _BuildHierarchyHelper(
-		std::vector<uint32_t>& _bottomNodeIndex,
+		std::span<uint32_t> _bottomNodeIndex,
+		std::vector<HierarchyNode>& _fullTree) const;
+
+	// Number of nodes _BuildHierarchyRange adds above _bottomNodeCount bottom nodes,
+	// tree shape only depends on the count, so subtrees can be allocated before they are built
+	uint32_t _GetHierarchyNodeCount(uint32_t _bottomNodeCount) const;
+
+	// Top-down build of the subtree over _bottomNodeIndex into preallocated nodes,
+	// its root goes to _fullTree[_nodeIndex], other nodes follow it,
+	// children ranges are built on worker threads when they are large enough
+	void _BuildHierarchyRange(
+		std::span<uint32_t> _bottomNodeIndex,
+		uint32_t _nodeIndex,
 		std::vector<HierarchyNode>& _fullTree) const;
 
-	// Optimize node grouping in hierarchy to minimize the bounding sphere size of each group
-	void _OptimizeHierarchyNodeGroups(
+	// Reorder nodes so that each child range [_childBegins[i], _childBegins[i + 1]) is spatially compact,
+	// ranges are split in halves recursively, each split picks the axis with the lowest
+	// sphere area cost: radius^2 * node count summed over both halves
+	void _PartitionHierarchyNodes(
 		const std::vector<HierarchyNode>& _fullTree,
-		const std::array<uint32_t, VG_HIERARCHY_MAX_CHILD>& _groupSize,
-		std::vector<uint32_t>& _nodeIndices) const;
+		std::span<const uint32_t> _childBegins,
+		std::span<uint32_t> _nodeIndices) const;
+
+	// Hash of the base mesh and build parameters, cache is only valid when the key matches
+	uint64_t _ComputeCacheKey() const;
+
+	// Load device data from cache file, return false if file is missing, outdated or built from other mesh
+	bool _LoadCache(const std::string& inCachePath);
 
-	// Merge _node1 to _merged node
-	// which involves:
-	// enlarge _merged node's bounding sphere to include _node1
-	// update parent error to the maximum of 2 nodes
-	void _MergeHierarchyNode(const HierarchyNode& _node1, HierarchyNode& _merged) const;
+	// Save device data to cache file
+	void _SaveCache(const std::string& inCachePath) const;
 
 public:
 	void PresetStaticMesh(const StaticMesh& _original);
+
+	// Cluster group encoding is RAW by default since device shaders read RAW layout,
+	// COMPACT is several times smaller and suits cache and page files
+	void PresetBuildSettings(const BuildSettings& inSettings);
+
+	// Load build result from inCachePath if it's built from the same mesh with the same parameters,
+	// otherwise build and write result to inCachePath.
+	// Only device data is cached
+	void PresetCacheFile(const std::string& inCachePath);
 	
 	void Init();
 
+	// Build virtual geometries of many meshes concurrently, one task for each mesh,
+	// result of a mesh is the same as building it alone with Init(),
+	// nodes and groups are appended in mesh order and their indices are rebased to the shared arrays
+	// inCachePaths: empty, or one cache file for each mesh, empty string if the mesh doesn't use cache
+	static void BuildBatch(
+		std::span<const StaticMesh* const> inMeshes,
+		const BuildSettings& inSettings,
+		BatchDeviceData& outData,
+		std::span<const std::string> inCachePaths = {});
+
+	// Get meshlets of the LOD, they are restored from cluster groups,
+	// so meshlets of the same group are next to each other,
+	// meshlet vertices index vertices from GetVirtualGeometryVertices, not the base mesh
 	void GetMeshletsAtLOD(uint32_t _lod, std::vector<Meshlet>& _meshlet) const;
 
+	// Vertices cluster groups point to, vertices of one group are next to each other
+	void GetVirtualGeometryVertices(std::vector<Vertex>& outVertices) const;
+
 	void GetVirtualGeometryDeviceData(
 		uint32_t& outRootNodeIndex,
 		std::vector<VirtualGeometry::IntermediateNode>& outHierarchyNodes,
 		std::vector<VirtualGeometry::ClusterGroupData>& outClusterGroupData) const;
+
+	// Same as above, but views data owned by this object without copying
+	void GetVirtualGeometryDeviceData(
+		uint32_t& outRootNodeIndex,
+		std::span<const VirtualGeometry::IntermediateNode>& outHierarchyNodes,
+		std::span<const VirtualGeometry::ClusterGroupData>& outClusterGroupData) const;
 };
\ No newline at end of file
@@ -0,0 +1,489 @@
+#include "virtual_geometry_streamer.h"
+#include "virtual_geometry_traversal.h"
+#include <meshoptimizer.h>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	constexpr uint32_t s_pageWordCount = VG_PAGE_SIZE / sizeof(uint32_t);
+	constexpr uint32_t s_headerWordCount = 8;
+	constexpr uint32_t s_groupWordCount = 6;
+	constexpr uint32_t s_clusterWordCount = 6;
+	constexpr uint32_t s_pageTableWordCount = 2;
+}
+
+bool VirtualGeometryStreamer::WritePageFile(
+	const std::string& inFilePath,
+	std::span<const VirtualGeometry::ClusterGroupData> inClusterGroups,
+	uint32_t inCoarseLodCount,
+	bool inCompressPages)
+{
+	const uint32_t groupCount = static_cast<uint32_t>(inClusterGroups.size());
+	std::vector<uint32_t> packOrder(groupCount);
+	std::vector<uint32_t> groupTable(groupCount * s_groupWordCount);
+	std::vector<uint32_t> clusterTable;
+	std::vector<uint32_t> pages;
+	std::vector<uint32_t> pageTable;
+	std::vector<uint8_t> pageBytes;
+	uint32_t maxLod = 0;
+	uint32_t coarsePageCount = 0;
+	uint32_t pageCount = 0;
+	uint32_t pageUsed = s_pageWordCount; // force a new page for the first group
+	bool packingCoarse = true;
+
+	CHECK_TRUE(groupCount > 0, "No cluster group to write!");
+	for (const auto& clusterGroup : inClusterGroups)
+	{
+		maxLod = std::max(maxLod, clusterGroup.GetLod());
+	}
+
+	// coarse LODs first, groups of the same LOD keep build order which is roughly spatial
+	for (uint32_t i = 0; i < groupCount; ++i)
+	{
+		packOrder[i] = i;
+	}
+	std::stable_sort(packOrder.begin(), packOrder.end(), [&](uint32_t inLhs, uint32_t inRhs)
+		{
+			return inClusterGroups[inLhs].GetLod() > inClusterGroups[inRhs].GetLod();
+		});
+
+	for (uint32_t groupIndex : packOrder)
+	{
+		const auto& clusterGroup = inClusterGroups[groupIndex];
+		const void* pSrc = nullptr;
+		size_t srcSize = 0;
+		uint32_t wordCount = 0;
+		bool isCoarse = clusterGroup.GetLod() + inCoarseLodCount > maxLod;
+		uint32_t* pEntry = &groupTable[groupIndex * s_groupWordCount];
+
+		clusterGroup.GetDataToCopyToDevice(pSrc, srcSize);
+		wordCount = static_cast<uint32_t>(srcSize / sizeof(uint32_t));
+		CHECK_TRUE(wordCount <= s_pageWordCount, "Cluster group is larger than a page!");
+
+		// coarse pages don't share groups with streamable ones
+		if (!isCoarse && packingCoarse)
+		{
+			packingCoarse = false;
+			coarsePageCount = pageCount;
+			pageUsed = s_pageWordCount;
+		}
+		if (pageUsed + wordCount > s_pageWordCount)
+		{
+			++pageCount;
+			pageUsed = 0;
+			pages.resize(static_cast<size_t>(pageCount) * s_pageWordCount, 0);
+		}
+		memcpy(&pages[static_cast<size_t>(pageCount - 1) * s_pageWordCount + pageUsed], pSrc, srcSize);
+
+		pEntry[0] = pageCount - 1;
+		pEntry[1] = pageUsed;
+		pEntry[2] = wordCount;
+		pEntry[3] = clusterGroup.GetLod();
+		pEntry[5] = clusterGroup.GetClusterCount();
+		pageUsed += wordCount;
+	}
+	if (packingCoarse)
+	{
+		coarsePageCount = pageCount;
+	}
+
+	// cluster table follows group index order instead of page order
+	for (uint32_t i = 0; i < groupCount; ++i)
+	{
+		const auto& clusterGroup = inClusterGroups[i];
+		uint32_t* pEntry = &groupTable[i * s_groupWordCount];
+
+		pEntry[4] = static_cast<uint32_t>(clusterTable.size() / s_clusterWordCount);
+		for (uint32_t k = 0; k < clusterGroup.GetClusterCount(); ++k)
+		{
+			float clusterError = clusterGroup.GetClusterError(k);
+			glm::vec3 center{};
+			float radius = 0.0f;
+			glm::vec4 sphere{};
+			std::array<uint32_t, 5> bits{};
+
+			clusterGroup.GetClusterBoundingSphere(k, center, radius);
+			sphere = glm::vec4(center, radius);
+			memcpy(&bits[0], &clusterError, sizeof(float));
+			memcpy(&bits[1], &sphere, sizeof(glm::vec4));
+			clusterTable.push_back(clusterGroup.GetClusterChildGroupDataIndex(k));
+			clusterTable.insert(clusterTable.end(), bits.begin(), bits.end());
+		}
+	}
+
+	// pages are encoded one by one so that any page can be decoded alone,
+	// a page is a stream of 4-byte elements, codec works on bytes of neighboring words
+	pageTable.reserve(static_cast<size_t>(pageCount) * s_pageTableWordCount);
+	if (inCompressPages)
+	{
+		std::vector<uint8_t> encoded(meshopt_encodeVertexBufferBound(s_pageWordCount, sizeof(uint32_t)));
+
+		for (uint32_t i = 0; i < pageCount; ++i)
+		{
+			size_t encodedSize = meshopt_encodeVertexBuffer(
+				encoded.data(), encoded.size(), &pages[static_cast<size_t>(i) * s_pageWordCount], s_pageWordCount, sizeof(uint32_t));
+
+			CHECK_TRUE(encodedSize > 0, "Failed to encode virtual geometry page!");
+			pageTable.push_back(static_cast<uint32_t>(pageBytes.size()));
+			pageTable.push_back(static_cast<uint32_t>(encodedSize));
+			pageBytes.insert(pageBytes.end(), encoded.begin(), encoded.begin() + encodedSize);
+			pageBytes.resize((pageBytes.size() + 3) & ~size_t(3), 0);
+		}
+	}
+	else
+	{
+		for (uint32_t i = 0; i < pageCount; ++i)
+		{
+			pageTable.push_back(i * VG_PAGE_SIZE);
+			pageTable.push_back(VG_PAGE_SIZE);
+		}
+		pageBytes.resize(pages.size() * sizeof(uint32_t));
+		memcpy(pageBytes.data(), pages.data(), pageBytes.size());
+	}
+
+	std::vector<uint32_t> words{
+		VG_PAGE_FILE_MAGIC,
+		VG_PAGE_FILE_VERSION,
+		VG_PAGE_SIZE,
+		pageCount,
+		coarsePageCount,
+		groupCount,
+		static_cast<uint32_t>(clusterTable.size() / s_clusterWordCount),
+		inCompressPages ? VG_PAGE_FILE_COMPRESSED : 0u };
+	words.reserve(words.size() + groupTable.size() + clusterTable.size() + pageTable.size() + pageBytes.size() / sizeof(uint32_t));
+	words.insert(words.end(), groupTable.begin(), groupTable.end());
+	words.insert(words.end(), clusterTable.begin(), clusterTable.end());
+	words.insert(words.end(), pageTable.begin(), pageTable.end());
+	words.resize(words.size() + pageBytes.size() / sizeof(uint32_t));
+	memcpy(words.data() + words.size() - pageBytes.size() / sizeof(uint32_t), pageBytes.data(), pageBytes.size());
+
+	return common_utils::WriteFile(inFilePath, words.data(), words.size() * sizeof(uint32_t));
+}
+
+void VirtualGeometryStreamer::PresetPageFile(const std::string& inFilePath)
+{
+	m_pageFilePath = inFilePath;
+}
+
+void VirtualGeometryStreamer::PresetBudget(size_t inBytes)
+{
+	m_budget = inBytes;
+}
+
+void VirtualGeometryStreamer::PresetMaxPageLoadsPerFrame(uint32_t inCount)
+{
+	m_maxPageLoadsPerFrame = inCount;
+}
+
+void VirtualGeometryStreamer::PresetUploadCallback(const std::function<void(uint32_t inSlot, const void* inData, size_t inSize)>& inCallback)
+{
+	m_uploadPage = inCallback;
+}
+
+void VirtualGeometryStreamer::Init(uint32_t inRootIndex, std::span<const VirtualGeometry::IntermediateNode> inHierarchyNodes)
+{
+	CHECK_TRUE(m_pageFile.Open(m_pageFilePath), "Failed to open virtual geometry page file!");
+
+	const uint32_t* pWords = reinterpret_cast<const uint32_t*>(m_pageFile.GetData());
+	const size_t wordCount = m_pageFile.GetSize() / sizeof(uint32_t);
+	uint32_t groupCount = 0;
+	uint32_t clusterCount = 0;
+	size_t cursor = s_headerWordCount;
+	size_t pageDataSize = 0;
+
+	CHECK_TRUE(wordCount >= s_headerWordCount, "Virtual geometry page file is too small!");
+	CHECK_TRUE(pWords[0] == VG_PAGE_FILE_MAGIC && pWords[1] == VG_PAGE_FILE_VERSION, "Unknown virtual geometry page file!");
+	CHECK_TRUE(pWords[2] == VG_PAGE_SIZE, "Page size of the file doesn't match!");
+	m_pageCount = pWords[3];
+	m_coarsePageCount = pWords[4];
+	groupCount = pWords[5];
+	clusterCount = pWords[6];
+	m_compressedPages = (pWords[7] & VG_PAGE_FILE_COMPRESSED) != 0;
+	CHECK_TRUE(cursor + static_cast<size_t>(groupCount) * s_groupWordCount + static_cast<size_t>(clusterCount) * s_clusterWordCount
+		+ static_cast<size_t>(m_pageCount) * s_pageTableWordCount <= wordCount, "Virtual geometry page file is truncated!");
+
+	m_groups.resize(groupCount);
+	for (auto& group : m_groups)
+	{
+		group.page = pWords[cursor + 0];
+		group.wordOffset = pWords[cursor + 1];
+		group.wordCount = pWords[cursor + 2];
+		group.lod = pWords[cursor + 3];
+		group.firstCluster = pWords[cursor + 4];
+		group.clusterCount = pWords[cursor + 5];
+		cursor += s_groupWordCount;
+	}
+	m_clusterChildGroups.resize(clusterCount);
+	m_clusterErrors.resize(clusterCount);
+	m_clusterSpheres.resize(clusterCount);
+	for (uint32_t i = 0; i < clusterCount; ++i)
+	{
+		m_clusterChildGroups[i] = pWords[cursor];
+		memcpy(&m_clusterErrors[i], &pWords[cursor + 1], sizeof(float));
+		memcpy(&m_clusterSpheres[i], &pWords[cursor + 2], sizeof(glm::vec4));
+		cursor += s_clusterWordCount;
+	}
+	m_pageOffsets.resize(m_pageCount);
+	m_pageSizes.resize(m_pageCount);
+	for (uint32_t i = 0; i < m_pageCount; ++i)
+	{
+		m_pageOffsets[i] = pWords[cursor];
+		m_pageSizes[i] = pWords[cursor + 1];
+		pageDataSize = std::max(pageDataSize, static_cast<size_t>(m_pageOffsets[i]) + m_pageSizes[i]);
+		cursor += s_pageTableWordCount;
+	}
+	CHECK_TRUE(cursor * sizeof(uint32_t) + pageDataSize <= m_pageFile.GetSize(), "Virtual geometry page file is truncated!");
+	m_pPages = reinterpret_cast<const uint8_t*>(pWords + cursor);
+
+	m_rootIndex = inRootIndex;
+	m_nodes.assign(inHierarchyNodes.begin(), inHierarchyNodes.end());
+
+	// reserve slots
+	m_slotCount = static_cast<uint32_t>(std::min<size_t>(m_budget / VG_PAGE_SIZE, m_pageCount));
+	CHECK_TRUE(m_slotCount >= m_coarsePageCount, "Budget cannot hold coarse pages of virtual geometry!");
+	m_residentWords.assign(static_cast<size_t>(m_slotCount) * s_pageWordCount, 0);
+	m_pageSlot.assign(m_pageCount, ~0u);
+	m_pageLastUsedFrame.assign(m_pageCount, 0);
+	m_lruPages.clear();
+	m_lruIterators.assign(m_pageCount, m_lruPages.end());
+	m_freeSlots.clear();
+	for (uint32_t i = m_slotCount; i > 0; --i)
+	{
+		m_freeSlots.push_back(i - 1);
+	}
+	m_frame = 0;
+
+	// coarse pages stay resident until Uninit
+	FrameStats initStats{};
+	for (uint32_t i = 0; i < m_coarsePageCount; ++i)
+	{
+		_LoadPage(i, initStats);
+	}
+}
+
+void VirtualGeometryStreamer::Uninit()
+{
+	m_lruPages.clear();
+	m_lruIterators.clear();
+	m_pageSlot.clear();
+	m_pageLastUsedFrame.clear();
+	m_freeSlots.clear();
+	m_residentWords.clear();
+	m_groups.clear();
+	m_clusterChildGroups.clear();
+	m_clusterErrors.clear();
+	m_clusterSpheres.clear();
+	m_pageOffsets.clear();
+	m_pageSizes.clear();
+	m_nodes.clear();
+	m_pPages = nullptr;
+	m_pageFile.Close();
+}
+
+bool VirtualGeometryStreamer::_LoadPage(uint32_t inPage, FrameStats& outStats)
+{
+	uint32_t slot = ~0u;
+
+	if (m_freeSlots.empty())
+	{
+		// pages used this frame are needed by traversal as well, don't drop them
+		if (m_lruPages.empty()) return false;
+		uint32_t victim = m_lruPages.back();
+		if (m_pageLastUsedFrame[victim] == m_frame) return false;
+
+		m_lruPages.pop_back();
+		m_lruIterators[victim] = m_lruPages.end();
+		m_freeSlots.push_back(m_pageSlot[victim]);
+		m_pageSlot[victim] = ~0u;
+		++outStats.evictedPages;
+	}
+
+	slot = m_freeSlots.back();
+	m_freeSlots.pop_back();
+	if (m_compressedPages)
+	{
+		int result = meshopt_decodeVertexBuffer(
+			&m_residentWords[static_cast<size_t>(slot) * s_pageWordCount], s_pageWordCount, sizeof(uint32_t),
+			m_pPages + m_pageOffsets[inPage], m_pageSizes[inPage]);
+		CHECK_TRUE(result == 0, "Failed to decode virtual geometry page!");
+	}
+	else
+	{
+		memcpy(&m_residentWords[static_cast<size_t>(slot) * s_pageWordCount], m_pPages + m_pageOffsets[inPage], VG_PAGE_SIZE);
+	}
+	m_pageSlot[inPage] = slot;
+	if (inPage >= m_coarsePageCount)
+	{
+		m_lruPages.push_front(inPage);
+		m_lruIterators[inPage] = m_lruPages.begin();
+	}
+	m_pageLastUsedFrame[inPage] = m_frame;
+	if (m_uploadPage)
+	{
+		m_uploadPage(slot, &m_residentWords[static_cast<size_t>(slot) * s_pageWordCount], VG_PAGE_SIZE);
+	}
+	++outStats.loadedPages;
+	outStats.loadedBytes += m_pageSizes[inPage];
+
+	return true;
+}
+
+void VirtualGeometryStreamer::_TouchPage(uint32_t inPage)
+{
+	m_pageLastUsedFrame[inPage] = m_frame;
+	if (m_pageSlot[inPage] == ~0u || inPage < m_coarsePageCount) return;
+	m_lruPages.splice(m_lruPages.begin(), m_lruPages, m_lruIterators[inPage]);
+}
+
+void VirtualGeometryStreamer::_TraverseHierarchy(
+	const PersCamera& inCamera,
+	float inPixelError,
+	std::vector<uint32_t>& outGroups,
+	FrameStats& outStats) const
+{
+	Frustum frustum = inCamera.GetFrustum();
+	const std::array<glm::vec4, 6> planes = {
+		frustum.leftPlane, frustum.rightPlane, frustum.topPlane, frustum.bottomPlane, frustum.nearPlane, frustum.farPlane };
+	std::vector<uint32_t> nodeStack{ m_rootIndex };
+
+	while (!nodeStack.empty())
+	{
+		const auto& node = m_nodes[nodeStack.back()];
+		glm::vec3 center{};
+		float radius = 0.0f;
+		bool culled = false;
+		float threshold = 0.0f;
+
+		nodeStack.pop_back();
+		++outStats.visitedNodes;
+
+		node.GetBoundingSphere(center, radius);
+		for (const auto& plane : planes)
+		{
+			culled = culled || (glm::dot(plane, glm::vec4(center, 1.0f)) > radius);
+		}
+		if (culled) continue;
+
+		// a coarser cut already satisfies the error tolerance
+		threshold = VirtualGeometryTraversal::GetErrorThreshold(center, radius, inCamera, inPixelError);
+		if (!node.ShouldTraverse(threshold)) continue;
+
+		if (node.IsLeaf())
+		{
+			outGroups.push_back(node.GetClusterGroupDataIndex());
+			continue;
+		}
+
+		std::array<uint32_t, VG_HIERARCHY_MAX_CHILD> children;
+		node.GetChildren(children);
+		for (auto child : children)
+		{
+			if (child == ~0u) continue;
+			nodeStack.push_back(child);
+		}
+	}
+}
+
+void VirtualGeometryStreamer::Update(const PersCamera& inCamera, float inPixelError, FrameStats* outStatsPtr)
+{
+	FrameStats stats{};
+	std::vector<uint32_t> requestedGroups;
+	std::vector<uint32_t> missingPages;
+	uint32_t loadCount = 0;
+
+	++m_frame;
+	_TraverseHierarchy(inCamera, inPixelError, requestedGroups, stats);
+	stats.requestedGroups = static_cast<uint32_t>(requestedGroups.size());
+
+	// pages used this frame move to the front of LRU list
+	for (auto groupIndex : requestedGroups)
+	{
+		uint32_t page = m_groups[groupIndex].page;
+		if (m_pageLastUsedFrame[page] == m_frame) continue;
+		_TouchPage(page);
+		++stats.requestedPages;
+		if (m_pageSlot[page] == ~0u)
+		{
+			missingPages.push_back(page);
+		}
+	}
+
+	// coarse pages come first in the file, load them first so that fallbacks get finer step by step
+	std::sort(missingPages.begin(), missingPages.end());
+	for (auto page : missingPages)
+	{
+		if (loadCount >= m_maxPageLoadsPerFrame) break;
+		if (!_LoadPage(page, stats)) break;
+		++loadCount;
+	}
+
+	// clusters that should be replaced by finer ones, but the finer group is not here yet,
+	// each cluster is tested with the threshold of its own sphere like VirtualGeometryTraversal does
+	for (size_t i = 0; i < requestedGroups.size(); ++i)
+	{
+		const auto& group = m_groups[requestedGroups[i]];
+
+		if (m_pageSlot[group.page] == ~0u)
+		{
+			++stats.missingGroups;
+			continue;
+		}
+		for (uint32_t k = 0; k < group.clusterCount; ++k)
+		{
+			const uint32_t clusterIndex = group.firstCluster + k;
+			const glm::vec4& sphere = m_clusterSpheres[clusterIndex];
+			uint32_t childGroup = m_clusterChildGroups[clusterIndex];
+
+			if (m_clusterErrors[clusterIndex] <= VirtualGeometryTraversal::GetErrorThreshold(glm::vec3(sphere), sphere.w, inCamera, inPixelError)) continue;
+			if (childGroup == ~0u) continue;
+			if (IsGroupResident(childGroup)) continue;
+			++stats.fallbackClusters;
+		}
+	}
+	stats.residentPages = m_slotCount - static_cast<uint32_t>(m_freeSlots.size());
+
+	if (outStatsPtr != nullptr)
+	{
+		*outStatsPtr = stats;
+	}
+}
+
+void VirtualGeometryStreamer::SimulateCameraPath(
+	std::span<const PersCamera> inCameraPath,
+	float inPixelError,
+	std::vector<FrameStats>& outStats)
+{
+	outStats.reserve(outStats.size() + inCameraPath.size());
+	for (const auto& camera : inCameraPath)
+	{
+		FrameStats stats{};
+		Update(camera, inPixelError, &stats);
+		outStats.push_back(stats);
+	}
+}
+
+bool VirtualGeometryStreamer::IsGroupResident(uint32_t inGroupIndex) const
+{
+	return m_pageSlot[m_groups[inGroupIndex].page] != ~0u;
+}
+
+void VirtualGeometryStreamer::GetResidentGroup(
+	uint32_t inGroupIndex,
+	const uint32_t*& outWords,
+	uint32_t& outWordOffset,
+	uint32_t& outWordCount) const
+{
+	const auto& group = m_groups[inGroupIndex];
+	uint32_t slot = m_pageSlot[group.page];
+
+	CHECK_TRUE(slot != ~0u, "Cluster group is not resident!");
+	outWordOffset = slot * s_pageWordCount + group.wordOffset;
+	outWordCount = group.wordCount;
+	outWords = &m_residentWords[outWordOffset];
+}
+
+uint32_t VirtualGeometryStreamer::GetSlotCount() const
+{
+	return m_slotCount;
+}
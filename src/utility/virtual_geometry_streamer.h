@@ -0,0 +1,148 @@
+#pragma once
+#include "common.h"
+#include "utils.h"
+#include "camera.h"
+#include "virtual_geometry.h"
+#include <list>
+#include <span>
+#include <functional>
+#define VG_PAGE_SIZE (128u * 1024u) // bytes of one streaming page
+#define VG_PAGE_FILE_MAGIC 0x4750564Cu // "LVPG"
+#define VG_PAGE_FILE_VERSION 3
+#define VG_PAGE_FILE_COMPRESSED 0x1u // page file flag, pages are encoded with meshoptimizer vertex codec
+
+// Streams cluster groups of a virtual geometry in fixed-size pages.
+// Cluster groups are packed into pages of a file, coarse LODs first,
+// pages of the coarsest LODs are always resident so there is always something to draw,
+// other pages are loaded when hierarchy traversal reaches their groups and
+// evicted in least recently used order when the page budget is full.
+// Hierarchy nodes are small and stay resident, only cluster group data is streamed
+class VirtualGeometryStreamer
+{
+public:
+	struct FrameStats
+	{
+		uint32_t visitedNodes = 0;		// hierarchy nodes tested in traversal
+		uint32_t requestedGroups = 0;	// cluster groups reached by traversal
+		uint32_t missingGroups = 0;		// requested groups whose page is still not resident after loading
+		uint32_t fallbackClusters = 0;	// resident clusters drawn because their finer groups are missing
+		uint32_t requestedPages = 0;	// pages that hold requested groups
+		uint32_t loadedPages = 0;		// pages read from file this frame
+		uint32_t loadedBytes = 0;		// bytes read from file this frame, less than loadedPages * VG_PAGE_SIZE when pages are compressed
+		uint32_t evictedPages = 0;		// pages dropped this frame to make room
+		uint32_t residentPages = 0;		// resident pages at the end of the frame, coarse pages included
+	};
+
+private:
+	// Where a cluster group lives in the page file, also keeps what traversal needs
+	// to decide fallback without touching the group data
+	struct GroupInfo
+	{
+		uint32_t page;
+		uint32_t wordOffset;	// offset in the page
+		uint32_t wordCount;
+		uint32_t lod;
+		uint32_t firstCluster;	// index in m_clusterChildGroups, m_clusterErrors and m_clusterSpheres
+		uint32_t clusterCount;
+	};
+
+	// layout
+	// header: magic | version | page size | page count | coarse page count | group count | cluster count | flags -> [0-7]
+	// group table: 6 words for each group, see GroupInfo
+	// cluster table: child group index | error | bounding sphere (4 floats) for each cluster
+	// page table: byte offset from the first page | byte size for each page
+	// pages: VG_PAGE_SIZE bytes each, or encoded bytes padded to 4 if VG_PAGE_FILE_COMPRESSED is set
+	common_utils::MappedFile m_pageFile;
+	const uint8_t* m_pPages = nullptr;	// first page in m_pageFile
+	std::vector<uint32_t> m_pageOffsets;
+	std::vector<uint32_t> m_pageSizes;
+	bool m_compressedPages = false;
+	uint32_t m_pageCount = 0;
+	uint32_t m_coarsePageCount = 0;		// pages [0, m_coarsePageCount) never get evicted
+	std::vector<GroupInfo> m_groups;
+	std::vector<uint32_t> m_clusterChildGroups;
+	std::vector<float> m_clusterErrors;
+	std::vector<glm::vec4> m_clusterSpheres;	// same spheres as in the cluster group data, traversal tests each cluster with its own
+
+	// hierarchy
+	uint32_t m_rootIndex = ~0u;
+	std::vector<VirtualGeometry::IntermediateNode> m_nodes;
+
+	// residency, a slot is a page-sized range of the resident buffer
+	uint32_t m_slotCount = 0;
+	std::vector<uint32_t> m_residentWords;			// m_slotCount pages, mirror of what is uploaded to device
+	std::vector<uint32_t> m_pageSlot;				// slot of each page, ~0u if not resident
+	std::vector<uint32_t> m_freeSlots;
+	std::vector<uint64_t> m_pageLastUsedFrame;
+	std::list<uint32_t> m_lruPages;					// resident streamable pages, most recently used in front
+	std::vector<std::list<uint32_t>::iterator> m_lruIterators;
+	uint64_t m_frame = 0;
+
+	// settings
+	std::string m_pageFilePath;
+	size_t m_budget = 256u * VG_PAGE_SIZE;	// bytes
+	uint32_t m_maxPageLoadsPerFrame = 16;
+	std::function<void(uint32_t, const void*, size_t)> m_uploadPage;
+
+private:
+	// Copy (or decode) page from file to a slot, evict the least recently used page if there is no free slot,
+	// return false if every resident page is still in use this frame
+	bool _LoadPage(uint32_t inPage, FrameStats& outStats);
+
+	void _TouchPage(uint32_t inPage);
+
+	// Walk hierarchy from root, output cluster groups reached
+	void _TraverseHierarchy(
+		const PersCamera& inCamera,
+		float inPixelError,
+		std::vector<uint32_t>& outGroups,
+		FrameStats& outStats) const;
+
+public:
+	// Pack cluster groups into pages and write them to inFilePath,
+	// groups of the inCoarseLodCount coarsest LODs go to the pages that always stay resident.
+	// inCompressPages: encode each page with meshoptimizer vertex codec, resident pages are decoded
+	// so device data doesn't change, only file size and bytes read per page do.
+	// Works best with COMPACT cluster groups, see VirtualGeometry::BuildSettings::clusterGroupEncoding
+	static bool WritePageFile(
+		const std::string& inFilePath,
+		std::span<const VirtualGeometry::ClusterGroupData> inClusterGroups,
+		uint32_t inCoarseLodCount = 2,
+		bool inCompressPages = false);
+
+	void PresetPageFile(const std::string& inFilePath);
+
+	// Device memory for cluster group pages in bytes, must be able to hold coarse pages
+	void PresetBudget(size_t inBytes);
+
+	// Limit file reads per frame, requests left are served in later frames
+	void PresetMaxPageLoadsPerFrame(uint32_t inCount);
+
+	// Called after a page is copied into slot inSlot of the resident buffer,
+	// use it to upload the page to device memory at inSlot * VG_PAGE_SIZE
+	void PresetUploadCallback(const std::function<void(uint32_t inSlot, const void* inData, size_t inSize)>& inCallback);
+
+	// Load coarse pages, hierarchy nodes are copied
+	void Init(uint32_t inRootIndex, std::span<const VirtualGeometry::IntermediateNode> inHierarchyNodes);
+
+	void Uninit();
+
+	// Traverse hierarchy with the camera, page in groups it reaches and update LRU order
+	// inPixelError: error tolerance in pixels on screen
+	void Update(const PersCamera& inCamera, float inPixelError, FrameStats* outStatsPtr = nullptr);
+
+	// Run Update on each camera of the path and collect statistics,
+	// doesn't need a device, so residency decisions can be checked without a window
+	void SimulateCameraPath(
+		std::span<const PersCamera> inCameraPath,
+		float inPixelError,
+		std::vector<FrameStats>& outStats);
+
+	bool IsGroupResident(uint32_t inGroupIndex) const;
+
+	// Get words of a resident cluster group, same layout as ClusterGroupData::GetDataToCopyToDevice,
+	// outWordOffset is the offset in the resident buffer
+	void GetResidentGroup(uint32_t inGroupIndex, const uint32_t*& outWords, uint32_t& outWordOffset, uint32_t& outWordCount) const;
+
+	uint32_t GetSlotCount() const;
+};
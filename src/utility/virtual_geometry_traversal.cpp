@@ -0,0 +1,159 @@
+#include "virtual_geometry_traversal.h"
+#include "task_scheduler.h"
+#include <algorithm>
+
+namespace
+{
+	bool _IsSphereOutside(const std::array<glm::vec4, 6>& inPlanes, const glm::vec3& inCenter, float inRadius)
+	{
+		for (const auto& plane : inPlanes)
+		{
+			if (glm::dot(plane, glm::vec4(inCenter, 1.0f)) > inRadius) return true;
+		}
+		return false;
+	}
+}
+
+float VirtualGeometryTraversal::GetErrorThreshold(
+	const glm::vec3& inCenter,
+	float inRadius,
+	const PersCamera& inCamera,
+	float inPixelError)
+{
+	float pixelsPerUnit = 0.5f * inCamera.height * inCamera.GetInverseTangentHalfFOVy(); // at distance 1
+	float distance = std::max(glm::length(inCenter - inCamera.eye) - inRadius, inCamera.near_clip);
+
+	return inPixelError * distance / pixelsPerUnit;
+}
+
+void VirtualGeometryTraversal::PresetMinNodesPerTask(uint32_t inCount)
+{
+	m_minNodesPerTask = inCount;
+}
+
+void VirtualGeometryTraversal::Init(
+	uint32_t inRootIndex,
+	std::span<const VirtualGeometry::IntermediateNode> inHierarchyNodes,
+	std::span<const VirtualGeometry::ClusterGroupData> inClusterGroups)
+{
+	CHECK_TRUE(inRootIndex < inHierarchyNodes.size(), "Root node is not in the hierarchy!");
+	m_rootIndex = inRootIndex;
+	m_nodes = inHierarchyNodes;
+	m_clusterGroups = inClusterGroups;
+}
+
+void VirtualGeometryTraversal::Traverse(
+	const PersCamera& inCamera,
+	float inPixelError,
+	std::vector<SelectedCluster>& outClusters,
+	Stats* outStatsPtr) const
+{
+	// each thread writes to its own output, merged after each level
+	struct ThreadOutput
+	{
+		std::vector<uint32_t> nextLevel;
+		std::vector<SelectedCluster> clusters;
+		Stats stats;
+	};
+	MyTaskScheduler& scheduler = MyTaskScheduler::GetInstance();
+	std::vector<ThreadOutput> threadOutputs(scheduler.GetThreadCount());
+	Frustum frustum = inCamera.GetFrustum();
+	const std::array<glm::vec4, 6> planes = {
+		frustum.leftPlane, frustum.rightPlane, frustum.topPlane, frustum.bottomPlane, frustum.nearPlane, frustum.farPlane };
+	std::vector<uint32_t> currentLevel{ m_rootIndex };
+	Stats stats{};
+
+	auto funcVisitNodes = [&](uint32_t inBegin, uint32_t inEnd, uint32_t inThreadIndex)
+		{
+			ThreadOutput& output = threadOutputs[inThreadIndex];
+
+			for (uint32_t i = inBegin; i < inEnd; ++i)
+			{
+				const auto& node = m_nodes[currentLevel[i]];
+				glm::vec3 center{};
+				float radius = 0.0f;
+				float threshold = 0.0f;
+
+				++output.stats.visitedNodes;
+				node.GetBoundingSphere(center, radius);
+				if (_IsSphereOutside(planes, center, radius)) continue;
+
+				// a coarser cut already satisfies the error tolerance
+				threshold = GetErrorThreshold(center, radius, inCamera, inPixelError);
+				if (!node.ShouldTraverse(threshold)) continue;
+
+				if (!node.IsLeaf())
+				{
+					std::array<uint32_t, VG_HIERARCHY_MAX_CHILD> children;
+
+					node.GetChildren(children);
+					for (auto child : children)
+					{
+						if (child == ~0u) continue;
+						output.nextLevel.push_back(child);
+					}
+					continue;
+				}
+
+				// group error is large enough, select clusters that are fine enough,
+				// a cluster has the sphere and error of its child group, so it is drawn exactly when that group is not traversed
+				const uint32_t groupIndex = node.GetClusterGroupDataIndex();
+				const auto& clusterGroup = m_clusterGroups[groupIndex];
+
+				++output.stats.visitedGroups;
+				for (uint32_t k = 0; k < clusterGroup.GetClusterCount(); ++k)
+				{
+					glm::vec3 clusterCenter{};
+					float clusterRadius = 0.0f;
+					float clusterError = clusterGroup.GetClusterError(k);
+					float clusterThreshold = 0.0f;
+
+					clusterGroup.GetClusterBoundingSphere(k, clusterCenter, clusterRadius);
+					clusterThreshold = GetErrorThreshold(clusterCenter, clusterRadius, inCamera, inPixelError);
+					if (clusterError > clusterThreshold) continue;
+					if (_IsSphereOutside(planes, clusterCenter, clusterRadius)) continue;
+
+					output.clusters.push_back({ groupIndex, k });
+					++output.stats.selectedClusters;
+					output.stats.selectedTriangles += clusterGroup.GetClusterTriangleCount(k);
+					if (clusterThreshold > 0.0f)
+					{
+						output.stats.errorBound = std::max(output.stats.errorBound, clusterError / clusterThreshold * inPixelError);
+					}
+				}
+			}
+		};
+
+	outClusters.clear();
+	while (!currentLevel.empty())
+	{
+		std::vector<uint32_t> nextLevel;
+
+		scheduler.ParallelFor(static_cast<uint32_t>(currentLevel.size()), m_minNodesPerTask, funcVisitNodes);
+		for (auto& output : threadOutputs)
+		{
+			nextLevel.insert(nextLevel.end(), output.nextLevel.begin(), output.nextLevel.end());
+			output.nextLevel.clear();
+		}
+		currentLevel = std::move(nextLevel);
+	}
+
+	for (auto& output : threadOutputs)
+	{
+		outClusters.insert(outClusters.end(), output.clusters.begin(), output.clusters.end());
+		stats.visitedNodes += output.stats.visitedNodes;
+		stats.visitedGroups += output.stats.visitedGroups;
+		stats.selectedClusters += output.stats.selectedClusters;
+		stats.selectedTriangles += output.stats.selectedTriangles;
+		stats.errorBound = std::max(stats.errorBound, output.stats.errorBound);
+	}
+	std::sort(outClusters.begin(), outClusters.end(), [](const SelectedCluster& inLhs, const SelectedCluster& inRhs)
+		{
+			return inLhs.groupIndex != inRhs.groupIndex ? inLhs.groupIndex < inRhs.groupIndex : inLhs.clusterIndex < inRhs.clusterIndex;
+		});
+
+	if (outStatsPtr != nullptr)
+	{
+		*outStatsPtr = stats;
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "common.h"
+#include "camera.h"
+#include "virtual_geometry.h"
+#include <span>
+
+// Host side hierarchy traversal of a virtual geometry, selects clusters of the LOD cut
+// with the same rules device culling uses, so it works as a reference for vg_cull.comp
+// and as the culling stage when there is no device.
+// Nodes of one level are tested on worker threads, then their children form the next level.
+// A cluster is selected when its group is reached (group error is too large)
+// and its own error is small enough for the threshold of its sphere.
+// A parent cluster shares sphere and error with the group it is simplified from (see VirtualGeometry::_BuildClusterGroups),
+// so either the parent or the clusters of that group are selected, never both or neither
+class VirtualGeometryTraversal
+{
+public:
+	struct SelectedCluster
+	{
+		uint32_t groupIndex;	// index of ClusterGroupData
+		uint32_t clusterIndex;	// index of cluster in the group
+	};
+
+	struct Stats
+	{
+		uint32_t visitedNodes = 0;		// hierarchy nodes tested, leaves included
+		uint32_t visitedGroups = 0;		// cluster groups whose clusters are tested
+		uint32_t selectedClusters = 0;
+		uint32_t selectedTriangles = 0;
+		float errorBound = 0.0f;		// max error of selected clusters projected on screen, in pixels
+	};
+
+private:
+	uint32_t m_rootIndex = ~0u;
+	std::span<const VirtualGeometry::IntermediateNode> m_nodes;
+	std::span<const VirtualGeometry::ClusterGroupData> m_clusterGroups;
+	uint32_t m_minNodesPerTask = 64;
+
+public:
+	// Object space error threshold of a sphere, so that the error projects to inPixelError pixels on screen
+	static float GetErrorThreshold(
+		const glm::vec3& inCenter,
+		float inRadius,
+		const PersCamera& inCamera,
+		float inPixelError);
+
+	// Minimum number of nodes a worker thread tests at a time, use 0xFFFFFFFF to traverse on calling thread
+	void PresetMinNodesPerTask(uint32_t inCount);
+
+	// Data is viewed, it must outlive this object,
+	// e.g. the output of VirtualGeometry::GetVirtualGeometryDeviceData
+	void Init(
+		uint32_t inRootIndex,
+		std::span<const VirtualGeometry::IntermediateNode> inHierarchyNodes,
+		std::span<const VirtualGeometry::ClusterGroupData> inClusterGroups);
+
+	// Select clusters for the camera, clusters outside frustum are dropped,
+	// output is sorted by group and cluster so results don't depend on thread scheduling
+	// inPixelError: error tolerance in pixels on screen
+	// outClusters: selected clusters, previous content is cleared
+	// outStatsPtr: if not nullptr, fill statistics of this traversal
+	void Traverse(
+		const PersCamera& inCamera,
+		float inPixelError,
+		std::vector<SelectedCluster>& outClusters,
+		Stats* outStatsPtr = nullptr) const;
+};